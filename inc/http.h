@@ -6,6 +6,8 @@
 #ifndef HTTP_H
 #define HTTP_H
 
+#include <stddef.h>
+
 #define HTTP_GET    0
 #define HTTP_HEAD   1
 #define HTTP_PUT    2
@@ -109,6 +111,44 @@
 #define HTTP_NETAUTHREQ_M     "Network Authentication Required"
 
 
+#define HTTP_MAX_HEADERS      32
+#define HTTP_INCOMPLETE        0
+#define HTTP_INVALID          -1
+
+typedef struct http_span {
+  const char *data;
+  size_t      size;
+} HttpSpan;
+
+typedef struct http_field {
+  HttpSpan name;
+  HttpSpan value;
+} HttpField;
+
+/*
+NOTE:
+HttpParser tokenizes a request head in a single pass, without copying or allocating anything: the
+request line and the header fields are spans of the caller's buffer. httpparse can be called again
+each time bytes are appended to the same buffer (it resumes where it stopped) and returns the size of
+the head once its blank line is in, HTTP_INCOMPLETE until then, or HTTP_INVALID. Field names are
+matched without regard to case, method is -1 for methods not listed above.
+Initialized with httpresponseinit, the parser reads a response head instead: the status line gives
+version, status and reason (method and file are left empty).
+*/
+typedef struct http_parser {
+  int        state;
+  size_t     offset;
+  size_t     mark;
+  size_t     end;
+  int        method;
+  HttpSpan   file;
+  HttpSpan   version;
+  int        status;
+  HttpSpan   reason;
+  HttpField  fields[HTTP_MAX_HEADERS];
+  int        count;
+} HttpParser;
+
 typedef struct http_request {
   int   method;
   char  file[512];
@@ -135,4 +175,10 @@ void httpreqfromstr(HttpRequest*, char*);
 void httprespfromstr(HttpResponse*, char*);
 void getfield(char*, char*, char*);
 
+void            httpparserinit(HttpParser*);
+void            httpresponseinit(HttpParser*);
+int             httpparse(HttpParser*, const char*, const size_t);
+const HttpSpan *httpfield(const HttpParser*, const char*);
+int             httptoken(const HttpSpan*, const char*);
+
 #endif
\ No newline at end of file
@@ -7,26 +7,91 @@
 #define WEBSOCKET_H
 
 #include <wsserver.h>
+#include <wsreactor.h>
+#include <wsexecutor.h>
 #include <pthread.h>
 
-typedef void (*ConnCallback)(WebSocketServer *server, int client, void *environment);
-typedef void (*ReadCallback)(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment);
-
 typedef struct websocket {
-  int              port;
-  FILE            *messages;
-  FILE            *errors;
-  pthread_t        server_thread;
-  WebSocketServer *server;
-  ConnCallback     onconnect;
-  ReadCallback     onread;
-  void            *env;
+  int                      port;
+  const char              *socketpath;
+  int                      socketfd;
+  int                      mode;
+  int                      workers;
+  int                      pin;
+  FILE                    *messages;
+  FILE                    *errors;
+  pthread_t                server_thread;
+  WebSocketServer         *server;
+  WebSocketReactor        *reactors[REACTOR_MAX_SHARDS];
+  pthread_t                threads[REACTOR_MAX_SHARDS];
+  int                      shards;
+  ConnCallback             onconnect;
+  ReadCallback             onread;
+  ChunkCallback            onchunk;
+  size_t                   maxmessage;
+  size_t                   spill;
+  WebSocketDeflateOptions  deflate;
+  WebSocketTLSOptions      tls;
+  size_t                   highwater;
+  size_t                   lowwater;
+  int                      overflow;
+  DrainCallback            ondrain;
+  int                      metrics;
+  unsigned int             handshaketimeout;
+  unsigned int             keepalive;
+  unsigned int             pongtimeout;
+  unsigned int             idletimeout;
+  WebSocketExecutorOptions executor;
+  WebSocketExecutor       *handlers;
+  void                    *env;
+  pthread_mutex_t          lock;
+  pthread_cond_t           done;
+  int                      readers;
 } WebSocket;
 
+/*
+NOTE:
+By default (WS_MODE_THREAD) each client gets its own reading thread. Set mode to WS_MODE_REACTOR
+before wsinit to serve every client from a single epoll thread instead (see wsreactor.h). In reactor
+mode, workers (1 by default) sets how many reactor threads share the port, each accepting its own
+connections, and pin pins each one to a CPU. WS_MODE_URING is reactor mode on io_uring (see wsuring.h),
+the reactors fall back to epoll (with a warning) where the kernel does not support it.
+The buffer handed to onread holds the whole message (up to maxmessage bytes, spilled to a file past
+spill bytes, see wsserver.h) and is only valid during the call (wsretain keeps it). Set onchunk before
+wsinit to receive messages in chunks instead, onread is then only called for pings and disconnections.
+Set deflate.enabled to offer permessage-deflate to the clients (see wsdeflate.h), messages are
+handed out decompressed.
+Set tls.enabled, with tls.certificate and tls.key, to serve wss:// (see wstls.h): the records go through
+the kernel (kTLS) where it can, OpenSSL otherwise. The connections made with wsconnect_client then use
+TLS too, tls.authority is what they check the servers against. wsinit fails (server is NULL) if TLS
+cannot be set up.
+Writes never wait on a slow client until its outbound queue goes past highwater bytes: overflow then
+decides what happens (WS_OVERFLOW_BLOCK, WS_OVERFLOW_DROP or WS_OVERFLOW_DISCONNECT, see wsserver.h),
+and ondrain (if set before wsinit) is called once the queue is back down to lowwater.
+Set metrics to answer plain HTTP requests for WS_METRICS_PATH with the counters of the server (see
+wsstats.h), wsstats and wsclientstats read them from the code.
+Set keepalive, pongtimeout, idletimeout and handshaketimeout (in ms) before wsinit to ping the clients
+that go quiet and to disconnect those that miss a deadline (see wsserver.h), the round trip of their
+last ping is in wsclientstats. Only handshaketimeout is on by default (WS_TIMEOUT).
+Set executor.threads to run onread on a pool of that many threads (see wsexecutor.h) instead of the
+thread that reads the client: the messages of a client are still handed out one at a time and in order,
+but onread gets a copy of them. Once executor.capacity messages are waiting, the clients that send more
+are not read until the pool has caught up.
+wsconnect_client connects to a WebSocket server (see wsdial in wsserver.h) once wsinit was called, and
+returns the ID of the connection (or a CONNECTION_ error): it is then served like the clients that
+connect, onconnect included, and what it sends is masked. In reactor mode, the connections are spread
+over the reactors, each of which serves thousands of them. Allocated with port 0, the WebSocket does not
+listen and only makes connections.
+Set socketpath before wsinit to listen on a Unix socket rather than the port (@ for an abstract name,
+see wsstartunix in wsserver.h), or socketfd to serve a socket that is already listening, e.g. one passed
+by socket activation (wsactivated(0)), see wsstartfd. The reactors then share that socket.
+*/
 WebSocket *wsalloc(const int port, FILE *messages, FILE *errors);
 void       wsfree(WebSocket *websocket);
 
 void wsinit(WebSocket *websocket, ConnCallback onconnect, ReadCallback onread);
 void wsteardown(WebSocket *websocket);
 
+int  wsconnect_client(WebSocket *websocket, const char *host, const short port, const char *path);
+
 #endif
\ No newline at end of file
@@ -8,7 +8,10 @@
 
 #include <string>
 #include <vector>
+#include <deque>
+#include <unordered_map>
 #include <thread>
+#include <mutex>
 #include <exception>
 
 #include <wsconnection.hpp>
@@ -26,17 +29,29 @@ namespace ws {
       WebSocket*  socket;
     };
 
-    class ConnectionEvent {
+    class ConnectionEvent : public Event<Connection*> {
       friend WebSocket;
     public:
       typedef void (*ConnectionCallback)(Connection* connection);
+    };
+
+    // Awaitable (see wstask.hpp)
+    class Acceptance {
+      friend WebSocket;
     public:
-      void operator +=(ConnectionCallback callback);
-      void operator -=(ConnectionCallback callback);
+      bool        await_ready();
+      Connection* await_resume();
+
+      template <typename Handle>
+      inline bool await_suspend(Handle handle) {
+        Resumable resumable;
+        resumable.set(handle);
+        return websocket->suspend(resumable);
+      }
     private:
-      void trigger(Connection* connection);
+      Acceptance(WebSocket* websocket);
     private:
-      std::vector<ConnectionCallback> callbacks;
+      WebSocket* websocket;
     };
 
   public:
@@ -52,6 +67,27 @@ namespace ws {
     ~WebSocket();
 
   public:
+    void setMode(Mode mode);
+    void setWorkers(int workers, bool pin = false);
+    void setStreaming(bool streaming);
+    void setMessageLimits(size_t maxMessage, size_t spill = 0);
+    void setQueueLimits(size_t highWater, size_t lowWater = WS_QUEUE_LOW, Overflow overflow = OVERFLOW_BLOCK);
+    void setCompression(bool enabled, int level = DEFLATE_LEVEL, bool takeover = false, size_t threshold = DEFLATE_THRESHOLD);
+    void setMetrics(bool enabled);
+    // Listens on a Unix socket rather than the port (@ for an abstract name, see wsstartunix in wsserver.h)
+    void setUnixSocket(const std::string& path);
+    // Serves a socket that is already listening, e.g. from socket activation (wsactivated(0), see wsstartfd)
+    void setSocket(int fd);
+    // Serves wss:// with the certificate (a PEM chain) and its key, through kTLS where the kernel has it (see wstls.h)
+    void setTLS(const std::string& certificate, const std::string& key, bool offload = true);
+    // Dials over TLS, checking the servers against the authority (a PEM file, the system's store when empty)
+    void setAuthority(const std::string& authority, bool verify = true);
+    // In ms, 0 turns each one off (see wsserver.h): pings the clients that go quiet, and disconnects those that do not answer
+    void setKeepAlive(unsigned int interval, unsigned int pongTimeout = 0);
+    // In ms: disconnects the clients that send nothing for idle, and those that take longer than handshake to connect
+    void setTimeouts(unsigned int idle, unsigned int handshake = WS_TIMEOUT);
+    // Runs the reception callbacks on a pool of threads, in order for each connection (see wsexecutor.h)
+    void setExecutor(int threads, size_t capacity = WS_EXECUTOR_CAPACITY);
     void start();
     void stop();
 
@@ -64,26 +100,124 @@ namespace ws {
       sendAll((void*)&serialized, sizeof(T));
     }
 
+    // Sends to the connections subscribed to the topic only (see Connection::subscribe), returns how many were sent it
+    int publish(const std::string& topic, const void* data, const size_t size);
+    int publish(const std::string& topic, const char* text);
+    int publish(const std::string& topic, const std::string& text);
+
+    // Connects to a server once started (see wsdial): the connection is then handed out like those that are accepted
+    // (onConnect, accept), from the thread that serves it. False if it could not be made.
+    bool dial(const std::string& host, const int port, const std::string& path = "/");
+
     const std::string& message();
     const std::string& error();
 
+    // A snapshot of the counters of the server (all zeros until it is started)
+    Stats stats();
+
+    /*
+    NOTE:
+    co_await accept() resumes with the next connection (after onConnect), on the thread that accepted
+    it: a coroutine started from there runs on the thread that reads the connection until it first
+    awaits. From the first call on, the connections that come while no coroutine waits are kept for the
+    next one. It resumes with nullptr once the server is stopped (from the thread that stops it).
+    */
+    Acceptance accept();
+
+  private:
+    // Reactor mode: each shard serves the connections it accepted, from a thread of its own
+    struct Shard {
+      WebSocket*                           websocket;
+      WebSocketReactor*                    reactor;
+      RawData                              data;
+      std::unordered_map<int, Connection*> connections;
+      std::thread*                         thread;
+    };
+
   private:
     void waitForConnections();
+    void purgeConnections();
+    void dropConnections();
+    void lastLine(int min, int max, std::string& line);
+    void connect(Connection* connection);
+    void release(Connection* connection);
+    bool suspend(const Resumable& resumable);
+
+    static void reactorConnect(WebSocketServer* server, int client, void* environment);
+    static void reactorRead(WebSocketServer* server, int client, unsigned char* buffer, size_t read, int status, void* environment);
+    static void executeRead(WebSocketServer* server, int client, unsigned char* buffer, size_t read, int status, void* environment);
+    static void drainConnection(WebSocketServer* server, int client, void* environment);
+    static void receiveChunk(WebSocketServer* server, int client, unsigned char* chunk, size_t size,
+                             unsigned long long offset, int status, int last, void* environment);
 
   public:
     ConnectionEvent onConnect;
 
   private:
-    const int        port;
-    const void*      envPtr;
-    std::FILE*       messages;
-    std::FILE*       errors;
-    WebSocketServer* server;
-    std::thread*     serverThread;
-    std::string      lastMessage;
-    std::string      lastError;
-    std::string      mname;
-    std::string      ename;
+    const int                            port;
+    std::string                          socketPath;
+    int                                  socketFd;
+    const void*                          envPtr;
+    Mode                                 mode;
+    int                                  workers;
+    bool                                 pin;
+    bool                                 streaming;
+    size_t                               maxMessage;
+    size_t                               spill;
+    WebSocketDeflateOptions              compression;
+    size_t                               highWater;
+    size_t                               lowWater;
+    Overflow                             overflow;
+    bool                                 metrics;
+    unsigned int                         keepAlive;
+    unsigned int                         pongTimeout;
+    unsigned int                         idleTimeout;
+    unsigned int                         handshakeTimeout;
+    WebSocketTLSOptions                  tlsOptions;
+    std::string                          certificate;
+    std::string                          key;
+    std::string                          authority;
+    WebSocketExecutorOptions             executorOptions;
+    WebSocketExecutor*                   executor;
+    WebSocketServer*                     server;
+    std::vector<Shard*>                  shards;
+    std::thread*                         serverThread;
+    std::unordered_map<int, Connection*> connections;
+    std::mutex                           connectionsLock;
+    std::string                          lastMessage;
+    std::string                          lastError;
+    std::mutex                           acceptLock;
+    Resumable                            acceptor;
+    Connection*                          accepted;
+    std::deque<Connection*>              backlog;
+    bool                                 accepting;
+    bool                                 stopped;
+
+  private:
+    static thread_local Shard* serving;
+  };
+
+  /*
+  NOTE:
+  A Client is a WebSocket that does not listen, it only makes connections (see WebSocket::dial). It is
+  in reactor mode unless told otherwise: each reactor serves thousands of connections from one thread.
+  With setAuthority, its connections are made over TLS (wss://).
+  */
+  class Client : public WebSocket {
+  public:
+    inline Client() : WebSocket(0) {
+      setMode(MODE_REACTOR);
+    }
+
+    template <typename T>
+    inline Client(const T& env) : WebSocket(0, env) {
+      setMode(MODE_REACTOR);
+    }
+
+  public:
+    inline bool connect(const std::string& host, const int port, const std::string& path = "/") {
+      return dial(host, port, path);
+    }
   };
 }
 
@@ -7,48 +7,166 @@
 #define WEBSOCKETCONNECTION_HPP
 
 #include <vector>
+#include <deque>
 #include <thread>
 #include <algorithm>
 #include <mutex>
+#include <string>
 
 #include <wstypes.hpp>
+#include <wsevent.hpp>
 
 namespace ws {
   class WebSocket;
   class Connection {
+    friend WebSocket;
+  private:
+    // What a coroutine can wait for, at most one of each kind at a time
+    enum Waiting {
+      WAITING_RECEIVE,
+      WAITING_SEND,
+      WAITING_PING,
+      WAITING_KINDS
+    };
+
   public:
-    class ReceptionEvent {
+    class ReceptionEvent : public Event<Connection*, const RawData*> {
       friend Connection;
     public:
       typedef void (*ReceptionCallback)(Connection* connection, const RawData* data);
+    };
+
+    class ChunkEvent : public Event<Connection*, const ChunkData*> {
+      friend Connection;
+    public:
+      typedef void (*ChunkCallback)(Connection* connection, const ChunkData* data);
+    };
+    class DrainEvent : public Event<Connection*> {
+      friend Connection;
+    public:
+      typedef void (*DrainCallback)(Connection* connection);
+    };
+
+    // Awaitables (see wstask.hpp)
+    class Reception {
+      friend Connection;
+    public:
+      bool    await_ready();
+      RawData await_resume();
+
+      template <typename Handle>
+      inline bool await_suspend(Handle handle) {
+        Resumable resumable;
+        resumable.set(handle);
+        return connection->suspend(WAITING_RECEIVE, resumable);
+      }
+    private:
+      Reception(Connection* connection);
+    private:
+      Connection* connection;
+    };
+
+    class Sending {
+      friend Connection;
+    public:
+      bool await_ready();
+      bool await_resume();
+
+      template <typename Handle>
+      inline bool await_suspend(Handle handle) {
+        Resumable resumable;
+        resumable.set(handle);
+        return connection->suspend(WAITING_SEND, resumable, size);
+      }
+    private:
+      Sending(Connection* connection, const void* data, const size_t size, const DataType type);
+    private:
+      Connection* connection;
+      const void* data;
+      size_t      size;
+      DataType    type;
+    };
+
+    class Pinging {
+      friend Connection;
     public:
-      void operator +=(ReceptionCallback callback);
-      void operator -=(ReceptionCallback callback);
+      bool await_ready();
+      int  await_resume();
+
+      template <typename Handle>
+      inline bool await_suspend(Handle handle) {
+        Resumable resumable;
+        resumable.set(handle);
+        return connection->suspend(WAITING_PING, resumable);
+      }
     private:
-      void trigger(Connection* connection, const RawData* data);
+      Pinging(Connection* connection);
     private:
-      std::vector<ReceptionCallback> callbacks;
+      Connection* connection;
     };
   public:
     Connection(WebSocketServer* server, const int client, const void* envPtr);
     ~Connection();
 
   public:
-    void send(const void* data, const size_t size);
-    void send(const char* text);
-    void send(const std::string& text);
+    // False if the message was dropped (or the client is gone), see WebSocket::setQueueLimits
+    bool send(const void* data, const size_t size);
+    bool send(const char* text);
+    bool send(const std::string& text);
 
     template <typename T>
-    inline void send(const T& serialized) {
-      send((void*)&serialized, sizeof(T));
+    inline bool send(const T& serialized) {
+      return send((void*)&serialized, sizeof(T));
     }
 
+    // Waits for the pong, returns the round trip in ms (-1 on timeout)
     int  ping(int timeout_ms = 1000);
+    // Does not wait: getRoundTrip has the round trip once the pong is in (see also pingAsync)
+    void sendPing();
+
+    /*
+    NOTE:
+    co_await receive() resumes with the next message, on the thread that reads the connection (its
+    reactor, or its own thread). The buffer stays valid until the coroutine awaits again. From the first
+    call on, the messages that arrive while the coroutine is busy elsewhere are kept for it (copied).
+    Once the connection is closed, receive resumes with the status it closed on (DATA_CLOSE_CLIENT,
+    DATA_CLOSE_SERVER or DATA_FAILURE): in reactor mode, the connection is deleted as soon as the
+    coroutine awaits something else. Only one coroutine at a time can wait for each operation.
+    co_await sendAsync(...) writes the message right away unless the outbound queue would go past
+    highwater: it then resumes once the queue is back down to lowwater (see WebSocket::setQueueLimits),
+    from the thread that wrote it out. It resumes with false if the client is gone.
+    co_await pingAsync() resumes with the round trip in ms once the pong arrives, -1 if the connection
+    closes first.
+    With an executor (see WebSocket::setExecutor), messages are received on its workers: receive and
+    pingAsync then resume there.
+    */
+    Reception receive();
+    Sending   sendAsync(const void* data, const size_t size);
+    Sending   sendAsync(const char* text);
+    Sending   sendAsync(const std::string& text);
+    Pinging   pingAsync();
+
+    /*
+    NOTE:
+    The data handed to onReceive is only valid until the callback returns. retain keeps it for as long
+    as the Message (or a copy of it) lives: on the thread that read it, the connection gives up the
+    buffer it is in instead of copying it (see wsretain). Messages received on an executor are copied.
+    */
+    Message retain(const RawData* data);
+
+    // See WebSocket::publish, a connection leaves its topics when it closes
+    bool subscribe(const std::string& topic);
+    bool unsubscribe(const std::string& topic);
+
     bool isAlive();
     void listen();
     void disconnect();
 
-    const int   getClientID();
+    const int          getClientID();
+    size_t             getQueuedBytes();
+    ConnectionStats    getStats();
+    // Round trip of the last ping that was answered in us (0 until then), without waiting
+    unsigned long long getRoundTrip();
 
     template <typename T>
     inline T* getEnvPtr() {
@@ -57,20 +175,52 @@ namespace ws {
 
   private:
     void waitForReceptions();
-    
+    void receive(const RawData* data);
+    void receive(const ChunkData* data);
+    void drain();
+
+    bool ready(Waiting waiting, const size_t size = 0);
+    bool suspend(Waiting waiting, const Resumable& resumable, const size_t size = 0);
+    void wake(Waiting waiting);
+    void deliver(const RawData* data);
+    bool congested(const size_t size);
+
     static void pong(Connection *connection, const RawData* data);
 
   public:
     ReceptionEvent   onReceive;
+    ChunkEvent       onChunk;
+    DrainEvent       onDrain;
 
   private:
-    WebSocketServer* server;
-    const int        client;
-    const void*      envPtr;
-    const int&       alive;
-    std::thread*     connectionThread;
-    std::timed_mutex pingMutex;
-    long             ping_ms;
+    // Connection whose thread is reading (thread mode), chunks are delivered to it
+    static thread_local Connection* reading;
+
+    WebSocketServer*   server;
+    const int          client;
+    const void*        envPtr;
+    WebSocket*         owner;
+    WebSocketExecutor* executor;
+    std::thread*       connectionThread;
+    std::timed_mutex   pingMutex;
+    long               ping_ms;
+
+    // Coroutines waiting on the connection (see receive), and the messages kept for them
+    struct Inbound {
+      DataType                   type;
+      std::vector<unsigned char> bytes;
+    };
+
+    std::mutex                 awaitLock;
+    Resumable                  waiting[WAITING_KINDS];
+    RawData                    received;
+    bool                       delivered;
+    long                       pinged;
+    bool                       awaited;
+    bool                       closed;
+    DataType                   closing;
+    std::deque<Inbound>        inbox;
+    std::vector<unsigned char> current;
   };
 }
 
@@ -0,0 +1,104 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: permessage-deflate extension (compression of messages with zlib).
+ * Standard: https://datatracker.ietf.org/doc/html/rfc7692
+ */
+
+#ifndef WSDEFLATE_H
+#define WSDEFLATE_H
+
+#include <stddef.h>
+
+#define DEFLATE_EXTENSION     "permessage-deflate"
+#define DEFLATE_THRESHOLD     128
+#define DEFLATE_LEVEL           6
+#define DEFLATE_MEMLEVEL        8
+#define DEFLATE_MIN_BITS        9
+#define DEFLATE_MAX_BITS       15
+#define DEFLATE_POOL_SIZE      64
+#define DEFLATE_MAX_CONTEXTS 1024
+#define DEFLATE_RESPONSE_SIZE 160
+
+/*
+NOTE:
+Compression is off until enabled is set (it costs CPU on both ends for every message). By default,
+both ends drop their compression context after each message (server_no_context_takeover and
+client_no_context_takeover are always part of the response): a connection then only holds zlib
+streams while it is compressing or decompressing a message, and they come from a pool (kept per
+window size, up to DEFLATE_POOL_SIZE of each). With takeover, compression is better for streams of
+small similar messages, but each connection keeps its streams: only DEFLATE_MAX_CONTEXTS connections
+can do so at a time, the others are negotiated without takeover.
+Messages smaller than threshold bytes, or that do not get smaller, are sent uncompressed.
+*/
+typedef struct websocket_deflate_options {
+  int    enabled;
+  int    level;
+  int    serverbits;
+  int    clientbits;
+  int    takeover;
+  size_t threshold;
+} WebSocketDeflateOptions;
+
+typedef struct websocket_deflate {
+  int    enabled;
+  int    serverbits;
+  int    clientbits;
+  int    servertakeover;
+  int    clienttakeover;
+  void  *deflater;
+  void  *inflater;
+} WebSocketDeflate;
+
+typedef struct websocket_deflate_stats {
+  unsigned long long deflated;
+  unsigned long long deflatein;
+  unsigned long long deflateout;
+  unsigned long long skipped;
+  unsigned long long inflated;
+  unsigned long long inflatein;
+  unsigned long long inflateout;
+  size_t             streams;
+  size_t             cached;
+  size_t             contexts;
+} WebSocketDeflateStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const unsigned char DEFLATE_TRAILER[4];
+
+void   wsdeflatedefaults(WebSocketDeflateOptions *options);
+
+// Picks the first acceptable offer of a Sec-WebSocket-Extensions header (length bytes, not necessarily
+// 0-terminated), returns 1 and fills in the value of the response header when one was accepted
+int    wsdeflatenegotiate(const WebSocketDeflateOptions *options, const char *offers, const size_t length,
+                          WebSocketDeflate *state, char *response);
+
+/*
+NOTE:
+wsdeflate compresses a whole message into a pool block (*block is its size, for wspoolfree), returns the
+compressed size or 0 when the message should go out uncompressed. state may be NULL for a message that
+is compressed once for many connections (without context takeover).
+wsinflate decompresses the payload of a message as it comes: it consumes the input and writes up to
+capacity bytes of output, and has to be called again while *size is not 0 or the output was filled.
+The payload of the last frame has to be followed by DEFLATE_TRAILER (left out by the sender), after
+which wsinflateend drops or keeps the context.
+*/
+size_t wsdeflate(WebSocketDeflate *state, const WebSocketDeflateOptions *options, const unsigned char *payload, const size_t size,
+                 unsigned char **output, size_t *block);
+int    wsinflate(WebSocketDeflate *state, const unsigned char **input, size_t *size,
+                 unsigned char *output, const size_t capacity, size_t *produced);
+void   wsinflateend(WebSocketDeflate *state);
+
+// Give the streams of a connection back (the deflater and the inflater are used by different threads)
+void   wsdeflaterelease(WebSocketDeflate *state);
+void   wsinflaterelease(WebSocketDeflate *state);
+
+void   wsdeflatestats(WebSocketDeflateStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,233 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Callback lists of the C++ wrapper, dispatched without locking.
+ */
+
+#ifndef WEBSOCKETEVENT_HPP
+#define WEBSOCKETEVENT_HPP
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Callables up to this size are kept in the callback itself
+#define WS_CALLBACK_INLINE (4 * sizeof(void*))
+
+namespace ws {
+  /*
+  NOTE:
+  A Callback holds a function or any copyable callable (e.g. a lambda with captures): those that fit in
+  WS_CALLBACK_INLINE bytes are stored inline, bigger ones are allocated once, when the callback is made.
+  */
+  template <typename... Args>
+  class Callback {
+  public:
+    typedef void (*Function)(Args...);
+
+  public:
+    inline Callback() : call(nullptr), manage(nullptr), function(nullptr) {}
+
+    template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Callback>::value>::type>
+    inline Callback(F&& callable) : Callback() {
+      typedef typename std::decay<F>::type Callable;
+
+      if constexpr (std::is_convertible<Callable, Function>::value && std::is_pointer<Callable>::value) {
+        function = callable;
+      }
+      if constexpr (sizeof(Callable) <= WS_CALLBACK_INLINE && alignof(Callable) <= alignof(std::max_align_t) &&
+                    std::is_nothrow_move_constructible<Callable>::value)
+      {
+        new (storage) Callable(std::forward<F>(callable));
+        call   = Inline<Callable>::call;
+        manage = Inline<Callable>::manage;
+      } else {
+        *(Callable**)storage = new Callable(std::forward<F>(callable));
+        call   = Boxed<Callable>::call;
+        manage = Boxed<Callable>::manage;
+      }
+    }
+
+    inline Callback(const Callback& other) : call(other.call), manage(other.manage), function(other.function) {
+      if (manage) manage(storage, other.storage);
+    }
+
+    inline Callback& operator =(const Callback& other) {
+      if (this != &other) {
+        if (manage) manage(nullptr, storage);
+        call     = other.call;
+        manage   = other.manage;
+        function = other.function;
+        if (manage) manage(storage, other.storage);
+      }
+      return *this;
+    }
+
+    inline ~Callback() {
+      if (manage) manage(nullptr, storage);
+    }
+
+    inline void operator ()(Args... args) const {
+      call(storage, args...);
+    }
+
+    // The function it holds, if it was made from one (nullptr otherwise)
+    inline Function target() const {
+      return function;
+    }
+
+  private:
+    // manage copies from into to, or destroys from when to is nullptr
+    template <typename F>
+    struct Inline {
+      static void call(const void* storage, Args... args) {
+        (*(F*)const_cast<void*>(storage))(args...);
+      }
+
+      static void manage(void* to, const void* from) {
+        if (to) new (to) F(*(const F*)from);
+        else    ((F*)const_cast<void*>(from))->~F();
+      }
+    };
+
+    template <typename F>
+    struct Boxed {
+      static void call(const void* storage, Args... args) {
+        (**(F* const*)storage)(args...);
+      }
+
+      static void manage(void* to, const void* from) {
+        if (to) *(F**)to = new F(**(F* const*)from);
+        else    delete *(F* const*)from;
+      }
+    };
+
+  private:
+    alignas(std::max_align_t) unsigned char storage[WS_CALLBACK_INLINE];
+    void     (*call)(const void* storage, Args... args);
+    void     (*manage)(void* to, const void* from);
+    Function function;
+  };
+
+  /*
+  NOTE:
+  An Event is a list of callbacks that is copied on write: adding or removing one publishes a new list
+  (under a lock that only writers take), and trigger goes through whichever list is current without
+  locking or allocating. A list that was replaced is freed once no trigger is left running, which is
+  looked at on the next change (or when the event goes).
+  Callbacks can be added and removed from any thread, including from a callback of the same event: the
+  trigger that is running goes on with the list it started with.
+  */
+  template <typename... Args>
+  class Event {
+  public:
+    typedef void (*Function)(Args...);
+
+  public:
+    inline Event() : current(nullptr), readers(0), next(1) {}
+
+    Event(const Event&) = delete;
+    Event& operator =(const Event&) = delete;
+
+    inline ~Event() {
+      delete current.load();
+      for (List* list : retired) delete list;
+    }
+
+    inline void operator +=(Function function) {
+      subscribe(function);
+    }
+
+    // Removes every callback made from the function
+    inline void operator -=(Function function) {
+      std::lock_guard<std::mutex> guard(lock);
+      List*                       list = copy();
+
+      for (auto it = list->begin(); it != list->end();) {
+        if (it->callback.target() == function) it = list->erase(it);
+        else                                   ++it;
+      }
+      publish(list);
+    }
+
+    // Returns what unsubscribe takes to remove it (callables cannot be compared)
+    template <typename F>
+    inline size_t subscribe(F&& callable) {
+      std::lock_guard<std::mutex> guard(lock);
+      List*                       list = copy();
+
+      list->push_back({ next, Callback<Args...>(std::forward<F>(callable)) });
+      publish(list);
+      return next++;
+    }
+
+    inline void unsubscribe(size_t id) {
+      std::lock_guard<std::mutex> guard(lock);
+      List*                       list = copy();
+
+      for (auto it = list->begin(); it != list->end(); ++it) {
+        if (it->id == id) {
+          list->erase(it);
+          break;
+        }
+      }
+      publish(list);
+    }
+
+  protected:
+    inline void trigger(Args... args) {
+      Reading     reading(readers);
+      const List* list = current.load();
+
+      if (list) for (const Entry& entry : *list) entry.callback(args...);
+    }
+
+  private:
+    struct Entry {
+      size_t            id;
+      Callback<Args...> callback;
+    };
+
+    typedef std::vector<Entry> List;
+
+    // Counts the trigger in for as long as it runs (even if a callback throws)
+    struct Reading {
+      inline Reading(std::atomic<long>& readers) : readers(readers) {
+        readers.fetch_add(1);
+      }
+
+      inline ~Reading() {
+        readers.fetch_sub(1);
+      }
+
+      std::atomic<long>& readers;
+    };
+
+    // The lock is held
+    inline List* copy() {
+      const List* list = current.load();
+      return list ? new List(*list) : new List();
+    }
+
+    inline void publish(List* list) {
+      retired.push_back(current.exchange(list));
+      // A trigger that starts after the exchange sees the new list: once none is running, the old ones can go
+      if (!readers.load()) {
+        for (List* old : retired) delete old;
+        retired.clear();
+      }
+    }
+
+  private:
+    std::atomic<List*> current;
+    std::atomic<long>  readers;
+    std::mutex         lock;
+    std::vector<List*> retired;
+    size_t             next;
+  };
+}
+
+#endif
@@ -0,0 +1,108 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Worker pool for the read callbacks, in order for each connection.
+ */
+
+#ifndef WSEXECUTOR_H
+#define WSEXECUTOR_H
+
+#include <wsreactor.h>
+#include <pthread.h>
+
+/*
+NOTE:
+The executor runs the read callbacks on a pool of threads so that a slow one (e.g. a database lookup)
+does not hold up the reading of its socket. Each message is copied into a job (from the buffer pool).
+The jobs of a client wait in its strand and run one at a time, in the order they came: the callbacks of
+a client never run concurrently, while those of different clients do.
+wsexecute never refuses a job, but once capacity jobs are queued the reading side is expected to stop
+reading (see wsexecutorhold and wsexecutorwait) until the queue is back down to half of it.
+*/
+#define WS_EXECUTOR_THREADS       4
+#define WS_EXECUTOR_CAPACITY   4096
+#define WS_EXECUTOR_BUCKETS    1024
+
+typedef void (*WakeCallback)(int client, void *environment);
+
+typedef struct websocket_executor_options {
+  int    threads;
+  size_t capacity;
+} WebSocketExecutorOptions;
+
+typedef struct websocket_job {
+  struct websocket_job *next;
+  int                   client;
+  int                   status;
+  void                 *env;
+  size_t                size;
+  size_t                block;
+  unsigned char         data[];
+} WebSocketJob;
+
+typedef struct websocket_strand {
+  int                      client;
+  int                      scheduled;
+  WebSocketJob            *head;
+  WebSocketJob            *tail;
+  struct websocket_strand *bucket;
+  struct websocket_strand *next;
+} WebSocketStrand;
+
+typedef struct websocket_hold {
+  int                     client;
+  WakeCallback            resume;
+  void                   *env;
+  struct websocket_hold  *next;
+} WebSocketHold;
+
+typedef struct websocket_executor {
+  WebSocketServer  *server;
+  ReadCallback      onread;
+  size_t            capacity;
+  size_t            queued;
+  int               stop;
+  int               count;
+  pthread_t        *threads;
+  pthread_mutex_t   lock;
+  pthread_cond_t    work;
+  pthread_cond_t    room;
+  pthread_cond_t    idle;
+  WebSocketStrand  *strands[WS_EXECUTOR_BUCKETS];
+  WebSocketStrand  *ready;
+  WebSocketStrand  *last;
+  WebSocketStrand  *spare;
+  WebSocketHold    *held;
+} WebSocketExecutor;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void               wsexecutordefaults(WebSocketExecutorOptions *options);
+
+// The jobs are handed to onread (with the environment they were given), NULL when threads is 0
+WebSocketExecutor *wsexecutoralloc(WebSocketServer *server, const WebSocketExecutorOptions *options, ReadCallback onread);
+
+// Runs what is queued, then stops the threads
+void               wsexecutorfree(WebSocketExecutor *executor);
+
+// Queues a copy of the message for the strand of the client, returns 1 once the queue is full (0 otherwise)
+int                wsexecute(WebSocketExecutor *executor, const int client, const unsigned char *buffer, const size_t size,
+                             const int status, void *environment);
+
+/*
+NOTE:
+wsexecutorhold returns 1 when the queue is full: resume(client, environment) is then called (from a worker)
+once there is room again, and the client should not be read until then. wsexecutorwait does the same for
+a thread that reads a single client: it returns once there is room. wsexecutorsync waits until the jobs of
+the client have all run.
+*/
+int                wsexecutorhold(WebSocketExecutor *executor, const int client, WakeCallback resume, void *environment);
+void               wsexecutorwait(WebSocketExecutor *executor);
+void               wsexecutorsync(WebSocketExecutor *executor, const int client);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
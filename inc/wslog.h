@@ -0,0 +1,80 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Asynchronous logger: a bounded lock-free queue of lines, written out by a thread of its own.
+ */
+
+#ifndef WSLOG_H
+#define WSLOG_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define WS_LOG_DEBUG       0
+#define WS_LOG_INFO        1
+#define WS_LOG_WARN        2
+#define WS_LOG_ERROR       3
+
+/*
+NOTE:
+A line is formatted straight into a slot of the queue (WS_LOG_SIZE slots of WS_LOG_LINE bytes, longer
+lines are cut): logging never takes a lock nor waits on a file. When the queue is full, the line is
+dropped and counted, the writer reports how many were lost.
+The writer thread puts the lines below WS_LOG_WARN in the messages sink and the others in the errors
+sink (either can be NULL), and keeps the last WS_LOG_RECENT lines in memory. It only has to be woken
+up when it ran out of lines, else it sleeps for WS_LOG_IDLE ms at most.
+Lines below level are not even formatted.
+*/
+#define WS_LOG_SIZE        1024
+#define WS_LOG_LINE         192
+#define WS_LOG_RECENT        64
+#define WS_LOG_IDLE         100
+
+typedef struct websocket_log_entry {
+  unsigned long long sequence;
+  int                level;
+  char               text[WS_LOG_LINE];
+} WebSocketLogEntry;
+
+typedef struct websocket_log {
+  WebSocketLogEntry  *entries;
+  unsigned long long  tail      __attribute__((aligned(64)));
+  unsigned long long  dropped;
+  unsigned long long  head      __attribute__((aligned(64)));
+  unsigned long long  reported;
+  int                 sleeping;
+  int                 stop;
+  int                 wake;
+  int                 level;
+  FILE               *messages;
+  FILE               *errors;
+  pthread_t           thread;
+  pthread_mutex_t     lock;
+  char                recent[WS_LOG_RECENT][WS_LOG_LINE];
+  int                 levels[WS_LOG_RECENT];
+  unsigned long long  written;
+} WebSocketLog;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+WebSocketLog *wslogopen(FILE *messages, FILE *errors);
+void          wslogclose(WebSocketLog *log);
+
+void          wslog(WebSocketLog *log, const int level, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+// Waits until the lines logged so far are written out
+void          wslogsync(WebSocketLog *log);
+
+/*
+NOTE:
+wslogrecent copies (oldest first, one per line) the last count lines written out whose level is between
+min and max, returns how many were copied. Lines that are still queued are not seen (see wslogsync).
+*/
+int           wslogrecent(WebSocketLog *log, const int min, const int max, char *buffer, const size_t size, const int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
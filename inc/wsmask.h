@@ -0,0 +1,41 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Frame payload masking (XOR with the 4-byte frame mask) kernels.
+ */
+
+#ifndef WSMASK_H
+#define WSMASK_H
+
+#include <stddef.h>
+
+#define MASK_KERNEL_AUTO  -1
+#define MASK_KERNEL_BYTE   0
+#define MASK_KERNEL_WORD   1
+#define MASK_KERNEL_SSE2   2
+#define MASK_KERNEL_AVX2   3
+
+/*
+NOTE:
+wsmask XORs size bytes of src with the mask into dst (src and dst may be the same buffer, neither needs
+to be aligned). The phase is the position in the mask of the first byte, i.e. the number of payload
+bytes of the frame that came before: it is returned updated, so a payload split in several pieces
+(reads, fragments, chunks) can be masked one piece at a time.
+The kernel is chosen on first use: AVX2 or SSE2 when the CPU has them, 64-bit words otherwise.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t wsmask(unsigned char *dst, const unsigned char *src, const size_t size, const unsigned char *mask, const size_t phase);
+
+// Returns 0 when the kernel is not supported by the CPU (MASK_KERNEL_AUTO picks the fastest one)
+int         wsmaskselect(const int kernel);
+int         wsmaskkernel();
+const char *wsmaskname(const int kernel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
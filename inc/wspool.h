@@ -0,0 +1,66 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Size-class buffer pool used for receive, message and send buffers.
+ */
+
+#ifndef WSPOOL_H
+#define WSPOOL_H
+
+#include <stddef.h>
+
+/*
+NOTE:
+Blocks are powers of two from 2^WS_POOL_MIN_BITS to 2^WS_POOL_MAX_BITS bytes, bigger requests go
+straight to the allocator. Freed blocks are kept for reuse, up to WS_POOL_CACHE bytes per size class,
+the rest goes back to the allocator (as does everything on wspooltrim).
+Connections only hold buffers while they have data in flight: an idle connection holds none.
+*/
+#define WS_POOL_MIN_BITS          8
+#define WS_POOL_MAX_BITS         20
+#define WS_POOL_CLASSES          (WS_POOL_MAX_BITS - WS_POOL_MIN_BITS + 1)
+#define WS_POOL_CACHE            (4 * 1024 * 1024)
+
+/*
+NOTE:
+The allocator hook replaces malloc and free underneath the pool (NULL restores them). It must be set
+before anything is allocated, i.e. before wsstart.
+*/
+typedef struct websocket_allocator {
+  void *(*alloc)(size_t size, void *environment);
+  void  (*free)(void *block, size_t size, void *environment);
+  void   *env;
+} WebSocketAllocator;
+
+typedef struct websocket_pool_class {
+  size_t             size;
+  size_t             used;
+  size_t             cached;
+  unsigned long long hits;
+  unsigned long long misses;
+} WebSocketPoolClass;
+
+typedef struct websocket_pool_stats {
+  WebSocketPoolClass classes[WS_POOL_CLASSES];
+  size_t             large;
+  size_t             usedbytes;
+  size_t             cachedbytes;
+  size_t             largebytes;
+} WebSocketPoolStats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void  wspoolallocator(const WebSocketAllocator *allocator);
+
+// *size is rounded up to the size of the block, which is what has to be given back to wspoolfree
+void *wspoolalloc(size_t *size);
+void  wspoolfree(void *block, const size_t size);
+void  wspooltrim();
+void  wspoolstats(WebSocketPoolStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Event-driven (epoll) connection handling for the WebSocket server.
+ */
+
+#ifndef WSREACTOR_H
+#define WSREACTOR_H
+
+#include <wsserver.h>
+#include <pthread.h>
+
+#define WS_MODE_THREAD        0
+#define WS_MODE_REACTOR       1
+#define WS_MODE_URING         2
+
+#define REACTOR_MAX_EVENTS  256
+#define REACTOR_MAX_SHARDS  WS_MAX_LISTENERS
+#define REACTOR_LISTENER    (~0ULL)
+#define REACTOR_WAKE        (~0ULL - 1)
+#define REACTOR_SHAKE       (1ULL << 32)
+
+typedef void (*ConnCallback)(WebSocketServer *server, int client, void *environment);
+typedef void (*ReadCallback)(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment);
+
+/*
+NOTE:
+The reactor serves every connection of a server from a single thread: sockets are only read when epoll
+reports them as readable, so idle connections cost a registry slot and nothing else (no thread, no
+stack). A connection it accepts does its handshake the same way (see wsgreet): the request is read as
+it comes in, a client that is slow to send it holds no one else up. Callbacks are invoked on the
+reactor thread and must not block, or every other client will wait. The buffer handed to the read callback is only valid for the duration of the call.
+The reactor also writes out the outbound queues of its connections (see wswatch), the drain callback of
+the server is then invoked on the reactor thread.
+To use more cores, wsreactorshards makes several reactors that each accept from a listening socket of
+their own (SO_REUSEPORT, see wsserver.h) and serve the connections they accepted. A socket that cannot
+be opened again (a Unix socket, an inherited one) is shared by the shards instead, each connection goes
+to one of those that wait on it. Callbacks are then invoked from several threads, but always from the
+same one for a given client. With cpu set (not -1), wsreact pins its thread to that CPU.
+wsreactoruring switches a reactor to io_uring (see wsuring.h) before it is started, it returns 0 when
+the kernel does not support it and the reactor then keeps using epoll.
+When the read callback hands the messages to an executor (see wsexecutor.h), set executor as well: the
+reactor then stops reading a client whenever the executor is full, until it has room again.
+wsreactorjoin hands the reactor a connection that was made elsewhere (see wsdial), from any thread: the
+reactor then serves it like those it accepts, from the onconnect callback on. It returns 0 if it could
+not, the connection is then closed. A reactor of a server that does not listen only serves those.
+*/
+// Clients handed over to the thread of the reactor
+typedef struct websocket_handoff {
+  int *clients;
+  int  count;
+  int  capacity;
+} WebSocketHandoff;
+
+typedef struct websocket_reactor {
+  int                         fd;
+  int                         listener;
+  int                         shard;
+  int                         cpu;
+  struct websocket_uring     *ring;
+  struct websocket_executor  *executor;
+  int                         wake;
+  pthread_mutex_t             lock;
+  WebSocketHandoff            woken;
+  WebSocketHandoff            joined;
+  WebSocketHandoff            expired;
+  WebSocketServer            *server;
+  ConnCallback                onconnect;
+  ReadCallback                onread;
+  void                       *env;
+} WebSocketReactor;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+WebSocketReactor *wsreactoralloc(WebSocketServer *server);
+void              wsreactorfree(WebSocketReactor *reactor);
+
+// Makes count reactors (the first one listens on the server socket), returns how many could be made
+int               wsreactorshards(WebSocketServer *server, WebSocketReactor **reactors, const int count, const int pin);
+int               wsreactoruring(WebSocketReactor *reactor);
+
+// Stops reading the client if the executor is full, returns 1 if it did (see wsexecutorhold)
+int               wsreactorhold(WebSocketReactor *reactor, const int client);
+// Called (from any thread) when the client can be read again, copies what was called so far into clients
+void              wsreactorwake(int client, void *environment);
+int               wsreactorwoken(WebSocketReactor *reactor, int *clients, const int max);
+int               wsreactorjoin(WebSocketReactor *reactor, const int client);
+int               wsreactorjoined(WebSocketReactor *reactor, int *clients, const int max);
+// Called (from the timer thread) when the handshake of a client it accepted timed out (see wsgreet)
+int               wsreactorexpire(int client, void *environment);
+int               wsreactorexpired(WebSocketReactor *reactor, int *clients, const int max);
+
+// Thread entry point, returns once the server has been shut down (see wsshutdown)
+void *wsreact(void *vargp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
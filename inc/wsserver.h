@@ -9,8 +9,15 @@
 
 #include <time.h>
 #include <stdio.h>
+#include <pthread.h>
 #include <netinet/in.h>
 
+#include <wsdeflate.h>
+#include <wsstats.h>
+#include <wslog.h>
+#include <wstimer.h>
+#include <wstls.h>
+
 /*
 NOTE: 
 This is designed for a Little Endian system (Intel), it hasn't been tested on a Big Endian system.
@@ -21,24 +28,129 @@ NOTE:
 The mask thing seems dumb. Since the mask is sent in the clear along with the message, anyone with
 the skill to listen will have the skill to apply a one-time pad. As it is, it's just a waste of
 processing, hence why it's left at 0.
+Clients must mask what they send all the same (RFC 6455, 5.3): the connections made with wsdial draw a
+key for each frame, from WS_ENTROPY_SIZE bytes of the kernel's generator that are fetched at a time. A
+payload of up to WS_MASK_INLINE bytes is masked on the stack, a bigger one is masked as it is copied
+into a frame of its own.
 */
-#define WS_MAX_CONN          32
+#define WS_BACKLOG         4096
+#define WS_RECV_MIN        1024
+#define WS_RECV_SIZE      16384
 #define WS_KEY_SIZE          64
+#define WS_NONCE_SIZE        16
+#define WS_ACCEPT_SIZE       29
+#define WS_REQUEST_SIZE    4096
+#define WS_RESPONSE_SIZE    512
 #define WS_TIMEOUT         3000
 #define WS_MASK      0x00000000
 #define WS_MASK_SIZE          4
+#define WS_MASK_INLINE     4096
+#define WS_ENTROPY_SIZE     256
+
+/*
+NOTE:
+Client IDs are generation-tagged: the low WS_SLOT_BITS bits select the slot in the registry, the bits
+above count how many times that slot has been reused. An ID that outlived its connection therefore
+never reaches the client that took over the slot. Slots are reused oldest first, so a generation only
+wraps after WS_GENERATION_MASK reuses of one slot. IDs are always positive.
+The registry grows by chunks of WS_REGISTRY_CHUNK connections, which are never moved or freed until
+wsstop: a lookup is a couple of atomic loads and never takes a lock.
+*/
+#define WS_SLOT_BITS                20
+#define WS_SLOT_MASK                ((1 << WS_SLOT_BITS) - 1)
+#define WS_SLOT_NONE                0xFFFFFFFF
+#define WS_GENERATION_MASK          0x7FF
+#define WS_REGISTRY_CHUNK_BITS      10
+#define WS_REGISTRY_CHUNK           (1 << WS_REGISTRY_CHUNK_BITS)
+#define WS_REGISTRY_CHUNKS          (1 << (WS_SLOT_BITS - WS_REGISTRY_CHUNK_BITS))
+#define WS_MAX_CONN                 (1 << WS_SLOT_BITS)
 
 /*
 NOTE:
-If we wanted to transmit a lot of data (bigger than 4 Long Frames), this implementation wouldn't work
-(READ_BUFFER_OVERFLOW). It would be possible to change it, but (1) it would come at a certain
-performance cost and (2) there are already a lot of protocols in place for file transfer or streaming.
-The point of WebSockets is a quick "instantaneous" and interractive connection to the server. In this
-regard, this implementation is not concerned with large data transfers.
+A broadcast encodes its frame once, in a reference-counted WebSocketFrame, and the same bytes are sent
+to every client. The clients are handed out WS_BROADCAST_BATCH slots at a time to the caller and to
+WS_BROADCAST_THREADS workers (started on the first broadcast large enough to need them), so a client
+that is slow to take its frame only holds up the thread sending to it.
 */
-#define FRAME_MAX_FRAGMENTS    4
-#define FRAME_MAX_SIZE     65536
+#define WS_BROADCAST_THREADS         4
+#define WS_BROADCAST_BATCH          64
+
+/*
+NOTE:
+Clients can be subscribed to topics (any name): a publication is encoded once and sent to the
+subscribers of its topic only, whatever the number of other clients. Each topic keeps the IDs of its
+subscribers in an array, which a publication copies out before sending. Each connection keeps its
+subscriptions, which know where they are in that array: subscribing and unsubscribing cost the same
+whatever the number of subscribers. Topics are looked up in a table of WS_TOPIC_BUCKETS chains, under a
+read-write lock that publications share. A topic goes with its last subscriber, and a client is
+unsubscribed from everything when it is closed.
+*/
+#define WS_TOPIC_BUCKETS          1024
+
+/*
+NOTE:
+wslistener adds a listening socket on the same port (SO_REUSEPORT, which the first one turns on for the
+socket of wsstart: until then, a second server on that port fails to bind), and the kernel spreads the
+new connections over them. Each one can be served by its own thread (see the reactor shards in
+wsreactor.h), the connections still share the registry of the server. Given a CPU, the socket is
+preferred for connections that the kernel handles on that CPU. A socket that cannot be opened again (a
+Unix socket, one inherited without SO_REUSEPORT) gets no more: wslistener returns -1.
+*/
+#define WS_MAX_LISTENERS            64
+#define WS_LISTEN_FDS_START          3
+
+/*
+NOTE:
+Each connection has an ordered outbound queue. A frame is written straight from the caller's buffer
+when nothing is queued ahead of it, without waiting: whatever the socket does not take at once is
+queued (broadcast frames by reference, other messages are copied) and written as the socket drains,
+by the thread that watches it (its reactor, see wswatch, or else a writer thread that the server starts
+the first time a queue builds up). Pongs and close replies go through the same queue, so they never
+interleave with a message, and are never refused.
+When a queue already holds frames and a message would take it past highwater bytes, overflow decides:
+WS_OVERFLOW_BLOCK waits (WS_TIMEOUT at most between writes, without holding the connection) until the
+queue is back down to lowwater, except on the threads that serve many clients (see wsnowait) where the
+message is queued past highwater (wsbackpressure tells beforehand), WS_OVERFLOW_DROP drops the message (WRITE_DROPPED is returned) and WS_OVERFLOW_DISCONNECT shuts the
+connection down (WRITE_FAILURE is returned, the reader then sees the connection closed). ondrain is
+called, from the thread that writes the queue out, once a queue that went past highwater is back down
+to lowwater.
+*/
+#define WS_QUEUE_HIGH               (1024 * 1024)
+#define WS_QUEUE_LOW                (256 * 1024)
+#define WS_QUEUE_IOV                64
+#define WS_WRITER_EVENTS            64
+#define WS_WRITER_WAKE              (~0ULL)
+#define WS_OVERFLOW_BLOCK            0
+#define WS_OVERFLOW_DROP             1
+#define WS_OVERFLOW_DISCONNECT       2
+
+/*
+NOTE:
+The deadlines of the connections (in ms, 0 turns one off, all but handshaketimeout are by default) are
+kept on a timer wheel (see wstimer.h) by a thread that the server starts the first time one is set:
+- handshaketimeout: the request has to come in and be answered within it, WS_TIMEOUT by default (or the
+  connection is closed, see wsgreet),
+- keepalive: a client that sent nothing for that long is pinged,
+- pongtimeout: a client that leaves a ping (from the keepalive or wsping) unanswered that long is shut down,
+- idletimeout: a client that sent nothing for that long is shut down (a pong counts).
+A client that is shut down on a deadline is reported closed (READ_CONNECTION_CLOSED_SERVER) by the
+thread that reads it. Reads only note the time: the timer of a connection is set for its next deadline,
+and the deadline is checked against what the client did in the meantime once it comes.
+*/
+#define WS_TIMER_BATCH             256
+
+/*
+NOTE:
+Frames and messages can be of any size (64-bit lengths). A message is assembled in memory until it is
+complete, up to maxmessage bytes (see WebSocketServer, 0 for no limit): what goes past is dropped and
+the read reports READ_BUFFER_OVERFLOW. Past spill bytes (0, the default, never spills), the message is
+moved out of the heap to a memory-mapped anonymous file.
+For uploads that should not be held in memory at all, set onchunk: messages are then handed out piece
+by piece, as they come off the socket, and never assembled.
+*/
+#define WS_MAX_MESSAGE       (64 * 1024 * 1024)
 #define FRAME_CONTROL_SIZE   125
+#define FRAME_HEADER_SIZE     14
 #define FRAME_CONTINUE       0x0
 #define FRAME_TEXT           0x1
 #define FRAME_BINARY         0x2
@@ -53,29 +165,16 @@ regard, this implementation is not concerned with large data transfers.
 #define READ_BUFFER_OVERFLOW             -2
 #define READ_CONNECTION_CLOSED_SERVER    -3
 #define READ_CONNECTION_CLOSED_CLIENT    -4
+#define READ_AGAIN                       -5
+
+#define WRITE_FAILURE            -1
+#define WRITE_DROPPED            -2
 
 #define CONNECTION_FAILURE       -1
 #define CONNECTION_MAX_READCHED  -2
 #define CONNECTION_BAD_HANDSHAKE -3
 #define CONNECTION_CLOSED        -4
-
-typedef struct websocket_connection {
-  int                   active;
-  int                   fd;
-  clock_t               ping;
-  char                  key[WS_KEY_SIZE];
-  int                   version;
-} WebSocketConnection;
-
-typedef struct websocket_server {
-  short                port;
-  int                  fd;
-  int                  close;
-  struct sockaddr_in   address;
-  FILE                *messages;
-  FILE                *errors;
-  WebSocketConnection *connections[WS_MAX_CONN];
-} WebSocketServer;
+#define CONNECTION_AGAIN         -5
 
 #pragma pack(push, 1)
 typedef struct frame_header {
@@ -94,39 +193,236 @@ typedef struct frame_header {
 } FrameHeader;
 #pragma pack(pop)
 
-#pragma pack(push, 1)
-typedef struct control_frame {
-  FrameHeader header;
-  union {
-    unsigned char spayload[FRAME_CONTROL_SIZE + WS_MASK_SIZE];
-    struct {
-      unsigned char mask[WS_MASK_SIZE];
-      unsigned char payload[FRAME_CONTROL_SIZE];
-    };
-  };
-} ControlFrame;
-#pragma pack(pop)
+#define RECV_HEADER          0
+#define RECV_PAYLOAD         1
+#define RECEIVE_FED         -1
 
-#pragma pack(push, 1)
-typedef struct long_frame {
-  FrameHeader    header;
-  unsigned short length;
-  union {
-    unsigned char spayload[FRAME_MAX_SIZE + WS_MASK_SIZE];
-    struct {
-      unsigned char mask[WS_MASK_SIZE];
-      unsigned char payload[FRAME_MAX_SIZE];
-    };
-  };
-} LongFrame;
-#pragma pack(pop)
+/*
+NOTE:
+Each connection buffers what it reads from its socket: a single read() brings in as many frames as the
+kernel holds, and the parser below decodes every complete frame in the buffer before reading again.
+The buffer comes from the pool (wspool.h) when there is something to read and goes back to it once
+the socket is drained, its size (WS_RECV_MIN to WS_RECV_SIZE) follows how much the reads bring in.
+Both buffers go back when the connection is closed, mid-message included (by its reader once it is done
+with them when it was at it, see receiving and stale).
+The parser is resumable: a frame (or a fragmented message) can be split across any number of reads.
+A single complete frame is unmasked in place and handed out without being copied, anything else is
+assembled in the message buffer (which is an mmap of the spill file descriptor once spilled). The byte
+that follows the data handed out is set to 0 for the caller, and put back before the next frame.
+*/
+typedef struct websocket_receiver {
+  unsigned char      *buffer;
+  size_t              bufsize;
+  size_t              hint;
+  size_t              high;
+  size_t              start;
+  size_t              end;
+  int                 state;
+  FrameHeader         header;
+  unsigned char       mask[WS_MASK_SIZE];
+  unsigned long long  remaining;
+  size_t              phase;
+  int                 opcode;
+  int                 compressed;
+  int                 overflow;
+  unsigned char      *message;
+  size_t              size;
+  size_t              capacity;
+  int                 spill;
+  unsigned char      *terminator;
+  unsigned char       saved;
+  unsigned char      *view;
+  unsigned char       control[FRAME_CONTROL_SIZE];
+  size_t              csize;
+} WebSocketReceiver;
+
+struct websocket_frame;
+
+typedef struct websocket_sender {
+  struct websocket_frame **frames;
+  size_t                   block;
+  unsigned int             head;
+  unsigned int             count;
+  unsigned int             capacity;
+  size_t                   offset;
+  size_t                   bytes;
+  int                      full;
+  int                      poll;
+  unsigned int             events;
+  int                      watched;
+} WebSocketSender;
+
+struct websocket_topic;
+
+typedef struct websocket_subscription {
+  struct websocket_topic        *topic;
+  unsigned int                   index;
+  struct websocket_subscription *next;
+} WebSocketSubscription;
+
+typedef struct websocket_topic {
+  struct websocket_topic  *next;
+  unsigned int             hash;
+  unsigned int             count;
+  unsigned int             capacity;
+  int                     *clients;
+  WebSocketSubscription  **subscriptions;
+  char                     name[];
+} WebSocketTopic;
+
+typedef struct websocket_topics {
+  pthread_rwlock_t      lock;
+  size_t                count;
+  WebSocketTopic       *buckets[WS_TOPIC_BUCKETS];
+} WebSocketTopics;
+
+struct websocket_shake;
+
+typedef struct websocket_connection {
+  int                      id;
+  int                      active;
+  int                      fd;
+  unsigned long long       ping;
+  char                     key[WS_KEY_SIZE];
+  int                      version;
+  unsigned int             slot;
+  unsigned int             generation;
+  unsigned int             next;
+  int                      shard;
+  int                      paused;
+  int                      shaking;
+  struct websocket_shake  *shake;
+  int                      masking;
+  int                      receiving;
+  int                      stale;
+  unsigned long long       seen;
+  WebSocketTimer           timer;
+  WebSocketSubscription   *subscriptions;
+  pthread_mutex_t          lock;
+  WebSocketReceiver        rx;
+  WebSocketSender          tx;
+  WebSocketDeflate         deflate;
+  WebSocketTLS             tls;
+  WebSocketConnectionStats stats;
+} WebSocketConnection;
+
+typedef struct websocket_registry {
+  WebSocketConnection *chunks[WS_REGISTRY_CHUNKS];
+  unsigned int         size;
+  unsigned int         count;
+  unsigned int         head;
+  unsigned int         tail;
+  pthread_mutex_t      lock;
+} WebSocketRegistry;
+
+struct websocket_server;
+
+/*
+NOTE:
+Streaming callback: offset is the position of the chunk in the message, status the type of the message
+(READ_TEXT or READ_BINARY) and last is set on its final chunk (which may be empty). The chunk is only
+valid for the duration of the call, it is invoked from the thread reading the connection.
+*/
+typedef void (*ChunkCallback)(struct websocket_server *server, int client, unsigned char *chunk, size_t size,
+                              unsigned long long offset, int status, int last, void *environment);
+typedef void (*DrainCallback)(struct websocket_server *server, int client, void *environment);
+// Called from the timer thread (under its lock) with a handshake that timed out, returns 0 if it could not take it
+typedef int  (*ExpireCallback)(int client, void *environment);
+
+typedef struct websocket_frame {
+  int                      refs;
+  int                      type;
+  size_t                   block;
+  size_t                   size;
+  size_t                   header;
+  unsigned char           *data;
+  struct websocket_frame  *deflated;
+} WebSocketFrame;
 
 /*
 NOTE:
-No need for Long Long Frame implementation (with length longer than 65536) : because that's insane!
-If very huge payloads need to be transmitted, use the fractionning functionnality. But anyways very
-big payloads are not the focus of this implementation.
+A retained message (see wsretain) holds the buffer it was received in, or a copy of it in the same
+block as itself. Its data is followed by a 0 byte.
 */
+typedef struct websocket_message {
+  int                      refs;
+  size_t                   block;
+  size_t                   size;
+  unsigned char           *data;
+  unsigned char           *buffer;
+  size_t                   bufsize;
+  int                      spill;
+} WebSocketMessage;
+
+typedef struct websocket_broadcast {
+  pthread_t             threads[WS_BROADCAST_THREADS];
+  int                   count;
+  int                   stop;
+  unsigned long         round;
+  int                   busy;
+  WebSocketFrame       *frame;
+  unsigned int          cursor;
+  unsigned int          end;
+  int                   sent;
+  pthread_mutex_t       call;
+  pthread_mutex_t       lock;
+  pthread_cond_t        wake;
+  pthread_cond_t        done;
+} WebSocketBroadcast;
+
+typedef struct websocket_writer {
+  pthread_t             thread;
+  int                   started;
+  int                   fd;
+  int                   wake;
+  pthread_mutex_t       lock;
+} WebSocketWriter;
+
+typedef struct websocket_timers {
+  pthread_t             thread;
+  int                   started;
+  int                   stop;
+  pthread_mutex_t       lock;
+  pthread_cond_t        wake;
+  WebSocketWheel        wheel;
+} WebSocketTimers;
+
+typedef struct websocket_server {
+  short                   port;
+  int                     fd;
+  int                     close;
+  int                     listeners[WS_MAX_LISTENERS];
+  int                     nlisteners;
+  struct sockaddr_storage address;
+  socklen_t               addrlen;
+  int                     inherited;
+  int                     wake;
+  FILE                   *messages;
+  FILE                   *errors;
+  WebSocketLog           *log;
+  WebSocketRegistry       registry;
+  WebSocketBroadcast      broadcast;
+  WebSocketWriter         writer;
+  WebSocketTimers         timers;
+  WebSocketTopics         topics;
+  size_t                  maxmessage;
+  size_t                  spill;
+  ChunkCallback           onchunk;
+  void                   *chunkenv;
+  WebSocketDeflateOptions deflate;
+  size_t                  highwater;
+  size_t                  lowwater;
+  int                     overflow;
+  DrainCallback           ondrain;
+  void                   *drainenv;
+  WebSocketCounters      *counters;
+  int                     metrics;
+  unsigned int            handshaketimeout;
+  unsigned int            keepalive;
+  unsigned int            pongtimeout;
+  unsigned int            idletimeout;
+  WebSocketTLSContext    *tls;
+} WebSocketServer;
 
 #ifdef __cplusplus
 extern "C" {
@@ -134,19 +430,180 @@ extern "C" {
 
 /*
 NOTE:
-This implementation is not optimized for multicast at all. For now, simply send the message to each
-client separetly.
+wsframe encodes a frame that can be sent to any number of clients, it holds one reference (wsframeretain
+adds one, wsframerelease drops one and frees the frame with the last). wsbroadcast sends it to every
+connected client and wsmulticast does all three. Both return the number of clients that were sent the
+frame.
 */
-void wsmulticast(WebSocketServer *server, const void *buffer, const size_t size, const int type);
-void wsping(WebSocketServer *server, int client);
+WebSocketFrame *wsframe(const void *buffer, const size_t size, const int type);
+WebSocketFrame *wsframeretain(WebSocketFrame *frame);
+void            wsframerelease(WebSocketFrame *frame);
+int             wswriteframe(WebSocketServer *server, const int client, WebSocketFrame *frame);
+int             wsbroadcast(WebSocketServer *server, WebSocketFrame *frame);
+int             wsmulticast(WebSocketServer *server, const void *buffer, const size_t size, const int type);
 
-void wswrite(WebSocketServer *server, const int client, const unsigned char *buffer, const size_t size, const int type);
+/*
+NOTE:
+wssubscribe returns 1 once the client is subscribed to the topic, 0 if it already was, and -1 if it is
+gone. wsunsubscribe returns 1 if it was subscribed (0 otherwise). wspublishframe sends the frame to the
+subscribers of the topic and wspublish encodes it first, both return the number of clients that were
+sent the frame. Publications made from one thread reach each subscriber in order.
+*/
+int             wssubscribe(WebSocketServer *server, const int client, const char *topic);
+int             wsunsubscribe(WebSocketServer *server, const int client, const char *topic);
+size_t          wssubscribers(WebSocketServer *server, const char *topic);
+int             wspublishframe(WebSocketServer *server, const char *topic, WebSocketFrame *frame);
+int             wspublish(WebSocketServer *server, const char *topic, const void *buffer, const size_t size, const int type);
+void            wsping(WebSocketServer *server, int client);
+
+/*
+NOTE:
+wswrite returns the size of the message once it is sent or queued. wsqueued returns how many bytes wait
+in the queue of a client, wsflush writes out what its socket takes without waiting and returns how many
+bytes are left (or -1). wswatch hands the connection over to the epoll set that reads it (registered
+with EPOLLIN and the client ID as data): EPOLLOUT is then added to it while the queue holds frames, and
+the events have to be passed to wsflush. wswatchoutput does the same for an epoll set that does not read
+the connection: the socket is only in it (EPOLLOUT, one-shot) while the queue holds frames.
+wsbackpressure returns 1 when a message of size bytes would take the queue past highwater (the drain
+callback is then called once it is back down to lowwater), 0 when it can be written now, -1 when the
+client is gone.
+*/
+size_t wsqueued(WebSocketServer *server, const int client);
+int    wsbackpressure(WebSocketServer *server, const int client, const size_t size);
+long   wsflush(WebSocketServer *server, const int client);
+void   wswatch(WebSocketServer *server, const int client, const int epoll);
+void   wswatchoutput(WebSocketServer *server, const int client, const int epoll);
+
+// While paused, the reactor does not read the client (its socket leaves the epoll set that reads it)
+void   wspause(WebSocketServer *server, const int client, const int paused);
+// Marks the calling thread as one that serves many clients (a reactor): its writes never wait on a queue
+void   wsnowait();
+
+/*
+NOTE:
+wstryread behaves like wsread, except that it returns READ_AGAIN instead of waiting when no new frame
+is available on the socket. It is meant to be called when the connection is known to be readable
+(e.g. from an epoll reactor).
+*/
+int  wswrite(WebSocketServer *server, const int client, const unsigned char *buffer, const size_t size, const int type);
 int  wsread(WebSocketServer *server, const int client, unsigned char *buffer, const size_t maxbytes, size_t *readbytes);
+int  wstryread(WebSocketServer *server, const int client, unsigned char *buffer, const size_t maxbytes, size_t *readbytes);
+
+/*
+NOTE:
+The view variants hand out the message where it was assembled instead of copying it (messages of any
+size, up to maxmessage). *data is only valid until the next read on the connection, it is followed by
+a 0 byte.
+*/
+int  wsreadview(WebSocketServer *server, const int client, unsigned char **data, size_t *readbytes);
+int  wstryreadview(WebSocketServer *server, const int client, unsigned char **data, size_t *readbytes);
+
+/*
+NOTE:
+wsretain keeps the message a view (or a read callback) was handed past the next read, it holds one
+reference (wsmessageretain adds one, wsmessagerelease drops one and frees the message with the last,
+from any thread). Called from the thread that read the message, the connection gives up the buffer the
+message is in rather than copying it, and takes another: what is left to parse in the receive buffer is
+moved over, unless that is more than the message (which is then copied instead). Anywhere else (e.g. on
+an executor, whose jobs hold a copy already), and for ping times, the message is copied.
+*/
+WebSocketMessage *wsretain(WebSocketServer *server, const int client, const unsigned char *data, const size_t size);
+WebSocketMessage *wsmessageretain(WebSocketMessage *message);
+void              wsmessagerelease(WebSocketMessage *message);
 
+// wsacceptfrom returns CONNECTION_AGAIN when another thread took the connection (a shared listening socket),
+// wsacceptsocket returns the socket it accepted without doing the handshake
 int  wsaccept(WebSocketServer *server);
+int  wsacceptfrom(WebSocketServer *server, const int listener);
+int  wsacceptsocket(WebSocketServer *server, const int listener);
+
+/*
+NOTE:
+wsadopt does the handshake on a socket that was accepted elsewhere and registers the connection, it
+returns like wsaccept (and closes the socket on failure). wsfeed hands the connection bytes that were
+read elsewhere (e.g. through io_uring) and returns how many it took (or -1): it takes less when its
+buffer is full, the frames that are in it have to be read first. wsnextview parses what was fed and
+never reads the socket, it returns READ_AGAIN once it needs more.
+wsgreet takes an accepted socket without waiting for its request: the socket is made nonblocking and
+the ID that the connection will have is returned (or an error like wsaccept, the socket is then closed).
+wsshake goes on with the handshake (the TLS one first on a secure server) whenever the socket is
+readable, from a single thread: it returns the ID once the connection is registered, CONNECTION_AGAIN
+while the request is not all in, and an error like wsaccept once the socket is closed (CONNECTION_CLOSED
+when no handshake goes by that ID). The request can be fed under that ID as well, wsshake then never
+reads the socket: what wsfeed did not take (past the request) goes to the connection once it is
+registered, ciphertext is then always decrypted by OpenSSL (never by the kernel). wsunshake gives up on
+the handshake. Once the handshake timeout is past, expire is called with that ID: the thread that goes
+on with the handshake then gives up on it (without expire, or if it returns 0, the socket is shut down
+and the next call gives up on it).
+wsdial is the client side: it connects to a server (host is a name or an address), asks it for path and
+returns the ID of the connection like wsaccept (CONNECTION_FAILURE if the server could not be reached).
+The connection is then used like any other, its frames are masked. A server started without a port (0)
+does not listen, it only makes connections.
+*/
+int  wsadopt(WebSocketServer *server, const int fd);
+int  wsgreet(WebSocketServer *server, const int fd, ExpireCallback expire, void *environment);
+int  wsshake(WebSocketServer *server, const int client);
+void wsunshake(WebSocketServer *server, const int client);
+int  wsdial(WebSocketServer *server, const char *host, const short port, const char *path);
+long wsfeed(WebSocketServer *server, const int client, const unsigned char *bytes, const size_t size);
+int  wsnextview(WebSocketServer *server, const int client, unsigned char **data, size_t *readbytes);
+
 void wsclose(WebSocketServer *server, int client);
 
+/*
+NOTE:
+wsconnection returns NULL for an ID that is not (or no longer) connected, wsshaking for one that is not
+doing its handshake (see wsgreet). wsnext iterates over the connected clients: start with -1, it returns
+-1 after the last one.
+*/
+WebSocketConnection *wsconnection(WebSocketServer *server, const int client);
+WebSocketConnection *wsshaking(WebSocketServer *server, const int client);
+int                  wsactive(WebSocketServer *server, const int client);
+int                  wsnext(WebSocketServer *server, const int client);
+int                  wscount(WebSocketServer *server);
+
+/*
+NOTE:
+wsstats sums the counters of the server (see wsstats.h), wsclientstats takes those of a client (it returns
+-1 if the client is not connected) and wsmetrics writes the former in the Prometheus text format.
+*/
+void   wsstats(WebSocketServer *server, WebSocketStats *stats);
+int    wsclientstats(WebSocketServer *server, const int client, WebSocketConnectionStats *stats);
+size_t wsmetrics(WebSocketServer *server, char *buffer, const size_t size);
+
+/*
+NOTE:
+What the server has to say goes through its log (see wslog.h): messages gets the lines below
+WS_LOG_WARN and errors the others (either can be NULL), from the thread of the log. Set log->level to
+hear less (or more), wslogrecent reads the last lines back from memory.
+*/
 WebSocketServer *wsstart(const short port, FILE *messages, FILE *errors);
+int              wslistener(WebSocketServer *server, const int cpu);
+
+/*
+NOTE:
+wsstartunix listens on a Unix socket instead of a TCP port, for clients on the same host (a local proxy,
+helper processes): the handshake and the frames are the same, without the loopback TCP stack. A path
+that starts with @ is in the abstract namespace (no file), otherwise the socket file is made, replacing
+one that nothing listens on anymore, and removed by wsstop.
+wsstartfd serves a socket that is already listening (TCP or Unix), handed down by a supervisor: the
+server starts without binding, and the connections that queue up while it restarts are kept. That
+socket is never shut down (wsshutdown wakes the server up instead) and is made nonblocking, wsstop only
+closes the server's descriptor of it. wsactivated returns the index-th socket passed by socket
+activation (LISTEN_FDS, for this process in LISTEN_PID, from descriptor 3 on), or -1.
+*/
+WebSocketServer *wsstartunix(const char *path, FILE *messages, FILE *errors);
+WebSocketServer *wsstartfd(const int fd, FILE *messages, FILE *errors);
+int              wsactivated(const int index);
+
+/*
+NOTE:
+wssecure sets TLS up (see wstls.h) once the server is started, before it accepts or makes a connection:
+the clients that connect then go through a TLS handshake (a listening server needs a certificate), and
+so do the connections made with wsdial. It returns 0, or -1 once the reason is logged.
+*/
+int              wssecure(WebSocketServer *server, const WebSocketTLSOptions *options);
+void             wsshutdown(WebSocketServer *server);
 void             wsstop(WebSocketServer *server);
 
 #ifdef __cplusplus
@@ -0,0 +1,102 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Runtime counters of the server and of its connections, and their text exposition.
+ */
+
+#ifndef WSSTATS_H
+#define WSSTATS_H
+
+#include <stddef.h>
+
+/*
+NOTE:
+The server counters are kept in WS_STATS_SHARDS copies, each on cache lines of its own: a thread always
+counts in the same copy (threads are handed one in turn), so threads seldom share the lines they write.
+Counting is a relaxed atomic add, reading sums the copies (counters are therefore not taken at the
+same instant).
+Latencies are counted in microseconds, in buckets of powers of two: bucket i holds the values up to
+2^i - 1 us (and more than the bucket before it), the last one holds everything above.
+*/
+#define WS_STATS_SHARDS    32
+#define WS_STATS_BUCKETS   24
+#define WS_STATS_LINE      64
+
+/*
+NOTE:
+With metrics set on the server, a GET of WS_METRICS_PATH without Upgrade header is answered with the
+counters in the Prometheus text format (on the port of the server, the connection is then closed).
+*/
+#define WS_METRICS_PATH    "/metrics"
+#define WS_METRICS_SIZE    8192
+
+typedef struct websocket_histogram {
+  unsigned long long buckets[WS_STATS_BUCKETS];
+  unsigned long long count;
+  unsigned long long sum;
+} WebSocketHistogram;
+
+// Only unsigned long long fields: the copies are summed as arrays
+typedef struct websocket_counters {
+  unsigned long long accepts;
+  unsigned long long handshakefailures;
+  unsigned long long refused;
+  unsigned long long closes;
+  unsigned long long scrapes;
+  unsigned long long framesin;
+  unsigned long long framesout;
+  unsigned long long bytesin;
+  unsigned long long bytesout;
+  unsigned long long messagesin;
+  unsigned long long messagesout;
+  unsigned long long dropped;
+  unsigned long long disconnected;
+  unsigned long long timeouts;
+  unsigned long long tlshandshakes;
+  unsigned long long tlsresumed;
+  unsigned long long tlsoffloaded;
+  WebSocketHistogram handshake;
+  WebSocketHistogram rtt;
+} __attribute__((aligned(WS_STATS_LINE))) WebSocketCounters;
+
+typedef struct websocket_stats {
+  WebSocketCounters  total;
+  unsigned int       connections;
+  size_t             queued;
+} WebSocketStats;
+
+// rtt is the round trip of the last ping that was answered (0 until then), since is when it connected
+typedef struct websocket_connection_stats {
+  unsigned long long framesin;
+  unsigned long long framesout;
+  unsigned long long bytesin;
+  unsigned long long bytesout;
+  unsigned long long messagesin;
+  unsigned long long messagesout;
+  unsigned long long rtt;
+  unsigned long long since;
+  size_t             queued;
+} WebSocketConnectionStats;
+
+#define WS_COUNT(counters, field, n) __atomic_add_fetch(&wscounters(counters)->field, (n), __ATOMIC_RELAXED)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Microseconds on the monotonic clock
+unsigned long long wsclock();
+
+WebSocketCounters *wscountersalloc();
+void               wscountersfree(WebSocketCounters *counters);
+WebSocketCounters *wscounters(WebSocketCounters *counters);
+void               wscountersum(const WebSocketCounters *counters, WebSocketCounters *total);
+void               wshistogram(WebSocketHistogram *histogram, const unsigned long long us);
+
+// Writes the Prometheus text exposition of the stats, returns its length (it is cut short to fit in size)
+size_t             wsstatsformat(const WebSocketStats *stats, char *buffer, const size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
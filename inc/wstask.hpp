@@ -0,0 +1,74 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Coroutines for the C++ wrapper (C++20).
+ */
+
+#ifndef WEBSOCKETTASK_HPP
+#define WEBSOCKETTASK_HPP
+
+#include <coroutine>
+#include <exception>
+#include <new>
+#include <cstddef>
+
+#include <wspool.h>
+#include <websocket.hpp>
+
+namespace ws {
+  /*
+  NOTE:
+  A Task is a coroutine that starts right away and frees itself once it returns: it can await
+  WebSocket::accept, Connection::receive, Connection::sendAsync and Connection::pingAsync, and is resumed
+  by the thread that serves the connection, so a conversation reads as straight-line code without a
+  thread of its own:
+    ws::Task session(ws::Connection* connection) {
+      for (;;) {
+        ws::RawData data = co_await connection->receive();
+        if (data.type < 0 && data.type != ws::DATA_INCOMPLETE) co_return;
+        co_await connection->sendAsync(data.buffer, data.size);
+      }
+    }
+  Frames come from the buffer pool (see wspool.h): once the pool is warm, starting one does not allocate.
+  An exception that escapes a task terminates the program.
+  */
+  class Task {
+  public:
+    struct promise_type {
+      inline Task get_return_object() noexcept {
+        return Task();
+      }
+
+      inline std::suspend_never initial_suspend() noexcept {
+        return {};
+      }
+
+      inline std::suspend_never final_suspend() noexcept {
+        return {};
+      }
+
+      inline void return_void() noexcept {}
+
+      inline void unhandled_exception() noexcept {
+        std::terminate();
+      }
+
+      // The size of the block is kept in front of the frame, wspoolfree needs it
+      static inline void* operator new(std::size_t size) {
+        std::size_t block  = size + alignof(std::max_align_t);
+        void*       memory = wspoolalloc(&block);
+
+        if (!memory) throw std::bad_alloc();
+        *(std::size_t*)memory = block;
+        return (char*)memory + alignof(std::max_align_t);
+      }
+
+      static inline void operator delete(void* frame) noexcept {
+        char* memory = (char*)frame - alignof(std::max_align_t);
+
+        wspoolfree(memory, *(std::size_t*)memory);
+      }
+    };
+  };
+}
+
+#endif
@@ -0,0 +1,61 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Hierarchical timer wheel for the deadlines of the connections.
+ */
+
+#ifndef WSTIMER_H
+#define WSTIMER_H
+
+#include <stddef.h>
+
+/*
+NOTE:
+Time is counted in ticks of WS_TIMER_TICK ms. The wheel has WS_TIMER_LEVELS levels of WS_TIMER_SLOTS
+slots: a timer goes in the slot of its tick at the highest level where its tick and the current one
+differ, and moves down a level each time the wheel gets to that slot. Setting, unsetting and
+expiring a timer cost the same whatever the number of timers, and a tick only looks at one slot (plus
+one slot of each level above, every WS_TIMER_SLOTS ticks of the level below).
+A deadline can be up to WS_TIMER_MAX ticks away (about 45 hours), a timer set further is expired at
+WS_TIMER_MAX: what it stands for has to be checked again when it expires.
+Timers are embedded in what they time, the wheel allocates nothing. It is not thread-safe.
+*/
+#define WS_TIMER_TICK        10
+#define WS_TIMER_BITS         6
+#define WS_TIMER_SLOTS       (1 << WS_TIMER_BITS)
+#define WS_TIMER_LEVELS       4
+#define WS_TIMER_MAX         ((unsigned long long)(WS_TIMER_SLOTS - 2) << (WS_TIMER_BITS * (WS_TIMER_LEVELS - 1)))
+
+typedef struct websocket_timer {
+  struct websocket_timer *next;
+  struct websocket_timer *prev;
+  unsigned long long      expires;
+} WebSocketTimer;
+
+typedef struct websocket_wheel {
+  unsigned long long now;
+  size_t             count;
+  WebSocketTimer     slots[WS_TIMER_LEVELS][WS_TIMER_SLOTS];
+} WebSocketWheel;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Ticks on the monotonic clock
+unsigned long long wsticks();
+
+void            wswheelinit(WebSocketWheel *wheel, const unsigned long long now);
+
+// A timer that is set again is moved, one that is due (or past due) expires on the next tick
+void            wstimerset(WebSocketWheel *wheel, WebSocketTimer *timer, unsigned long long expires);
+void            wstimerunset(WebSocketWheel *wheel, WebSocketTimer *timer);
+int             wstimerpending(const WebSocketTimer *timer);
+
+// Moves the wheel up to now and returns the timers that expired on the way, chained through next
+WebSocketTimer *wswheeladvance(WebSocketWheel *wheel, const unsigned long long now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
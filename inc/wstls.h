@@ -0,0 +1,119 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: TLS of the connections (wss://) with OpenSSL, offloaded to the kernel (kTLS) where it can be.
+ * Standard: https://datatracker.ietf.org/doc/html/rfc8446
+ */
+
+#ifndef WSTLS_H
+#define WSTLS_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define WS_TLS_CACHE      20480
+#define WS_TLS_TICKETS        2
+#define WS_TLS_SESSIONS      64
+#define WS_TLS_PEER_SIZE    272
+#define WS_TLS_RECORD     16384
+#define WS_TLS_REASON       256
+
+#define WS_TLS_SEND           1
+#define WS_TLS_RECV           2
+
+struct ssl_st;
+struct ssl_ctx_st;
+struct ssl_session_st;
+
+/*
+NOTE:
+TLS is off until enabled is set. The connections that are accepted then go through a TLS handshake
+before the HTTP one, with the certificate (a PEM chain) and its key. The connections that are made
+(wsdial) go through the client side of it: the certificate of the server is checked against authority
+(a PEM file, the system's store when it is NULL) and the name that was dialled, unless verify is 0.
+Sessions are resumed: the server hands out tickets (tickets per handshake, 0 turns them off) and keeps
+up to cache sessions, the connections that are made keep the last session of each of WS_TLS_SESSIONS
+servers.
+With offload, OpenSSL hands the record layer over to the kernel (kTLS, TCP_ULP "tls") once the handshake
+is done, in each direction it can: a connection that the kernel encrypts for is written with sendmsg
+like a plain one (frames still go out straight from their buffers, a broadcast frame is encrypted by
+the kernel for each client), one that the kernel decrypts for is read with recv (or io_uring). What
+the kernel does not take (no tls module, a cipher it does not have) goes through OpenSSL.
+*/
+typedef struct websocket_tls_options {
+  int         enabled;
+  const char *certificate;
+  const char *key;
+  const char *authority;
+  int         verify;
+  int         offload;
+  int         tickets;
+  long        cache;
+} WebSocketTLSOptions;
+
+typedef struct websocket_tls_session {
+  char                   peer[WS_TLS_PEER_SIZE];
+  struct ssl_session_st *session;
+} WebSocketTLSSession;
+
+typedef struct websocket_tls_context {
+  struct ssl_ctx_st   *server;
+  struct ssl_ctx_st   *client;
+  pthread_mutex_t      lock;
+  unsigned int         next;
+  WebSocketTLSSession  sessions[WS_TLS_SESSIONS];
+} WebSocketTLSContext;
+
+/*
+NOTE:
+The TLS state of a connection: ssl is NULL for a plain one, kernel holds the directions that kTLS took
+over (WS_TLS_SEND, WS_TLS_RECV). What goes through OpenSSL is done under lock, the reading thread and
+the writers can then share the connection like a plain one. Once fed is set, what comes off the socket
+is handed in with wstlsfeed (e.g. from io_uring) rather than read by OpenSSL.
+*/
+typedef struct websocket_tls {
+  struct ssl_st   *ssl;
+  int              kernel;
+  int              resumed;
+  int              fed;
+  pthread_mutex_t  lock;
+} WebSocketTLS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void                 wstlsdefaults(WebSocketTLSOptions *options);
+
+// Returns NULL when the options cannot be used, with the reason (WS_TLS_REASON bytes)
+WebSocketTLSContext *wstlscontext(const WebSocketTLSOptions *options, char *reason);
+void                 wstlscontextfree(WebSocketTLSContext *context);
+
+/*
+NOTE:
+wstlsopen does the handshake on the socket (which is made nonblocking) within timeout ms between
+steps: the server side when host is NULL, the client side of a connection to host and port otherwise.
+It returns 0 once done (tls is left plain when the context does not serve that side) and 1 if it
+failed. wstlsinit and wstlsstep do the same without waiting on the peer: wstlsinit sets the state up,
+then each call to wstlsstep goes as far as what the peer sent so far allows and returns -1 when it
+needs more (the socket is to be read, or the bytes fed with wstlsfeed), 0 and 1 as above (wstlsclose
+frees the state either way). wstlsclose sends the closing alert and frees the state.
+wstlsrecv and wstlssend behave like recv and sendmsg without waiting (the byte counts are those of the
+plaintext), wstlsfeed takes bytes that came off the socket elsewhere and returns how many (or -1).
+*/
+int     wstlsopen(WebSocketTLSContext *context, WebSocketTLS *tls, const int fd, const char *host, const short port,
+                  const int timeout);
+int     wstlsinit(WebSocketTLSContext *context, WebSocketTLS *tls, const int fd, const char *host, const short port);
+int     wstlsstep(WebSocketTLS *tls, const int fd, const int timeout);
+void    wstlsclose(WebSocketTLS *tls);
+int     wstlsciphered(WebSocketTLS *tls);
+ssize_t wstlsrecv(WebSocketTLS *tls, const int fd, void *buffer, const size_t size);
+ssize_t wstlssend(WebSocketTLS *tls, const int fd, struct iovec *iov, const int count);
+long    wstlsfeed(WebSocketTLS *tls, const unsigned char *bytes, const size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,9 +2,29 @@
 #define WEBSOCKETYPES_HPP
 
 #include <wsserver.h>
+#include <wsreactor.h>
+#include <wsexecutor.h>
 #include <cstddef>
+#include <utility>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
 
 namespace ws {
+  enum Mode {
+    MODE_THREAD  = WS_MODE_THREAD,
+    MODE_REACTOR = WS_MODE_REACTOR,
+    MODE_URING   = WS_MODE_URING
+  };
+
+  // What happens to a message for a client whose outbound queue is full (see WebSocket::setQueueLimits)
+  enum Overflow {
+    OVERFLOW_BLOCK      = WS_OVERFLOW_BLOCK,
+    OVERFLOW_DROP       = WS_OVERFLOW_DROP,
+    OVERFLOW_DISCONNECT = WS_OVERFLOW_DISCONNECT
+  };
+
   enum DataType {
     DATA_PING         = READ_PING_TIME,
     DATA_TEXT         = READ_TEXT,
@@ -15,10 +35,86 @@ namespace ws {
     DATA_CLOSE_SERVER = READ_CONNECTION_CLOSED_SERVER
   };
 
+  // The buffer is only valid for the duration of the callback it is handed to (see Connection::retain)
   struct RawData {
-    unsigned char buffer[FRAME_MAX_FRAGMENTS * FRAME_MAX_SIZE];
-    size_t        size;
-    DataType      type;
+    unsigned char* buffer;
+    size_t         size;
+    DataType       type;
+
+#ifdef __cpp_lib_span
+    inline std::span<const unsigned char> view() const {
+      return std::span<const unsigned char>(buffer, size);
+    }
+#endif
+  };
+
+  // A message kept past its callback (see Connection::retain), released along with its last copy
+  class Message {
+  public:
+    inline Message() : message(nullptr) {}
+    inline explicit Message(WebSocketMessage* message) : message(message) {}
+    inline Message(const Message& other) : message(wsmessageretain(other.message)) {}
+    inline Message(Message&& other) : message(other.message) { other.message = nullptr; }
+
+    inline Message& operator =(Message other) {
+      std::swap(message, other.message);
+      return *this;
+    }
+
+    inline ~Message() {
+      wsmessagerelease(message);
+    }
+
+    // Followed by a 0 byte
+    inline const unsigned char* data() const {
+      return message ? message->data : nullptr;
+    }
+
+    inline size_t size() const {
+      return message ? message->size : 0;
+    }
+
+    inline explicit operator bool() const {
+      return message != nullptr;
+    }
+
+#ifdef __cpp_lib_span
+    inline std::span<const unsigned char> view() const {
+      return std::span<const unsigned char>(data(), size());
+    }
+#endif
+
+  private:
+    WebSocketMessage* message;
+  };
+
+  // Counters of the server and of a connection (see wsstats.h and WebSocket::stats)
+  typedef WebSocketStats           Stats;
+  typedef WebSocketConnectionStats ConnectionStats;
+
+  // A piece of a message that is received in chunks (see WebSocket::setStreaming)
+  struct ChunkData {
+    unsigned char*     buffer;
+    size_t             size;
+    unsigned long long offset;
+    DataType           type;
+    bool               last;
+  };
+
+  // A suspended coroutine (see wstask.hpp), held without <coroutine> so that the library builds as C++17
+  struct Resumable {
+    void* frame;
+    void  (*resume)(void* frame);
+
+    template <typename Handle>
+    inline void set(Handle handle) {
+      frame  = handle.address();
+      resume = [](void* frame) { Handle::from_address(frame).resume(); };
+    }
+
+    inline void operator ()() const {
+      resume(frame);
+    }
   };
 }
 
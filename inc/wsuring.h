@@ -0,0 +1,76 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: io_uring backend of the reactor.
+ */
+
+#ifndef WSURING_H
+#define WSURING_H
+
+#include <wsreactor.h>
+
+/*
+NOTE:
+A reactor switched to io_uring (see wsreactoruring) accepts with a multishot accept and reads every
+connection with a multishot receive into buffers provided to the kernel (URING_BUFFERS of
+URING_BUFFER_SIZE bytes, shared by the connections of the reactor): the bytes are fed to the connection
+(see wsfeed) and the buffer is given back at once. The request of a connection that was accepted is
+received the same way (see wsgreet), under the ID that the connection gets once it is upgraded. A
+single io_uring_enter submits what the last batch of completions called for and waits for the next
+one, no other call is made to read.
+Frames are still sent with sendmsg by the thread that writes them (header and payload together). The
+queues that build up are written out by the reactor: their sockets wait in its epoll set (see
+wswatchoutput), which the ring polls.
+The kernel must support multishot receive (Linux 6.0), wsuringalloc returns NULL otherwise.
+*/
+#define URING_ENTRIES        512
+#define URING_COMPLETIONS   4096
+#define URING_BUFFERS       1024
+#define URING_BUFFER_SIZE   4096
+#define URING_GROUP            0
+#define URING_ACCEPT        (~0ULL)
+#define URING_OUTPUT        (~0ULL - 1)
+#define URING_CANCEL        (~0ULL - 2)
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+typedef struct websocket_uring {
+  int                       fd;
+  unsigned int             *sqhead;
+  unsigned int             *sqtail;
+  unsigned int             *sqmask;
+  unsigned int             *sqarray;
+  unsigned int              sqentries;
+  unsigned int              tail;
+  unsigned int              submitted;
+  struct io_uring_sqe      *sqes;
+  unsigned int             *cqhead;
+  unsigned int             *cqtail;
+  unsigned int             *cqmask;
+  struct io_uring_cqe      *cqes;
+  void                     *sqring;
+  size_t                    sqringsize;
+  void                     *cqring;
+  size_t                    cqringsize;
+  size_t                    sqessize;
+  struct io_uring_buf_ring *buffers;
+  unsigned char            *pool;
+  unsigned short            buftail;
+} WebSocketUring;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+WebSocketUring *wsuringalloc();
+void            wsuringfree(WebSocketUring *ring);
+
+// Event loop of a reactor that was switched to io_uring, returns once the server has been shut down
+void           *wsuringreact(WebSocketReactor *reactor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
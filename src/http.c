@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 void httpreqstr(HttpRequest *request, char *buffer) {
   char *method;
@@ -146,4 +147,204 @@ void getfield(char *text, char *field, char *buffer) {
       if (text[i + j] != field[j]) break;
     }
   }
-}
\ No newline at end of file
+}
+#define HTTP_PARSE_METHOD      0
+#define HTTP_PARSE_FILE        1
+#define HTTP_PARSE_VERSION     2
+#define HTTP_PARSE_LINE_END    3
+#define HTTP_PARSE_NAME_START  4
+#define HTTP_PARSE_NAME        5
+#define HTTP_PARSE_VALUE_START 6
+#define HTTP_PARSE_VALUE       7
+#define HTTP_PARSE_FIELD_END   8
+#define HTTP_PARSE_HEAD_END    9
+#define HTTP_PARSE_RESPONSE   10
+#define HTTP_PARSE_STATUS     11
+#define HTTP_PARSE_REASON     12
+
+// Characters allowed in a method or a field name (RFC 9110, 5.6.2)
+int httpistoken(const char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '-' || (c >= '0' && c <= '9') || (c && strchr("!#$%&'*+-.^_`|~", c));
+}
+
+// Characters allowed in a field value, tab and obs-text included
+int httpisvalue(const char c) {
+  return (unsigned char)c >= ' ' ? c != 0x7F : c == '\t';
+}
+
+int httpmethod(const char *method, const size_t size) {
+  static const char *methods[] = { "GET", "HEAD", "PUT", "POST", "DELETE" };
+
+  for (int i = 0; i < 5; i++) {
+    if (strlen(methods[i]) == size && !memcmp(methods[i], method, size)) return i;
+  }
+  return -1;
+}
+
+void httpparserinit(HttpParser *parser) {
+  memset(parser, 0, sizeof(HttpParser));
+  parser->state  = HTTP_PARSE_METHOD;
+  parser->method = -1;
+}
+
+void httpresponseinit(HttpParser *parser) {
+  httpparserinit(parser);
+  parser->state = HTTP_PARSE_RESPONSE;
+}
+
+int httpparse(HttpParser *parser, const char *buffer, const size_t size) {
+  // Kept in locals: stores through the char buffer could otherwise alias the parser
+  int    state = parser->state;
+  size_t mark  = parser->mark;
+  size_t end   = parser->end;
+  size_t i;
+
+  for (i = parser->offset; i < size; i++) {
+    const char c = buffer[i];
+
+    switch (state) {
+      case HTTP_PARSE_METHOD:
+        if (c == ' ' && i > mark) {
+          parser->method = httpmethod(&buffer[mark], i - mark);
+          mark           = i + 1;
+          state          = HTTP_PARSE_FILE;
+        } else if (!httpistoken(c)) {
+          return HTTP_INVALID;
+        }
+        break;
+      case HTTP_PARSE_FILE:
+        if (c == ' ' && i > mark) {
+          parser->file.data = &buffer[mark];
+          parser->file.size = i - mark;
+          mark              = i + 1;
+          state             = HTTP_PARSE_VERSION;
+        } else if (c <= ' ' || c == 0x7F) {
+          return HTTP_INVALID;
+        }
+        break;
+      case HTTP_PARSE_VERSION:
+        if ((c == '\r' || c == '\n') && i > mark) {
+          parser->version.data = &buffer[mark];
+          parser->version.size = i - mark;
+          state                = c == '\r' ? HTTP_PARSE_LINE_END : HTTP_PARSE_NAME_START;
+        } else if (c <= ' ' || c == 0x7F) {
+          return HTTP_INVALID;
+        }
+        break;
+      case HTTP_PARSE_RESPONSE:
+        if (c == ' ' && i > mark) {
+          parser->version.data = &buffer[mark];
+          parser->version.size = i - mark;
+          mark                 = i + 1;
+          state                = HTTP_PARSE_STATUS;
+        } else if (c <= ' ' || c == 0x7F) {
+          return HTTP_INVALID;
+        }
+        break;
+      case HTTP_PARSE_STATUS:
+        // Three digits, the reason that follows can be empty
+        if (i - mark < 3 && c >= '0' && c <= '9') {
+          parser->status = parser->status * 10 + c - '0';
+        } else if (i - mark == 3 && c == ' ') {
+          mark  = i + 1;
+          state = HTTP_PARSE_REASON;
+        } else if (i - mark == 3 && (c == '\r' || c == '\n')) {
+          parser->reason.data = &buffer[i];
+          parser->reason.size = 0;
+          state               = c == '\r' ? HTTP_PARSE_LINE_END : HTTP_PARSE_NAME_START;
+        } else {
+          return HTTP_INVALID;
+        }
+        break;
+      case HTTP_PARSE_REASON:
+        if (c == '\r' || c == '\n') {
+          parser->reason.data = &buffer[mark];
+          parser->reason.size = i - mark;
+          state               = c == '\r' ? HTTP_PARSE_LINE_END : HTTP_PARSE_NAME_START;
+        } else if (!httpisvalue(c)) {
+          return HTTP_INVALID;
+        }
+        break;
+      case HTTP_PARSE_LINE_END:
+      case HTTP_PARSE_FIELD_END:
+        if (c != '\n') return HTTP_INVALID;
+        state = HTTP_PARSE_NAME_START;
+        break;
+      case HTTP_PARSE_NAME_START:
+        if (c == '\r') {
+          state = HTTP_PARSE_HEAD_END;
+          break;
+        }
+        if (c == '\n') {
+          parser->offset = i + 1;
+          return (int)(i + 1);
+        }
+        if (!httpistoken(c) || parser->count == HTTP_MAX_HEADERS) return HTTP_INVALID;
+        mark  = i;
+        state = HTTP_PARSE_NAME;
+        break;
+      case HTTP_PARSE_NAME:
+        if (c == ':') {
+          parser->fields[parser->count].name.data = &buffer[mark];
+          parser->fields[parser->count].name.size = i - mark;
+          state                                   = HTTP_PARSE_VALUE_START;
+        } else if (!httpistoken(c)) {
+          return HTTP_INVALID;
+        }
+        break;
+      case HTTP_PARSE_VALUE_START:
+        if (c == ' ' || c == '\t') break;
+        mark  = i;
+        end   = i;
+        state = HTTP_PARSE_VALUE;
+        // fallthrough
+      case HTTP_PARSE_VALUE:
+        // Most of the head is values: skim to the end of the line (trailing whitespace is left out)
+        for (; i < size && httpisvalue(buffer[i]); i++) {
+          if (buffer[i] != ' ' && buffer[i] != '\t') end = i + 1;
+        }
+        if (i == size) break;
+        if (buffer[i] != '\r' && buffer[i] != '\n') return HTTP_INVALID;
+        parser->fields[parser->count].value.data = &buffer[mark];
+        parser->fields[parser->count].value.size = end - mark;
+        parser->count++;
+        state = buffer[i] == '\r' ? HTTP_PARSE_FIELD_END : HTTP_PARSE_NAME_START;
+        break;
+      case HTTP_PARSE_HEAD_END:
+        if (c != '\n') return HTTP_INVALID;
+        parser->offset = i + 1;
+        return (int)(i + 1);
+    }
+  }
+  parser->state  = state;
+  parser->mark   = mark;
+  parser->end    = end;
+  parser->offset = size;
+  return HTTP_INCOMPLETE;
+}
+
+const HttpSpan *httpfield(const HttpParser *parser, const char *name) {
+  size_t size = strlen(name);
+
+  for (int i = 0; i < parser->count; i++) {
+    if (parser->fields[i].name.size == size && !strncasecmp(parser->fields[i].name.data, name, size)) {
+      return &parser->fields[i].value;
+    }
+  }
+  return NULL;
+}
+
+// Whether a comma-separated list (e.g. "keep-alive, Upgrade") holds the token, regardless of case
+int httptoken(const HttpSpan *value, const char *token) {
+  size_t size = strlen(token);
+
+  for (size_t i = 0; i < value->size;) {
+    size_t start, end;
+
+    while (i < value->size && (value->data[i] == ' ' || value->data[i] == '\t' || value->data[i] == ',')) i++;
+    for (start = i; i < value->size && value->data[i] != ','; i++);
+    for (end = i; end > start && (value->data[end - 1] == ' ' || value->data[end - 1] == '\t'); end--);
+    if (end - start == size && !strncasecmp(&value->data[start], token, size)) return 1;
+  }
+  return 0;
+}
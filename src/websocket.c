@@ -7,59 +7,88 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
 
 
 void *wslisten(void *vargp) {
   int            readstatus;
   size_t         readbytes  = 0;
-  unsigned char *buffer     = malloc(FRAME_MAX_FRAGMENTS * FRAME_MAX_SIZE * sizeof(unsigned char));
+  unsigned char *data;
+  unsigned char  empty      = 0;
   WebSocket     *websocket  = ((WebSocket**)vargp)[0];
   int            client     =       ((long*)vargp)[1];
+
+  free(vargp);
   do {
-    readstatus = wsread(websocket->server, client, buffer, FRAME_MAX_SIZE, &readbytes);
-    websocket->onread(websocket->server, client, buffer, readbytes, readstatus, websocket->env);
+    // The message is handed out where it was assembled, no copy (unless it goes to the executor)
+    readstatus = wsreadview(websocket->server, client, &data, &readbytes);
+    if (!websocket->handlers) {
+      websocket->onread(websocket->server, client, data ? data : &empty, readbytes, readstatus, websocket->env);
+    } else if (wsexecute(websocket->handlers, client, data ? data : &empty, readbytes, readstatus, websocket->env)) {
+      // The client is not read until the executor has room
+      wsexecutorwait(websocket->handlers);
+    }
   } while (readstatus >= 0 || readstatus == READ_BUFFER_OVERFLOW); // (Buffer overflow is not a fatal error)
-  
-  free(buffer);
+
+  // The reading thread owns its connection
+  wsclose(websocket->server, client);
+  pthread_mutex_lock(&websocket->lock);
+  if (!--websocket->readers) pthread_cond_broadcast(&websocket->done);
+  pthread_mutex_unlock(&websocket->lock);
   return NULL;
 }
 
 
+// Gives the client a reading thread of its own, returns 0 if it could not (the client is then closed)
+int wsspawn(WebSocket *websocket, const int client) {
+  void           **vargp   = malloc(2 * sizeof(void*));
+  int              spawned = 0;
+  pthread_attr_t   attributes;
+  pthread_t        thread;
+
+  if (vargp) {
+    vargp[0] = (void*)websocket;
+    vargp[1] = (void*)(long)client;
+    websocket->onconnect(websocket->server, client, websocket->env);
+    pthread_mutex_lock(&websocket->lock);
+    websocket->readers++;
+    pthread_mutex_unlock(&websocket->lock);
+    // Reading threads clean up after themselves, there is nothing to join
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    spawned = !pthread_create(&thread, &attributes, wslisten, vargp);
+    pthread_attr_destroy(&attributes);
+    if (!spawned) {
+      pthread_mutex_lock(&websocket->lock);
+      websocket->readers--;
+      pthread_mutex_unlock(&websocket->lock);
+      free(vargp);
+    }
+  }
+  if (!spawned) wsclose(websocket->server, client);
+  return spawned;
+}
+
+// Wakes up the reading threads, and waits for them to be done with the server
+void wsjoinreaders(WebSocket *websocket) {
+  for (int i = wsnext(websocket->server, -1); i >= 0; i = wsnext(websocket->server, i)) {
+    wsclose(websocket->server, i);
+  }
+  pthread_mutex_lock(&websocket->lock);
+  while (websocket->readers) pthread_cond_wait(&websocket->done, &websocket->lock);
+  pthread_mutex_unlock(&websocket->lock);
+}
+
 void *wsconnect(void *vargp) {
-  pthread_t           client_thread[WS_MAX_CONN];
-  WebSocket          *websocket = (WebSocket*)vargp;
+  WebSocket *websocket = (WebSocket*)vargp;
 
-  memset(client_thread, 0, WS_MAX_CONN * sizeof(pthread_t));
   while (1) {
     int client = wsaccept(websocket->server);
     if (client == CONNECTION_FAILURE || client == CONNECTION_CLOSED) break;
-    // Purge the old connections
-    for (int i = 0; i < WS_MAX_CONN; i++) {
-      // This means that the thread is still going but that the connection is closed
-      if (client_thread[i] && !websocket->server->connections[i]->active) {
-        pthread_join(client_thread[i], NULL);
-        client_thread[i] = 0;
-        wsclose(websocket->server, i);
-      }
-    }
-    if (client != CONNECTION_BAD_HANDSHAKE && client != CONNECTION_MAX_READCHED) {
-      void **vargp = malloc(2 * sizeof(void*));
-      if (vargp) {
-        vargp[0] = (void*)websocket;
-        vargp[1] = (void*)(long)client;
-        websocket->onconnect(websocket->server, client, websocket->env);
-        pthread_create(&client_thread[client], NULL, wslisten, vargp);
-      } else {
-        wsclose(websocket->server, client);
-      }
-    }
-  }
-  for (int i = 0; i < WS_MAX_CONN; i++) {
-    if (client_thread[i]) {
-      wsclose(websocket->server, i);
-      pthread_join(client_thread[i], NULL);
-    }
+    if (client != CONNECTION_BAD_HANDSHAKE && client != CONNECTION_MAX_READCHED) wsspawn(websocket, client);
   }
+  wsjoinreaders(websocket);
 
   return NULL;
 }
@@ -68,9 +97,23 @@ WebSocket *wsalloc(const int port, FILE *messages, FILE *errors) {
   WebSocket *websocket = malloc(sizeof(WebSocket));
   
   if (websocket) {
-    websocket->port     = port;
-    websocket->messages = messages;
-    websocket->errors   = errors;
+    memset(websocket, 0, sizeof(WebSocket));
+    websocket->port       = port;
+    websocket->socketfd   = -1;
+    websocket->messages   = messages;
+    websocket->errors     = errors;
+    websocket->maxmessage = WS_MAX_MESSAGE;
+    websocket->highwater  = WS_QUEUE_HIGH;
+    websocket->lowwater   = WS_QUEUE_LOW;
+    websocket->overflow   = WS_OVERFLOW_BLOCK;
+    websocket->workers    = 1;
+    // A client that never finishes its handshake would hold on to its slot for good
+    websocket->handshaketimeout = WS_TIMEOUT;
+    wsdeflatedefaults(&websocket->deflate);
+    wstlsdefaults(&websocket->tls);
+    wsexecutordefaults(&websocket->executor);
+    pthread_mutex_init(&websocket->lock, NULL);
+    pthread_cond_init(&websocket->done, NULL);
   }
 
   return websocket;
@@ -78,24 +121,138 @@ WebSocket *wsalloc(const int port, FILE *messages, FILE *errors) {
 
 void wsfree(WebSocket *websocket) {
   wsteardown(websocket);
+  pthread_mutex_destroy(&websocket->lock);
+  pthread_cond_destroy(&websocket->done);
   free(websocket);
 }
 
+// Callbacks of the reactors when there is an executor (their environment is the WebSocket)
+void wsdispatchconnect(WebSocketServer *server, int client, void *environment) {
+  WebSocket *websocket = environment;
+
+  websocket->onconnect(server, client, websocket->env);
+}
+
+void wsdispatch(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  WebSocket *websocket = environment;
+
+  // Whether the client should be held is checked by the reactor (see wsreactorhold)
+  wsexecute(websocket->handlers, client, buffer, read, status, websocket->env);
+}
+
+void wsreactorstart(WebSocket *websocket) {
+  int workers = websocket->workers < 1 ? 1 : websocket->workers;
+
+  websocket->shards = wsreactorshards(websocket->server, websocket->reactors, workers, websocket->pin);
+  for (int i = 0; i < websocket->shards; i++) {
+    WebSocketReactor *reactor = websocket->reactors[i];
+
+    reactor->onconnect = websocket->onconnect;
+    reactor->onread    = websocket->onread;
+    reactor->env       = websocket->env;
+    if (websocket->handlers) {
+      reactor->onconnect = wsdispatchconnect;
+      reactor->onread    = wsdispatch;
+      reactor->env       = websocket;
+      reactor->executor  = websocket->handlers;
+    }
+    if (websocket->mode == WS_MODE_URING && !wsreactoruring(reactor)) {
+      wslog(websocket->server->log, WS_LOG_WARN, "io_uring is not available, shard %d uses epoll", i);
+    }
+    if (pthread_create(&websocket->threads[i], NULL, wsreact, reactor)) {
+      // Shutting its socket down takes the shard out of the port, the kernel sends its connections to the others
+      for (int j = i; j < websocket->shards; j++) {
+        if (j && websocket->reactors[j]->listener != websocket->server->fd) shutdown(websocket->reactors[j]->listener, SHUT_RDWR);
+        wsreactorfree(websocket->reactors[j]);
+        websocket->reactors[j] = NULL;
+      }
+      websocket->shards = i;
+      break;
+    }
+  }
+}
+
 void wsinit(WebSocket *websocket, ConnCallback onconnect, ReadCallback onread) {
   if (websocket->server) return;
-  websocket->server    = wsstart(websocket->port, websocket->messages, websocket->errors);
+  if (websocket->socketfd >= 0) {
+    websocket->server = wsstartfd(websocket->socketfd, websocket->messages, websocket->errors);
+  } else if (websocket->socketpath) {
+    websocket->server = wsstartunix(websocket->socketpath, websocket->messages, websocket->errors);
+  } else {
+    websocket->server = wsstart(websocket->port, websocket->messages, websocket->errors);
+  }
   websocket->onconnect = onconnect;
   websocket->onread    = onread;
-  pthread_create(&websocket->server_thread, NULL, wsconnect, (void*)websocket);
+  if (!websocket->server) return;
+  websocket->server->maxmessage       = websocket->maxmessage;
+  websocket->server->spill            = websocket->spill;
+  websocket->server->onchunk          = websocket->onchunk;
+  websocket->server->chunkenv         = websocket->env;
+  websocket->server->deflate          = websocket->deflate;
+  websocket->server->highwater        = websocket->highwater;
+  websocket->server->lowwater         = websocket->lowwater;
+  websocket->server->overflow         = websocket->overflow;
+  websocket->server->ondrain          = websocket->ondrain;
+  websocket->server->drainenv         = websocket->env;
+  websocket->server->metrics          = websocket->metrics;
+  websocket->server->handshaketimeout = websocket->handshaketimeout;
+  websocket->server->keepalive        = websocket->keepalive;
+  websocket->server->pongtimeout      = websocket->pongtimeout;
+  websocket->server->idletimeout      = websocket->idletimeout;
+  if (websocket->tls.enabled && wssecure(websocket->server, &websocket->tls) < 0) {
+    wsstop(websocket->server);
+    websocket->server = NULL;
+    return;
+  }
+  websocket->handlers                 = wsexecutoralloc(websocket->server, &websocket->executor, onread);
+  if (websocket->mode == WS_MODE_REACTOR || websocket->mode == WS_MODE_URING) {
+    wsreactorstart(websocket);
+  } else if (websocket->server->fd >= 0) {
+    pthread_create(&websocket->server_thread, NULL, wsconnect, (void*)websocket);
+  }
+}
+
+int wsconnect_client(WebSocket *websocket, const char *host, const short port, const char *path) {
+  int client;
+
+  if (!websocket->server) return CONNECTION_FAILURE;
+  if ((client = wsdial(websocket->server, host, port, path)) < 0) return client;
+  if (websocket->mode == WS_MODE_REACTOR || websocket->mode == WS_MODE_URING) {
+    if (!websocket->shards) {
+      wsclose(websocket->server, client);
+      return CONNECTION_FAILURE;
+    }
+    // Spread over the shards (the client is closed if it cannot be joined)
+    if (!wsreactorjoin(websocket->reactors[(client & WS_SLOT_MASK) % websocket->shards], client)) return CONNECTION_FAILURE;
+  } else if (!wsspawn(websocket, client)) {
+    return CONNECTION_FAILURE;
+  }
+  return client;
 }
 
 void wsteardown(WebSocket *websocket) {
   if (websocket->server) {
-    wsstop(websocket->server);
+    // The serving thread must be done with the server before it is freed
+    wsshutdown(websocket->server);
     if (websocket->server_thread) {
       pthread_join(websocket->server_thread, NULL);
       websocket->server_thread = 0;
+    } else if (websocket->mode != WS_MODE_REACTOR && websocket->mode != WS_MODE_URING) {
+      // Without a port, the reading threads of the connections that were made have no serving thread to wait for them
+      wsjoinreaders(websocket);
+    }
+    // Reactors that do not listen are not woken up by the shutdown of the socket
+    for (int i = 0; i < websocket->shards; i++) eventfd_write(websocket->reactors[i]->wake, 1);
+    for (int i = 0; i < websocket->shards; i++) pthread_join(websocket->threads[i], NULL);
+    // What is still queued runs before the server goes
+    wsexecutorfree(websocket->handlers);
+    websocket->handlers = NULL;
+    wsstop(websocket->server);
+    for (int i = 0; i < websocket->shards; i++) {
+      wsreactorfree(websocket->reactors[i]);
+      websocket->reactors[i] = NULL;
     }
+    websocket->shards = 0;
     websocket->server = NULL;
   }
 }
\ No newline at end of file
@@ -7,7 +7,7 @@
 
 #include <algorithm>
 #include <cstring>
-#include <fstream>
+#include <sys/eventfd.h>
 
 namespace ws {
   // ServerException
@@ -22,62 +22,279 @@ namespace ws {
     return exception.c_str();
   }
 
-  // ConnectionEvent
+  // Acceptance
   ///////////////////////////////////////////////////////////////////////////////////////////////////////
-  void WebSocket::ConnectionEvent::trigger(Connection* connection) {
-    for (auto callback : callbacks) callback(connection);
+  WebSocket::Acceptance::Acceptance(WebSocket* websocket)
+    : websocket(websocket)
+  {
   }
 
-  void WebSocket::ConnectionEvent::operator +=(ConnectionCallback callback) {
-    callbacks.push_back(callback);
+  bool WebSocket::Acceptance::await_ready() {
+    std::lock_guard<std::mutex> guard(websocket->acceptLock);
+
+    websocket->accepting = true;
+    return websocket->stopped || !websocket->backlog.empty();
   }
 
-  void WebSocket::ConnectionEvent::operator -=(ConnectionCallback callback) {
-    callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), callback), callbacks.end());
+  Connection* WebSocket::Acceptance::await_resume() {
+    std::lock_guard<std::mutex> guard(websocket->acceptLock);
+    Connection*                 connection = websocket->accepted;
+
+    websocket->accepted = nullptr;
+    if (!connection && !websocket->stopped && !websocket->backlog.empty()) {
+      connection = websocket->backlog.front();
+      websocket->backlog.pop_front();
+    }
+    return connection;
   }
 
   // WebSocket
   ///////////////////////////////////////////////////////////////////////////////////////////////////////
   WebSocket::WebSocket(const int port, const void* envPtr)
     : port(port)
+    , socketFd(-1)
     , envPtr(envPtr)
+    , mode(MODE_THREAD)
+    , workers(1)
+    , pin(false)
+    , streaming(false)
+    , maxMessage(WS_MAX_MESSAGE)
+    , spill(0)
+    , highWater(WS_QUEUE_HIGH)
+    , lowWater(WS_QUEUE_LOW)
+    , overflow(OVERFLOW_BLOCK)
+    , metrics(false)
+    , keepAlive(0)
+    , pongTimeout(0)
+    , idleTimeout(0)
+    , handshakeTimeout(WS_TIMEOUT)
+    , executor(nullptr)
     , server(nullptr)
     , serverThread(nullptr)
     , lastMessage("")
     , lastError("")
-    , mname(".messages." + std::to_string(port) + ".tmp")
-    , ename(".errors."   + std::to_string(port) + ".tmp")
+    , acceptor()
+    , accepted(nullptr)
+    , accepting(false)
+    , stopped(false)
   {
-    messages = std::fopen(mname.c_str(), "w+");
-    errors   = std::fopen(ename.c_str(), "w+");
+    wsdeflatedefaults(&compression);
+    wstlsdefaults(&tlsOptions);
+    wsexecutordefaults(&executorOptions);
   }
 
   WebSocket::WebSocket(const int port) : WebSocket(port, nullptr) {}
 
   WebSocket::~WebSocket() {
     stop();
-    std::fclose(messages);
-    std::fclose(errors);
-    std::remove(mname.c_str());
-    std::remove(ename.c_str());
+  }
+
+  void WebSocket::setMode(Mode mode) {
+    if (!server) this->mode = mode;
+  }
+
+  void WebSocket::setWorkers(int workers, bool pin) {
+    if (!server) {
+      this->workers = workers < 1 ? 1 : workers;
+      this->pin     = pin;
+    }
+  }
+
+  void WebSocket::setStreaming(bool streaming) {
+    if (!server) this->streaming = streaming;
+  }
+
+  void WebSocket::setMessageLimits(size_t maxMessage, size_t spill) {
+    if (!server) {
+      this->maxMessage = maxMessage;
+      this->spill      = spill;
+    }
+  }
+
+  void WebSocket::setQueueLimits(size_t highWater, size_t lowWater, Overflow overflow) {
+    if (!server) {
+      this->highWater = highWater;
+      this->lowWater  = lowWater < highWater ? lowWater : highWater;
+      this->overflow  = overflow;
+    }
+  }
+
+  void WebSocket::setCompression(bool enabled, int level, bool takeover, size_t threshold) {
+    if (!server) {
+      compression.enabled   = enabled;
+      compression.level     = level;
+      compression.takeover  = takeover;
+      compression.threshold = threshold;
+    }
+  }
+
+  void WebSocket::setMetrics(bool enabled) {
+    if (!server) metrics = enabled;
+  }
+
+  void WebSocket::setUnixSocket(const std::string& path) {
+    if (!server) socketPath = path;
+  }
+
+  void WebSocket::setSocket(int fd) {
+    if (!server) socketFd = fd;
+  }
+
+  void WebSocket::setTLS(const std::string& certificate, const std::string& key, bool offload) {
+    if (!server) {
+      this->certificate  = certificate;
+      this->key          = key;
+      tlsOptions.enabled = true;
+      tlsOptions.offload = offload;
+    }
+  }
+
+  void WebSocket::setAuthority(const std::string& authority, bool verify) {
+    if (!server) {
+      this->authority    = authority;
+      tlsOptions.enabled = true;
+      tlsOptions.verify  = verify;
+    }
+  }
+
+  void WebSocket::setKeepAlive(unsigned int interval, unsigned int pongTimeout) {
+    if (!server) {
+      this->keepAlive   = interval;
+      this->pongTimeout = pongTimeout;
+    }
+  }
+
+  void WebSocket::setTimeouts(unsigned int idle, unsigned int handshake) {
+    if (!server) {
+      idleTimeout      = idle;
+      handshakeTimeout = handshake;
+    }
+  }
+
+  void WebSocket::setExecutor(int threads, size_t capacity) {
+    if (!server) {
+      executorOptions.threads  = threads < 0 ? 0 : threads;
+      executorOptions.capacity = capacity;
+    }
   }
 
   void WebSocket::start() {
     if (server) return;
-    server = wsstart(port, messages, errors);
-    serverThread = new std::thread(&ws::WebSocket::waitForConnections, this);
+    {
+      std::lock_guard<std::mutex> guard(acceptLock);
+      stopped = false;
+    }
+    // The lines of the server are only kept in memory (see message and error)
+    if (socketFd >= 0)            server = wsstartfd(socketFd, nullptr, nullptr);
+    else if (!socketPath.empty()) server = wsstartunix(socketPath.c_str(), nullptr, nullptr);
+    else                          server = wsstart(port, nullptr, nullptr);
+    if (!server) throw ServerException(this);
+    server->maxmessage       = maxMessage;
+    server->spill            = spill;
+    server->deflate          = compression;
+    server->highwater        = highWater;
+    server->lowwater         = lowWater;
+    server->overflow         = overflow;
+    server->metrics          = metrics;
+    server->keepalive        = keepAlive;
+    server->pongtimeout      = pongTimeout;
+    server->idletimeout      = idleTimeout;
+    server->handshaketimeout = handshakeTimeout;
+    if (tlsOptions.enabled) {
+      tlsOptions.certificate = certificate.empty() ? nullptr : certificate.c_str();
+      tlsOptions.key         = key.empty()         ? nullptr : key.c_str();
+      tlsOptions.authority   = authority.empty()   ? nullptr : authority.c_str();
+      if (wssecure(server, &tlsOptions) < 0) {
+        wsstop(server);
+        server = nullptr;
+        throw ServerException(this);
+      }
+    }
+    server->ondrain          = drainConnection;
+    server->drainenv         = this;
+    if (streaming) {
+      server->onchunk  = receiveChunk;
+      server->chunkenv = this;
+    }
+    executor = wsexecutoralloc(server, &executorOptions, executeRead);
+    if (mode == MODE_REACTOR || mode == MODE_URING) {
+      WebSocketReactor* reactors[REACTOR_MAX_SHARDS];
+      int               count = wsreactorshards(server, reactors, workers, pin);
+
+      if (!count) throw ServerException(this);
+      for (int i = 0; i < count; i++) {
+        Shard* shard = new Shard();
+
+        shard->websocket      = this;
+        shard->reactor        = reactors[i];
+        reactors[i]->onconnect = reactorConnect;
+        reactors[i]->onread    = reactorRead;
+        reactors[i]->env       = shard;
+        reactors[i]->executor  = executor;
+        if (mode == MODE_URING && !wsreactoruring(reactors[i])) {
+          wslog(server->log, WS_LOG_WARN, "io_uring is not available, shard %d uses epoll", i);
+        }
+        shards.push_back(shard);
+      }
+      for (Shard* shard : shards) {
+        shard->thread = new std::thread([shard]() {
+          serving = shard;
+          wsreact(shard->reactor);
+        });
+      }
+    } else if (server->fd >= 0) {
+      serverThread = new std::thread(&ws::WebSocket::waitForConnections, this);
+    }
   }
 
   void WebSocket::stop() {
     if (server) {
-      wsstop(server);
+      // The serving thread must be done with the server before it is freed
+      wsshutdown(server);
       if (serverThread) {
         serverThread->join();
         delete serverThread;
         serverThread = nullptr;
+      } else {
+        // The connections that were made have no serving thread to see to them
+        dropConnections();
       }
+      // Reactors that do not listen are not woken up by the shutdown of the socket
+      for (Shard* shard : shards) eventfd_write(shard->reactor->wake, 1);
+      for (Shard* shard : shards) {
+        shard->thread->join();
+        delete shard->thread;
+      }
+      // What is still queued runs before the server goes (the connections of the shards are deleted by their last job)
+      wsexecutorfree(executor);
+      executor = nullptr;
+      // The last lines stay readable once the server is gone
+      message();
+      error();
+      wsstop(server);
+      for (Shard* shard : shards) {
+        wsreactorfree(shard->reactor);
+        delete shard;
+      }
+      shards.clear();
       server = NULL;
     }
+    {
+      Resumable resumable = { nullptr, nullptr };
+
+      {
+        // The connections that were never accepted are gone with their threads
+        std::lock_guard<std::mutex> guard(acceptLock);
+        stopped = true;
+        backlog.clear();
+        std::swap(resumable, acceptor);
+      }
+      if (resumable.frame) resumable();
+    }
+  }
+
+  WebSocket::Acceptance WebSocket::accept() {
+    return Acceptance(this);
   }
 
   void WebSocket::sendAll(const void* data, const size_t size) {
@@ -92,60 +309,215 @@ namespace ws {
     wsmulticast(server, (unsigned char*)text.c_str(), text.length(), DATA_TEXT);
   }
 
-  const std::string& WebSocket::message() {
-    std::fflush(messages);
+  int WebSocket::publish(const std::string& topic, const void* data, const size_t size) {
+    return wspublish(server, topic.c_str(), data, size, DATA_BINARY);
+  }
+
+  int WebSocket::publish(const std::string& topic, const char* text) {
+    return wspublish(server, topic.c_str(), text, std::strlen(text), DATA_TEXT);
+  }
+
+  int WebSocket::publish(const std::string& topic, const std::string& text) {
+    return wspublish(server, topic.c_str(), text.c_str(), text.length(), DATA_TEXT);
+  }
+
+  bool WebSocket::dial(const std::string& host, const int port, const std::string& path) {
+    int client;
+
+    if (!server || (client = wsdial(server, host.c_str(), port, path.c_str())) < 0) return false;
+    // Spread over the shards, the connection is made on the thread of its shard (see reactorConnect)
+    if (!shards.empty()) return wsreactorjoin(shards[(client & WS_SLOT_MASK) % shards.size()]->reactor, client);
     {
-      std::ifstream mfile(mname, std::ios_base::in);
-      std::string   m;
+      std::lock_guard<std::mutex> guard(connectionsLock);
+      Connection*                 connection = new Connection(server, client, envPtr);
 
-      while (std::getline(mfile, m)) lastMessage = m;
-      mfile.close();
+      purgeConnections();
+      connect(connection);
+      connections[client] = connection;
+      connection->listen();
     }
+    return true;
+  }
+
+  const std::string& WebSocket::message() {
+    lastLine(WS_LOG_DEBUG, WS_LOG_INFO, lastMessage);
     return lastMessage;
   }
 
   const std::string& WebSocket::error() {
-    std::fflush(errors);
+    lastLine(WS_LOG_WARN, WS_LOG_ERROR, lastError);
+    return lastError;
+  }
+
+  void WebSocket::lastLine(int min, int max, std::string& line) {
+    char buffer[WS_LOG_LINE + 1];
+
+    if (!server) return;
+    wslogsync(server->log);
+    if (wslogrecent(server->log, min, max, buffer, sizeof(buffer), 1)) line.assign(buffer, std::strlen(buffer) - 1);
+  }
+
+  // Hands a new connection over to the coroutine waiting in accept, if any
+  void WebSocket::connect(Connection* connection) {
+    Resumable resumable = { nullptr, nullptr };
+
+    connection->owner    = this;
+    connection->executor = executor;
+    onConnect.trigger(connection);
     {
-      std::ifstream mfile(mname, std::ios_base::in);
-      std::string   m;
+      std::lock_guard<std::mutex> guard(acceptLock);
 
-      while (std::getline(mfile, lastMessage)) lastError = m;
-      mfile.close();
+      if (acceptor.frame) {
+        accepted = connection;
+        std::swap(resumable, acceptor);
+      } else if (accepting) {
+        backlog.push_back(connection);
+      }
     }
-    return lastMessage;
+    if (resumable.frame) resumable();
+  }
+
+  void WebSocket::release(Connection* connection) {
+    {
+      std::lock_guard<std::mutex> guard(acceptLock);
+      backlog.erase(std::remove(backlog.begin(), backlog.end(), connection), backlog.end());
+    }
+    delete connection;
+  }
+
+  bool WebSocket::suspend(const Resumable& resumable) {
+    std::lock_guard<std::mutex> guard(acceptLock);
+
+    if (stopped || !backlog.empty() || acceptor.frame) return false;
+    acceptor = resumable;
+    return true;
+  }
+
+  Stats WebSocket::stats() {
+    Stats stats;
+
+    if (server) wsstats(server, &stats);
+    else        std::memset(&stats, 0, sizeof(Stats));
+    return stats;
   }
 
   void WebSocket::waitForConnections() {
-    int         client;
-    Connection* connections[WS_MAX_CONN] = { nullptr };
+    int client;
 
     while (true) {
       client = wsaccept(server);
       if (client == CONNECTION_FAILURE || client == CONNECTION_CLOSED) break;
-      // Purge the old connections
-      for (int i = 0; i < WS_MAX_CONN; i++) {
-        // This means that the thread is still going but that the connection is closed
-        if (connections[i] && !connections[i]->isAlive()) {
-          delete connections[i];
-          connections[i] = nullptr;
-          wsclose(server, i);
-        }
-      }
+      // Purge the old connections (the writer thread may be looking one up)
+      std::lock_guard<std::mutex> guard(connectionsLock);
+      purgeConnections();
       if (client != CONNECTION_BAD_HANDSHAKE && client != CONNECTION_MAX_READCHED) {
         Connection* connection = new Connection(this->server, client, envPtr);
-        onConnect.trigger(connection);
+        connect(connection);
         connections[client] = connection;
         connection->listen();
       }
     }
-    for (int i = 0; i < WS_MAX_CONN; i++) {
-      if (connections[i]) {
-        connections[i]->disconnect();
-        delete connections[i];
+    dropConnections();
+
+    if (client != CONNECTION_CLOSED) throw ServerException(this);
+  }
+
+  // Connections lock held
+  void WebSocket::purgeConnections() {
+    for (auto it = connections.begin(); it != connections.end();) {
+      // This means that the thread is still going but that the connection is closed
+      if (!it->second->isAlive()) {
+        release(it->second);
+        wsclose(server, it->first);
+        it = connections.erase(it);
+      } else {
+        ++it;
       }
     }
+  }
 
-    if (client != CONNECTION_CLOSED) throw ServerException(this);
+  void WebSocket::dropConnections() {
+    std::lock_guard<std::mutex> guard(connectionsLock);
+
+    for (auto& entry : connections) {
+      entry.second->disconnect();
+      release(entry.second);
+    }
+    connections.clear();
+  }
+
+  // Reactor mode: connections have no thread of their own, the thread of their shard dispatches to them
+  thread_local WebSocket::Shard* WebSocket::serving = nullptr;
+
+  void WebSocket::reactorConnect(WebSocketServer* server, int client, void* environment) {
+    Shard*      shard      = (Shard*)environment;
+    Connection* connection = new Connection(server, client, shard->websocket->envPtr);
+
+    shard->connections[client] = connection;
+    shard->websocket->connect(connection);
+  }
+
+  void WebSocket::reactorRead(WebSocketServer* server, int client, unsigned char* buffer, size_t read, int status, void* environment) {
+    Shard* shard = (Shard*)environment;
+    auto   entry = shard->connections.find(client);
+
+    if (entry == shard->connections.end()) return;
+    if (shard->websocket->executor) {
+      // The connection goes with its last job (see executeRead)
+      wsexecute(shard->websocket->executor, client, buffer, read, status, entry->second);
+      if (status < 0 && status != DATA_INCOMPLETE) shard->connections.erase(entry);
+      return;
+    }
+    shard->data.buffer = buffer;
+    shard->data.size   = read;
+    shard->data.type   = (DataType)status;
+    entry->second->receive(&shard->data);
+    if (status < 0 && status != DATA_INCOMPLETE) {
+      // The reactor closes the client right after this call
+      shard->websocket->release(entry->second);
+      shard->connections.erase(entry);
+    }
+  }
+
+  // Runs on a worker of the executor, the jobs of a connection one after the other
+  void WebSocket::executeRead(WebSocketServer* server, int client, unsigned char* buffer, size_t read, int status, void* environment) {
+    Connection* connection = (Connection*)environment;
+    RawData     data       = { buffer, read, (DataType)status };
+
+    connection->receive(&data);
+    // In thread mode, the connection is deleted once its thread is done (which waits for its jobs)
+    if (status < 0 && status != DATA_INCOMPLETE && connection->owner->mode != MODE_THREAD) {
+      connection->owner->release(connection);
+    }
+  }
+
+  // Queues are written out by the reactor of the connection, or else by the writer thread of the server
+  void WebSocket::drainConnection(WebSocketServer* server, int client, void* environment) {
+    WebSocket* websocket = (WebSocket*)environment;
+
+    if (serving) {
+      auto entry = serving->connections.find(client);
+      if (entry != serving->connections.end()) entry->second->drain();
+    } else {
+      std::lock_guard<std::mutex> guard(websocket->connectionsLock);
+      auto                        entry = websocket->connections.find(client);
+      if (entry != websocket->connections.end()) entry->second->drain();
+    }
+  }
+
+  void WebSocket::receiveChunk(WebSocketServer* server, int client, unsigned char* chunk, size_t size,
+                               unsigned long long offset, int status, int last, void* environment)
+  {
+    Connection* connection = Connection::reading;
+    ChunkData   data       = { chunk, size, offset, (DataType)status, last != 0 };
+
+    // In reactor mode, the thread of the shard is the only one to use its connection map
+    if (!connection) {
+      if (!serving) return;
+      auto entry = serving->connections.find(client);
+      if (entry == serving->connections.end()) return;
+      connection = entry->second;
+    }
+    connection->receive(&data);
   }
 }
\ No newline at end of file
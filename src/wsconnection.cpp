@@ -9,28 +9,94 @@
 #include <cstring>
 
 namespace ws {
-  // ReceptionEvent
+  // Awaitables
   ///////////////////////////////////////////////////////////////////////////////////////////////////////
-  void Connection::ReceptionEvent::trigger(Connection* connection, const RawData *data) {
-    for (auto callback : callbacks) callback(connection, data);
+  static unsigned char nothing = 0;
+
+  Connection::Reception::Reception(Connection* connection)
+    : connection(connection)
+  {
+  }
+
+  bool Connection::Reception::await_ready() {
+    return connection->ready(WAITING_RECEIVE);
+  }
+
+  RawData Connection::Reception::await_resume() {
+    std::lock_guard<std::mutex> guard(connection->awaitLock);
+    // Nothing for this one (another coroutine was already waiting) unless the connection is closed
+    RawData                     data = { &nothing, 0, connection->closed ? connection->closing : DATA_FAILURE };
+
+    if (connection->delivered) {
+      connection->delivered = false;
+      data = connection->received;
+    } else if (!connection->inbox.empty()) {
+      Inbound& inbound = connection->inbox.front();
+
+      // The buffer of the previous message is reused
+      connection->current.swap(inbound.bytes);
+      data.buffer = connection->current.empty() ? &nothing : connection->current.data();
+      data.size   = connection->current.size();
+      data.type   = inbound.type;
+      connection->inbox.pop_front();
+    }
+    return data;
+  }
+
+  Connection::Sending::Sending(Connection* connection, const void* data, const size_t size, const DataType type)
+    : connection(connection)
+    , data(data)
+    , size(size)
+    , type(type)
+  {
+  }
+
+  bool Connection::Sending::await_ready() {
+    return connection->ready(WAITING_SEND, size);
+  }
+
+  bool Connection::Sending::await_resume() {
+    {
+      std::lock_guard<std::mutex> guard(connection->awaitLock);
+      if (connection->closed) return false;
+    }
+    return wswrite(connection->server, connection->client, (unsigned char*)data, size, type) >= 0;
+  }
+
+  Connection::Pinging::Pinging(Connection* connection)
+    : connection(connection)
+  {
   }
 
-  void Connection::ReceptionEvent::operator +=(ReceptionCallback callback) {
-    callbacks.push_back(callback);
+  bool Connection::Pinging::await_ready() {
+    return connection->ready(WAITING_PING);
   }
 
-  void Connection::ReceptionEvent::operator -=(ReceptionCallback callback) {
-    callbacks.erase(std::remove(callbacks.begin(), callbacks.end(), callback), callbacks.end());
+  int Connection::Pinging::await_resume() {
+    std::lock_guard<std::mutex> guard(connection->awaitLock);
+    int                         ms = (int)connection->pinged;
+
+    connection->pinged = -1;
+    return ms;
   }
 
   // WebSocketConnection
   ///////////////////////////////////////////////////////////////////////////////////////////////////////
+  thread_local Connection* Connection::reading = nullptr;
+
   Connection::Connection(WebSocketServer* server, const int client, const void* envPtr)
     : server(server)
     , client(client)
     , envPtr(envPtr)
-    , alive(server->connections[client]->active)
+    , owner(nullptr)
+    , executor(nullptr)
     , connectionThread(nullptr)
+    , waiting()
+    , delivered(false)
+    , pinged(-1)
+    , awaited(false)
+    , closed(false)
+    , closing(DATA_FAILURE)
   {
   }
 
@@ -38,16 +104,29 @@ namespace ws {
     disconnect();
   }
 
-  void Connection::send(const void* data, const size_t size) {
-    wswrite(server, client, (unsigned char*)data, size, DATA_BINARY);
+  bool Connection::send(const void* data, const size_t size) {
+    return wswrite(server, client, (unsigned char*)data, size, DATA_BINARY) >= 0;
+  }
+
+  bool Connection::send(const char* text) {
+    return wswrite(server, client, (unsigned char*)text, std::strlen(text), DATA_TEXT) >= 0;
   }
 
-  void Connection::send(const char* text) {
-    wswrite(server, client, (unsigned char*)text, std::strlen(text), DATA_TEXT);
+  bool Connection::send(const std::string& text) {
+    return wswrite(server, client, (unsigned char*)text.c_str(), text.length(), DATA_TEXT) >= 0;
   }
 
-  void Connection::send(const std::string& text) {
-    wswrite(server, client, (unsigned char*)text.c_str(), text.length(), DATA_TEXT);
+  Message Connection::retain(const RawData* data) {
+    return Message(wsretain(server, client, data->buffer, data->size));
+  }
+
+  // False if the client is gone
+  bool Connection::subscribe(const std::string& topic) {
+    return wssubscribe(server, client, topic.c_str()) >= 0;
+  }
+
+  bool Connection::unsubscribe(const std::string& topic) {
+    return wsunsubscribe(server, client, topic.c_str()) > 0;
   }
 
   int Connection::ping(int timeout_ms) {
@@ -64,8 +143,32 @@ namespace ws {
     return p;
   }
 
+  void Connection::sendPing() {
+    wsping(server, client);
+  }
+
+  Connection::Reception Connection::receive() {
+    return Reception(this);
+  }
+
+  Connection::Sending Connection::sendAsync(const void* data, const size_t size) {
+    return Sending(this, data, size, DATA_BINARY);
+  }
+
+  Connection::Sending Connection::sendAsync(const char* text) {
+    return Sending(this, text, std::strlen(text), DATA_TEXT);
+  }
+
+  Connection::Sending Connection::sendAsync(const std::string& text) {
+    return Sending(this, text.c_str(), text.length(), DATA_TEXT);
+  }
+
+  Connection::Pinging Connection::pingAsync() {
+    return Pinging(this);
+  }
+
   bool Connection::isAlive() {
-    return alive;
+    return wsactive(server, client);
   }
 
   void Connection::listen() {
@@ -89,13 +192,128 @@ namespace ws {
     return client;
   }
 
+  size_t Connection::getQueuedBytes() {
+    return wsqueued(server, client);
+  }
+
+  // All zeros once the client is gone
+  ConnectionStats Connection::getStats() {
+    ConnectionStats stats;
+
+    if (wsclientstats(server, client, &stats) < 0) std::memset(&stats, 0, sizeof(ConnectionStats));
+    return stats;
+  }
+
+  unsigned long long Connection::getRoundTrip() {
+    return getStats().rtt;
+  }
+
   void Connection::waitForReceptions() {
-    RawData *data = new RawData;
+    RawData       data;
+    unsigned char empty = 0;
+
+    reading = this;
     do {
-      data->type = (DataType)wsread(server, client, data->buffer, FRAME_MAX_SIZE, &data->size);
-      onReceive.trigger(this, data);
-    } while (data->type >= 0 || data->type == DATA_INCOMPLETE);
-    delete data;
+      // The message is handed out where it was assembled, no copy (unless it goes to the executor)
+      data.type = (DataType)wsreadview(server, client, &data.buffer, &data.size);
+      if (!data.buffer) data.buffer = &empty;
+      if (!executor) {
+        receive(&data);
+      } else if (wsexecute(executor, client, data.buffer, data.size, data.type, this)) {
+        // The connection is not read until the executor has room
+        wsexecutorwait(executor);
+      }
+    } while (data.type >= 0 || data.type == DATA_INCOMPLETE);
+    reading = nullptr;
+    // The connection must outlive its jobs
+    if (executor) wsexecutorsync(executor, client);
+  }
+
+  void Connection::receive(const RawData* data) {
+    onReceive.trigger(this, data);
+    deliver(data);
+  }
+
+  void Connection::receive(const ChunkData* data) {
+    onChunk.trigger(this, data);
+  }
+
+  void Connection::drain() {
+    onDrain.trigger(this);
+    wake(WAITING_SEND);
+  }
+
+  // A message of size bytes would have to wait for the queue to drain
+  bool Connection::congested(const size_t size) {
+    return wsbackpressure(server, client, size) > 0;
+  }
+
+  bool Connection::ready(Waiting waiting, const size_t size) {
+    std::lock_guard<std::mutex> guard(awaitLock);
+
+    switch (waiting) {
+    case WAITING_RECEIVE:
+      awaited = true;
+      return closed || !inbox.empty();
+    case WAITING_SEND:
+      return closed || !congested(size);
+    default:
+      return closed;
+    }
+  }
+
+  // Returns false when the coroutine does not have to wait after all (it then goes on at once)
+  bool Connection::suspend(Waiting waiting, const Resumable& resumable, const size_t size) {
+    std::lock_guard<std::mutex> guard(awaitLock);
+
+    if (closed || this->waiting[waiting].frame) return false;
+    if (waiting == WAITING_RECEIVE && !inbox.empty())  return false;
+    // The queue may have drained in the meantime, its drain would then never come
+    if (waiting == WAITING_SEND && !congested(size))   return false;
+    this->waiting[waiting] = resumable;
+    // Sent once the coroutine is registered, the pong cannot come before
+    if (waiting == WAITING_PING) wsping(server, client);
+    return true;
+  }
+
+  void Connection::wake(Waiting waiting) {
+    Resumable resumable = { nullptr, nullptr };
+
+    {
+      std::lock_guard<std::mutex> guard(awaitLock);
+      std::swap(resumable, this->waiting[waiting]);
+    }
+    if (resumable.frame) resumable();
+  }
+
+  // Hands the message over to the coroutine that waits for it, or keeps it for the next receive
+  void Connection::deliver(const RawData* data) {
+    if (data->type == DATA_PING) {
+      {
+        std::lock_guard<std::mutex> guard(awaitLock);
+        if (!waiting[WAITING_PING].frame) return;
+        pinged = *(long*)(void*)data->buffer;
+      }
+      wake(WAITING_PING);
+    } else if (data->type >= 0 || data->type == DATA_INCOMPLETE) {
+      {
+        std::lock_guard<std::mutex> guard(awaitLock);
+        if (!waiting[WAITING_RECEIVE].frame) {
+          if (awaited) inbox.push_back({ data->type, std::vector<unsigned char>(data->buffer, data->buffer + data->size) });
+          return;
+        }
+        received  = *data;
+        delivered = true;
+      }
+      wake(WAITING_RECEIVE);
+    } else {
+      {
+        std::lock_guard<std::mutex> guard(awaitLock);
+        closed  = true;
+        closing = data->type;
+      }
+      for (int i = 0; i < WAITING_KINDS; i++) wake((Waiting)i);
+    }
   }
 
 
@@ -0,0 +1,319 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: permessage-deflate extension (compression of messages with zlib).
+ * Standard: https://datatracker.ietf.org/doc/html/rfc7692
+ */
+
+#include <wsdeflate.h>
+#include <wspool.h>
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+const unsigned char DEFLATE_TRAILER[4] = { 0x00, 0x00, 0xFF, 0xFF };
+
+typedef struct deflate_stream {
+  z_stream z;
+  int      bits;
+  int      level;
+} DeflateStream;
+
+// Streams that are not in use, by kind (deflate or inflate) and window size
+typedef struct deflate_pool {
+  pthread_mutex_t  lock;
+  DeflateStream   *streams[2][DEFLATE_MAX_BITS + 1][DEFLATE_POOL_SIZE];
+  int              count[2][DEFLATE_MAX_BITS + 1];
+} DeflatePool;
+
+#define DEFLATE_DEFLATER 0
+#define DEFLATE_INFLATER 1
+
+static DeflatePool           deflate_pool = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static WebSocketDeflateStats deflate_stats;
+
+void wsdeflatedefaults(WebSocketDeflateOptions *options) {
+  options->enabled    = 0;
+  options->level      = DEFLATE_LEVEL;
+  options->serverbits = DEFLATE_MAX_BITS;
+  options->clientbits = DEFLATE_MAX_BITS;
+  options->takeover   = 0;
+  options->threshold  = DEFLATE_THRESHOLD;
+}
+
+// Pool
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+DeflateStream *wsstreamacquire(const int kind, const int bits, const int level) {
+  DeflateStream *stream = NULL;
+
+  pthread_mutex_lock(&deflate_pool.lock);
+  if (deflate_pool.count[kind][bits]) {
+    stream = deflate_pool.streams[kind][bits][--deflate_pool.count[kind][bits]];
+    deflate_stats.cached--;
+  }
+  pthread_mutex_unlock(&deflate_pool.lock);
+
+  if (!stream) {
+    int status;
+
+    if (!(stream = malloc(sizeof(DeflateStream)))) return NULL;
+    memset(stream, 0, sizeof(DeflateStream));
+    stream->bits  = bits;
+    stream->level = level;
+    // Negative window bits: raw deflate, no zlib header or checksum
+    if (kind == DEFLATE_DEFLATER) status = deflateInit2(&stream->z, level, Z_DEFLATED, -bits, DEFLATE_MEMLEVEL, Z_DEFAULT_STRATEGY);
+    else                          status = inflateInit2(&stream->z, -bits);
+    if (status != Z_OK) {
+      free(stream);
+      return NULL;
+    }
+    __atomic_add_fetch(&deflate_stats.streams, 1, __ATOMIC_RELAXED);
+  } else if (kind == DEFLATE_DEFLATER && stream->level != level) {
+    deflateParams(&stream->z, level, Z_DEFAULT_STRATEGY);
+    stream->level = level;
+  }
+  return stream;
+}
+
+void wsstreamrelease(const int kind, DeflateStream *stream) {
+  if (!stream) return;
+  if (kind == DEFLATE_DEFLATER) deflateReset(&stream->z);
+  else                          inflateReset(&stream->z);
+
+  pthread_mutex_lock(&deflate_pool.lock);
+  if (deflate_pool.count[kind][stream->bits] < DEFLATE_POOL_SIZE) {
+    deflate_pool.streams[kind][stream->bits][deflate_pool.count[kind][stream->bits]++] = stream;
+    deflate_stats.cached++;
+    stream = NULL;
+  }
+  pthread_mutex_unlock(&deflate_pool.lock);
+
+  if (stream) {
+    if (kind == DEFLATE_DEFLATER) deflateEnd(&stream->z);
+    else                          inflateEnd(&stream->z);
+    free(stream);
+    __atomic_sub_fetch(&deflate_stats.streams, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// Takes one of the DEFLATE_MAX_CONTEXTS streams that may be kept between messages
+int wscontextreserve() {
+  size_t contexts = __atomic_load_n(&deflate_stats.contexts, __ATOMIC_RELAXED);
+
+  do {
+    if (contexts >= DEFLATE_MAX_CONTEXTS) return 0;
+  } while (!__atomic_compare_exchange_n(&deflate_stats.contexts, &contexts, contexts + 1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+  return 1;
+}
+
+void wsdeflaterelease(WebSocketDeflate *state) {
+  wsstreamrelease(DEFLATE_DEFLATER, state->deflater);
+  state->deflater = NULL;
+  if (state->servertakeover) {
+    state->servertakeover = 0;
+    __atomic_sub_fetch(&deflate_stats.contexts, 1, __ATOMIC_RELAXED);
+  }
+}
+
+void wsinflaterelease(WebSocketDeflate *state) {
+  wsstreamrelease(DEFLATE_INFLATER, state->inflater);
+  state->inflater = NULL;
+  if (state->clienttakeover) {
+    state->clienttakeover = 0;
+    __atomic_sub_fetch(&deflate_stats.contexts, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// Negotiation
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+char *wsdeflatetrim(char *text) {
+  char *end;
+
+  while (isspace((unsigned char)*text)) text++;
+  for (end = text + strlen(text); end > text && isspace((unsigned char)end[-1]); end--);
+  *end = 0;
+  return text;
+}
+
+// Window bits parameter, -1 when invalid
+int wsdeflatebits(char *value) {
+  int bits;
+
+  if (!value) return -1;
+  value = wsdeflatetrim(value);
+  if (*value == '"') {
+    size_t length = strlen(value);
+    if (length < 2 || value[length - 1] != '"') return -1;
+    value[length - 1] = 0;
+    value++;
+  }
+  if (!isdigit((unsigned char)value[0]) || (value[1] && (!isdigit((unsigned char)value[1]) || value[2]))) return -1;
+  bits = atoi(value);
+  return bits >= 8 && bits <= DEFLATE_MAX_BITS ? bits : -1;
+}
+
+int wsdeflatenegotiate(const WebSocketDeflateOptions *options, const char *offers, const size_t length,
+                       WebSocketDeflate *state, char *response)
+{
+  char  copy[1024];
+  char *offer, *offers_save;
+
+  memset(state, 0, sizeof(WebSocketDeflate));
+  if (!options->enabled || !offers || length >= sizeof(copy)) return 0;
+  memcpy(copy, offers, length);
+  copy[length] = 0;
+
+  for (offer = strtok_r(copy, ",", &offers_save); offer; offer = strtok_r(NULL, ",", &offers_save)) {
+    char *param, *params_save;
+    int   servernotakeover = 0, clientnotakeover = 0;
+    int   serverbits       = 0, clientbits       = -1;
+    int   valid            = 1;
+
+    param = strtok_r(offer, ";", &params_save);
+    if (!param || strcmp(wsdeflatetrim(param), DEFLATE_EXTENSION)) continue;
+    while (valid && (param = strtok_r(NULL, ";", &params_save))) {
+      char *value = strchr(param, '=');
+
+      if (value) *value++ = 0;
+      param = wsdeflatetrim(param);
+      // Every parameter may only appear once
+      if (!strcmp(param, "server_no_context_takeover") && !value && !servernotakeover) {
+        servernotakeover = 1;
+      } else if (!strcmp(param, "client_no_context_takeover") && !value && !clientnotakeover) {
+        clientnotakeover = 1;
+      } else if (!strcmp(param, "server_max_window_bits") && !serverbits) {
+        valid = (serverbits = wsdeflatebits(value)) > 0;
+      } else if (!strcmp(param, "client_max_window_bits") && clientbits < 0) {
+        valid = (clientbits = value ? wsdeflatebits(value) : 0) >= 0;
+      } else {
+        valid = 0;
+      }
+    }
+    // zlib cannot compress with a 256-byte window
+    if (!valid || serverbits == 8) continue;
+
+    state->enabled        = 1;
+    state->serverbits     = serverbits && serverbits < options->serverbits ? serverbits : options->serverbits;
+    state->clientbits     = DEFLATE_MAX_BITS;
+    if (clientbits >= 0) {
+      // The client accepts a limit on its window: ours, or its own if lower
+      state->clientbits = clientbits && clientbits < options->clientbits ? clientbits : options->clientbits;
+      if (state->clientbits < DEFLATE_MIN_BITS) state->clientbits = DEFLATE_MIN_BITS;
+    }
+    state->servertakeover = options->takeover && !servernotakeover && wscontextreserve();
+    state->clienttakeover = options->takeover && !clientnotakeover && wscontextreserve();
+
+    snprintf(response, DEFLATE_RESPONSE_SIZE, "%s%s%s", DEFLATE_EXTENSION,
+             state->servertakeover ? "" : "; server_no_context_takeover",
+             state->clienttakeover ? "" : "; client_no_context_takeover");
+    if (serverbits || state->serverbits < DEFLATE_MAX_BITS) {
+      sprintf(response + strlen(response), "; server_max_window_bits=%d", state->serverbits);
+    }
+    if (clientbits >= 0) {
+      sprintf(response + strlen(response), "; client_max_window_bits=%d", state->clientbits);
+    }
+    return 1;
+  }
+  return 0;
+}
+
+// Compression
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+size_t wsdeflate(WebSocketDeflate *state, const WebSocketDeflateOptions *options, const unsigned char *payload, const size_t size,
+                 unsigned char **output, size_t *block)
+{
+  int            takeover = state && state->servertakeover;
+  int            bits     = state ? state->serverbits : options->serverbits;
+  DeflateStream *stream;
+  size_t         length   = 0;
+
+  *output = NULL;
+  if (size < options->threshold) {
+    __atomic_add_fetch(&deflate_stats.skipped, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  stream = takeover && state->deflater ? state->deflater : wsstreamacquire(DEFLATE_DEFLATER, bits, options->level);
+  if (!stream) return 0;
+
+  // Room for the empty block of the flush as well
+  *block = deflateBound(&stream->z, size) + 16;
+  if ((*output = wspoolalloc(block))) {
+    stream->z.next_in   = (unsigned char*)payload;
+    stream->z.avail_in  = size;
+    stream->z.next_out  = *output;
+    stream->z.avail_out = *block;
+    if (deflate(&stream->z, Z_SYNC_FLUSH) == Z_OK && !stream->z.avail_in) {
+      length = *block - stream->z.avail_out;
+      // The 00 00 FF FF that ends the flush is left out (RFC 7692, 7.2.1)
+      length = length >= sizeof(DEFLATE_TRAILER) ? length - sizeof(DEFLATE_TRAILER) : 0;
+    }
+  }
+  if (takeover) {
+    state->deflater = stream;
+  } else {
+    wsstreamrelease(DEFLATE_DEFLATER, stream);
+    // Without context takeover, the message may just as well go uncompressed
+    if (length >= size) length = 0;
+  }
+  if (!length) {
+    wspoolfree(*output, *block);
+    *output = NULL;
+    __atomic_add_fetch(&deflate_stats.skipped, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  __atomic_add_fetch(&deflate_stats.deflated, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&deflate_stats.deflatein, size, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&deflate_stats.deflateout, length, __ATOMIC_RELAXED);
+  return length;
+}
+
+int wsinflate(WebSocketDeflate *state, const unsigned char **input, size_t *size,
+              unsigned char *output, const size_t capacity, size_t *produced)
+{
+  DeflateStream *stream = state->inflater;
+  int            status;
+
+  *produced = 0;
+  if (!stream && !(stream = state->inflater = wsstreamacquire(DEFLATE_INFLATER, state->clientbits, 0))) return -1;
+  stream->z.next_in   = (unsigned char*)*input;
+  stream->z.avail_in  = *size;
+  stream->z.next_out  = output;
+  stream->z.avail_out = capacity;
+  status = inflate(&stream->z, Z_SYNC_FLUSH);
+  // A final block ends the stream, what comes after starts a new one
+  if (status == Z_STREAM_END) status = inflateReset(&stream->z);
+  if (status != Z_OK && status != Z_BUF_ERROR) return -1;
+
+  __atomic_add_fetch(&deflate_stats.inflatein, *size - stream->z.avail_in, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&deflate_stats.inflateout, capacity - stream->z.avail_out, __ATOMIC_RELAXED);
+  *produced = capacity - stream->z.avail_out;
+  *input    = stream->z.next_in;
+  *size     = stream->z.avail_in;
+  return 0;
+}
+
+void wsinflateend(WebSocketDeflate *state) {
+  __atomic_add_fetch(&deflate_stats.inflated, 1, __ATOMIC_RELAXED);
+  if (!state->clienttakeover) {
+    wsstreamrelease(DEFLATE_INFLATER, state->inflater);
+    state->inflater = NULL;
+  }
+}
+
+void wsdeflatestats(WebSocketDeflateStats *stats) {
+  pthread_mutex_lock(&deflate_pool.lock);
+  stats->cached     = deflate_stats.cached;
+  pthread_mutex_unlock(&deflate_pool.lock);
+  stats->deflated   = __atomic_load_n(&deflate_stats.deflated,   __ATOMIC_RELAXED);
+  stats->deflatein  = __atomic_load_n(&deflate_stats.deflatein,  __ATOMIC_RELAXED);
+  stats->deflateout = __atomic_load_n(&deflate_stats.deflateout, __ATOMIC_RELAXED);
+  stats->skipped    = __atomic_load_n(&deflate_stats.skipped,    __ATOMIC_RELAXED);
+  stats->inflated   = __atomic_load_n(&deflate_stats.inflated,   __ATOMIC_RELAXED);
+  stats->inflatein  = __atomic_load_n(&deflate_stats.inflatein,  __ATOMIC_RELAXED);
+  stats->inflateout = __atomic_load_n(&deflate_stats.inflateout, __ATOMIC_RELAXED);
+  stats->streams    = __atomic_load_n(&deflate_stats.streams,    __ATOMIC_RELAXED);
+  stats->contexts   = __atomic_load_n(&deflate_stats.contexts,   __ATOMIC_RELAXED);
+}
@@ -0,0 +1,222 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Worker pool for the read callbacks, in order for each connection.
+ */
+
+#include <wsexecutor.h>
+#include <wspool.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+void wsexecutordefaults(WebSocketExecutorOptions *options) {
+  options->threads  = 0;
+  options->capacity = WS_EXECUTOR_CAPACITY;
+}
+
+// Strand of the client, made if it has none (executor locked)
+WebSocketStrand *wsstrand(WebSocketExecutor *executor, const int client, const int make) {
+  WebSocketStrand **bucket = &executor->strands[(unsigned int)client % WS_EXECUTOR_BUCKETS];
+  WebSocketStrand  *strand;
+
+  for (strand = *bucket; strand; strand = strand->bucket) {
+    if (strand->client == client) return strand;
+  }
+  if (!make) return NULL;
+  if ((strand = executor->spare)) executor->spare = strand->next;
+  else if (!(strand = malloc(sizeof(WebSocketStrand)))) return NULL;
+  memset(strand, 0, sizeof(WebSocketStrand));
+  strand->client = client;
+  strand->bucket = *bucket;
+  *bucket        = strand;
+  return strand;
+}
+
+// A strand is only kept while it has jobs (executor locked)
+void wsstranddrop(WebSocketExecutor *executor, WebSocketStrand *strand) {
+  WebSocketStrand **bucket = &executor->strands[(unsigned int)strand->client % WS_EXECUTOR_BUCKETS];
+
+  while (*bucket != strand) bucket = &(*bucket)->bucket;
+  *bucket          = strand->bucket;
+  strand->next     = executor->spare;
+  executor->spare  = strand;
+  pthread_cond_broadcast(&executor->idle);
+}
+
+void wsstrandschedule(WebSocketExecutor *executor, WebSocketStrand *strand) {
+  strand->scheduled = 1;
+  strand->next      = NULL;
+  if (executor->last) executor->last->next = strand;
+  else                executor->ready      = strand;
+  executor->last = strand;
+  pthread_cond_signal(&executor->work);
+}
+
+void *wsexecutorrun(void *args) {
+  WebSocketExecutor *executor = args;
+
+  pthread_mutex_lock(&executor->lock);
+  for (;;) {
+    WebSocketStrand *strand;
+    WebSocketJob    *job;
+    WebSocketHold   *held = NULL;
+
+    while (!executor->ready && !executor->stop) pthread_cond_wait(&executor->work, &executor->lock);
+    if (!(strand = executor->ready)) break;
+    if (!(executor->ready = strand->next)) executor->last = NULL;
+    // The strand stays scheduled (out of the ready list) while its job runs, no other worker takes it
+    job = strand->head;
+    pthread_mutex_unlock(&executor->lock);
+
+    executor->onread(executor->server, job->client, job->data, job->size, job->status, job->env);
+
+    pthread_mutex_lock(&executor->lock);
+    if (!(strand->head = job->next)) strand->tail = NULL;
+    executor->queued--;
+    if (strand->head) wsstrandschedule(executor, strand);
+    else              wsstranddrop(executor, strand);
+    if (executor->queued <= executor->capacity / 2) {
+      held           = executor->held;
+      executor->held = NULL;
+      pthread_cond_broadcast(&executor->room);
+    }
+    pthread_mutex_unlock(&executor->lock);
+    wspoolfree(job, job->block);
+    while (held) {
+      WebSocketHold *next = held->next;
+
+      held->resume(held->client, held->env);
+      free(held);
+      held = next;
+    }
+    pthread_mutex_lock(&executor->lock);
+  }
+  pthread_mutex_unlock(&executor->lock);
+  return NULL;
+}
+
+WebSocketExecutor *wsexecutoralloc(WebSocketServer *server, const WebSocketExecutorOptions *options, ReadCallback onread) {
+  WebSocketExecutor *executor;
+
+  if (options->threads < 1 || !(executor = malloc(sizeof(WebSocketExecutor)))) return NULL;
+  memset(executor, 0, sizeof(WebSocketExecutor));
+  executor->server   = server;
+  executor->onread   = onread;
+  executor->capacity = options->capacity ? options->capacity : WS_EXECUTOR_CAPACITY;
+  pthread_mutex_init(&executor->lock, NULL);
+  pthread_cond_init(&executor->work, NULL);
+  pthread_cond_init(&executor->room, NULL);
+  pthread_cond_init(&executor->idle, NULL);
+  if (!(executor->threads = malloc(options->threads * sizeof(pthread_t)))) {
+    wsexecutorfree(executor);
+    return NULL;
+  }
+  for (; executor->count < options->threads; executor->count++) {
+    if (pthread_create(&executor->threads[executor->count], NULL, wsexecutorrun, executor)) break;
+  }
+  if (!executor->count) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot start the executor");
+    wsexecutorfree(executor);
+    return NULL;
+  }
+  return executor;
+}
+
+void wsexecutorfree(WebSocketExecutor *executor) {
+  if (executor) {
+    pthread_mutex_lock(&executor->lock);
+    executor->stop = 1;
+    pthread_cond_broadcast(&executor->work);
+    pthread_cond_broadcast(&executor->room);
+    pthread_mutex_unlock(&executor->lock);
+    for (int i = 0; i < executor->count; i++) pthread_join(executor->threads[i], NULL);
+    while (executor->held) {
+      WebSocketHold *next = executor->held->next;
+
+      free(executor->held);
+      executor->held = next;
+    }
+    while (executor->spare) {
+      WebSocketStrand *next = executor->spare->next;
+
+      free(executor->spare);
+      executor->spare = next;
+    }
+    pthread_cond_destroy(&executor->idle);
+    pthread_cond_destroy(&executor->room);
+    pthread_cond_destroy(&executor->work);
+    pthread_mutex_destroy(&executor->lock);
+    free(executor->threads);
+    free(executor);
+  }
+}
+
+int wsexecute(WebSocketExecutor *executor, const int client, const unsigned char *buffer, const size_t size,
+              const int status, void *environment)
+{
+  size_t           block = sizeof(WebSocketJob) + size;
+  WebSocketJob    *job   = wspoolalloc(&block);
+  WebSocketStrand *strand;
+  int              full;
+
+  if (!job) {
+    wslog(executor->server->log, WS_LOG_ERROR, "Cannot queue a message for client %d", client);
+    return 0;
+  }
+  job->next   = NULL;
+  job->client = client;
+  job->status = status;
+  job->env    = environment;
+  job->size   = size;
+  job->block  = block;
+  if (size) memcpy(job->data, buffer, size);
+
+  pthread_mutex_lock(&executor->lock);
+  if (!(strand = wsstrand(executor, client, 1))) {
+    pthread_mutex_unlock(&executor->lock);
+    wspoolfree(job, block);
+    wslog(executor->server->log, WS_LOG_ERROR, "Cannot queue a message for client %d", client);
+    return 0;
+  }
+  if (strand->tail) strand->tail->next = job;
+  else              strand->head       = job;
+  strand->tail = job;
+  executor->queued++;
+  if (!strand->scheduled) wsstrandschedule(executor, strand);
+  full = executor->queued >= executor->capacity;
+  pthread_mutex_unlock(&executor->lock);
+  return full;
+}
+
+int wsexecutorhold(WebSocketExecutor *executor, const int client, WakeCallback resume, void *environment) {
+  WebSocketHold *hold = malloc(sizeof(WebSocketHold));
+  int            full;
+
+  pthread_mutex_lock(&executor->lock);
+  // Checked under the lock: room made in the meantime would otherwise never be reported
+  full = executor->queued >= executor->capacity && !executor->stop && hold;
+  if (full) {
+    hold->client   = client;
+    hold->resume   = resume;
+    hold->env      = environment;
+    hold->next     = executor->held;
+    executor->held = hold;
+  }
+  pthread_mutex_unlock(&executor->lock);
+  if (!full) free(hold);
+  return full;
+}
+
+void wsexecutorwait(WebSocketExecutor *executor) {
+  pthread_mutex_lock(&executor->lock);
+  if (executor->queued >= executor->capacity) {
+    while (executor->queued > executor->capacity / 2 && !executor->stop) pthread_cond_wait(&executor->room, &executor->lock);
+  }
+  pthread_mutex_unlock(&executor->lock);
+}
+
+void wsexecutorsync(WebSocketExecutor *executor, const int client) {
+  pthread_mutex_lock(&executor->lock);
+  while (wsstrand(executor, client, 0)) pthread_cond_wait(&executor->idle, &executor->lock);
+  pthread_mutex_unlock(&executor->lock);
+}
@@ -0,0 +1,199 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Asynchronous logger: a bounded lock-free queue of lines, written out by a thread of its own.
+ */
+
+#include <wslog.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+/*
+NOTE:
+The queue is a ring of slots that each carry a sequence number: a slot is free for the line of position
+p when its sequence is p, and holds that line when it is p + 1. Loggers claim a position by moving the
+tail forward, the writer gives the slot back (sequence p + WS_LOG_SIZE) once the line is out.
+*/
+void wslogwrite(WebSocketLog *log, const int level, const char *text) {
+  FILE *sink = level >= WS_LOG_WARN ? log->errors : log->messages;
+  int   slot;
+
+  if (sink) {
+    fputs(text, sink);
+    fputc('\n', sink);
+  }
+  pthread_mutex_lock(&log->lock);
+  slot = log->written++ % WS_LOG_RECENT;
+  strcpy(log->recent[slot], text);
+  log->levels[slot] = level;
+  pthread_mutex_unlock(&log->lock);
+}
+
+// Writes out every line that is ready, returns how many
+int wslogdrain(WebSocketLog *log) {
+  int count = 0;
+
+  for (;; count++) {
+    unsigned long long  head  = log->head;
+    WebSocketLogEntry  *entry = &log->entries[head % WS_LOG_SIZE];
+
+    if (__atomic_load_n(&entry->sequence, __ATOMIC_SEQ_CST) != head + 1) break;
+    wslogwrite(log, entry->level, entry->text);
+    __atomic_store_n(&entry->sequence, head + WS_LOG_SIZE, __ATOMIC_RELEASE);
+    __atomic_store_n(&log->head, head + 1, __ATOMIC_RELEASE);
+  }
+  if (__atomic_load_n(&log->dropped, __ATOMIC_RELAXED) != log->reported) {
+    char               text[WS_LOG_LINE];
+    unsigned long long dropped = __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+
+    snprintf(text, sizeof(text), "%llu log lines were dropped", dropped - log->reported);
+    wslogwrite(log, WS_LOG_WARN, text);
+    log->reported = dropped;
+    count++;
+  }
+  if (count) {
+    if (log->messages) fflush(log->messages);
+    if (log->errors)   fflush(log->errors);
+  }
+  return count;
+}
+
+void *wslogrun(void *args) {
+  WebSocketLog *log = args;
+
+  for (;;) {
+    struct pollfd input = { log->wake, POLLIN, 0 };
+    int           stop  = __atomic_load_n(&log->stop, __ATOMIC_ACQUIRE);
+
+    if (wslogdrain(log)) continue;
+    if (stop) break;
+    // Loggers check sleeping after they publish their line, so one of the two sees the other
+    __atomic_store_n(&log->sleeping, 1, __ATOMIC_SEQ_CST);
+    if (!wslogdrain(log) && poll(&input, 1, WS_LOG_IDLE) > 0) {
+      eventfd_t value;
+      eventfd_read(log->wake, &value);
+    }
+    __atomic_store_n(&log->sleeping, 0, __ATOMIC_SEQ_CST);
+  }
+  return NULL;
+}
+
+WebSocketLog *wslogopen(FILE *messages, FILE *errors) {
+  WebSocketLog *log = aligned_alloc(64, sizeof(WebSocketLog));
+
+  if (!log) return NULL;
+  memset(log, 0, sizeof(WebSocketLog));
+  log->level    = WS_LOG_INFO;
+  log->messages = messages;
+  log->errors   = errors;
+  log->wake     = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  log->entries  = malloc(WS_LOG_SIZE * sizeof(WebSocketLogEntry));
+  pthread_mutex_init(&log->lock, NULL);
+  if (log->entries) {
+    for (unsigned long long i = 0; i < WS_LOG_SIZE; i++) log->entries[i].sequence = i;
+  }
+  if (log->wake < 0 || !log->entries || pthread_create(&log->thread, NULL, wslogrun, log)) {
+    if (log->wake >= 0) close(log->wake);
+    pthread_mutex_destroy(&log->lock);
+    free(log->entries);
+    free(log);
+    return NULL;
+  }
+  return log;
+}
+
+// Everything that was logged before is written out
+void wslogclose(WebSocketLog *log) {
+  if (log) {
+    __atomic_store_n(&log->stop, 1, __ATOMIC_RELEASE);
+    eventfd_write(log->wake, 1);
+    pthread_join(log->thread, NULL);
+    close(log->wake);
+    pthread_mutex_destroy(&log->lock);
+    free(log->entries);
+    free(log);
+  }
+}
+
+void wslog(WebSocketLog *log, const int level, const char *format, ...) {
+  unsigned long long  tail;
+  WebSocketLogEntry  *entry;
+  va_list             args;
+
+  if (!log || level < log->level) return;
+  tail = __atomic_load_n(&log->tail, __ATOMIC_RELAXED);
+  for (;;) {
+    long long difference;
+
+    entry      = &log->entries[tail % WS_LOG_SIZE];
+    difference = (long long)(__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE) - tail);
+    if (!difference) {
+      if (__atomic_compare_exchange_n(&log->tail, &tail, tail + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+    } else if (difference < 0) {
+      // The writer is a whole queue behind
+      __atomic_add_fetch(&log->dropped, 1, __ATOMIC_RELAXED);
+      return;
+    } else {
+      tail = __atomic_load_n(&log->tail, __ATOMIC_RELAXED);
+    }
+  }
+  va_start(args, format);
+  vsnprintf(entry->text, WS_LOG_LINE, format, args);
+  va_end(args);
+  entry->level = level;
+  __atomic_store_n(&entry->sequence, tail + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&log->sleeping, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&log->sleeping, 0, __ATOMIC_SEQ_CST)) {
+    eventfd_write(log->wake, 1);
+  }
+}
+
+void wslogsync(WebSocketLog *log) {
+  unsigned long long tail;
+
+  if (!log) return;
+  tail = __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE);
+  while (__atomic_load_n(&log->head, __ATOMIC_ACQUIRE) < tail) {
+    eventfd_write(log->wake, 1);
+    usleep(100);
+  }
+}
+
+int wslogrecent(WebSocketLog *log, const int min, const int max, char *buffer, const size_t size, const int count) {
+  unsigned long long start;
+  int                found  = 0;
+  int                copied = 0;
+  size_t             length = 0;
+
+  if (!log || !size) return 0;
+  buffer[0] = 0;
+  pthread_mutex_lock(&log->lock);
+  // Back from the newest line to find the first one to copy
+  start = log->written;
+  for (unsigned long long i = log->written; i > 0 && log->written - i < WS_LOG_RECENT && found < count; i--) {
+    int level = log->levels[(i - 1) % WS_LOG_RECENT];
+
+    if (level >= min && level <= max) {
+      start = i - 1;
+      found++;
+    }
+  }
+  for (unsigned long long i = start; i < log->written && copied < found; i++) {
+    const char *line  = log->recent[i % WS_LOG_RECENT];
+    int         level = log->levels[i % WS_LOG_RECENT];
+    size_t      n     = strlen(line);
+
+    if (level < min || level > max) continue;
+    if (length + n + 2 > size) break;
+    memcpy(&buffer[length], line, n);
+    length          += n;
+    buffer[length++] = '\n';
+    buffer[length]   = 0;
+    copied++;
+  }
+  pthread_mutex_unlock(&log->lock);
+  return copied;
+}
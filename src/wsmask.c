@@ -0,0 +1,151 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Frame payload masking (XOR with the 4-byte frame mask) kernels.
+ */
+
+#include <wsmask.h>
+#include <wsserver.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MASK_X86
+#endif
+
+typedef void (*MaskKernel)(unsigned char *dst, const unsigned char *src, size_t size, uint32_t mask);
+
+// The kernels only see whole 4-byte periods of the mask, rotated to the right phase, the bytes after the
+// last whole period are done by wsmask
+void wsmaskbyte(unsigned char *dst, const unsigned char *src, size_t size, uint32_t mask) {
+  unsigned char bytes[WS_MASK_SIZE];
+
+  memcpy(bytes, &mask, WS_MASK_SIZE);
+  for (size_t i = 0; i < size; i++) dst[i] = src[i] ^ bytes[i % WS_MASK_SIZE];
+}
+
+void wsmaskword(unsigned char *dst, const unsigned char *src, size_t size, uint32_t mask) {
+  uint64_t wmask = ((uint64_t)mask << 32) | mask;
+  size_t   i     = 0;
+
+  // memcpy compiles to plain (unaligned) loads and stores
+  for (; i + 4 * sizeof(uint64_t) <= size; i += 4 * sizeof(uint64_t)) {
+    uint64_t w[4];
+    memcpy(w, &src[i], sizeof(w));
+    w[0] ^= wmask;
+    w[1] ^= wmask;
+    w[2] ^= wmask;
+    w[3] ^= wmask;
+    memcpy(&dst[i], w, sizeof(w));
+  }
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, &src[i], sizeof(uint64_t));
+    w ^= wmask;
+    memcpy(&dst[i], &w, sizeof(uint64_t));
+  }
+  wsmaskbyte(&dst[i], &src[i], size - i, mask);
+}
+
+#ifdef MASK_X86
+__attribute__((target("sse2")))
+void wsmasksse2(unsigned char *dst, const unsigned char *src, size_t size, uint32_t mask) {
+  __m128i vmask = _mm_set1_epi32((int)mask);
+  size_t  i     = 0;
+
+  for (; i + 4 * sizeof(__m128i) <= size; i += 4 * sizeof(__m128i)) {
+    __m128i a = _mm_loadu_si128((const __m128i*)&src[i]);
+    __m128i b = _mm_loadu_si128((const __m128i*)&src[i + 16]);
+    __m128i c = _mm_loadu_si128((const __m128i*)&src[i + 32]);
+    __m128i d = _mm_loadu_si128((const __m128i*)&src[i + 48]);
+    _mm_storeu_si128((__m128i*)&dst[i],      _mm_xor_si128(a, vmask));
+    _mm_storeu_si128((__m128i*)&dst[i + 16], _mm_xor_si128(b, vmask));
+    _mm_storeu_si128((__m128i*)&dst[i + 32], _mm_xor_si128(c, vmask));
+    _mm_storeu_si128((__m128i*)&dst[i + 48], _mm_xor_si128(d, vmask));
+  }
+  for (; i + sizeof(__m128i) <= size; i += sizeof(__m128i)) {
+    _mm_storeu_si128((__m128i*)&dst[i], _mm_xor_si128(_mm_loadu_si128((const __m128i*)&src[i]), vmask));
+  }
+  wsmaskword(&dst[i], &src[i], size - i, mask);
+}
+
+__attribute__((target("avx2")))
+void wsmaskavx2(unsigned char *dst, const unsigned char *src, size_t size, uint32_t mask) {
+  __m256i vmask = _mm256_set1_epi32((int)mask);
+  size_t  i     = 0;
+
+  for (; i + 4 * sizeof(__m256i) <= size; i += 4 * sizeof(__m256i)) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)&src[i]);
+    __m256i b = _mm256_loadu_si256((const __m256i*)&src[i + 32]);
+    __m256i c = _mm256_loadu_si256((const __m256i*)&src[i + 64]);
+    __m256i d = _mm256_loadu_si256((const __m256i*)&src[i + 96]);
+    _mm256_storeu_si256((__m256i*)&dst[i],      _mm256_xor_si256(a, vmask));
+    _mm256_storeu_si256((__m256i*)&dst[i + 32], _mm256_xor_si256(b, vmask));
+    _mm256_storeu_si256((__m256i*)&dst[i + 64], _mm256_xor_si256(c, vmask));
+    _mm256_storeu_si256((__m256i*)&dst[i + 96], _mm256_xor_si256(d, vmask));
+  }
+  for (; i + sizeof(__m256i) <= size; i += sizeof(__m256i)) {
+    _mm256_storeu_si256((__m256i*)&dst[i], _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)&src[i]), vmask));
+  }
+  // Leaving AVX state dirty would stall the SSE2 code that follows
+  _mm256_zeroupper();
+  wsmasksse2(&dst[i], &src[i], size - i, mask);
+}
+#endif
+
+static const char *MASK_KERNEL_NAMES[] = { "byte", "word", "sse2", "avx2" };
+
+static MaskKernel  mask_kernel = NULL;
+static int         mask_kernel_id;
+
+int wsmaskselect(const int kernel) {
+  MaskKernel selected = NULL;
+  int        id       = kernel;
+
+  if (kernel == MASK_KERNEL_AUTO) {
+    for (id = MASK_KERNEL_AVX2; id > MASK_KERNEL_WORD && !wsmaskselect(id); id--);
+    return id == MASK_KERNEL_WORD ? wsmaskselect(id) : 1;
+  }
+  switch (kernel) {
+    case MASK_KERNEL_BYTE: selected = wsmaskbyte; break;
+    case MASK_KERNEL_WORD: selected = wsmaskword; break;
+#ifdef MASK_X86
+    case MASK_KERNEL_SSE2: if (__builtin_cpu_supports("sse2")) selected = wsmasksse2; break;
+    case MASK_KERNEL_AVX2: if (__builtin_cpu_supports("avx2")) selected = wsmaskavx2; break;
+#endif
+  }
+  if (!selected) return 0;
+  __atomic_store_n(&mask_kernel_id, id, __ATOMIC_RELAXED);
+  __atomic_store_n(&mask_kernel, selected, __ATOMIC_RELEASE);
+  return 1;
+}
+
+int wsmaskkernel() {
+  if (!__atomic_load_n(&mask_kernel, __ATOMIC_ACQUIRE)) wsmaskselect(MASK_KERNEL_AUTO);
+  return __atomic_load_n(&mask_kernel_id, __ATOMIC_RELAXED);
+}
+
+const char *wsmaskname(const int kernel) {
+  return kernel >= MASK_KERNEL_BYTE && kernel <= MASK_KERNEL_AVX2 ? MASK_KERNEL_NAMES[kernel] : "none";
+}
+
+size_t wsmask(unsigned char *dst, const unsigned char *src, const size_t size, const unsigned char *mask, const size_t phase) {
+  MaskKernel kernel = __atomic_load_n(&mask_kernel, __ATOMIC_ACQUIRE);
+  uint32_t   rotated;
+  size_t     whole  = size & ~(size_t)(WS_MASK_SIZE - 1);
+
+  if (!kernel) {
+    wsmaskselect(MASK_KERNEL_AUTO);
+    kernel = __atomic_load_n(&mask_kernel, __ATOMIC_ACQUIRE);
+  }
+  // Rotate the mask so that the kernels always start at phase 0
+  {
+    unsigned char bytes[WS_MASK_SIZE];
+    for (int i = 0; i < WS_MASK_SIZE; i++) bytes[i] = mask[(phase + i) % WS_MASK_SIZE];
+    memcpy(&rotated, bytes, WS_MASK_SIZE);
+  }
+  kernel(dst, src, whole, rotated);
+  for (size_t i = whole; i < size; i++) dst[i] = src[i] ^ mask[(phase + i) % WS_MASK_SIZE];
+  return (phase + size) % WS_MASK_SIZE;
+}
@@ -0,0 +1,156 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Size-class buffer pool used for receive, message and send buffers.
+ */
+
+#include <wspool.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct pool_block {
+  struct pool_block *next;
+} PoolBlock;
+
+typedef struct pool_class {
+  pthread_mutex_t    lock;
+  PoolBlock         *free;
+  size_t             used;
+  size_t             cached;
+  unsigned long long hits;
+  unsigned long long misses;
+} PoolClass;
+
+static PoolClass          pool_classes[WS_POOL_CLASSES];
+static pthread_once_t     pool_once       = PTHREAD_ONCE_INIT;
+static WebSocketAllocator pool_allocator  = { NULL, NULL, NULL };
+static size_t             pool_large      = 0;
+static size_t             pool_largebytes = 0;
+
+void wspoolinit() {
+  for (int i = 0; i < WS_POOL_CLASSES; i++) pthread_mutex_init(&pool_classes[i].lock, NULL);
+}
+
+void *wspoolsysalloc(const size_t size) {
+  return pool_allocator.alloc ? pool_allocator.alloc(size, pool_allocator.env) : malloc(size);
+}
+
+void wspoolsysfree(void *block, const size_t size) {
+  if (pool_allocator.free) pool_allocator.free(block, size, pool_allocator.env);
+  else                     free(block);
+}
+
+// Index of the smallest class that fits, WS_POOL_CLASSES when none does
+int wspoolclass(const size_t size) {
+  int bits = WS_POOL_MIN_BITS;
+
+  if (size > ((size_t)1 << WS_POOL_MAX_BITS)) return WS_POOL_CLASSES;
+  if (size > ((size_t)1 << WS_POOL_MIN_BITS)) bits = (int)(sizeof(unsigned long long) * 8) - __builtin_clzll(size - 1);
+  return bits - WS_POOL_MIN_BITS;
+}
+
+void wspoolallocator(const WebSocketAllocator *allocator) {
+  if (allocator) pool_allocator = *allocator;
+  else           memset(&pool_allocator, 0, sizeof(WebSocketAllocator));
+}
+
+void *wspoolalloc(size_t *size) {
+  int        index = wspoolclass(*size);
+  PoolClass *class;
+  PoolBlock *block;
+
+  if (index == WS_POOL_CLASSES) {
+    void *large = wspoolsysalloc(*size);
+    if (large) {
+      __atomic_add_fetch(&pool_large, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&pool_largebytes, *size, __ATOMIC_RELAXED);
+    }
+    return large;
+  }
+  pthread_once(&pool_once, wspoolinit);
+  class = &pool_classes[index];
+  *size = (size_t)1 << (index + WS_POOL_MIN_BITS);
+
+  pthread_mutex_lock(&class->lock);
+  if ((block = class->free)) {
+    class->free = block->next;
+    class->cached--;
+    class->hits++;
+  } else {
+    class->misses++;
+  }
+  class->used++;
+  pthread_mutex_unlock(&class->lock);
+
+  if (!block && !(block = wspoolsysalloc(*size))) {
+    pthread_mutex_lock(&class->lock);
+    class->used--;
+    pthread_mutex_unlock(&class->lock);
+  }
+  return block;
+}
+
+void wspoolfree(void *block, const size_t size) {
+  int        index = wspoolclass(size);
+  PoolClass *class;
+
+  if (!block) return;
+  if (index == WS_POOL_CLASSES) {
+    __atomic_sub_fetch(&pool_large, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&pool_largebytes, size, __ATOMIC_RELAXED);
+    wspoolsysfree(block, size);
+    return;
+  }
+  class = &pool_classes[index];
+  pthread_mutex_lock(&class->lock);
+  class->used--;
+  if ((class->cached + 1) * size <= WS_POOL_CACHE) {
+    ((PoolBlock*)block)->next = class->free;
+    class->free               = block;
+    class->cached++;
+    block                     = NULL;
+  }
+  pthread_mutex_unlock(&class->lock);
+  if (block) wspoolsysfree(block, size);
+}
+
+void wspooltrim() {
+  pthread_once(&pool_once, wspoolinit);
+  for (int i = 0; i < WS_POOL_CLASSES; i++) {
+    PoolClass *class = &pool_classes[i];
+    PoolBlock *block;
+
+    pthread_mutex_lock(&class->lock);
+    block         = class->free;
+    class->free   = NULL;
+    class->cached = 0;
+    pthread_mutex_unlock(&class->lock);
+    while (block) {
+      PoolBlock *next = block->next;
+      wspoolsysfree(block, (size_t)1 << (i + WS_POOL_MIN_BITS));
+      block = next;
+    }
+  }
+}
+
+void wspoolstats(WebSocketPoolStats *stats) {
+  memset(stats, 0, sizeof(WebSocketPoolStats));
+  pthread_once(&pool_once, wspoolinit);
+  for (int i = 0; i < WS_POOL_CLASSES; i++) {
+    PoolClass          *class = &pool_classes[i];
+    WebSocketPoolClass *out   = &stats->classes[i];
+
+    pthread_mutex_lock(&class->lock);
+    out->size   = (size_t)1 << (i + WS_POOL_MIN_BITS);
+    out->used   = class->used;
+    out->cached = class->cached;
+    out->hits   = class->hits;
+    out->misses = class->misses;
+    pthread_mutex_unlock(&class->lock);
+    stats->usedbytes   += out->used   * out->size;
+    stats->cachedbytes += out->cached * out->size;
+  }
+  stats->large      = __atomic_load_n(&pool_large, __ATOMIC_RELAXED);
+  stats->largebytes = __atomic_load_n(&pool_largebytes, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,309 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Event-driven (epoll) connection handling for the WebSocket server.
+ */
+
+// pthread_setaffinity_np
+#define _GNU_SOURCE
+
+#include <wsreactor.h>
+#include <wsuring.h>
+#include <wsexecutor.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+void wsreactorread(WebSocketReactor *reactor, int client) {
+  WebSocketServer *server = reactor->server;
+  unsigned char   *data;
+  unsigned char    empty  = 0;
+  size_t           readbytes;
+  int              status;
+
+  // Event left over from a connection closed earlier in the same batch (or held, see wsreactorhold)
+  if (!wsconnection(server, client) || wsconnection(server, client)->paused) return;
+  do {
+    // The message is handed out where it was assembled, no copy
+    status = wstryreadview(server, client, &data, &readbytes);
+    if (status == READ_AGAIN) return;
+    reactor->onread(server, client, data ? data : &empty, readbytes, status, reactor->env);
+    if ((status >= 0 || status == READ_BUFFER_OVERFLOW) && wsreactorhold(reactor, client)) return;
+  } while (status >= 0 || status == READ_BUFFER_OVERFLOW); // (Buffer overflow is not a fatal error)
+
+  // Closing the descriptor also removes it from the epoll set
+  wsclose(server, client);
+}
+
+// Serves a connection that went through its handshake (accepted, or made elsewhere and joined), the
+// socket of an accepted one is in the epoll set already
+void wsreactorattach(WebSocketReactor *reactor, const int client, const int accepted) {
+  WebSocketServer    *server = reactor->server;
+  struct epoll_event  event;
+
+  // Closed since it was joined
+  if (!wsconnection(server, client)) return;
+  wsconnection(server, client)->shard = reactor->shard;
+
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events   = EPOLLIN;
+  event.data.u64 = client;
+  if (epoll_ctl(reactor->fd, accepted ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, wsconnection(server, client)->fd, &event) < 0) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot watch client %d", client);
+    wsclose(server, client);
+    return;
+  }
+  // The reactor also writes out the queue of the client when its socket fills up
+  wswatch(server, client, reactor->fd);
+  reactor->onconnect(server, client, reactor->env);
+  // Frames sent along with the request were read by the handshake, the socket will not signal them
+  if (wsconnection(server, client) && wsconnection(server, client)->rx.end) wsreactorread(reactor, client);
+}
+
+// Reads what came of the request of a client that was accepted, and serves it once it is upgraded
+void wsreactorshake(WebSocketReactor *reactor, const int client) {
+  if (wsshake(reactor->server, client) == client) wsreactorattach(reactor, client, 1);
+}
+
+void wsreactoraccept(WebSocketReactor *reactor) {
+  WebSocketServer    *server = reactor->server;
+  int                 fd     = wsacceptsocket(server, reactor->listener);
+  int                 client;
+  struct epoll_event  event;
+
+  if (fd < 0 || (client = wsgreet(server, fd, wsreactorexpire, reactor)) < 0) return;
+  wsshaking(server, client)->shard = reactor->shard;
+  // Until it is upgraded, the socket is only read for the request
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events   = EPOLLIN;
+  event.data.u64 = REACTOR_SHAKE | client;
+  if (epoll_ctl(reactor->fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot watch client %d", client);
+    // The socket is then given up on as if it had hung up
+    shutdown(fd, SHUT_RDWR);
+  }
+  // The request often comes along with the connection
+  wsreactorshake(reactor, client);
+}
+
+WebSocketReactor *wsreactoralloc(WebSocketServer *server) {
+  WebSocketReactor *reactor = malloc(sizeof(WebSocketReactor));
+
+  if (reactor) {
+    memset(reactor, 0, sizeof(WebSocketReactor));
+    reactor->server   = server;
+    reactor->listener = server->fd;
+    reactor->cpu      = -1;
+    reactor->wake     = -1;
+    if ((reactor->fd = epoll_create1(EPOLL_CLOEXEC)) < 0 || (reactor->wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+      wslog(server->log, WS_LOG_ERROR, "Cannot create reactor");
+      if (reactor->fd >= 0) close(reactor->fd);
+      free(reactor);
+      return NULL;
+    }
+    pthread_mutex_init(&reactor->lock, NULL);
+  }
+  return reactor;
+}
+
+void wsreactorfree(WebSocketReactor *reactor) {
+  if (reactor) {
+    wsuringfree(reactor->ring);
+    close(reactor->fd);
+    close(reactor->wake);
+    pthread_mutex_destroy(&reactor->lock);
+    free(reactor->woken.clients);
+    free(reactor->joined.clients);
+    free(reactor->expired.clients);
+    free(reactor);
+  }
+}
+
+int wsreactorshards(WebSocketServer *server, WebSocketReactor **reactors, const int count, const int pin) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int  made = 0;
+
+  for (; made < count && made < REACTOR_MAX_SHARDS; made++) {
+    int cpu = pin && cpus > 0 ? made % cpus : -1;
+
+    if (!(reactors[made] = wsreactoralloc(server))) break;
+    reactors[made]->shard = made;
+    reactors[made]->cpu   = cpu;
+    // Without a listening socket (see wsstart), no shard has one. One that cannot be opened again (see
+    // wslistener) is shared, the kernel wakes one of the idle shards for it
+    if (made && server->fd >= 0 && (reactors[made]->listener = wslistener(server, cpu)) < 0) reactors[made]->listener = server->fd;
+  }
+  // The server socket was opened before the CPU was known
+  if (made && pin) setsockopt(server->fd, SOL_SOCKET, SO_INCOMING_CPU, &reactors[0]->cpu, sizeof(int));
+  return made;
+}
+
+int wsreactorhold(WebSocketReactor *reactor, const int client) {
+  if (!reactor->executor || !wsexecutorhold(reactor->executor, client, wsreactorwake, reactor)) return 0;
+  wspause(reactor->server, client, 1);
+  return 1;
+}
+
+// Hands the client over to the thread of the reactor, returns 0 if it could not
+int wsreactorhand(WebSocketReactor *reactor, WebSocketHandoff *handoff, const int client) {
+  pthread_mutex_lock(&reactor->lock);
+  if (handoff->count == handoff->capacity) {
+    int  size    = handoff->capacity ? handoff->capacity << 1 : 64;
+    int *clients = realloc(handoff->clients, size * sizeof(int));
+
+    if (!clients) {
+      pthread_mutex_unlock(&reactor->lock);
+      return 0;
+    }
+    handoff->clients  = clients;
+    handoff->capacity = size;
+  }
+  handoff->clients[handoff->count++] = client;
+  pthread_mutex_unlock(&reactor->lock);
+  eventfd_write(reactor->wake, 1);
+  return 1;
+}
+
+int wsreactortake(WebSocketReactor *reactor, WebSocketHandoff *handoff, int *clients, const int max) {
+  int count;
+
+  pthread_mutex_lock(&reactor->lock);
+  count = handoff->count < max ? handoff->count : max;
+  memcpy(clients, &handoff->clients[handoff->count - count], count * sizeof(int));
+  handoff->count -= count;
+  pthread_mutex_unlock(&reactor->lock);
+  return count;
+}
+
+void wsreactorwake(int client, void *environment) {
+  WebSocketReactor *reactor = environment;
+
+  if (!wsreactorhand(reactor, &reactor->woken, client)) wslog(reactor->server->log, WS_LOG_ERROR, "Cannot resume client %d", client);
+}
+
+int wsreactorwoken(WebSocketReactor *reactor, int *clients, const int max) {
+  return wsreactortake(reactor, &reactor->woken, clients, max);
+}
+
+int wsreactorjoin(WebSocketReactor *reactor, const int client) {
+  if (wsreactorhand(reactor, &reactor->joined, client)) return 1;
+  wslog(reactor->server->log, WS_LOG_ERROR, "Cannot serve client %d", client);
+  wsclose(reactor->server, client);
+  return 0;
+}
+
+int wsreactorjoined(WebSocketReactor *reactor, int *clients, const int max) {
+  return wsreactortake(reactor, &reactor->joined, clients, max);
+}
+
+int wsreactorexpire(int client, void *environment) {
+  return wsreactorhand(environment, &((WebSocketReactor*)environment)->expired, client);
+}
+
+int wsreactorexpired(WebSocketReactor *reactor, int *clients, const int max) {
+  return wsreactortake(reactor, &reactor->expired, clients, max);
+}
+
+// Reads the clients that were held until the executor had room, serves those that were joined and gives
+// up on the handshakes that timed out
+void wsreactorresume(WebSocketReactor *reactor) {
+  int       clients[REACTOR_MAX_EVENTS];
+  int       count;
+  eventfd_t value;
+
+  eventfd_read(reactor->wake, &value);
+  while ((count = wsreactorwoken(reactor, clients, REACTOR_MAX_EVENTS))) {
+    for (int i = 0; i < count; i++) {
+      wspause(reactor->server, clients[i], 0);
+      wsreactorread(reactor, clients[i]);
+    }
+  }
+  while ((count = wsreactorjoined(reactor, clients, REACTOR_MAX_EVENTS))) {
+    for (int i = 0; i < count; i++) wsreactorattach(reactor, clients[i], 0);
+  }
+  // Closing the socket takes it out of epoll
+  while ((count = wsreactorexpired(reactor, clients, REACTOR_MAX_EVENTS))) {
+    for (int i = 0; i < count; i++) wsunshake(reactor->server, clients[i]);
+  }
+}
+
+int wsreactoruring(WebSocketReactor *reactor) {
+  if (!reactor->ring) reactor->ring = wsuringalloc();
+  return reactor->ring != NULL;
+}
+
+void *wsreact(void *vargp) {
+  WebSocketReactor   *reactor = (WebSocketReactor*)vargp;
+  WebSocketServer    *server  = reactor->server;
+  struct epoll_event  events[REACTOR_MAX_EVENTS];
+  struct epoll_event  listener;
+  unsigned char       empty   = 0;
+
+  // A callback that writes to a slow client must not hold the others up
+  wsnowait();
+  // A connection can be gone by the time it is accepted (or taken by another shard): accept must not wait
+  if (reactor->listener >= 0) fcntl(reactor->listener, F_SETFL, fcntl(reactor->listener, F_GETFL) | O_NONBLOCK);
+  if (reactor->cpu >= 0) {
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(reactor->cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpus);
+  }
+  memset(&listener, 0, sizeof(struct epoll_event));
+  listener.events   = EPOLLIN;
+  listener.data.u64 = REACTOR_WAKE;
+  if (epoll_ctl(reactor->fd, EPOLL_CTL_ADD, reactor->wake, &listener) < 0) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot watch wake-up");
+    return NULL;
+  }
+  if (reactor->ring) return wsuringreact(reactor);
+  // A shared listening socket wakes one reactor rather than all of them
+  listener.events   = EPOLLIN | EPOLLEXCLUSIVE;
+  listener.data.u64 = REACTOR_LISTENER;
+  if (reactor->listener >= 0 && epoll_ctl(reactor->fd, EPOLL_CTL_ADD, reactor->listener, &listener) < 0) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot watch server socket");
+    return NULL;
+  }
+
+  while (!__atomic_load_n(&server->close, __ATOMIC_ACQUIRE)) {
+    int n = epoll_wait(reactor->fd, events, REACTOR_MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      wslog(server->log, WS_LOG_ERROR, "Reactor failure");
+      break;
+    }
+    for (int i = 0; i < n && !__atomic_load_n(&server->close, __ATOMIC_ACQUIRE); i++) {
+      if (events[i].data.u64 == REACTOR_LISTENER) {
+        wsreactoraccept(reactor);
+      } else if (events[i].data.u64 == REACTOR_WAKE) {
+        wsreactorresume(reactor);
+      } else if (events[i].data.u64 & REACTOR_SHAKE) {
+        wsreactorshake(reactor, (int)events[i].data.u64);
+      } else {
+        if (events[i].events & EPOLLOUT) wsflush(server, (int)events[i].data.u64);
+        // A held client that hangs up is read to the end (the hang-up would be reported over and over)
+        if (events[i].events & (EPOLLHUP | EPOLLERR)) wspause(server, (int)events[i].data.u64, 0);
+        if (events[i].events & ~EPOLLOUT) wsreactorread(reactor, (int)events[i].data.u64);
+      }
+    }
+  }
+
+  // Let the application know about the connections that are still open (the other shards see to theirs)
+  for (int i = wsnext(server, -1); i >= 0; i = wsnext(server, i)) {
+    WebSocketConnection *connection = wsconnection(server, i);
+
+    if (!connection || connection->shard != reactor->shard) continue;
+    reactor->onread(server, i, &empty, 0, READ_CONNECTION_CLOSED_SERVER, reactor->env);
+    wsclose(server, i);
+  }
+  wslog(server->log, WS_LOG_INFO, "Closing server");
+  return NULL;
+}
@@ -4,28 +4,57 @@
  * Standard: https://datatracker.ietf.org/doc/html/rfc6455
  */
 
+// mremap, memfd_create, pthread_rwlockattr_setkind_np
+#define _GNU_SOURCE
+
 #include <wsserver.h>
+#include <wsmask.h>
+#include <wspool.h>
+#include <wsdeflate.h>
+#include <wsstats.h>
+#include <wslog.h>
 #include <http.h>
 
 #include <openssl/sha.h>
 #include <openssl/evp.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
+#include <sys/un.h>
+#include <netinet/tcp.h>
 
-const char           *SOCKET_MAGIC_STR = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
-const struct timeval  TIMEOUT          = { WS_TIMEOUT / 1000, (WS_TIMEOUT % 1000) * 1000};
+const char *SOCKET_MAGIC_STR = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
-// A conceptual frame (no specific byte format)
-typedef struct frame {
-  FrameHeader   header;
-  unsigned char mask[WS_MASK_SIZE];
-  unsigned int  length;
-  unsigned char payload[FRAME_MAX_SIZE];
-} Frame;
+// Receiver of the last view handed out on this thread (see wsretain)
+static __thread WebSocketReceiver *viewing = NULL;
+
+// Set on the threads that serve many clients, their writes never wait on one (see wsnowait)
+static __thread int nowait = 0;
+
+// Handshake of a connection that a reactor goes on with as its request comes in (see wsgreet)
+typedef struct websocket_shake {
+  HttpParser         parser;
+  unsigned long long start;
+  size_t             block;
+  size_t             size;
+  int                fed;
+  int                tls;
+  ExpireCallback     expire;
+  void              *environment;
+  char               request[WS_REQUEST_SIZE];
+} WebSocketShake;
 
 int masktoint(unsigned char *mask) {
   int imask = 0;
@@ -41,414 +70,2799 @@ void inttomask(int imask, unsigned char *mask) {
   }
 }
 
-// https://stackoverflow.com/questions/342409/how-do-i-base64-encode-decode-in-c
-unsigned char *encode64(const unsigned char *input, int length) {
-  const int pl = 4 * ((length + 2) / 3);
-  unsigned char *output = malloc((pl + 1) * sizeof(unsigned char));
-  EVP_EncodeBlock(output, input, length);
-  return output;
-}
-// https://stackoverflow.com/questions/342409/how-do-i-base64-encode-decode-in-c
-unsigned char *decode64(const unsigned char *input, int length) {
-  const int pl = 3 * length / 4;
-  unsigned char *output = malloc((pl + 1) * sizeof(unsigned char));
-  EVP_DecodeBlock(output, input, length);
-  return output;
-}
-
-int handshake(WebSocketConnection *connection) {
-  const int bufsize = 4096;
-  char buffer[bufsize];
-
-  HttpRequest  request;
-  HttpResponse response;
-  memset(&request,  0, sizeof(HttpRequest));
-  memset(&response, 0, sizeof(HttpResponse));
-  memset(buffer, 0, bufsize * sizeof(char));
-  read(connection->fd, buffer, bufsize);
-  httpreqfromstr(&request, buffer);
-  buffer[0] = 0;
-  getfield(request.header, "Connection", buffer);
-  if (!strstr(buffer, "Upgrade")) {
-    free(request.body);
-    return 1;
-  }
-  buffer[0] = 0;
-  getfield(request.header, "Upgrade", buffer);
-  if (!strstr(buffer, "websocket")) {
-    free(request.body);
-    return 1;
+// Draws the masking key of a frame sent by a client (the random bytes are fetched for each thread)
+int wsmaskkey() {
+  static __thread unsigned char entropy[WS_ENTROPY_SIZE];
+  static __thread size_t        drawn = WS_ENTROPY_SIZE;
+  int                           key;
+
+  if (drawn == WS_ENTROPY_SIZE) {
+    // Up to 256 bytes, getrandom is not cut short once the generator is ready
+    while (getrandom(entropy, WS_ENTROPY_SIZE, 0) < 0 && errno == EINTR);
+    drawn = 0;
   }
-  connection->key[0] = 0;
-  getfield(request.header, "Sec-WebSocket-Key", connection->key);
-  getfield(request.header, "Sec-WebSocket-Version", buffer);
-  if (!connection->key[0]) {
-    getfield(request.header, "Sec-Websocket-Key", connection->key);
-    getfield(request.header, "Sec-Websocket-Version", buffer);
+  key    = masktoint(&entropy[drawn]);
+  drawn += WS_MASK_SIZE;
+  return key;
+}
+
+// Drops the spill file of the last message, the next one starts back in the pool
+void wsunspill(WebSocketReceiver *rx) {
+  if (rx->spill >= 0) {
+    munmap(rx->message, rx->capacity + 1);
+    close(rx->spill);
+    rx->spill    = -1;
+    rx->message  = NULL;
+    rx->capacity = 0;
   }
-  connection->version = atoi(buffer);
+}
 
-  // Response
-  unsigned char *resp = malloc((strlen(connection->key) + strlen(SOCKET_MAGIC_STR) + 1) * sizeof(char));
-  unsigned char  digest[SHA_DIGEST_LENGTH];
-  unsigned char *ans;
-  int   i;
-
-  for (i = 0; connection->key[i]; i++) resp[i] = connection->key[i];
-  for (int p = 0; SOCKET_MAGIC_STR[p]; i++, p++) resp[i] = SOCKET_MAGIC_STR[p];
-  resp[i] = 0;
-  SHA1(resp, i, digest);
-  ans = encode64(digest, SHA_DIGEST_LENGTH);
-  sprintf(response.version, "%s", request.version);
-  response.status = HTTP_SWITCH;
-  sprintf(response.message, HTTP_SWITCH_M);
-  buildhttpresp(&response, "Upgrade", "websocket");
-  buildhttpresp(&response, "Connection", "Upgrade");
-  buildhttpresp(&response, "Sec-WebSocket-Accept", (char*)ans);
-  response.body = "";
-  httprespstr(&response, buffer);
-  write(connection->fd, buffer, strlen(buffer));
-
-  free(resp);
-  free(ans);
-  free(request.body);
-  return 0;
+// Gives the message buffer back (the capacity leaves out the byte kept for the terminator)
+void wsrelinquish(WebSocketReceiver *rx) {
+  if (rx->spill >= 0) {
+    wsunspill(rx);
+  } else if (rx->message) {
+    wspoolfree(rx->message, rx->capacity + 1);
+    rx->message  = NULL;
+    rx->capacity = 0;
+  }
 }
 
-void wsmulticast(WebSocketServer *server, const void *buffer, const size_t size, const int type) {
-  for (int i = 0; i < WS_MAX_CONN; i++) {
-    if (server->connections[i]) wswrite(server, i, buffer, size, type);
+// Gives every buffer of the connection back to the pool
+void wsdrop(WebSocketReceiver *rx) {
+  if (rx->buffer) {
+    wspoolfree(rx->buffer, rx->bufsize + 1);
+    rx->buffer  = NULL;
+    rx->bufsize = 0;
   }
+  rx->terminator = NULL;
+  rx->view       = NULL;
+  wsrelinquish(rx);
 }
 
-void wsping(WebSocketServer *server, int client) {
-  wswrite(server, client, NULL, 0, FRAME_PING);
+// Registry
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+WebSocketConnection *wsslot(WebSocketServer *server, const unsigned int slot) {
+  WebSocketConnection *chunk;
+
+  if (slot >= WS_MAX_CONN) return NULL;
+  chunk = __atomic_load_n(&server->registry.chunks[slot >> WS_REGISTRY_CHUNK_BITS], __ATOMIC_ACQUIRE);
+  return chunk ? &chunk[slot & (WS_REGISTRY_CHUNK - 1)] : NULL;
 }
 
-void wswrite(WebSocketServer *server, const int client, const unsigned char *buffer, const size_t size, const int type) {
-  unsigned char        mask[WS_MASK_SIZE];
-  WebSocketConnection *connection = server->connections[client];
-  int                  masked     = WS_MASK != 0;
-
-  memset(&mask, 0, WS_MASK_SIZE * sizeof(unsigned char));
-  if (masked) inttomask(WS_MASK, mask);
-
-  // If size is 0, it's a ping
-  if (!size) {
-    ControlFrame  cframe;
-    int  i = 0;
-
-    memset(&cframe.header, 0, sizeof(FrameHeader));
-    cframe.header.end    = 1;
-    cframe.header.mask   = masked;
-    cframe.header.length = size;
-    cframe.header.opcode = FRAME_PING;
-    cframe.header.bytes  = htons(cframe.header.bytes);
-    if (masked) {
-      for (i = 0; i < WS_MASK_SIZE; i++) {
-        cframe.spayload[i] = mask[i];
+// Takes the oldest free slot, the registry grows by one chunk when there is none. The connection stays
+// invisible to lookups until its ID is published.
+WebSocketConnection *wsreserve(WebSocketServer *server) {
+  WebSocketRegistry   *registry   = &server->registry;
+  WebSocketConnection *connection = NULL;
+
+  pthread_mutex_lock(&registry->lock);
+  if (registry->head == WS_SLOT_NONE && registry->size < WS_MAX_CONN) {
+    WebSocketConnection *chunk = malloc(WS_REGISTRY_CHUNK * sizeof(WebSocketConnection));
+    unsigned int         first = registry->size;
+
+    if (chunk) {
+      memset(chunk, 0, WS_REGISTRY_CHUNK * sizeof(WebSocketConnection));
+      for (int i = 0; i < WS_REGISTRY_CHUNK; i++) {
+        chunk[i].id    = -1;
+        chunk[i].fd    = -1;
+        chunk[i].stale = -1;
+        chunk[i].slot  = first + i;
+        chunk[i].next = i + 1 < WS_REGISTRY_CHUNK ? first + i + 1 : WS_SLOT_NONE;
+        chunk[i].rx.spill = -1;
+        chunk[i].tx.poll  = -1;
+        pthread_mutex_init(&chunk[i].lock, NULL);
+        pthread_mutex_init(&chunk[i].tls.lock, NULL);
       }
+      __atomic_store_n(&registry->chunks[first >> WS_REGISTRY_CHUNK_BITS], chunk, __ATOMIC_RELEASE);
+      __atomic_store_n(&registry->size, first + WS_REGISTRY_CHUNK, __ATOMIC_RELEASE);
+      registry->head = first;
+      registry->tail = first + WS_REGISTRY_CHUNK - 1;
     }
-    write(connection->fd, &cframe, size + sizeof(FrameHeader) + (masked ? WS_MASK_SIZE : 0));
-    connection->ping = clock();
-  } 
-  // If it fits in a Control Frame
-  else if (size <= FRAME_CONTROL_SIZE) {
-    ControlFrame  cframe;
-
-    memset(&cframe.header, 0, sizeof(FrameHeader));
-    cframe.header.end    = 1;
-    cframe.header.mask   = masked;
-    cframe.header.length = size;
-    cframe.header.opcode = type;
-    cframe.header.bytes  = htons(cframe.header.bytes);
-    if (masked) {
-      for (int i = 0; i < WS_MASK_SIZE; i++) cframe.spayload[i] = mask[i];
-      for (int i = 0; i < size;         i++) cframe.payload[i]  = buffer[i] ^ mask[i % WS_MASK_SIZE];
-      write(connection->fd, &cframe, size + sizeof(FrameHeader) + WS_MASK_SIZE* sizeof(unsigned char));
-    } else {
-      for (int i = 0; i < size; i++) cframe.spayload[i] = buffer[i];
-      write(connection->fd, &cframe, size + sizeof(FrameHeader));
-    }
-  }
-  // If it fits in a Long Frame
-  else if (size <= FRAME_MAX_SIZE) {
-    LongFrame lframe;
-
-    memset(&lframe.header, 0, sizeof(FrameHeader));
-    lframe.header.end    = 1;
-    lframe.header.mask   = masked;
-    lframe.header.length = 126;
-    lframe.header.opcode = type;
-    lframe.header.bytes  = htons(lframe.header.bytes);
-    lframe.length        = htons((unsigned short)size);
-    if (masked) {
-      for (int i = 0; i < WS_MASK_SIZE; i++) lframe.spayload[i] = mask[i];
-      for (int i = 0; i < size;         i++) lframe.payload[i]  = buffer[i] ^ mask[i % WS_MASK_SIZE];
-      write(connection->fd, &lframe, size + sizeof(FrameHeader) +
-                                            sizeof(unsigned short) +
-                                            WS_MASK_SIZE * sizeof(unsigned char));
+  }
+  if (registry->head != WS_SLOT_NONE) {
+    connection     = wsslot(server, registry->head);
+    registry->head = connection->next;
+    if (registry->head == WS_SLOT_NONE) registry->tail = WS_SLOT_NONE;
+  }
+  pthread_mutex_unlock(&registry->lock);
+
+  if (connection) {
+    connection->fd      = -1;
+    connection->ping    = 0;
+    connection->seen    = 0;
+    connection->shaking = 0;
+    connection->version = 0;
+    __atomic_store_n(&connection->active, 0, __ATOMIC_RELEASE);
+    memset(connection->key, 0, WS_KEY_SIZE * sizeof(char));
+    connection->rx.start  = 0;
+    connection->rx.end    = 0;
+    connection->rx.state  = RECV_HEADER;
+    connection->rx.opcode = 0;
+    connection->rx.hint   = 0;
+    connection->tx.poll    = -1;
+    connection->tx.watched = 0;
+    memset(&connection->stats, 0, sizeof(WebSocketConnectionStats));
+    connection->stats.since = wsclock();
+    // What the reader of the last connection did not give back (see wsreceived)
+    pthread_mutex_lock(&connection->lock);
+    __atomic_store_n(&connection->stale, -1, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&connection->receiving, 0, __ATOMIC_SEQ_CST);
+    wsdrop(&connection->rx);
+    wsinflaterelease(&connection->deflate);
+    pthread_mutex_unlock(&connection->lock);
+    wsdeflaterelease(&connection->deflate);
+    connection->deflate.enabled = 0;
+  }
+  return connection;
+}
+
+// Puts a slot back at the end of the free list, its generation is bumped so that the old ID goes stale
+void wsrelease(WebSocketServer *server, WebSocketConnection *connection) {
+  WebSocketRegistry *registry = &server->registry;
+
+  connection->generation = (connection->generation + 1) & WS_GENERATION_MASK;
+  connection->next       = WS_SLOT_NONE;
+  pthread_mutex_lock(&registry->lock);
+  if (registry->tail == WS_SLOT_NONE) registry->head = connection->slot;
+  else                                wsslot(server, registry->tail)->next = connection->slot;
+  registry->tail = connection->slot;
+  pthread_mutex_unlock(&registry->lock);
+}
+
+WebSocketConnection *wsconnection(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection;
+
+  if (client < 0) return NULL;
+  connection = wsslot(server, client & WS_SLOT_MASK);
+  if (connection && __atomic_load_n(&connection->id, __ATOMIC_ACQUIRE) == client) return connection;
+  return NULL;
+}
+
+// The connection that does its handshake under that ID (see wsgreet), NULL if there is none
+WebSocketConnection *wsshaking(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection;
+
+  if (client < 0) return NULL;
+  connection = wsslot(server, client & WS_SLOT_MASK);
+  // The generation only changes once the slot is released, after the handshake was let go of
+  if (connection && __atomic_load_n(&connection->shake, __ATOMIC_ACQUIRE) &&
+      (int)((connection->generation << WS_SLOT_BITS) | connection->slot) == client)
+  {
+    return connection;
+  }
+  return NULL;
+}
+
+int wsactive(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  return connection && __atomic_load_n(&connection->active, __ATOMIC_ACQUIRE);
+}
+
+int wsnext(WebSocketServer *server, const int client) {
+  unsigned int size = __atomic_load_n(&server->registry.size, __ATOMIC_ACQUIRE);
+
+  for (unsigned int slot = client < 0 ? 0 : (client & WS_SLOT_MASK) + 1; slot < size; slot++) {
+    int id = __atomic_load_n(&wsslot(server, slot)->id, __ATOMIC_ACQUIRE);
+    if (id >= 0) return id;
+  }
+  return -1;
+}
+
+int wscount(WebSocketServer *server) {
+  return (int)__atomic_load_n(&server->registry.count, __ATOMIC_RELAXED);
+}
+
+// Timers
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+int wstiming(WebSocketServer *server) {
+  return server->handshaketimeout || server->keepalive || server->pongtimeout || server->idletimeout;
+}
+
+// Notes when the client last sent something (only when a deadline depends on it)
+void wsseen(WebSocketServer *server, WebSocketConnection *connection) {
+  if (server->keepalive || server->idletimeout) __atomic_store_n(&connection->seen, wsclock(), __ATOMIC_RELAXED);
+}
+
+// Next deadline of an open connection (us), 0 if it has none
+unsigned long long wsdeadline(WebSocketServer *server, WebSocketConnection *connection, const unsigned long long now) {
+  unsigned long long seen = __atomic_load_n(&connection->seen, __ATOMIC_RELAXED);
+  unsigned long long ping = __atomic_load_n(&connection->ping, __ATOMIC_RELAXED);
+  unsigned long long next = ~0ULL;
+
+  if (server->idletimeout) next = seen + server->idletimeout * 1000ULL;
+  if (server->pongtimeout && ping && ping + server->pongtimeout * 1000ULL < next) next = ping + server->pongtimeout * 1000ULL;
+  // While a ping is out, the keepalive looks again later
+  if (server->keepalive && (ping ? now : seen) + server->keepalive * 1000ULL < next) next = (ping ? now : seen) + server->keepalive * 1000ULL;
+  return next == ~0ULL ? 0 : next;
+}
+
+// Shuts the client down, its reader then reports it closed
+void wsexpel(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection = wsconnection(server, client);
+
+  if (connection) {
+    pthread_mutex_lock(&connection->lock);
+    if (connection->id == client) {
+      __atomic_store_n(&connection->active, 0, __ATOMIC_RELEASE);
+      shutdown(connection->fd, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&connection->lock);
+  }
+}
+
+// Sets the timer of the connection for deadline (us), if it is still the client and that is sooner than
+// the one it has. 0 unsets it. Nothing is timed until the thread is started (see wstimers).
+void wsarm(WebSocketServer *server, WebSocketConnection *connection, const int client, const unsigned long long deadline) {
+  WebSocketTimers    *timers = &server->timers;
+  unsigned long long  ticks  = (deadline + WS_TIMER_TICK * 1000ULL - 1) / (WS_TIMER_TICK * 1000ULL);
+
+  if (!__atomic_load_n(&timers->started, __ATOMIC_ACQUIRE)) return;
+  pthread_mutex_lock(&timers->lock);
+  if (connection->id == client) {
+    if (!deadline) {
+      wstimerunset(&timers->wheel, &connection->timer);
+    } else if (!wstimerpending(&connection->timer) || ticks < connection->timer.expires) {
+      if (!timers->wheel.count) pthread_cond_signal(&timers->wake);
+      wstimerset(&timers->wheel, &connection->timer, ticks);
+    }
+  }
+  pthread_mutex_unlock(&timers->lock);
+}
+
+// Pings the client, or shuts it down, once it is past a deadline (timer thread)
+void wsexpire(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  unsigned long long   now        = wsclock();
+  unsigned long long   seen, ping;
+  const char          *reason     = NULL;
+
+  if (!connection) return;
+  seen = __atomic_load_n(&connection->seen, __ATOMIC_RELAXED);
+  ping = __atomic_load_n(&connection->ping, __ATOMIC_RELAXED);
+  if (server->pongtimeout && ping && now >= ping + server->pongtimeout * 1000ULL) reason = "did not answer a ping";
+  else if (server->idletimeout && now >= seen + server->idletimeout * 1000ULL)    reason = "was idle for too long";
+  if (reason) {
+    WS_COUNT(server->counters, timeouts, 1);
+    wslog(server->log, WS_LOG_INFO, "Client %d %s, shutting it down", client, reason);
+    wsexpel(server, client);
+    return;
+  }
+  if (server->keepalive && !ping && now >= seen + server->keepalive * 1000ULL) wsping(server, client);
+  wsarm(server, connection, client, wsdeadline(server, connection, now));
+}
+
+void *wstimersrun(void *args) {
+  WebSocketServer *server = args;
+  WebSocketTimers *timers = &server->timers;
+  int              clients[WS_TIMER_BATCH];
+
+  pthread_mutex_lock(&timers->lock);
+  while (!timers->stop) {
+    WebSocketTimer *timer;
+    WebSocketTimer *next;
+    int             count = 0;
+
+    if (!timers->wheel.count) {
+      pthread_cond_wait(&timers->wake, &timers->lock);
     } else {
-      for (int i = 0; i < size; i++) lframe.spayload[i] = buffer[i];
-      write(connection->fd, &lframe, size + sizeof(FrameHeader) + sizeof(unsigned short));
+      struct timespec deadline;
+
+      clock_gettime(CLOCK_MONOTONIC, &deadline);
+      deadline.tv_nsec += WS_TIMER_TICK * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&timers->wake, &timers->lock, &deadline);
     }
-  } else {
-    int frames  = size / FRAME_MAX_SIZE;
-    for (int j = 0; j < frames; j++) {
-      LongFrame lframe;
-      int last  = j == (frames - 1);
-      int fsize = last ? size % FRAME_MAX_SIZE : FRAME_MAX_SIZE;
-
-      memset(&lframe.header, 0, sizeof(FrameHeader));
-      lframe.header.end    = last;
-      lframe.header.mask   = masked;
-      lframe.header.length = 126;
-      lframe.header.opcode = type;
-      lframe.header.bytes  = htons(lframe.header.bytes);
-      lframe.length        = htons((unsigned short)size);
-      if (masked && !j) {
-        for (int i = 0; i < WS_MASK_SIZE;   i++) lframe.spayload[i] = mask[i];
-        for (int i = 0; i < FRAME_MAX_SIZE; i++) lframe.payload[i]  = buffer[i] ^ mask[i % WS_MASK_SIZE];
-        write(connection->fd, &lframe, FRAME_MAX_SIZE * sizeof(unsigned char) + 
-                                       sizeof(FrameHeader) + 
-                                       sizeof(unsigned short) + 
-                                       WS_MASK_SIZE * sizeof(unsigned char));
-      } else {
-        int done = j * FRAME_MAX_SIZE;
-        for (int i = 0; i < FRAME_MAX_SIZE && done + i < size; i++) {
-          lframe.spayload[i] = buffer[done + i] ^ mask[(done + i) % WS_MASK_SIZE];
+    for (timer = wswheeladvance(&timers->wheel, wsticks()); timer; timer = next) {
+      WebSocketConnection *connection = (WebSocketConnection*)((char*)timer - offsetof(WebSocketConnection, timer));
+      int                  client     = __atomic_load_n(&connection->id, __ATOMIC_ACQUIRE);
+
+      next = timer->next;
+      if (__atomic_load_n(&connection->shaking, __ATOMIC_ACQUIRE)) {
+        WebSocketShake *shake = __atomic_load_n(&connection->shake, __ATOMIC_ACQUIRE);
+
+        // The handshake unsets the timer before it lets go of the socket (and of its state): both are
+        // still there. The reactor going on with it closes it, a blocking one fails on the shut down socket.
+        WS_COUNT(server->counters, timeouts, 1);
+        if (!shake || !shake->expire ||
+            !shake->expire((connection->generation << WS_SLOT_BITS) | connection->slot, shake->environment))
+        {
+          shutdown(connection->fd, SHUT_RDWR);
         }
-        write(connection->fd, &lframe, (last ? fsize : FRAME_MAX_SIZE) * sizeof(unsigned char) + 
-                                      sizeof(FrameHeader) + 
-                                      sizeof(unsigned short));
+      } else if (client >= 0 && count < WS_TIMER_BATCH) {
+        clients[count++] = client;
+      } else if (client >= 0) {
+        wstimerset(&timers->wheel, timer, timers->wheel.now + 1);
       }
     }
+    // The clients are looked at without the lock, their deadlines set it again
+    pthread_mutex_unlock(&timers->lock);
+    for (int i = 0; i < count; i++) wsexpire(server, clients[i]);
+    pthread_mutex_lock(&timers->lock);
   }
+  pthread_mutex_unlock(&timers->lock);
+  return NULL;
 }
 
-int wsread(WebSocketServer *server, const int client, unsigned char *buffer, const size_t maxbytes, size_t *readbytes) {
-  Frame                frame;
-  ControlFrame         cframe;
-  WebSocketConnection *connection = server->connections[client];
-  int                  expect     = 0;
-  int                  readstatus = READ_FAILURE;
-  struct timeval       timeout    = TIMEOUT;
-
-  *readbytes = 0;
+// Starts the timer thread the first time a deadline is set, returns 1 once it runs
+int wstimers(WebSocketServer *server) {
+  WebSocketTimers *timers = &server->timers;
 
-  while (connection->active) {
-    fd_set input;
-    FD_ZERO(&input);
-    FD_SET(connection->fd, &input);
-    int n = select(connection->fd + 1, &input, NULL, NULL, &timeout);
-    if (n < 0) {
-      connection->active = 0;
-      fprintf(server->messages, "Connection was closed by server\n");
-      return READ_CONNECTION_CLOSED_SERVER;
+  if (!__atomic_load_n(&timers->started, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&timers->lock);
+    if (!timers->started && !timers->stop) {
+      wswheelinit(&timers->wheel, wsticks());
+      if (!pthread_create(&timers->thread, NULL, wstimersrun, server)) __atomic_store_n(&timers->started, 1, __ATOMIC_RELEASE);
+      else                                                              wslog(server->log, WS_LOG_ERROR, "Cannot start timers");
     }
-    else if (n == 0) continue; // select timed out
+    pthread_mutex_unlock(&timers->lock);
+  }
+  return timers->started;
+}
 
-    // Frame header
-    {
-      short header;
-      int   bytes = read(connection->fd, &header, sizeof(short));
-      if (!bytes) {
-        connection->active = 0;
-        fprintf(server->errors, "Connection was closed by client unexpectedly\n");
-        return READ_CONNECTION_CLOSED_CLIENT;
+// Frames
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+void wsping(WebSocketServer *server, int client) {
+  WebSocketConnection *connection;
+  unsigned long long   ping;
+
+  wswrite(server, client, NULL, 0, FRAME_PING);
+  // The pong is waited for from the time the ping went out (unless it already came)
+  if (server->pongtimeout && wstimers(server) && (connection = wsconnection(server, client)) &&
+      (ping = __atomic_load_n(&connection->ping, __ATOMIC_RELAXED)))
+  {
+    wsarm(server, connection, client, ping + server->pongtimeout * 1000ULL);
+  }
+}
+
+// Builds the header of an unfragmented frame, returns its size (up to FRAME_HEADER_SIZE bytes). RSV1 marks
+// a compressed message.
+size_t wsheader(unsigned char *header, const size_t size, const int type, const int compressed, const unsigned char *mask) {
+  FrameHeader fheader;
+  size_t      length = sizeof(FrameHeader);
+
+  memset(&fheader, 0, sizeof(FrameHeader));
+  fheader.end    = 1;
+  fheader.rsv1   = compressed != 0;
+  fheader.opcode = type;
+  fheader.mask   = mask != NULL;
+  if (size < 126) {
+    fheader.length = size;
+  } else if (size <= 0xFFFF) {
+    fheader.length = 126;
+    header[length++] = size >> 8;
+    header[length++] = size;
+  } else {
+    fheader.length = 127;
+    for (int i = 7; i >= 0; i--) header[length++] = (unsigned long long)size >> (i << 3);
+  }
+  header[0] = fheader.bytes >> 8;
+  header[1] = fheader.bytes;
+  if (mask) {
+    memcpy(&header[length], mask, WS_MASK_SIZE);
+    length += WS_MASK_SIZE;
+  }
+  return length;
+}
+
+// Sends every byte of the vector (which is consumed), resuming after partial writes
+ssize_t wssendv(WebSocketConnection *connection, struct iovec *iov, int count) {
+  ssize_t total = 0;
+
+  while (count) {
+    ssize_t n;
+
+    // With MSG_NOSIGNAL: a client that went away must not kill the process with SIGPIPE
+    if ((n = wstlssend(&connection->tls, connection->fd, iov, count)) < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd output = { connection->fd, POLLOUT, 0 };
+        if (poll(&output, 1, WS_TIMEOUT) > 0) continue;
       }
-      frame.header.bytes = ntohs(header);
-    }
-    if (frame.header.length < 126) {
-      frame.length = frame.header.length;
-    } else if (frame.header.length == 126) {
-      short l;
-      read(connection->fd, &l, sizeof(short));
-      frame.length = ntohs(l);
-    } else if (frame.header.length == 127) {
-      // Unsupported: Long Long Frame
-      int l;
-      read(connection->fd, &l, sizeof(int));
-      frame.length = ntohl(l);
-    }
-    if (frame.header.mask) {
-      read(connection->fd, frame.mask, WS_MASK_SIZE);
-    } else {
-      memset(frame.mask, 0, WS_MASK_SIZE * sizeof(unsigned char));
+      return -1;
     }
-    read(connection->fd, frame.payload, frame.length);
+    total += n;
+    for (; count && (size_t)n >= iov->iov_len; iov++, count--) n -= iov->iov_len;
+    if (count) {
+      iov->iov_base  = (unsigned char*)iov->iov_base + n;
+      iov->iov_len  -= n;
+    }
+  }
+  return total;
+}
 
-    switch (frame.header.opcode) {
-      case FRAME_CONTINUE:
-      case FRAME_TEXT:
-      case FRAME_BINARY:
-        if (frame.header.opcode == FRAME_CONTINUE && !expect) {
-          fprintf(server->errors, "Received a continued frame without previous opcode!\n");
-          // TODO: EMPTY STREAM
-          break;
-        } else if (frame.header.opcode == FRAME_BINARY) {
-          readstatus = READ_BINARY;
-        } else if (frame.header.opcode == FRAME_TEXT) {
-          readstatus = READ_TEXT;
-        }
-        expect = !frame.header.end;
-        {
-          int i;
-          for (i = *readbytes; i < frame.length && i < maxbytes; i++) {
-            buffer[i] = frame.payload[i] ^ frame.mask[i % WS_MASK_SIZE];
-          }
-          *readbytes = i;
-          if (i == maxbytes) return READ_BUFFER_OVERFLOW;
-        }
-        if (!expect) return readstatus;
-        break;
-      case FRAME_CLOSE:
-        memset(&cframe, 0, sizeof(ControlFrame));
-        cframe.header.opcode = FRAME_CLOSE;
-        cframe.header.end    = 1;
-        cframe.header.mask   = WS_MASK != 0;
-        cframe.header.length = 0;
-        if (WS_MASK) {
-          inttomask(WS_MASK, cframe.mask);
-          write(connection->fd, &cframe, sizeof(FrameHeader) + WS_MASK_SIZE * sizeof(unsigned char));
-        } else {
-          write(connection->fd, &cframe, sizeof(FrameHeader));
-        }
-        connection->active = 0;
-        fprintf(server->messages, "Connection was closed by client\n");
-        shutdown(connection->fd, SHUT_RDWR);
-        return READ_CONNECTION_CLOSED_CLIENT;
-      case FRAME_PING:
-        memset(&cframe, 0, sizeof(ControlFrame));
-        cframe.header.opcode = FRAME_PONG;
-        cframe.header.end    = 1;
-        cframe.header.mask   = frame.header.mask;
-        cframe.header.length = 0;
-        if (WS_MASK) {
-          inttomask(WS_MASK, cframe.mask);
-          write(connection->fd, &cframe, sizeof(FrameHeader) + WS_MASK_SIZE * sizeof(unsigned char));
-        } else {
-          write(connection->fd, &cframe, sizeof(FrameHeader));
-        }
-        break;
-      case FRAME_PONG:
-        *(long*)(void*)buffer = (long)(clock() - connection->ping) / (CLOCKS_PER_SEC / 1000);
-        *readbytes = sizeof(long);
-        return READ_PING_TIME;
-      default:
-        fprintf(server->errors, "Fatal error: unimplemented (wsread)\n");
-        return READ_FAILURE;
+// The payload is masked as it is copied when there is a mask (NULL otherwise)
+WebSocketFrame *wsencodemasked(const void *buffer, const size_t size, const int type, const int compressed, const unsigned char *mask) {
+  size_t          block = sizeof(WebSocketFrame) + FRAME_HEADER_SIZE + size;
+  WebSocketFrame *frame = wspoolalloc(&block);
+
+  if (!frame) return NULL;
+  frame->block    = block;
+  frame->refs     = 1;
+  frame->type     = type;
+  frame->deflated = NULL;
+  frame->data     = (unsigned char*)(frame + 1);
+  frame->header   = wsheader(frame->data, size, type, compressed, mask);
+  if (mask) wsmask(&frame->data[frame->header], buffer, size, mask, 0);
+  else if (size) memcpy(&frame->data[frame->header], buffer, size);
+  frame->size = frame->header + size;
+  return frame;
+}
+
+WebSocketFrame *wsencode(const void *buffer, const size_t size, const int type, const int compressed) {
+  unsigned char mask[WS_MASK_SIZE];
+
+  if (WS_MASK) inttomask(WS_MASK, mask);
+  return wsencodemasked(buffer, size, type, compressed, WS_MASK ? mask : NULL);
+}
+
+WebSocketFrame *wsframe(const void *buffer, const size_t size, const int type) {
+  return wsencode(buffer, size, type, 0);
+}
+
+WebSocketFrame *wsframeretain(WebSocketFrame *frame) {
+  if (frame) __atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+  return frame;
+}
+
+void wsframerelease(WebSocketFrame *frame) {
+  if (frame && !__atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL)) {
+    if (frame->deflated != frame) wsframerelease(frame->deflated);
+    wspoolfree(frame, frame->block);
+  }
+}
+
+// Outbound queue
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Copies what the socket did not take of a frame (the first skip bytes of the vector) to a frame of its own
+WebSocketFrame *wsleftover(const struct iovec *iov, const int count, size_t skip, const int type) {
+  WebSocketFrame *frame;
+  size_t          size = 0, block, done = 0;
+
+  for (int i = 0; i < count; i++) size += iov[i].iov_len;
+  block = sizeof(WebSocketFrame) + size - skip;
+  if (!(frame = wspoolalloc(&block))) return NULL;
+  frame->block    = block;
+  frame->refs     = 1;
+  frame->type     = type;
+  frame->deflated = NULL;
+  frame->data     = (unsigned char*)(frame + 1);
+  frame->header   = 0;
+  frame->size     = size - skip;
+  for (int i = 0; i < count; i++) {
+    if (skip >= iov[i].iov_len) {
+      skip -= iov[i].iov_len;
+      continue;
     }
+    memcpy(&frame->data[done], (unsigned char*)iov[i].iov_base + skip, iov[i].iov_len - skip);
+    done += iov[i].iov_len - skip;
+    skip  = 0;
   }
-  return readstatus;
+  return frame;
 }
 
-int wsaccept(WebSocketServer *server) {
-  int       client = CONNECTION_MAX_READCHED;
-  int       client_fd;
-  socklen_t addrlen = sizeof(struct sockaddr_in);
+// Drops whatever is queued, the queue gives its ring back to the pool
+void wsdiscard(WebSocketSender *tx) {
+  for (; tx->count; tx->count--, tx->head = (tx->head + 1) % tx->capacity) wsframerelease(tx->frames[tx->head]);
+  if (tx->frames) wspoolfree(tx->frames, tx->block);
+  tx->frames   = NULL;
+  tx->block    = 0;
+  tx->capacity = 0;
+  tx->head     = 0;
+  tx->offset   = 0;
+  tx->bytes    = 0;
+  tx->full     = 0;
+}
+
+// Queues a frame (the queue takes the reference), of which the first offset bytes were already sent
+int wspush(WebSocketServer *server, WebSocketSender *tx, WebSocketFrame *frame, const size_t offset) {
+  if (tx->count == tx->capacity) {
+    size_t           block  = (tx->capacity ? tx->capacity * 2 : 16) * sizeof(WebSocketFrame*);
+    WebSocketFrame **frames = wspoolalloc(&block);
+
+    if (!frames) return -1;
+    for (unsigned int i = 0; i < tx->count; i++) frames[i] = tx->frames[(tx->head + i) % tx->capacity];
+    if (tx->frames) wspoolfree(tx->frames, tx->block);
+    tx->frames   = frames;
+    tx->block    = block;
+    tx->capacity = block / sizeof(WebSocketFrame*);
+    tx->head     = 0;
+  }
+  tx->frames[(tx->head + tx->count++) % tx->capacity] = frame;
+  if (tx->count == 1) tx->offset = offset;
+  tx->bytes += frame->size - offset;
+  if (tx->bytes > server->highwater) tx->full = 1;
+  return 0;
+}
+
+void *wswriterrun(void *args) {
+  WebSocketServer    *server = args;
+  struct epoll_event  events[WS_WRITER_EVENTS];
 
-  if ((client_fd = accept(server->fd, (struct sockaddr *restrict)&server->address, &addrlen)) < 0) {
-    for (int i = 0; i < WS_MAX_CONN; i++) wsclose(server, i);
-    if (server->close) {
-      fprintf(server->messages, "Closing server\n");
-      return CONNECTION_CLOSED;
+  for (;;) {
+    int n = epoll_wait(server->writer.fd, events, WS_WRITER_EVENTS, -1);
+
+    if (n < 0 && errno != EINTR) break;
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.u64 == WS_WRITER_WAKE) return NULL;
+      wsflush(server, (int)events[i].data.u64);
     }
-    fprintf(server->errors, "Cannot accept\n");
-    return CONNECTION_FAILURE;
   }
+  return NULL;
+}
 
-  for (int i = 0; i < WS_MAX_CONN; i++) {
-    if (!server->connections[i]) {
-      WebSocketConnection *connection = malloc(sizeof(WebSocketConnection));
+// Starts the writer thread the first time it is needed, returns its epoll set (or -1)
+int wswriter(WebSocketServer *server) {
+  WebSocketWriter *writer = &server->writer;
 
-      memset(connection, 0, sizeof(WebSocketConnection));
-      connection->active = 1;
-      connection->fd     = client_fd;
+  if (!__atomic_load_n(&writer->started, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&writer->lock);
+    if (!writer->started) {
+      struct epoll_event event;
 
-      if (handshake(connection)) {
-        client = CONNECTION_BAD_HANDSHAKE;
-        free(connection);
+      memset(&event, 0, sizeof(struct epoll_event));
+      event.events   = EPOLLIN;
+      event.data.u64 = WS_WRITER_WAKE;
+      writer->fd     = epoll_create1(EPOLL_CLOEXEC);
+      writer->wake   = eventfd(0, EFD_CLOEXEC);
+      if (writer->fd >= 0 && writer->wake >= 0 && !epoll_ctl(writer->fd, EPOLL_CTL_ADD, writer->wake, &event) &&
+          !pthread_create(&writer->thread, NULL, wswriterrun, server))
+      {
+        __atomic_store_n(&writer->started, 1, __ATOMIC_RELEASE);
       } else {
-        client = i;
-        server->connections[i] = connection;
+        wslog(server->log, WS_LOG_ERROR, "Cannot start writer");
+        if (writer->fd >= 0)   close(writer->fd);
+        if (writer->wake >= 0) close(writer->wake);
+        writer->fd   = -1;
+        writer->wake = -1;
       }
-      break;
     }
+    pthread_mutex_unlock(&writer->lock);
   }
-  if (client >= 0) {
-    fprintf(server->messages, "Connection with client %d success\n", client);
-  } else if (client == CONNECTION_BAD_HANDSHAKE) {
-    fprintf(server->errors, "Failed to perform handshake\n");
-    close(client_fd);
+  return writer->started ? writer->fd : -1;
+}
+
+// Has the poller of the connection report (or stop reporting) that its socket can take more. The writer
+// thread is only asked once at a time (EPOLLONESHOT), the reactor keeps reading the socket.
+void wswant(WebSocketServer *server, WebSocketConnection *connection, const int writable) {
+  WebSocketSender    *tx = &connection->tx;
+  struct epoll_event  event;
+
+  if (tx->poll < 0) {
+    if (!writable || (tx->poll = wswriter(server)) < 0) return;
+    tx->events  = EPOLLONESHOT;
+    tx->watched = 0;
+  }
+  if (!writable && (tx->events & EPOLLONESHOT)) return;
+  memset(&event, 0, sizeof(struct epoll_event));
+  event.events   = tx->events | (writable ? EPOLLOUT : 0);
+  event.data.u64 = connection->id;
+  if (!epoll_ctl(tx->poll, tx->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, connection->fd, &event)) tx->watched = 1;
+}
+
+// Counts what went out on the connection (connection locked)
+void wscountbytes(WebSocketServer *server, WebSocketConnection *connection, const size_t bytes) {
+  if (bytes) {
+    __atomic_add_fetch(&connection->stats.bytesout, bytes, __ATOMIC_RELAXED);
+    WS_COUNT(server->counters, bytesout, bytes);
+  }
+}
+
+void wscountframe(WebSocketServer *server, WebSocketConnection *connection, const int type) {
+  WebSocketCounters *counters = wscounters(server->counters);
+
+  __atomic_add_fetch(&connection->stats.framesout, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&counters->framesout, 1, __ATOMIC_RELAXED);
+  if (type == FRAME_TEXT || type == FRAME_BINARY) {
+    __atomic_add_fetch(&connection->stats.messagesout, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&counters->messagesout, 1, __ATOMIC_RELAXED);
+  }
+}
+
+// Writes out what the socket takes without waiting (connection locked), returns -1 if it failed (the queue
+// is then dropped). *drained is set once a queue that went past highwater is back down to lowwater.
+int wsdrain(WebSocketServer *server, WebSocketConnection *connection, int *drained) {
+  WebSocketSender *tx     = &connection->tx;
+  int              queued = tx->count != 0;
+
+  while (tx->count) {
+    struct iovec iov[WS_QUEUE_IOV];
+    int          count = tx->count < WS_QUEUE_IOV ? tx->count : WS_QUEUE_IOV;
+    ssize_t      n;
+
+    for (int i = 0; i < count; i++) {
+      WebSocketFrame *frame = tx->frames[(tx->head + i) % tx->capacity];
+
+      iov[i].iov_base = frame->data;
+      iov[i].iov_len  = frame->size;
+    }
+    iov[0].iov_base = (unsigned char*)iov[0].iov_base + tx->offset;
+    iov[0].iov_len -= tx->offset;
+    if ((n = wstlssend(&connection->tls, connection->fd, iov, count)) < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+      wsdiscard(tx);
+      return -1;
+    }
+    tx->bytes -= n;
+    wscountbytes(server, connection, n);
+    n         += tx->offset;
+    while (tx->count && (size_t)n >= tx->frames[tx->head]->size) {
+      n -= tx->frames[tx->head]->size;
+      wsframerelease(tx->frames[tx->head]);
+      tx->head = (tx->head + 1) % tx->capacity;
+      tx->count--;
+    }
+    tx->offset = n;
+  }
+  if (tx->full && tx->bytes <= server->lowwater) {
+    tx->full = 0;
+    if (drained) *drained = 1;
+  }
+  if (queued && !tx->count) {
+    wsdiscard(tx);
+    wswant(server, connection, 0);
+  }
+  return 0;
+}
+
+void wsnowait() {
+  nowait = 1;
+}
+
+// Waits for the queue of a client that has no room for size more bytes to be back down to lowwater when
+// the server blocks on overflow (connection locked). The lock is let go of in the meantime, so that the
+// queue can be written out and the connection closed by others. Returns 0 once there is room, the
+// connection locked and still the client, WRITE_FAILURE otherwise.
+int wsmakeroom(WebSocketServer *server, WebSocketConnection *connection, const int client, const size_t size, const int type) {
+  WebSocketSender *tx = &connection->tx;
+
+  if (server->overflow != WS_OVERFLOW_BLOCK || nowait || type == FRAME_CLOSE || type == FRAME_PONG) return 0;
+  if (tx->count && wsdrain(server, connection, NULL) < 0) return WRITE_FAILURE;
+  if (!tx->count || tx->bytes + size <= server->highwater) return 0;
+  tx->full = 1;
+  while (tx->count && tx->bytes > server->lowwater) {
+    struct pollfd output = { connection->fd, POLLOUT, 0 };
+    int           ready;
+
+    pthread_mutex_unlock(&connection->lock);
+    ready = poll(&output, 1, WS_TIMEOUT);
+    pthread_mutex_lock(&connection->lock);
+    if (ready <= 0 || connection->id != client || wsdrain(server, connection, NULL) < 0) return WRITE_FAILURE;
+  }
+  return 0;
+}
+
+/*
+NOTE:
+Sends a frame, or queues it behind the frames that are waiting (connection locked). The frame is either
+given, and then queued by reference, or made of the vector (header and payload), which is only copied
+if it has to be queued. Returns 0, WRITE_DROPPED or WRITE_FAILURE.
+*/
+int wspost(WebSocketServer *server, WebSocketConnection *connection, WebSocketFrame *frame, struct iovec *iov, int count, const int type) {
+  WebSocketSender *tx      = &connection->tx;
+  int              control = type == FRAME_CLOSE || type == FRAME_PONG;
+  struct iovec     whole;
+  size_t           size    = 0;
+  ssize_t          sent    = 0;
+
+  if (frame) {
+    whole.iov_base = frame->data;
+    whole.iov_len  = frame->size;
+    iov            = &whole;
+    count          = 1;
+  }
+  for (int i = 0; i < count; i++) size += iov[i].iov_len;
+
+  if (tx->count && wsdrain(server, connection, NULL) < 0) return WRITE_FAILURE;
+  if (tx->count && !control && tx->bytes + size > server->highwater) {
+    tx->full = 1;
+    if (server->overflow == WS_OVERFLOW_DROP) {
+      WS_COUNT(server->counters, dropped, 1);
+      return WRITE_DROPPED;
+    }
+    if (server->overflow == WS_OVERFLOW_DISCONNECT) {
+      WS_COUNT(server->counters, disconnected, 1);
+      shutdown(connection->fd, SHUT_RDWR);
+      return WRITE_FAILURE;
+    }
+    // Blocking, the writer already waited for room (see wsmakeroom): only a thread that never waits gets
+    // here, the message is then queued past highwater rather than hold its other clients up
+  }
+  if (!tx->count) {
+    while ((sent = wstlssend(&connection->tls, connection->fd, iov, count)) < 0 && errno == EINTR);
+    if (sent < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) return WRITE_FAILURE;
+      sent = 0;
+    }
+    wscountbytes(server, connection, sent);
+    wscountframe(server, connection, type);
+    if ((size_t)sent == size) return 0;
   } else {
-    fprintf(server->errors, "Max connections reached\n");
-    close(client_fd);
+    wscountframe(server, connection, type);
   }
-  return client;
+
+  // The socket is full: the rest waits in the queue
+  if (frame) {
+    wsframeretain(frame);
+  } else {
+    if (!(frame = wsleftover(iov, count, sent, type))) return WRITE_FAILURE;
+    sent = 0;
+  }
+  if (wspush(server, tx, frame, sent) < 0) {
+    wsframerelease(frame);
+    return WRITE_FAILURE;
+  }
+  if (tx->count == 1) wswant(server, connection, 1);
+  return 0;
 }
 
-void wsclose(WebSocketServer *server, int client) {
-  WebSocketConnection *connection = server->connections[client];
+// Sends a payload masked with a key of its own, as a client has to (connection locked): a small one is
+// masked on the stack and only copied if it has to be queued, a bigger one is encoded whole
+int wspostmasked(WebSocketServer *server, WebSocketConnection *connection, const unsigned char *payload, const size_t size,
+                 const int type, const int compressed)
+{
+  unsigned char   header[FRAME_HEADER_SIZE];
+  unsigned char   masked[WS_MASK_INLINE];
+  unsigned char   mask[WS_MASK_SIZE];
+  struct iovec    iov[2];
+  WebSocketFrame *frame;
+  int             status;
+
+  inttomask(connection->masking ? wsmaskkey() : WS_MASK, mask);
+  if (size <= WS_MASK_INLINE) {
+    wsmask(masked, payload, size, mask, 0);
+    iov[0].iov_base = header;
+    iov[0].iov_len  = wsheader(header, size, type, compressed, mask);
+    iov[1].iov_base = masked;
+    iov[1].iov_len  = size;
+    return wspost(server, connection, NULL, iov, 2, type);
+  }
+  if (!(frame = wsencodemasked(payload, size, type, compressed, mask))) return WRITE_FAILURE;
+  status = wspost(server, connection, frame, NULL, 0, type);
+  wsframerelease(frame);
+  return status;
+}
+
+size_t wsqueued(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  size_t               bytes      = 0;
 
   if (connection) {
-    shutdown(connection->fd, SHUT_RDWR);
-    close(connection->fd);
-    free(connection);
-    server->connections[client] = NULL;
+    pthread_mutex_lock(&connection->lock);
+    if (connection->id == client) bytes = connection->tx.bytes;
+    pthread_mutex_unlock(&connection->lock);
   }
+  return bytes;
 }
 
-WebSocketServer *wsstart(const short port, FILE *messages, FILE *errors) {
-  WebSocketServer *server = malloc(sizeof(WebSocketServer));
-  if (server) {
-    int                 server_fd;
-    struct sockaddr_in *address;
+int wsbackpressure(WebSocketServer *server, const int client, const size_t size) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  int                  full       = -1;
 
-    server->port     = port;
-    server->messages = messages;
-    server->errors   = errors;
-    address          = &server->address;
-    memset(server->connections, 0, WS_MAX_CONN * sizeof(WebSocketConnection*));
+  if (connection) {
+    pthread_mutex_lock(&connection->lock);
+    if (connection->id == client) {
+      WebSocketSender *tx = &connection->tx;
 
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-      fprintf(errors, "Cannot create socket\n");
-      return NULL;
+      // The queue reports its drain once it is flagged as full
+      full = tx->count && tx->bytes + size > server->highwater;
+      if (full) tx->full = 1;
     }
-    fprintf(messages, "WebSocket Server created successfully\n");
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int)) < 0) {
-      fprintf(errors, "Cannot reuse socket\n");
-      return NULL;
+    pthread_mutex_unlock(&connection->lock);
+  }
+  return full;
+}
+
+long wsflush(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  int                  drained    = 0;
+  long                 left;
+
+  if (!connection) return -1;
+  pthread_mutex_lock(&connection->lock);
+  if (connection->id != client) {
+    pthread_mutex_unlock(&connection->lock);
+    return -1;
+  }
+  left = wsdrain(server, connection, &drained) < 0 ? -1 : (long)connection->tx.bytes;
+  if (connection->tx.count && (connection->tx.events & EPOLLONESHOT)) wswant(server, connection, 1);
+  pthread_mutex_unlock(&connection->lock);
+  if (drained && server->ondrain) server->ondrain(server, client, server->drainenv);
+
+  return left;
+}
+
+void wswatch(WebSocketServer *server, const int client, const int epoll) {
+  WebSocketConnection *connection = wsconnection(server, client);
+
+  if (connection) {
+    pthread_mutex_lock(&connection->lock);
+    if (connection->id == client) {
+      connection->tx.poll    = epoll;
+      connection->tx.events  = EPOLLIN;
+      connection->tx.watched = 1;
+      if (connection->tx.count) wswant(server, connection, 1);
     }
-    fprintf(messages, "Socket setup successful\n");
+    pthread_mutex_unlock(&connection->lock);
+  }
+}
 
-    memset(address, 0, sizeof(struct sockaddr_in));
-    memset(address->sin_zero, 0, sizeof(unsigned char));
-    address->sin_family      = AF_INET;
-    address->sin_addr.s_addr = htonl(INADDR_ANY);
-    address->sin_port        = htons(port);
+void wswatchoutput(WebSocketServer *server, const int client, const int epoll) {
+  WebSocketConnection *connection = wsconnection(server, client);
 
-    if (bind(server_fd, (struct sockaddr *restrict)address, sizeof(struct sockaddr_in)) < 0) {
-      fprintf(errors, "Bind failed\n");
-      return NULL;
+  if (connection) {
+    pthread_mutex_lock(&connection->lock);
+    if (connection->id == client) {
+      WebSocketSender *tx = &connection->tx;
+
+      // Taken away from the writer thread
+      if (tx->poll >= 0 && tx->watched) epoll_ctl(tx->poll, EPOLL_CTL_DEL, connection->fd, NULL);
+      tx->poll    = epoll;
+      tx->events  = EPOLLONESHOT;
+      tx->watched = 0;
+      if (tx->count) wswant(server, connection, 1);
     }
-    fprintf(messages, "Socket binded successfuly\n");
+    pthread_mutex_unlock(&connection->lock);
+  }
+}
 
-    if (listen(server_fd, WS_MAX_CONN) < 0) {
-      fprintf(errors, "Cannot listen\n");
-      return NULL;
+void wspause(WebSocketServer *server, const int client, const int paused) {
+  WebSocketConnection *connection = wsconnection(server, client);
+
+  if (connection) {
+    pthread_mutex_lock(&connection->lock);
+    if (connection->id == client && connection->paused != paused) {
+      WebSocketSender *tx = &connection->tx;
+
+      connection->paused = paused;
+      // Writes go on (EPOLLOUT), only the socket of a reactor that reads it from the set is concerned
+      if (tx->poll >= 0 && tx->watched && !(tx->events & EPOLLONESHOT)) {
+        tx->events = paused ? 0 : EPOLLIN;
+        wswant(server, connection, tx->count > 0);
+      }
     }
-    server->fd = server_fd;
-    fprintf(messages, "Listening on port %d for WebSocket connections...\n", port);
+    pthread_mutex_unlock(&connection->lock);
   }
-  return server;
 }
 
-void wsstop(WebSocketServer *server) {
-  if (server) {
-    for (int i = 0; i < WS_MAX_CONN; i++) wsclose(server, i);
-    shutdown(server->fd, SHUT_RDWR);
-    close(server->fd);
+/*
+NOTE:
+The payload is sent straight from the caller's buffer along with the header (one sendmsg), it is only
+copied if it has to be masked or compressed, or queued. Messages of any size go in a single frame
+(64-bit length). Compression happens under the lock of the connection, which serializes the use of its
+context.
+*/
+int wswrite(WebSocketServer *server, const int client, const unsigned char *buffer, const size_t size, const int type) {
+  unsigned char        header[FRAME_HEADER_SIZE];
+  struct iovec         iov[2];
+  WebSocketConnection *connection = wsconnection(server, client);
+  const unsigned char *payload    = buffer;
+  size_t               length     = size;
+  unsigned char       *deflated   = NULL;
+  size_t               block      = 0;
+  int                  status;
+
+  if (!connection) return WRITE_FAILURE;
+
+  // The lock keeps frames in order and makes sure the ID still designates this client
+  pthread_mutex_lock(&connection->lock);
+  if (connection->id != client || wsmakeroom(server, connection, client, size, type) < 0) {
+    pthread_mutex_unlock(&connection->lock);
+    return WRITE_FAILURE;
+  }
+  if (connection->deflate.enabled && (type == FRAME_TEXT || type == FRAME_BINARY)) {
+    size_t compressed = wsdeflate(&connection->deflate, &server->deflate, buffer, size, &deflated, &block);
+
+    if (compressed) {
+      payload = deflated;
+      length  = compressed;
+    }
+  }
+  // Noted before it goes out, the pong could otherwise be read first
+  if (type == FRAME_PING) __atomic_store_n(&connection->ping, wsclock(), __ATOMIC_RELAXED);
+  if (WS_MASK || connection->masking) {
+    status = wspostmasked(server, connection, payload, length, type, deflated != NULL);
+  } else {
+    iov[0].iov_base = header;
+    iov[0].iov_len  = wsheader(header, length, type, deflated != NULL, NULL);
+    iov[1].iov_base = (void*)payload;
+    iov[1].iov_len  = length;
+    status = wspost(server, connection, NULL, iov, 2, type);
+  }
+  pthread_mutex_unlock(&connection->lock);
+  if (deflated) wspoolfree(deflated, block);
+
+  return status < 0 ? status : (int)size;
+}
+
+/*
+NOTE:
+The compressed version of a frame is made once (on its first broadcast), with the server options and
+without context takeover, so that it suits every connection that negotiated the same window. It points
+back to the frame itself when the payload is not worth compressing.
+*/
+WebSocketFrame *wsframedeflate(WebSocketServer *server, WebSocketFrame *frame) {
+  WebSocketFrame *deflated = __atomic_load_n(&frame->deflated, __ATOMIC_ACQUIRE);
+
+  // Masked payloads would have to be unmasked first, the frame is then sent as it is
+  if (!deflated && !WS_MASK && (frame->type == FRAME_TEXT || frame->type == FRAME_BINARY)) {
+    unsigned char *output;
+    size_t         block;
+    size_t         length = wsdeflate(NULL, &server->deflate, &frame->data[frame->header], frame->size - frame->header, &output, &block);
+
+    deflated = length ? wsencode(output, length, frame->type, 1) : NULL;
+    if (length) wspoolfree(output, block);
+    if (!deflated) deflated = frame;
+    if (!__atomic_compare_exchange_n(&frame->deflated, &(WebSocketFrame*){NULL}, deflated, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      if (deflated != frame) wsframerelease(deflated);
+      deflated = __atomic_load_n(&frame->deflated, __ATOMIC_ACQUIRE);
+    }
+  }
+  return deflated;
+}
+
+/*
+NOTE:
+Without wait, the frame is only sent (or queued) if the connection is free: 0 is returned otherwise and
+the frame can be sent later.
+*/
+int wssendframe(WebSocketServer *server, const int client, WebSocketFrame *frame, const int wait) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  int                  status;
+
+  if (!connection || !frame) return WRITE_FAILURE;
+  if (wait) pthread_mutex_lock(&connection->lock);
+  else if (pthread_mutex_trylock(&connection->lock)) return 0;
+  if (connection->id != client || wsmakeroom(server, connection, client, frame->size, frame->type) < 0) {
+    pthread_mutex_unlock(&connection->lock);
+    return WRITE_FAILURE;
+  }
+  // Connections that keep their context (or use another window) need a frame of their own
+  if (frame->deflated && frame->deflated != frame && connection->deflate.enabled &&
+      !connection->deflate.servertakeover && connection->deflate.serverbits == server->deflate.serverbits)
+  {
+    frame = frame->deflated;
+  }
+  if (frame->type == FRAME_PING) __atomic_store_n(&connection->ping, wsclock(), __ATOMIC_RELAXED);
+  // A client masks the payload with a key of its own (frames made with WS_MASK are masked already)
+  if (connection->masking && !WS_MASK) {
+    status = wspostmasked(server, connection, &frame->data[frame->header], frame->size - frame->header, frame->type,
+                          (frame->data[0] & 0x40) != 0);
+  } else {
+    status = wspost(server, connection, frame, NULL, 0, frame->type);
+  }
+  pthread_mutex_unlock(&connection->lock);
+
+  return status < 0 ? status : (int)frame->size;
+}
+
+int wswriteframe(WebSocketServer *server, const int client, WebSocketFrame *frame) {
+  return wssendframe(server, client, frame, 1);
+}
+
+/*
+NOTE:
+Sends the frame of the current broadcast to the clients of the next free batch, until there is none.
+Clients that cannot take the frame at once are sent it after the rest of their batch.
+*/
+void wsbroadcastrun(WebSocketServer *server, WebSocketFrame *frame) {
+  WebSocketBroadcast *broadcast = &server->broadcast;
+  unsigned int        slot;
+  int                 sent      = 0;
+
+  while ((slot = __atomic_fetch_add(&broadcast->cursor, WS_BROADCAST_BATCH, __ATOMIC_RELAXED)) < broadcast->end) {
+    unsigned int end = broadcast->end - slot < WS_BROADCAST_BATCH ? broadcast->end : slot + WS_BROADCAST_BATCH;
+    int          deferred[WS_BROADCAST_BATCH];
+    int          ndeferred = 0;
+
+    for (; slot < end; slot++) {
+      int client = __atomic_load_n(&wsslot(server, slot)->id, __ATOMIC_ACQUIRE);
+      int status;
+
+      if (client < 0) continue;
+      if (!(status = wssendframe(server, client, frame, 0))) deferred[ndeferred++] = client;
+      else if (status > 0)                                   sent++;
+    }
+    for (int i = 0; i < ndeferred; i++) {
+      if (wssendframe(server, deferred[i], frame, 1) >= 0) sent++;
+    }
+  }
+  __atomic_add_fetch(&broadcast->sent, sent, __ATOMIC_RELAXED);
+}
+
+void *wsbroadcastworker(void *args) {
+  WebSocketServer    *server    = args;
+  WebSocketBroadcast *broadcast = &server->broadcast;
+  unsigned long       round     = 0;
+
+  pthread_mutex_lock(&broadcast->lock);
+  for (;;) {
+    WebSocketFrame *frame;
+
+    while (!broadcast->stop && broadcast->round == round) pthread_cond_wait(&broadcast->wake, &broadcast->lock);
+    if (broadcast->stop) break;
+    round = broadcast->round;
+    frame = broadcast->frame;
+    pthread_mutex_unlock(&broadcast->lock);
+    wsbroadcastrun(server, frame);
+    pthread_mutex_lock(&broadcast->lock);
+    if (!--broadcast->busy) pthread_cond_signal(&broadcast->done);
+  }
+  pthread_mutex_unlock(&broadcast->lock);
+  return NULL;
+}
+
+int wsbroadcast(WebSocketServer *server, WebSocketFrame *frame) {
+  WebSocketBroadcast *broadcast = &server->broadcast;
+  unsigned int        size      = __atomic_load_n(&server->registry.size, __ATOMIC_ACQUIRE);
+  int                 sent;
+
+  if (!frame) return 0;
+  if (server->deflate.enabled) wsframedeflate(server, frame);
+  // One broadcast at a time, so that every client gets them in the same order
+  pthread_mutex_lock(&broadcast->call);
+  if (!broadcast->count && wscount(server) > WS_BROADCAST_BATCH) {
+    while (broadcast->count < WS_BROADCAST_THREADS &&
+           !pthread_create(&broadcast->threads[broadcast->count], NULL, wsbroadcastworker, server)) broadcast->count++;
+  }
+  broadcast->cursor = 0;
+  broadcast->end    = size;
+  broadcast->sent   = 0;
+  if (broadcast->count && wscount(server) > WS_BROADCAST_BATCH) {
+    pthread_mutex_lock(&broadcast->lock);
+    broadcast->frame = frame;
+    broadcast->busy  = broadcast->count;
+    broadcast->round++;
+    pthread_cond_broadcast(&broadcast->wake);
+    pthread_mutex_unlock(&broadcast->lock);
+
+    wsbroadcastrun(server, frame);
+
+    pthread_mutex_lock(&broadcast->lock);
+    while (broadcast->busy) pthread_cond_wait(&broadcast->done, &broadcast->lock);
+    broadcast->frame = NULL;
+    pthread_mutex_unlock(&broadcast->lock);
+  } else {
+    wsbroadcastrun(server, frame);
+  }
+  sent = broadcast->sent;
+  pthread_mutex_unlock(&broadcast->call);
+
+  return sent;
+}
+
+int wsmulticast(WebSocketServer *server, const void *buffer, const size_t size, const int type) {
+  WebSocketFrame *frame = wsframe(buffer, size, type);
+  int             sent  = wsbroadcast(server, frame);
+
+  wsframerelease(frame);
+  return sent;
+}
+
+// Topics
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+unsigned int wstopichash(const char *name) {
+  unsigned int hash = 2166136261u;
+
+  while (*name) hash = (hash ^ (unsigned char)*name++) * 16777619u;
+  return hash;
+}
+
+// The topic of that name, NULL if no one is subscribed to it (topics locked)
+WebSocketTopic *wstopic(WebSocketTopics *topics, const char *name, const unsigned int hash) {
+  for (WebSocketTopic *topic = topics->buckets[hash % WS_TOPIC_BUCKETS]; topic; topic = topic->next) {
+    if (topic->hash == hash && !strcmp(topic->name, name)) return topic;
+  }
+  return NULL;
+}
+
+// Topics locked for writing, from here on
+void wstopicdrop(WebSocketTopics *topics, WebSocketTopic *topic) {
+  WebSocketTopic **bucket = &topics->buckets[topic->hash % WS_TOPIC_BUCKETS];
+
+  while (*bucket != topic) bucket = &(*bucket)->next;
+  *bucket = topic->next;
+  topics->count--;
+  free(topic->clients);
+  free(topic->subscriptions);
+  free(topic);
+}
+
+int wstopicjoin(WebSocketTopic *topic, WebSocketConnection *connection, const int client) {
+  WebSocketSubscription *subscription;
+
+  if (topic->count == topic->capacity) {
+    unsigned int            capacity      = topic->capacity ? topic->capacity << 1 : 8;
+    int                    *clients       = realloc(topic->clients, capacity * sizeof(int));
+    WebSocketSubscription **subscriptions;
+
+    if (!clients) return 0;
+    topic->clients = clients;
+    if (!(subscriptions = realloc(topic->subscriptions, capacity * sizeof(WebSocketSubscription*)))) return 0;
+    topic->subscriptions = subscriptions;
+    topic->capacity      = capacity;
+  }
+  if (!(subscription = malloc(sizeof(WebSocketSubscription)))) return 0;
+  subscription->topic                 = topic;
+  subscription->index                 = topic->count;
+  subscription->next                  = connection->subscriptions;
+  connection->subscriptions           = subscription;
+  topic->clients[topic->count]        = client;
+  topic->subscriptions[topic->count]  = subscription;
+  topic->count++;
+  return 1;
+}
+
+// The subscription is taken out of the list of its connection beforehand
+void wstopicleave(WebSocketTopics *topics, WebSocketSubscription *subscription) {
+  WebSocketTopic *topic = subscription->topic;
+  unsigned int    last  = --topic->count;
+
+  // The last subscriber takes the place of the one that leaves
+  if (subscription->index != last) {
+    topic->clients[subscription->index]              = topic->clients[last];
+    topic->subscriptions[subscription->index]        = topic->subscriptions[last];
+    topic->subscriptions[subscription->index]->index = subscription->index;
+  }
+  if (!topic->count) wstopicdrop(topics, topic);
+  free(subscription);
+}
+
+// Unsubscribes a connection that is being closed from everything
+void wstopicsleave(WebSocketServer *server, WebSocketConnection *connection) {
+  WebSocketTopics *topics = &server->topics;
+
+  pthread_rwlock_wrlock(&topics->lock);
+  while (connection->subscriptions) {
+    WebSocketSubscription *subscription = connection->subscriptions;
+
+    connection->subscriptions = subscription->next;
+    wstopicleave(topics, subscription);
+  }
+  pthread_rwlock_unlock(&topics->lock);
+}
+
+int wssubscribe(WebSocketServer *server, const int client, const char *name) {
+  WebSocketTopics     *topics     = &server->topics;
+  WebSocketConnection *connection = wsconnection(server, client);
+  unsigned int         hash;
+  WebSocketTopic      *topic;
+  int                  status     = -1;
+
+  if (!connection || !name) return -1;
+  hash = wstopichash(name);
+  pthread_rwlock_wrlock(&topics->lock);
+  // Checked under the lock: a client that is closed leaves its topics under it (see wsclose)
+  if (__atomic_load_n(&connection->id, __ATOMIC_ACQUIRE) == client) {
+    for (WebSocketSubscription *subscription = connection->subscriptions; subscription; subscription = subscription->next) {
+      if (subscription->topic->hash == hash && !strcmp(subscription->topic->name, name)) {
+        pthread_rwlock_unlock(&topics->lock);
+        return 0;
+      }
+    }
+    if (!(topic = wstopic(topics, name, hash)) && (topic = calloc(1, sizeof(WebSocketTopic) + strlen(name) + 1))) {
+      topic->hash = hash;
+      strcpy(topic->name, name);
+      topic->next = topics->buckets[hash % WS_TOPIC_BUCKETS];
+      topics->buckets[hash % WS_TOPIC_BUCKETS] = topic;
+      topics->count++;
+    }
+    if (topic && wstopicjoin(topic, connection, client)) {
+      status = 1;
+    } else {
+      if (topic && !topic->count) wstopicdrop(topics, topic);
+      wslog(server->log, WS_LOG_ERROR, "Cannot subscribe client %d to %s", client, name);
+    }
+  }
+  pthread_rwlock_unlock(&topics->lock);
+  return status;
+}
+
+int wsunsubscribe(WebSocketServer *server, const int client, const char *name) {
+  WebSocketTopics     *topics     = &server->topics;
+  WebSocketConnection *connection = wsconnection(server, client);
+  int                  status     = 0;
+
+  if (!connection || !name) return 0;
+  pthread_rwlock_wrlock(&topics->lock);
+  if (__atomic_load_n(&connection->id, __ATOMIC_ACQUIRE) == client) {
+    for (WebSocketSubscription **link = &connection->subscriptions; *link; link = &(*link)->next) {
+      WebSocketSubscription *subscription = *link;
+
+      if (!strcmp(subscription->topic->name, name)) {
+        *link  = subscription->next;
+        wstopicleave(topics, subscription);
+        status = 1;
+        break;
+      }
+    }
+  }
+  pthread_rwlock_unlock(&topics->lock);
+  return status;
+}
+
+size_t wssubscribers(WebSocketServer *server, const char *name) {
+  WebSocketTopics *topics = &server->topics;
+  WebSocketTopic  *topic;
+  size_t           count;
+
+  if (!name) return 0;
+  pthread_rwlock_rdlock(&topics->lock);
+  count = (topic = wstopic(topics, name, wstopichash(name))) ? topic->count : 0;
+  pthread_rwlock_unlock(&topics->lock);
+  return count;
+}
+
+/*
+NOTE:
+The subscribers are copied out under the read lock, and sent the frame once it is released: a client
+that is slow to take it does not hold up subscriptions. Like a broadcast, clients that are busy are
+sent the frame after the others.
+*/
+int wspublishframe(WebSocketServer *server, const char *name, WebSocketFrame *frame) {
+  WebSocketTopics *topics   = &server->topics;
+  WebSocketTopic  *topic;
+  int             *clients  = NULL;
+  size_t           block    = 0;
+  unsigned int     count    = 0;
+  unsigned int     deferred = 0;
+  int              sent     = 0;
+
+  if (!frame || !name) return 0;
+  pthread_rwlock_rdlock(&topics->lock);
+  if ((topic = wstopic(topics, name, wstopichash(name)))) {
+    block = topic->count * sizeof(int);
+    if ((clients = wspoolalloc(&block))) {
+      count = topic->count;
+      memcpy(clients, topic->clients, count * sizeof(int));
+    }
+  }
+  pthread_rwlock_unlock(&topics->lock);
+  if (!clients) return 0;
+
+  if (server->deflate.enabled) wsframedeflate(server, frame);
+  for (unsigned int i = 0; i < count; i++) {
+    int status = wssendframe(server, clients[i], frame, 0);
+
+    if (!status)         clients[deferred++] = clients[i];
+    else if (status > 0) sent++;
+  }
+  for (unsigned int i = 0; i < deferred; i++) {
+    if (wssendframe(server, clients[i], frame, 1) >= 0) sent++;
+  }
+  wspoolfree(clients, block);
+  return sent;
+}
+
+int wspublish(WebSocketServer *server, const char *name, const void *buffer, const size_t size, const int type) {
+  WebSocketFrame *frame = wsframe(buffer, size, type);
+  int             sent  = wspublishframe(server, name, frame);
+
+  wsframerelease(frame);
+  return sent;
+}
+
+// Reception
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Moves what is left to read to a new buffer of the given size (from the pool)
+int wsresize(WebSocketReceiver *rx, size_t size) {
+  unsigned char *buffer = wspoolalloc(&size);
+
+  if (!buffer) return 0;
+  if (rx->buffer) {
+    memcpy(buffer, &rx->buffer[rx->start], rx->end - rx->start);
+    wspoolfree(rx->buffer, rx->bufsize + 1);
+  }
+  rx->end    -= rx->start;
+  rx->start   = 0;
+  rx->high    = rx->end;
+  rx->buffer  = buffer;
+  // One byte is kept for the terminator of a payload that ends the buffer
+  rx->bufsize = size - 1;
+  rx->hint    = size;
+  return 1;
+}
+
+// Makes room at the end of the receive buffer, returns 0 if there is no buffer
+int wsroom(WebSocketReceiver *rx) {
+  if (rx->terminator) {
+    *rx->terminator = rx->saved;
+    rx->terminator  = NULL;
+  }
+  rx->view = NULL;
+  if (!rx->buffer) {
+    rx->start = rx->end = 0;
+    if (!wsresize(rx, rx->hint ? rx->hint : WS_RECV_MIN)) return 0;
+  }
+  if (rx->start == rx->end) {
+    rx->start = rx->end = 0;
+  } else if (rx->bufsize - rx->end < rx->bufsize / 4) {
+    // Only a partial frame is left, move it to the front
+    memmove(rx->buffer, &rx->buffer[rx->start], rx->end - rx->start);
+    rx->end  -= rx->start;
+    rx->start = 0;
+  }
+  return 1;
+}
+
+void wsfilled(WebSocketReceiver *rx, const size_t n) {
+  rx->end += n;
+  if (rx->end > rx->high) rx->high = rx->end;
+  // The socket had at least as much as the buffer could take, a bigger one will need fewer reads
+  if (rx->end == rx->bufsize && rx->bufsize + 1 < WS_RECV_SIZE) wsresize(rx, (rx->bufsize + 1) << 1);
+}
+
+// Reads as much as the socket holds in a single call, returns the byte count, 0 at the end of the stream
+// or -1 (errno is EAGAIN when there was nothing to read)
+ssize_t wsfill(WebSocketConnection *connection) {
+  WebSocketReceiver *rx = &connection->rx;
+  ssize_t            n;
+
+  if (!wsroom(rx)) return -1;
+  n = wstlsrecv(&connection->tls, __atomic_load_n(&connection->fd, __ATOMIC_ACQUIRE), &rx->buffer[rx->end],
+                rx->bufsize - rx->end);
+  if (n > 0) wsfilled(rx, n);
+  return n;
+}
+
+/*
+NOTE:
+The receive side of a connection (its buffers and its inflater) belongs to the thread that reads it,
+from the moment it starts receiving to the end of the call, or to the next call when it hands out a
+view. wsclose gives it back when the reader is not at it, the reader does otherwise once it is done.
+*/
+// Gives back the receive side of the connection that was closed as client, unless it was already
+// (connection locked)
+void wsdropstale(WebSocketConnection *connection, const int client) {
+  if (__atomic_load_n(&connection->stale, __ATOMIC_SEQ_CST) == client) {
+    __atomic_store_n(&connection->stale, -1, __ATOMIC_SEQ_CST);
+    wsdrop(&connection->rx);
+    wsinflaterelease(&connection->deflate);
+  }
+}
+
+// The reader starts receiving, returns 0 if the connection was closed in the meantime
+int wsreceiving(WebSocketConnection *connection, const int client) {
+  __atomic_store_n(&connection->receiving, 1, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&connection->stale, __ATOMIC_SEQ_CST) != client;
+}
+
+// The reader is done receiving
+void wsreceived(WebSocketConnection *connection, const int client) {
+  __atomic_store_n(&connection->receiving, 0, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&connection->stale, __ATOMIC_SEQ_CST) == client) {
+    pthread_mutex_lock(&connection->lock);
+    wsdropstale(connection, client);
+    pthread_mutex_unlock(&connection->lock);
+  }
+}
+
+// Takes what was received of the request of a connection that is doing its handshake (see wsshake)
+long wsfeedshake(WebSocketConnection *connection, const unsigned char *bytes, const size_t size) {
+  WebSocketShake *shake = connection->shake;
+  size_t          n     = size < WS_REQUEST_SIZE - shake->size ? size : WS_REQUEST_SIZE - shake->size;
+
+  shake->fed = 1;
+  if (wstlsciphered(&connection->tls)) return wstlsfeed(&connection->tls, bytes, size);
+  memcpy(&shake->request[shake->size], bytes, n);
+  shake->size += n;
+  return (long)n;
+}
+
+long wsfeed(WebSocketServer *server, const int client, const unsigned char *bytes, const size_t size) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  WebSocketReceiver   *rx;
+  long                 n          = -1;
+
+  if (!connection) return (connection = wsshaking(server, client)) ? wsfeedshake(connection, bytes, size) : -1;
+  // Ciphertext is left to OpenSSL, it is decrypted as the frames are read (see wsreceive)
+  if (wstlsciphered(&connection->tls)) return wstlsfeed(&connection->tls, bytes, size);
+  if (wsreceiving(connection, client) && wsroom(&connection->rx)) {
+    rx = &connection->rx;
+    n  = size < rx->bufsize - rx->end ? (long)size : (long)(rx->bufsize - rx->end);
+    memcpy(&rx->buffer[rx->end], bytes, n);
+    wsfilled(rx, n);
+    wsseen(server, connection);
+    __atomic_add_fetch(&connection->stats.bytesin, n, __ATOMIC_RELAXED);
+    WS_COUNT(server->counters, bytesin, n);
+  }
+  wsreceived(connection, client);
+  return n;
+}
+
+/*
+NOTE:
+Called when the socket has nothing more to read: the connection gives its buffers back to the pool
+unless they still hold part of a frame or of a message. A buffer that was mostly unused is followed by
+a smaller one.
+*/
+void wsidle(WebSocketReceiver *rx) {
+  if (rx->buffer && rx->start == rx->end) {
+    size_t size = rx->bufsize + 1;
+
+    rx->hint = rx->high < size / 4 && size > WS_RECV_MIN ? size >> 1 : size;
+    wspoolfree(rx->buffer, size);
+    rx->buffer  = NULL;
+    rx->bufsize = 0;
+  }
+  if (!rx->opcode) wsrelinquish(rx);
+}
+
+// Grows the message buffer to at least capacity bytes, on the heap or in the spill file
+int wsgrow(WebSocketServer *server, WebSocketReceiver *rx, size_t capacity) {
+  unsigned char *message;
+  size_t         block = capacity + 1;
+
+  if (server->spill && capacity > server->spill) {
+    if (rx->spill < 0) {
+      int fd = memfd_create("wsmessage", MFD_CLOEXEC);
+
+      if (fd < 0) return 0;
+      if (ftruncate(fd, capacity + 1) ||
+          (message = mmap(NULL, capacity + 1, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+      {
+        close(fd);
+        return 0;
+      }
+      memcpy(message, rx->message, rx->size);
+      if (rx->message) wspoolfree(rx->message, rx->capacity + 1);
+      rx->spill = fd;
+    } else if (ftruncate(rx->spill, capacity + 1) ||
+               (message = mremap(rx->message, rx->capacity + 1, capacity + 1, MREMAP_MAYMOVE)) == MAP_FAILED)
+    {
+      return 0;
+    }
+  } else {
+    if (!(message = wspoolalloc(&block))) return 0;
+    if (rx->message) {
+      memcpy(message, rx->message, rx->size);
+      wspoolfree(rx->message, rx->capacity + 1);
+    }
+    capacity = block - 1;
+  }
+  rx->message  = message;
+  rx->capacity = capacity;
+  return 1;
+}
+
+// Appends unmasked payload to the message being assembled, what goes past maxmessage is dropped
+void wsappend(WebSocketServer *server, WebSocketReceiver *rx, const unsigned char *payload, size_t size) {
+  if (server->maxmessage && rx->size + size > server->maxmessage) {
+    rx->overflow = 1;
+    size         = server->maxmessage - rx->size;
+  }
+  if (rx->size + size > rx->capacity) {
+    // Pool blocks are powers of two, this only matters past the biggest ones
+    size_t capacity = rx->capacity << 1;
+
+    if (capacity < rx->size + size) capacity = rx->size + size;
+    if (server->maxmessage && capacity > server->maxmessage) capacity = server->maxmessage;
+    if (!wsgrow(server, rx, capacity)) {
+      rx->overflow = 1;
+      return;
+    }
+  }
+  wsmask(&rx->message[rx->size], payload, size, rx->mask, rx->phase);
+  rx->size += size;
+}
+
+/*
+NOTE:
+Inflates payload of a compressed message into the message buffer, or hands it to onchunk a piece at a
+time. Once past maxmessage, the rest is still inflated (the context may be kept for the next message)
+but dropped. Returns 0 when the payload cannot be inflated.
+*/
+int wsinflatepayload(WebSocketServer *server, WebSocketConnection *connection, const int client,
+                     const unsigned char *payload, const size_t size, const int last)
+{
+  WebSocketReceiver *rx = &connection->rx;
+  unsigned char      scratch[4096];
+
+  // The trailer left out by the sender follows the last frame
+  for (int pass = 0; pass <= last; pass++) {
+    const unsigned char *input     = pass ? DEFLATE_TRAILER : payload;
+    size_t               remaining = pass ? sizeof(DEFLATE_TRAILER) : size;
+    size_t               produced, capacity;
+
+    do {
+      unsigned char *output = scratch;
+
+      capacity = sizeof(scratch);
+      if (!server->onchunk && !rx->overflow) {
+        size_t limit = server->maxmessage ? server->maxmessage : (size_t)-1;
+
+        if (rx->size == rx->capacity && rx->size < limit) {
+          size_t grow = rx->capacity < WS_RECV_MIN ? WS_RECV_MIN : rx->capacity << 1;
+
+          if (!wsgrow(server, rx, grow < limit ? grow : limit)) rx->overflow = 1;
+        }
+        if (rx->size < rx->capacity && rx->size < limit) {
+          output   = &rx->message[rx->size];
+          capacity = (rx->capacity < limit ? rx->capacity : limit) - rx->size;
+        }
+      }
+      if (wsinflate(&connection->deflate, &input, &remaining, output, capacity, &produced)) return 0;
+      if (server->onchunk) {
+        if (produced) server->onchunk(server, client, output, produced, rx->size, rx->opcode, 0, server->chunkenv);
+        rx->size += produced;
+      } else if (output == scratch) {
+        if (produced) rx->overflow = 1;
+      } else {
+        rx->size += produced;
+      }
+    } while (remaining || produced == capacity);
+  }
+  if (last) {
+    wsinflateend(&connection->deflate);
+    if (server->onchunk) server->onchunk(server, client, scratch, 0, rx->size, rx->opcode, 1, server->chunkenv);
+  }
+  return 1;
+}
+
+void wscountmessage(WebSocketServer *server, WebSocketConnection *connection) {
+  __atomic_add_fetch(&connection->stats.messagesin, 1, __ATOMIC_RELAXED);
+  WS_COUNT(server->counters, messagesin, 1);
+}
+
+// Hands out data that ends with a 0 (the byte it replaces is put back by the next call to wsparse)
+int wsyield(WebSocketReceiver *rx, unsigned char *payload, const size_t size, unsigned char **data, size_t *dsize, const int status) {
+  rx->terminator  = &payload[size];
+  rx->saved       = payload[size];
+  rx->view        = payload;
+  payload[size]   = 0;
+  viewing         = rx;
+  *data           = payload;
+  *dsize          = size;
+  return status;
+}
+
+/*
+NOTE:
+Decodes the frames buffered for the connection. Returns READ_AGAIN when more bytes are needed. For data
+(and READ_PING_TIME) *data and *size designate the payload: it is only valid until the next call.
+Pings are answered on the spot.
+*/
+int wsparse(WebSocketServer *server, WebSocketConnection *connection, const int client, unsigned char **data, size_t *size) {
+  WebSocketReceiver *rx = &connection->rx;
+
+  if (rx->terminator) {
+    *rx->terminator = rx->saved;
+    rx->terminator  = NULL;
+  }
+  rx->view = NULL;
+  if (!rx->buffer) return READ_AGAIN;
+  while (1) {
+    unsigned char *bytes     = &rx->buffer[rx->start];
+    size_t         available = rx->end - rx->start;
+
+    if (rx->state == RECV_HEADER) {
+      size_t needed = 2;
+
+      if (available < needed) return READ_AGAIN;
+      rx->header.bytes = (bytes[0] << 8) | bytes[1];
+      if      (rx->header.length == 126) needed += sizeof(unsigned short);
+      else if (rx->header.length == 127) needed += sizeof(unsigned long long);
+      if (rx->header.mask)               needed += WS_MASK_SIZE;
+      if (available < needed) return READ_AGAIN;
+
+      if (rx->header.length < 126) {
+        rx->remaining = rx->header.length;
+      } else {
+        rx->remaining = 0;
+        for (int i = 2; i < (rx->header.length == 126 ? 4 : 10); i++) rx->remaining = (rx->remaining << 8) | bytes[i];
+      }
+      if (rx->header.mask) memcpy(rx->mask, &bytes[needed - WS_MASK_SIZE], WS_MASK_SIZE);
+      else                 memset(rx->mask, 0, WS_MASK_SIZE);
+      rx->start += needed;
+      rx->phase  = 0;
+      rx->state  = RECV_PAYLOAD;
+      available -= needed;
+      bytes     += needed;
+      __atomic_add_fetch(&connection->stats.framesin, 1, __ATOMIC_RELAXED);
+      WS_COUNT(server->counters, framesin, 1);
+
+      // RSV1 is only valid on the first frame of a message, with permessage-deflate
+      if (rx->header.rsv1 && (!connection->deflate.enabled || (rx->header.opcode != FRAME_TEXT && rx->header.opcode != FRAME_BINARY))) {
+        wslog(server->log, WS_LOG_WARN, "Received a frame with an unexpected RSV1 bit");
+        return READ_FAILURE;
+      }
+      switch (rx->header.opcode) {
+        case FRAME_CLOSE:
+        case FRAME_PING:
+        case FRAME_PONG:
+          if (rx->remaining > FRAME_CONTROL_SIZE || !rx->header.end) {
+            wslog(server->log, WS_LOG_WARN, "Received an invalid control frame");
+            return READ_FAILURE;
+          }
+          rx->csize = 0;
+          break;
+        case FRAME_CONTINUE:
+          if (!rx->opcode) {
+            wslog(server->log, WS_LOG_WARN, "Received a continued frame without previous opcode!");
+            return READ_FAILURE;
+          }
+          break;
+        case FRAME_TEXT:
+        case FRAME_BINARY:
+          if (rx->opcode) {
+            wslog(server->log, WS_LOG_WARN, "Received a new message before the end of the previous one");
+            return READ_FAILURE;
+          }
+          rx->opcode     = rx->header.opcode;
+          rx->compressed = rx->header.rsv1;
+          rx->size       = 0;
+          rx->overflow   = 0;
+          wsunspill(rx);
+          // The whole message is already there: unmask it in place
+          if (rx->header.end && available >= rx->remaining && !server->onchunk && !rx->compressed) {
+            size_t n = rx->remaining;
+
+            if (rx->header.mask) wsmask(bytes, bytes, n, rx->mask, 0);
+            rx->start += n;
+            rx->state  = RECV_HEADER;
+            rx->opcode = 0;
+            wscountmessage(server, connection);
+            return wsyield(rx, bytes, n, data, size, rx->header.opcode);
+          }
+          break;
+        default:
+          wslog(server->log, WS_LOG_WARN, "Fatal error: unimplemented (wsread)");
+          return READ_FAILURE;
+      }
+      continue;
+    }
+
+    // RECV_PAYLOAD
+    {
+      size_t n = rx->remaining < available ? rx->remaining : available;
+
+      if (rx->header.opcode & 0x8) {
+        wsmask(&rx->control[rx->csize], bytes, n, rx->mask, rx->phase);
+        rx->csize += n;
+      } else if (rx->compressed) {
+        int last = rx->header.end && n == rx->remaining;
+
+        if (rx->header.mask) wsmask(bytes, bytes, n, rx->mask, rx->phase);
+        if (!wsinflatepayload(server, connection, client, bytes, n, last)) {
+          wslog(server->log, WS_LOG_WARN, "Received an invalid compressed message");
+          return READ_FAILURE;
+        }
+      } else if (server->onchunk) {
+        // Streaming: the chunk is unmasked in place and handed out as it is
+        int last = rx->header.end && n == rx->remaining;
+
+        if (rx->header.mask) wsmask(bytes, bytes, n, rx->mask, rx->phase);
+        if (n || last) server->onchunk(server, client, bytes, n, rx->size, rx->opcode, last, server->chunkenv);
+        rx->size += n;
+      } else if (!rx->overflow) {
+        wsappend(server, rx, bytes, n);
+      }
+      rx->start     += n;
+      rx->phase     += n;
+      rx->remaining -= n;
+      if (rx->remaining) return READ_AGAIN;
+      rx->state = RECV_HEADER;
+    }
+
+    switch (rx->header.opcode) {
+      case FRAME_CLOSE:
+        // Echo the status code
+        wswrite(server, client, rx->control, rx->csize < 2 ? rx->csize : 2, FRAME_CLOSE);
+        __atomic_store_n(&connection->active, 0, __ATOMIC_RELEASE);
+        wslog(server->log, WS_LOG_INFO, "Connection was closed by client");
+        shutdown(connection->fd, SHUT_RDWR);
+        return READ_CONNECTION_CLOSED_CLIENT;
+      case FRAME_PING:
+        wswrite(server, client, rx->control, rx->csize, FRAME_PONG);
+        break;
+      case FRAME_PONG:
+        {
+          unsigned long long ping = __atomic_exchange_n(&connection->ping, 0, __ATOMIC_RELAXED);
+          unsigned long long rtt  = ping ? wsclock() - ping : 0;
+          long               ms   = (long)(rtt / 1000);
+
+          // An unsolicited pong has no round trip (the ping is answered, see wsdeadline)
+          if (ping) {
+            __atomic_store_n(&connection->stats.rtt, rtt, __ATOMIC_RELAXED);
+            wshistogram(&wscounters(server->counters)->rtt, rtt);
+          }
+          memcpy(rx->control, &ms, sizeof(long));
+          return wsyield(rx, rx->control, sizeof(long), data, size, READ_PING_TIME);
+        }
+      default:
+        if (rx->header.end) {
+          int opcode = rx->opcode;
+
+          rx->opcode = 0;
+          wscountmessage(server, connection);
+          if (server->onchunk) break;
+          if (!rx->message && !wsgrow(server, rx, 0)) return READ_BUFFER_OVERFLOW;
+          return wsyield(rx, rx->message, rx->size, data, size, rx->overflow ? READ_BUFFER_OVERFLOW : opcode);
+        }
+        break;
+    }
+  }
+}
+
+// Receives the next message of the connection (see wsreceive)
+int wsreceivefrom(WebSocketServer *server, WebSocketConnection *connection, const int client, unsigned char **data,
+                  size_t *readbytes, const int wait)
+{
+  // The slot outlives the connection: stop as soon as it was closed (and maybe reused)
+  while (__atomic_load_n(&connection->active, __ATOMIC_ACQUIRE) && __atomic_load_n(&connection->id, __ATOMIC_ACQUIRE) == client) {
+    ssize_t n;
+    int     status = wsparse(server, connection, client, data, readbytes);
+
+    if (status != READ_AGAIN) {
+      // The connection is over, its buffers are of no use anymore
+      if (status < 0 && status != READ_BUFFER_OVERFLOW) {
+        wsdrop(&connection->rx);
+        wsinflaterelease(&connection->deflate);
+      }
+      return status;
+    }
+    if (wait == RECEIVE_FED && !connection->tls.fed) {
+      wsidle(&connection->rx);
+      return READ_AGAIN;
+    }
+
+    if ((n = wsfill(connection)) > 0) {
+      wsseen(server, connection);
+      __atomic_add_fetch(&connection->stats.bytesin, n, __ATOMIC_RELAXED);
+      WS_COUNT(server->counters, bytesin, n);
+      continue;
+    }
+    if (__atomic_load_n(&connection->id, __ATOMIC_ACQUIRE) != client) break;
+    if (!n || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      __atomic_store_n(&connection->active, 0, __ATOMIC_RELEASE);
+      wsdrop(&connection->rx);
+      wsinflaterelease(&connection->deflate);
+      wslog(server->log, WS_LOG_WARN, "Connection was closed by client unexpectedly");
+      return READ_CONNECTION_CLOSED_CLIENT;
+    }
+    // Nothing more to read for now: an idle connection holds no buffer
+    wsidle(&connection->rx);
+    if (!wait || wait == RECEIVE_FED) return READ_AGAIN;
+    {
+      // poll rather than select: descriptors can go past FD_SETSIZE with many connections
+      struct pollfd input = { __atomic_load_n(&connection->fd, __ATOMIC_ACQUIRE), POLLIN, 0 };
+      if (poll(&input, 1, WS_TIMEOUT) < 0 && errno != EINTR) {
+        __atomic_store_n(&connection->active, 0, __ATOMIC_RELEASE);
+        wsdrop(&connection->rx);
+        wsinflaterelease(&connection->deflate);
+        wslog(server->log, WS_LOG_INFO, "Connection was closed by server");
+        return READ_CONNECTION_CLOSED_SERVER;
+      }
+    }
+  }
+  return READ_CONNECTION_CLOSED_SERVER;
+}
+
+// When wait is 0, returns READ_AGAIN instead of waiting for the socket, when it is RECEIVE_FED, the
+// socket is not read at all (the bytes are fed by the caller)
+int wsreceive(WebSocketServer *server, const int client, unsigned char **data, size_t *readbytes, const int wait) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  int                  status     = READ_CONNECTION_CLOSED_SERVER;
+
+  *data      = NULL;
+  *readbytes = 0;
+  if (!connection) {
+    // Closed while the reader held a view: it is done with it now
+    if (client >= 0 && (connection = wsslot(server, client & WS_SLOT_MASK)) &&
+        __atomic_load_n(&connection->stale, __ATOMIC_SEQ_CST) == client)
+    {
+      wsreceived(connection, client);
+    }
+    return READ_CONNECTION_CLOSED_SERVER;
+  }
+  if (wsreceiving(connection, client)) status = wsreceivefrom(server, connection, client, data, readbytes, wait);
+  // A view stays the reader's until its next call
+  if (!*data) wsreceived(connection, client);
+  return status;
+}
+
+// Copies the message out of the connection buffers
+int wscopy(unsigned char *data, size_t size, int status, unsigned char *buffer, const size_t maxbytes, size_t *readbytes) {
+  *readbytes = 0;
+  if (data) {
+    *readbytes = size < maxbytes ? size : maxbytes;
+    memcpy(buffer, data, *readbytes);
+    if (size > maxbytes) return READ_BUFFER_OVERFLOW;
+  }
+  return status;
+}
+
+int wsread(WebSocketServer *server, const int client, unsigned char *buffer, const size_t maxbytes, size_t *readbytes) {
+  unsigned char *data;
+  size_t         size;
+  int            status = wsreceive(server, client, &data, &size, 1);
+
+  return wscopy(data, size, status, buffer, maxbytes, readbytes);
+}
+
+int wstryread(WebSocketServer *server, const int client, unsigned char *buffer, const size_t maxbytes, size_t *readbytes) {
+  unsigned char *data;
+  size_t         size;
+  int            status = wsreceive(server, client, &data, &size, 0);
+
+  return wscopy(data, size, status, buffer, maxbytes, readbytes);
+}
+
+int wsreadview(WebSocketServer *server, const int client, unsigned char **data, size_t *readbytes) {
+  return wsreceive(server, client, data, readbytes, 1);
+}
+
+int wstryreadview(WebSocketServer *server, const int client, unsigned char **data, size_t *readbytes) {
+  return wsreceive(server, client, data, readbytes, 0);
+}
+
+int wsnextview(WebSocketServer *server, const int client, unsigned char **data, size_t *readbytes) {
+  return wsreceive(server, client, data, readbytes, RECEIVE_FED);
+}
+
+// Takes the receive buffer the view is in, what is left to parse is moved to a new one (tail bytes)
+int wsretainbuffer(WebSocketReceiver *rx, WebSocketMessage *message, const size_t tail) {
+  size_t         size   = rx->bufsize + 1;
+  unsigned char *buffer = NULL;
+
+  if (tail) {
+    if (!(buffer = wspoolalloc(&size))) return 0;
+    memcpy(buffer, &rx->buffer[rx->start], tail);
+    // The first byte was replaced by the terminator of the message
+    buffer[0] = rx->saved;
+  }
+  message->buffer  = rx->buffer;
+  message->bufsize = rx->bufsize + 1;
+  rx->buffer       = buffer;
+  rx->bufsize      = buffer ? size - 1 : 0;
+  rx->start        = 0;
+  rx->end          = tail;
+  rx->high         = tail;
+  return 1;
+}
+
+// Takes the message buffer the view is in (the message is complete, the next one gets a new buffer)
+void wsretainmessage(WebSocketReceiver *rx, WebSocketMessage *message) {
+  message->buffer  = rx->message;
+  message->bufsize = rx->capacity + 1;
+  message->spill   = rx->spill;
+  rx->message      = NULL;
+  rx->capacity     = 0;
+  rx->spill        = -1;
+}
+
+WebSocketMessage *wsretain(WebSocketServer *server, const int client, const unsigned char *data, const size_t size) {
+  WebSocketConnection *connection = wsconnection(server, client);
+  WebSocketReceiver   *rx         = connection ? &connection->rx : NULL;
+  // Only the thread that parsed the view may touch the receiver
+  int                  viewed     = rx && rx == viewing && data && data == rx->view;
+  int                  inbuffer   = viewed && rx->buffer && data >= rx->buffer && data < &rx->buffer[rx->bufsize + 1] &&
+                                    rx->end - rx->start <= size;
+  int                  inmessage  = viewed && data == rx->message;
+  size_t               block      = sizeof(WebSocketMessage) + (inbuffer || inmessage ? 0 : size + 1);
+  WebSocketMessage    *message    = wspoolalloc(&block);
+
+  if (!message) return NULL;
+  message->refs    = 1;
+  message->block   = block;
+  message->size    = size;
+  message->buffer  = NULL;
+  message->bufsize = 0;
+  message->spill   = -1;
+  if (inbuffer || inmessage) {
+    if (inmessage) {
+      wsretainmessage(rx, message);
+    } else if (!wsretainbuffer(rx, message, rx->end - rx->start)) {
+      wspoolfree(message, block);
+      return NULL;
+    }
+    // The terminator stays with the message
+    rx->terminator = NULL;
+    rx->view       = NULL;
+    message->data  = (unsigned char*)data;
+  } else {
+    message->data = (unsigned char*)&message[1];
+    if (size) memcpy(message->data, data, size);
+    message->data[size] = 0;
+  }
+  return message;
+}
+
+WebSocketMessage *wsmessageretain(WebSocketMessage *message) {
+  if (message) __atomic_add_fetch(&message->refs, 1, __ATOMIC_RELAXED);
+  return message;
+}
+
+void wsmessagerelease(WebSocketMessage *message) {
+  if (message && !__atomic_sub_fetch(&message->refs, 1, __ATOMIC_ACQ_REL)) {
+    if (message->spill >= 0) {
+      munmap(message->buffer, message->bufsize);
+      close(message->spill);
+    } else if (message->buffer) {
+      wspoolfree(message->buffer, message->bufsize);
+    }
+    wspoolfree(message, message->block);
+  }
+}
+
+// Answers a plain request for the metrics of the server, returns 2 once they were sent (1 otherwise)
+int wsscrape(WebSocketServer *server, WebSocketConnection *connection, const HttpParser *parser) {
+  char         header[WS_RESPONSE_SIZE];
+  size_t       block = WS_METRICS_SIZE;
+  char        *body;
+  struct iovec iov[2];
+  int          sent;
+
+  if (parser->file.size != strlen(WS_METRICS_PATH) || memcmp(parser->file.data, WS_METRICS_PATH, parser->file.size)) return 1;
+  if (!(body = wspoolalloc(&block))) return 1;
+  WS_COUNT(server->counters, scrapes, 1);
+  iov[1].iov_base = body;
+  iov[1].iov_len  = wsmetrics(server, body, block);
+  iov[0].iov_base = header;
+  iov[0].iov_len  = snprintf(header, sizeof(header),
+                             "%.*s %d %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                             (int)parser->version.size, parser->version.data, HTTP_OK, HTTP_OK_M, iov[1].iov_len);
+  sent = wssendv(connection, iov, 2) >= 0;
+  wspoolfree(body, block);
+  return sent ? 2 : 1;
+}
+
+// Reads a head until its blank line (it may come in several pieces) and parses it where it was read,
+// returns its size (or HTTP_INVALID), *size is set to how much was read
+int wsreadhead(WebSocketConnection *connection, HttpParser *parser, char *head, const size_t capacity, size_t *size) {
+  int length = HTTP_INCOMPLETE;
+
+  *size = 0;
+  while (length == HTTP_INCOMPLETE) {
+    struct pollfd input = { connection->fd, POLLIN, 0 };
+    ssize_t       n;
+
+    if (*size == capacity) return HTTP_INVALID;
+    if ((n = wstlsrecv(&connection->tls, connection->fd, &head[*size], capacity - *size)) > 0) {
+      *size += n;
+      length = httpparse(parser, head, *size);
+    } else if (!n || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      return HTTP_INVALID;
+    } else if (errno != EINTR && poll(&input, 1, WS_TIMEOUT) <= 0) {
+      return HTTP_INVALID;
+    }
+  }
+  return length;
+}
+
+// Keeps what came after the head (the first frames) in the receive buffer, returns 0 if it could not
+int wskeep(WebSocketConnection *connection, const char *head, const size_t length, const size_t size) {
+  WebSocketReceiver *rx = &connection->rx;
+
+  if (length == size) return 1;
+  if (!wsresize(rx, WS_REQUEST_SIZE)) return 0;
+  memcpy(rx->buffer, &head[length], size - length);
+  rx->end = rx->high = size - length;
+  return 1;
+}
+
+// Sec-WebSocket-Accept for the key (as base64)
+void wsacceptkey(const char *key, unsigned char *accept) {
+  char          salted[WS_KEY_SIZE + 36];
+  unsigned char digest[SHA_DIGEST_LENGTH];
+
+  SHA1((unsigned char*)salted, snprintf(salted, sizeof(salted), "%s%s", key, SOCKET_MAGIC_STR), digest);
+  EVP_EncodeBlock(accept, digest, SHA_DIGEST_LENGTH);
+}
+
+// Reads what the socket holds of a request without waiting (or only parses what was fed, see wsfeed),
+// parsed where it stopped, returns like httpparse (HTTP_INVALID once the request fills its buffer)
+int wsreadshake(WebSocketConnection *connection, WebSocketShake *shake) {
+  int length = httpparse(&shake->parser, shake->request, shake->size);
+
+  while (length == HTTP_INCOMPLETE && shake->size < WS_REQUEST_SIZE) {
+    ssize_t n;
+
+    // Fed ciphertext is still to be decrypted
+    if (shake->fed && !wstlsciphered(&connection->tls)) return HTTP_INCOMPLETE;
+    if ((n = wstlsrecv(&connection->tls, connection->fd, &shake->request[shake->size], WS_REQUEST_SIZE - shake->size)) > 0) {
+      shake->size += n;
+      length       = httpparse(&shake->parser, shake->request, shake->size);
+    } else if (!n || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      return HTTP_INVALID;
+    } else if (errno != EINTR) {
+      return HTTP_INCOMPLETE;
+    }
+  }
+  return length == HTTP_INCOMPLETE ? HTTP_INVALID : length;
+}
+
+// Answers a request (parsed), returns 0 once the connection is upgraded, 2 if it was for the metrics
+// (served) and 1 otherwise
+int wsupgrade(WebSocketServer *server, WebSocketConnection *connection, const HttpParser *parser) {
+  char            response[WS_RESPONSE_SIZE];
+  char            accepted[DEFLATE_RESPONSE_SIZE];
+  unsigned char   accept[WS_ACCEPT_SIZE];
+  const HttpSpan *field;
+  struct iovec    iov;
+  int             extension;
+
+  if (parser->method != HTTP_GET) return 1;
+  if (!httpfield(parser, "Upgrade")) return server->metrics ? wsscrape(server, connection, parser) : 1;
+  if (!(field = httpfield(parser, "Connection")) || !httptoken(field, "upgrade"))   return 1;
+  if (!(field = httpfield(parser, "Upgrade"))    || !httptoken(field, "websocket")) return 1;
+  if (!(field = httpfield(parser, "Sec-WebSocket-Key")) || !field->size || field->size >= WS_KEY_SIZE) return 1;
+  memcpy(connection->key, field->data, field->size);
+  connection->key[field->size] = 0;
+  // The value is followed by the end of its line, atoi stops there
+  connection->version = (field = httpfield(parser, "Sec-WebSocket-Version")) ? atoi(field->data) : 0;
+  field     = httpfield(parser, "Sec-WebSocket-Extensions");
+  extension = field && wsdeflatenegotiate(&server->deflate, field->data, field->size, &connection->deflate, accepted);
+
+  // Response
+  wsacceptkey(connection->key, accept);
+  iov.iov_base = response;
+  iov.iov_len  = snprintf(response, sizeof(response),
+                          "%.*s %d %s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n%s%s%s\r\n",
+                          (int)parser->version.size, parser->version.data, HTTP_SWITCH, HTTP_SWITCH_M, accept,
+                          extension ? "Sec-WebSocket-Extensions: " : "", extension ? accepted : "", extension ? "\r\n" : "");
+  return wssendv(connection, &iov, 1) < 0;
+}
+
+/*
+NOTE:
+The request is read until its blank line (a client may send it in several pieces) and parsed where it
+was read, nothing is allocated. Whatever the client sent after the request (its first frames) is kept
+in the receive buffer.
+*/
+int handshake(WebSocketServer *server, WebSocketConnection *connection) {
+  char       request[WS_REQUEST_SIZE];
+  HttpParser parser;
+  size_t     size;
+  int        length;
+  int        status;
+
+  httpparserinit(&parser);
+  if ((length = wsreadhead(connection, &parser, request, sizeof(request), &size)) < 0) return 1;
+  if ((status = wsupgrade(server, connection, &parser))) return status;
+  return !wskeep(connection, request, length, size);
+}
+
+/*
+NOTE:
+The client side of the handshake: the request goes out with a random key, the response has to switch
+protocols and accept that key. No extension is asked for, none can be in the response. Whatever the
+server sent after its response is kept in the receive buffer, like the frames that come with a request.
+*/
+int clienthandshake(WebSocketServer *server, WebSocketConnection *connection, const char *host, const short port, const char *path) {
+  char            request[WS_REQUEST_SIZE];
+  char            response[WS_REQUEST_SIZE];
+  unsigned char   nonce[WS_NONCE_SIZE];
+  unsigned char   accept[WS_ACCEPT_SIZE];
+  HttpParser      parser;
+  const HttpSpan *field;
+  struct iovec    iov;
+  size_t          size;
+  int             length;
+
+  if (getrandom(nonce, sizeof(nonce), 0) != sizeof(nonce)) return 1;
+  EVP_EncodeBlock((unsigned char*)connection->key, nonce, sizeof(nonce));
+  iov.iov_base = request;
+  iov.iov_len  = snprintf(request, sizeof(request),
+                          "GET %s HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n\r\n",
+                          path, host, (unsigned short)port, connection->key);
+  if (iov.iov_len >= sizeof(request) || wssendv(connection, &iov, 1) < 0) return 1;
+
+  httpresponseinit(&parser);
+  length = wsreadhead(connection, &parser, response, sizeof(response), &size);
+  if (length < 0) {
+    wslog(server->log, WS_LOG_WARN, "No response from %s:%d", host, (unsigned short)port);
+    return 1;
+  }
+  if (parser.status != HTTP_SWITCH) {
+    wslog(server->log, WS_LOG_WARN, "%s:%d did not switch protocols (%d)", host, (unsigned short)port, parser.status);
+    return 1;
+  }
+  wsacceptkey(connection->key, accept);
+  if (!(field = httpfield(&parser, "Connection")) || !httptoken(field, "upgrade")   ||
+      !(field = httpfield(&parser, "Upgrade"))    || !httptoken(field, "websocket") ||
+      httpfield(&parser, "Sec-WebSocket-Extensions") ||
+      !(field = httpfield(&parser, "Sec-WebSocket-Accept")) || field->size != strlen((char*)accept) ||
+      memcmp(field->data, accept, field->size))
+  {
+    wslog(server->log, WS_LOG_WARN, "%s:%d sent an invalid handshake response", host, (unsigned short)port);
+    return 1;
+  }
+  connection->version = 13;
+  return !wskeep(connection, response, length, size);
+}
+
+// The server is closing, and so are its connections
+int wsclosing(WebSocketServer *server) {
+  for (int i = wsnext(server, -1); i >= 0; i = wsnext(server, i)) wsclose(server, i);
+  wslog(server->log, WS_LOG_INFO, "Closing server");
+  return CONNECTION_CLOSED;
+}
+
+int wsaccept(WebSocketServer *server) {
+  struct pollfd wait[2] = { { .fd = server->fd, .events = POLLIN }, { .fd = server->wake, .events = POLLIN } };
+  int           client  = CONNECTION_AGAIN;
+
+  while (client == CONNECTION_AGAIN) {
+    // An inherited socket is not shut down (see wsshutdown): the wake-up of the server is waited on along
+    // with it, and the connections still queued are left to the next server
+    if (server->inherited) {
+      if (poll(wait, 2, -1) < 0 && errno != EINTR) {
+        wslog(server->log, WS_LOG_ERROR, "Cannot accept");
+        return CONNECTION_FAILURE;
+      }
+      if (__atomic_load_n(&server->close, __ATOMIC_ACQUIRE)) return wsclosing(server);
+    }
+    client = wsacceptfrom(server, server->fd);
+  }
+  return client;
+}
+
+// Takes a connection from one of the listening sockets of the server, returns its socket (or fails like
+// wsaccept)
+int wsacceptsocket(WebSocketServer *server, const int listener) {
+  int client_fd;
+
+  if ((client_fd = accept(listener, NULL, NULL)) < 0) {
+    if (__atomic_load_n(&server->close, __ATOMIC_ACQUIRE)) return wsclosing(server);
+    // A nonblocking socket that another thread accepted from first (or whose client is already gone)
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) return CONNECTION_AGAIN;
+    wslog(server->log, WS_LOG_ERROR, "Cannot accept");
+    return CONNECTION_FAILURE;
+  }
+  return client_fd;
+}
+
+// Accepts a connection from one of the listening sockets of the server
+int wsacceptfrom(WebSocketServer *server, const int listener) {
+  int client_fd = wsacceptsocket(server, listener);
+
+  return client_fd < 0 ? client_fd : wsadopt(server, client_fd);
+}
+
+void wscounttls(WebSocketServer *server, WebSocketConnection *connection) {
+  if (connection->tls.ssl) {
+    WS_COUNT(server->counters, tlshandshakes, 1);
+    WS_COUNT(server->counters, tlsresumed, connection->tls.resumed);
+    WS_COUNT(server->counters, tlsoffloaded, (connection->tls.kernel & WS_TLS_SEND) != 0);
+  }
+}
+
+// Registers a connection that went through its handshake (status is what it returned, 0 once done) or
+// releases its slot. Returns its ID, or CONNECTION_BAD_HANDSHAKE.
+int wsregister(WebSocketServer *server, WebSocketConnection *connection, const unsigned long long start, const int status) {
+  int client;
+
+  // The timer is unset before the socket is let go of (see wstimersrun)
+  __atomic_store_n(&connection->shaking, 0, __ATOMIC_RELEASE);
+  wsarm(server, connection, -1, 0);
+  if (status) {
+    wstlsclose(&connection->tls);
+    __atomic_store_n(&connection->active, 0, __ATOMIC_RELEASE);
+    connection->fd = -1;
+    wsrelease(server, connection);
+    return CONNECTION_BAD_HANDSHAKE;
+  }
+  client = (connection->generation << WS_SLOT_BITS) | connection->slot;
+  wshistogram(&wscounters(server->counters)->handshake, wsclock() - start);
+  __atomic_add_fetch(&server->registry.count, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&connection->seen, wsclock(), __ATOMIC_RELAXED);
+  __atomic_store_n(&connection->id, client, __ATOMIC_RELEASE);
+  if (wstiming(server) && wstimers(server)) wsarm(server, connection, client, wsdeadline(server, connection, connection->seen));
+  return client;
+}
+
+// Does the handshake of a reserved connection (the client side when there is a path), the TLS one first
+// when the server is secure, then registers it. Returns its ID, or CONNECTION_BAD_HANDSHAKE once the slot
+// is released (*status has what the handshake returned).
+int wsestablish(WebSocketServer *server, WebSocketConnection *connection, const char *host, const short port, const char *path,
+                int *status)
+{
+  unsigned long long start = wsclock();
+
+  // A handshake that takes too long gets its socket shut down (see wstimersrun)
+  __atomic_store_n(&connection->shaking, 1, __ATOMIC_RELEASE);
+  if (server->handshaketimeout && wstimers(server)) wsarm(server, connection, -1, start + server->handshaketimeout * 1000ULL);
+  *status = server->tls ? wstlsopen(server->tls, &connection->tls, connection->fd, path ? host : NULL, port, WS_TIMEOUT) : 0;
+  wscounttls(server, connection);
+  if (!*status) *status = path ? clienthandshake(server, connection, host, port, path) : handshake(server, connection);
+  return wsregister(server, connection, start, *status);
+}
+
+// Says how the handshake of an accepted socket went (status is what it returned), closes the socket if
+// it failed. Returns client.
+int wsadopted(WebSocketServer *server, const int client_fd, const int client, const int status) {
+  if (client >= 0) {
+    wslog(server->log, WS_LOG_INFO, "Connection with client %d success", client);
+  } else if (status == 2) {
+    // Metrics were served, the request was not for a WebSocket
+    wslog(server->log, WS_LOG_INFO, "Metrics sent");
+    close(client_fd);
+  } else if (client == CONNECTION_BAD_HANDSHAKE) {
+    WS_COUNT(server->counters, handshakefailures, 1);
+    wslog(server->log, WS_LOG_WARN, "Failed to perform handshake");
+    close(client_fd);
+  } else {
+    WS_COUNT(server->counters, refused, 1);
+    wslog(server->log, WS_LOG_WARN, "Max connections reached");
+    close(client_fd);
+  }
+  return client;
+}
+
+// Takes a slot for an accepted socket
+WebSocketConnection *wsaccepted(WebSocketServer *server, const int client_fd) {
+  WebSocketConnection *connection;
+
+  WS_COUNT(server->counters, accepts, 1);
+  if ((connection = wsreserve(server))) {
+    connection->shard   = 0;
+    connection->paused  = 0;
+    connection->masking = 0;
+    connection->fd      = client_fd;
+    __atomic_store_n(&connection->active, 1, __ATOMIC_RELEASE);
+  }
+  return connection;
+}
+
+int wsadopt(WebSocketServer *server, const int client_fd) {
+  WebSocketConnection *connection = wsaccepted(server, client_fd);
+  int                  client     = CONNECTION_MAX_READCHED;
+  int                  status     = 0;
+
+  if (connection) client = wsestablish(server, connection, NULL, 0, NULL, &status);
+  return wsadopted(server, client_fd, client, status);
+}
+
+int wsgreet(WebSocketServer *server, const int client_fd, ExpireCallback expire, void *environment) {
+  WebSocketConnection *connection = wsaccepted(server, client_fd);
+  WebSocketShake      *shake      = NULL;
+  size_t               block      = sizeof(WebSocketShake);
+  unsigned long long   start      = wsclock();
+  int                  status     = 0;
+
+  if (!connection || !(shake = wspoolalloc(&block))) {
+    if (connection) wsrelease(server, connection);
+    return wsadopted(server, client_fd, CONNECTION_MAX_READCHED, 0);
+  }
+  httpparserinit(&shake->parser);
+  shake->start       = start;
+  shake->block       = block;
+  shake->size        = 0;
+  shake->fed         = 0;
+  shake->expire      = expire;
+  shake->environment = environment;
+  // The request (and the TLS handshake before it) is read as it comes in, the deadline is what keeps a
+  // client from holding on to the slot
+  fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+  __atomic_store_n(&connection->shaking, 1, __ATOMIC_RELEASE);
+  if (server->handshaketimeout && wstimers(server)) wsarm(server, connection, -1, start + server->handshaketimeout * 1000ULL);
+  if (server->tls && (status = wstlsinit(server->tls, &connection->tls, client_fd, NULL, 0))) {
+    wspoolfree(shake, block);
+    return wsadopted(server, client_fd, wsregister(server, connection, start, status), status);
+  }
+  shake->tls = connection->tls.ssl != NULL;
+  __atomic_store_n(&connection->shake, shake, __ATOMIC_RELEASE);
+  return (connection->generation << WS_SLOT_BITS) | connection->slot;
+}
+
+// Lets go of the handshake that a reactor went on with, the connection is then registered (status 0) or
+// closed, returns like wsaccept
+int wsshaken(WebSocketServer *server, WebSocketConnection *connection, const int status) {
+  WebSocketShake     *shake     = connection->shake;
+  int                 client_fd = connection->fd;
+  unsigned long long  start     = shake->start;
+
+  // The timer is unset before the state goes (see wstimersrun)
+  __atomic_store_n(&connection->shaking, 0, __ATOMIC_RELEASE);
+  wsarm(server, connection, -1, 0);
+  __atomic_store_n(&connection->shake, NULL, __ATOMIC_RELEASE);
+  wspoolfree(shake, shake->block);
+  // A receive that io_uring has going on the socket only ends with it (closing it is not enough)
+  if (status) shutdown(client_fd, SHUT_RDWR);
+  return wsadopted(server, client_fd, wsregister(server, connection, start, status), status);
+}
+
+int wsshake(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection = wsshaking(server, client);
+  WebSocketShake      *shake;
+  int                  length;
+  int                  status;
+
+  if (!connection) return CONNECTION_CLOSED;
+  shake = connection->shake;
+  if (shake->tls) {
+    if ((status = wstlsstep(&connection->tls, connection->fd, WS_TIMEOUT)) < 0) return CONNECTION_AGAIN;
+    if (status) return wsshaken(server, connection, status);
+    shake->tls = 0;
+    wscounttls(server, connection);
+  }
+  if ((length = wsreadshake(connection, shake)) == HTTP_INCOMPLETE) return CONNECTION_AGAIN;
+  status = length < 0 ? 1 : wsupgrade(server, connection, &shake->parser);
+  if (!status && !wskeep(connection, shake->request, length, shake->size)) status = 1;
+  return wsshaken(server, connection, status);
+}
+
+void wsunshake(WebSocketServer *server, const int client) {
+  WebSocketConnection *connection = wsshaking(server, client);
+
+  if (connection) wsshaken(server, connection, 1);
+}
+
+// Connects to the first address of the host that answers within WS_TIMEOUT, returns the socket (or -1)
+int wsconnectto(WebSocketServer *server, const char *host, const short port) {
+  struct addrinfo  hints;
+  struct addrinfo *addresses;
+  char             service[8];
+  int              fd = -1;
+
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(service, sizeof(service), "%d", (unsigned short)port);
+  if (getaddrinfo(host, service, &hints, &addresses)) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot resolve %s", host);
+    return -1;
+  }
+  for (struct addrinfo *address = addresses; address && fd < 0; address = address->ai_next) {
+    struct pollfd output;
+    int           error = 0;
+
+    if ((fd = socket(address->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) continue;
+    output.fd     = fd;
+    output.events = POLLOUT;
+    if (connect(fd, address->ai_addr, address->ai_addrlen) < 0 &&
+        (errno != EINPROGRESS || poll(&output, 1, WS_TIMEOUT) <= 0 ||
+         getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &(socklen_t){sizeof(int)}) < 0 || error))
+    {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot connect to %s:%d", host, (unsigned short)port);
+    return -1;
+  }
+  // Like the sockets that are accepted, reads and writes say when they should not wait
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  // Each frame goes out in a single write (header and payload together), there is nothing to coalesce
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+  return fd;
+}
+
+int wsdial(WebSocketServer *server, const char *host, const short port, const char *path) {
+  int                  client = CONNECTION_MAX_READCHED;
+  int                  fd     = wsconnectto(server, host, port);
+  WebSocketConnection *connection;
+  int                  status = 0;
+
+  if (fd < 0) return CONNECTION_FAILURE;
+  if ((connection = wsreserve(server))) {
+    // No reactor serves it until it is joined to one (see wsreactorjoin)
+    connection->shard   = -1;
+    connection->paused  = 0;
+    connection->masking = 1;
+    connection->fd      = fd;
+    __atomic_store_n(&connection->active, 1, __ATOMIC_RELEASE);
+    client = wsestablish(server, connection, host, port, path ? path : "/", &status);
+  }
+  if (client >= 0) {
+    wslog(server->log, WS_LOG_INFO, "Connection to %s:%d as client %d success", host, (unsigned short)port, client);
+  } else if (client == CONNECTION_BAD_HANDSHAKE) {
+    WS_COUNT(server->counters, handshakefailures, 1);
+    wslog(server->log, WS_LOG_WARN, "Failed to perform handshake with %s:%d", host, (unsigned short)port);
+    close(fd);
+  } else {
+    wslog(server->log, WS_LOG_WARN, "Max connections reached");
+    close(fd);
+  }
+  return client;
+}
+
+void wsclose(WebSocketServer *server, int client) {
+  WebSocketConnection *connection = wsconnection(server, client);
+
+  if (connection) {
+    pthread_mutex_lock(&connection->lock);
+    if (connection->id != client) {
+      // Closed by another thread in the meantime
+      pthread_mutex_unlock(&connection->lock);
+      return;
+    }
+    __atomic_store_n(&connection->id, -1, __ATOMIC_RELEASE);
+    __atomic_store_n(&connection->active, 0, __ATOMIC_RELEASE);
+    // The receive side goes back now, or once its reader is done with it (see wsreceived)
+    __atomic_store_n(&connection->stale, client, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&connection->receiving, __ATOMIC_SEQ_CST)) wsdropstale(connection, client);
+    // What the socket takes right away still goes out (e.g. the reply to a close), the rest is dropped
+    wsdrain(server, connection, NULL);
+    wsdiscard(&connection->tx);
+    connection->tx.poll = -1;
+    wstlsclose(&connection->tls);
+    shutdown(connection->fd, SHUT_RDWR);
+    close(connection->fd);
+    __atomic_store_n(&connection->fd, -1, __ATOMIC_RELEASE);
+    wsdeflaterelease(&connection->deflate);
+    __atomic_sub_fetch(&server->registry.count, 1, __ATOMIC_RELAXED);
+    WS_COUNT(server->counters, closes, 1);
+    pthread_mutex_unlock(&connection->lock);
+    wsarm(server, connection, -1, 0);
+    wstopicsleave(server, connection);
+    wsrelease(server, connection);
+  }
+}
+
+// Stats
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+void wsstats(WebSocketServer *server, WebSocketStats *stats) {
+  wscountersum(server->counters, &stats->total);
+  stats->connections = wscount(server);
+  stats->queued      = 0;
+  for (int i = wsnext(server, -1); i >= 0; i = wsnext(server, i)) {
+    WebSocketConnection *connection = wsconnection(server, i);
+    if (connection) stats->queued += __atomic_load_n(&connection->tx.bytes, __ATOMIC_RELAXED);
+  }
+}
+
+int wsclientstats(WebSocketServer *server, const int client, WebSocketConnectionStats *stats) {
+  WebSocketConnection *connection = wsconnection(server, client);
+
+  if (!connection) return -1;
+  stats->framesin    = __atomic_load_n(&connection->stats.framesin,    __ATOMIC_RELAXED);
+  stats->framesout   = __atomic_load_n(&connection->stats.framesout,   __ATOMIC_RELAXED);
+  stats->bytesin     = __atomic_load_n(&connection->stats.bytesin,     __ATOMIC_RELAXED);
+  stats->bytesout    = __atomic_load_n(&connection->stats.bytesout,    __ATOMIC_RELAXED);
+  stats->messagesin  = __atomic_load_n(&connection->stats.messagesin,  __ATOMIC_RELAXED);
+  stats->messagesout = __atomic_load_n(&connection->stats.messagesout, __ATOMIC_RELAXED);
+  stats->rtt         = __atomic_load_n(&connection->stats.rtt,         __ATOMIC_RELAXED);
+  stats->since       = connection->stats.since;
+  stats->queued      = __atomic_load_n(&connection->tx.bytes,          __ATOMIC_RELAXED);
+  // The slot may have been taken over while it was read
+  return __atomic_load_n(&connection->id, __ATOMIC_ACQUIRE) == client ? 0 : -1;
+}
+
+size_t wsmetrics(WebSocketServer *server, char *buffer, const size_t size) {
+  WebSocketStats stats;
+
+  wsstats(server, &stats);
+  return wsstatsformat(&stats, buffer, size);
+}
+
+// Gives up on a server that could not be set up, once the reason is written out
+WebSocketServer *wsabandon(WebSocketServer *server, const int fd, const char *reason) {
+  wslog(server->log, WS_LOG_ERROR, "%s", reason);
+  if (fd >= 0) close(fd);
+  wslogclose(server->log);
+  wscountersfree(server->counters);
+  free(server);
+  return NULL;
+}
+
+// The server without its listening socket
+WebSocketServer *wscreate(FILE *messages, FILE *errors) {
+  WebSocketServer *server = malloc(sizeof(WebSocketServer));
+  if (server) {
+    server->port             = 0;
+    server->fd               = -1;
+    server->close            = 0;
+    server->nlisteners       = 0;
+    server->addrlen          = 0;
+    server->inherited        = 0;
+    server->wake             = -1;
+    server->maxmessage       = WS_MAX_MESSAGE;
+    server->spill            = 0;
+    server->onchunk          = NULL;
+    server->chunkenv         = NULL;
+    wsdeflatedefaults(&server->deflate);
+    server->highwater        = WS_QUEUE_HIGH;
+    server->lowwater         = WS_QUEUE_LOW;
+    server->overflow         = WS_OVERFLOW_BLOCK;
+    server->ondrain          = NULL;
+    server->drainenv         = NULL;
+    server->metrics          = 0;
+    server->handshaketimeout = WS_TIMEOUT;
+    server->keepalive        = 0;
+    server->pongtimeout      = 0;
+    server->idletimeout      = 0;
+    server->tls              = NULL;
+    server->counters         = wscountersalloc();
+    server->log              = wslogopen(messages, errors);
+    if (!server->counters || !server->log) {
+      wscountersfree(server->counters);
+      wslogclose(server->log);
+      free(server);
+      return NULL;
+    }
+    server->messages   = messages;
+    server->errors     = errors;
+    memset(&server->address, 0, sizeof(struct sockaddr_storage));
+    memset(&server->registry, 0, sizeof(WebSocketRegistry));
+    server->registry.head = WS_SLOT_NONE;
+    server->registry.tail = WS_SLOT_NONE;
+    pthread_mutex_init(&server->registry.lock, NULL);
+    memset(&server->broadcast, 0, sizeof(WebSocketBroadcast));
+    pthread_mutex_init(&server->broadcast.call, NULL);
+    pthread_mutex_init(&server->broadcast.lock, NULL);
+    pthread_cond_init(&server->broadcast.wake, NULL);
+    pthread_cond_init(&server->broadcast.done, NULL);
+    memset(&server->writer, 0, sizeof(WebSocketWriter));
+    server->writer.fd   = -1;
+    server->writer.wake = -1;
+    pthread_mutex_init(&server->writer.lock, NULL);
+    memset(&server->timers, 0, sizeof(WebSocketTimers));
+    pthread_mutex_init(&server->timers.lock, NULL);
+    {
+      pthread_condattr_t attributes;
+
+      // Ticks are counted on the monotonic clock
+      pthread_condattr_init(&attributes);
+      pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+      pthread_cond_init(&server->timers.wake, &attributes);
+      pthread_condattr_destroy(&attributes);
+    }
+    memset(&server->topics, 0, sizeof(WebSocketTopics));
+    {
+      pthread_rwlockattr_t attributes;
+
+      // Publications share the lock, subscriptions should not wait for them to pause
+      pthread_rwlockattr_init(&attributes);
+      pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+      pthread_rwlock_init(&server->topics.lock, &attributes);
+      pthread_rwlockattr_destroy(&attributes);
+    }
+  }
+  return server;
+}
+
+WebSocketServer *wsstart(const short port, FILE *messages, FILE *errors) {
+  WebSocketServer    *server = wscreate(messages, errors);
+  struct sockaddr_in *address;
+  int                 server_fd;
+
+  if (!server) return NULL;
+  server->port = port;
+  // Without a port, the server does not listen: it only makes connections (see wsdial)
+  if (!port) {
+    wslog(server->log, WS_LOG_INFO, "WebSocket Server created without a port");
+    return server;
+  }
+
+  if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) return wsabandon(server, server_fd, "Cannot create socket");
+  wslog(server->log, WS_LOG_INFO, "WebSocket Server created successfully");
+  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int)) < 0) {
+    return wsabandon(server, server_fd, "Cannot reuse socket");
+  }
+  // Connections are only accepted once their request came in (in seconds, not critical if unsupported)
+  setsockopt(server_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &(int){WS_TIMEOUT / 1000}, sizeof(int));
+  wslog(server->log, WS_LOG_INFO, "Socket setup successful");
+
+  address                  = (struct sockaddr_in*)&server->address;
+  address->sin_family      = AF_INET;
+  address->sin_addr.s_addr = htonl(INADDR_ANY);
+  address->sin_port        = htons(port);
+  server->addrlen          = sizeof(struct sockaddr_in);
+
+  if (bind(server_fd, (struct sockaddr *restrict)address, server->addrlen) < 0) {
+    return wsabandon(server, server_fd, "Bind failed");
+  }
+  wslog(server->log, WS_LOG_INFO, "Socket binded successfuly");
+
+  if (listen(server_fd, WS_BACKLOG) < 0) return wsabandon(server, server_fd, "Cannot listen");
+  server->fd = server_fd;
+  wslog(server->log, WS_LOG_INFO, "Listening on port %d for WebSocket connections...", port);
+  return server;
+}
+
+// Removes the socket file at address if nothing listens on it anymore, returns 1 if it did
+int wsstale(const struct sockaddr_un *address, const socklen_t length) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int stale;
+
+  if (fd < 0) return 0;
+  stale = connect(fd, (const struct sockaddr*)address, length) < 0 && errno == ECONNREFUSED && !unlink(address->sun_path);
+  close(fd);
+  return stale;
+}
+
+WebSocketServer *wsstartunix(const char *path, FILE *messages, FILE *errors) {
+  WebSocketServer    *server = wscreate(messages, errors);
+  size_t              length = path ? strlen(path) : 0;
+  struct sockaddr_un *address;
+  int                 server_fd;
+
+  if (!server) return NULL;
+  address = (struct sockaddr_un*)&server->address;
+  if (!length || length >= sizeof(address->sun_path)) return wsabandon(server, -1, "Bad socket path");
+  if ((server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) return wsabandon(server, server_fd, "Cannot create socket");
+  wslog(server->log, WS_LOG_INFO, "WebSocket Server created successfully");
+
+  // An abstract name is not terminated, the kernel takes the length as is
+  address->sun_family = AF_UNIX;
+  memcpy(address->sun_path, path, length);
+  if (path[0] == '@') address->sun_path[0] = 0;
+  server->addrlen = offsetof(struct sockaddr_un, sun_path) + length + (path[0] != '@');
+
+  if (bind(server_fd, (struct sockaddr*)address, server->addrlen) < 0 &&
+      (errno != EADDRINUSE || path[0] == '@' || !wsstale(address, server->addrlen) ||
+       bind(server_fd, (struct sockaddr*)address, server->addrlen) < 0))
+  {
+    return wsabandon(server, server_fd, "Bind failed");
+  }
+  if (listen(server_fd, WS_BACKLOG) < 0) {
+    if (path[0] != '@') unlink(path);
+    return wsabandon(server, server_fd, "Cannot listen");
+  }
+  server->fd = server_fd;
+  wslog(server->log, WS_LOG_INFO, "Listening on %s for WebSocket connections...", path);
+  return server;
+}
+
+WebSocketServer *wsstartfd(const int fd, FILE *messages, FILE *errors) {
+  WebSocketServer *server    = wscreate(messages, errors);
+  int              listening = 0;
+  int              type      = 0;
+
+  if (!server) return NULL;
+  server->addrlen = sizeof(struct sockaddr_storage);
+  // The socket is not the server's to close if it cannot be used
+  if (fd < 0 || getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &(socklen_t){sizeof(int)}) < 0 || !listening ||
+      getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &(socklen_t){sizeof(int)}) < 0 || type != SOCK_STREAM ||
+      getsockname(fd, (struct sockaddr*)&server->address, &server->addrlen) < 0)
+  {
+    return wsabandon(server, -1, "Not a listening stream socket");
+  }
+  if ((server->wake = eventfd(0, EFD_CLOEXEC)) < 0) return wsabandon(server, -1, "Cannot create wake-up");
+  // The threads that wait on it may not all get the connection they were woken for
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  server->fd        = fd;
+  server->inherited = 1;
+  if (server->address.ss_family == AF_INET)  server->port = ntohs(((struct sockaddr_in*)&server->address)->sin_port);
+  if (server->address.ss_family == AF_INET6) server->port = ntohs(((struct sockaddr_in6*)&server->address)->sin6_port);
+  wslog(server->log, WS_LOG_INFO, "Listening on inherited socket %d (port %d) for WebSocket connections...", fd,
+        (unsigned short)server->port);
+  return server;
+}
+
+int wsactivated(const int index) {
+  const char *pid   = getenv("LISTEN_PID");
+  const char *count = getenv("LISTEN_FDS");
+
+  // Sockets passed to another process (e.g. the parent of this one) are not this one's
+  if (!pid || !count || atol(pid) != getpid() || index < 0 || index >= atoi(count)) return -1;
+  return WS_LISTEN_FDS_START + index;
+}
+
+// Opens one more listening socket on the port of the server, returns it (or -1)
+int wslistener(WebSocketServer *server, const int cpu) {
+  int reuse = 0;
+  int fd;
+
+  if (server->nlisteners == WS_MAX_LISTENERS || server->fd < 0 ||
+      (server->address.ss_family != AF_INET && server->address.ss_family != AF_INET6))
+  {
+    return -1;
+  }
+  // The port of wsstart is only opened to other sockets once it is sharded (another server of the same
+  // user would take half of the connections otherwise), an inherited socket has to have SO_REUSEPORT already
+  if (!server->inherited && !server->nlisteners) setsockopt(server->fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int));
+  if (getsockopt(server->fd, SOL_SOCKET, SO_REUSEPORT, &reuse, &(socklen_t){sizeof(int)}) < 0 || !reuse ||
+      (fd = socket(server->address.ss_family, SOCK_STREAM, 0)) < 0)
+  {
+    return -1;
+  }
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int));
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int));
+  setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &(int){WS_TIMEOUT / 1000}, sizeof(int));
+  if (cpu >= 0) setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(int));
+  if (bind(fd, (struct sockaddr*)&server->address, server->addrlen) < 0 || listen(fd, WS_BACKLOG) < 0) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot add a listener on port %d", server->port);
+    close(fd);
+    return -1;
+  }
+  server->listeners[server->nlisteners++] = fd;
+  return fd;
+}
+
+int wssecure(WebSocketServer *server, const WebSocketTLSOptions *options) {
+  char reason[WS_TLS_REASON];
+
+  if (server->tls) {
+    wslog(server->log, WS_LOG_ERROR, "TLS is already set up");
+    return -1;
+  }
+  // Clients that think they connect over TLS must not be served in the clear
+  if (server->fd >= 0 && !options->certificate) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot set up TLS: a listening server needs a certificate");
+    return -1;
+  }
+  if (!(server->tls = wstlscontext(options, reason))) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot set up TLS: %s", reason);
+    return -1;
+  }
+  wslog(server->log, WS_LOG_INFO, "TLS set up%s", options->offload ? " (kTLS where the kernel has it)" : "");
+  return 0;
+}
+
+// Unblocks the threads waiting on the listening sockets, wsaccept will then return CONNECTION_CLOSED
+void wsshutdown(WebSocketServer *server) {
+  if (server) {
+    __atomic_store_n(&server->close, 1, __ATOMIC_RELEASE);
+    // An inherited socket outlives the server: the connections that queue up are for the next one
+    if (server->inherited) eventfd_write(server->wake, 1);
+    else                   shutdown(server->fd, SHUT_RDWR);
+    for (int i = 0; i < server->nlisteners; i++) shutdown(server->listeners[i], SHUT_RDWR);
+  }
+}
+
+void wsstop(WebSocketServer *server) {
+  if (server) {
+    WebSocketBroadcast *broadcast = &server->broadcast;
+
+    pthread_mutex_lock(&broadcast->lock);
+    broadcast->stop = 1;
+    pthread_cond_broadcast(&broadcast->wake);
+    pthread_mutex_unlock(&broadcast->lock);
+    for (int i = 0; i < broadcast->count; i++) pthread_join(broadcast->threads[i], NULL);
+    pthread_cond_destroy(&broadcast->done);
+    pthread_cond_destroy(&broadcast->wake);
+    pthread_mutex_destroy(&broadcast->lock);
+    pthread_mutex_destroy(&broadcast->call);
+    if (server->writer.started) {
+      eventfd_write(server->writer.wake, 1);
+      pthread_join(server->writer.thread, NULL);
+      close(server->writer.fd);
+      close(server->writer.wake);
+    }
+    pthread_mutex_destroy(&server->writer.lock);
+    pthread_mutex_lock(&server->timers.lock);
+    server->timers.stop = 1;
+    pthread_cond_signal(&server->timers.wake);
+    pthread_mutex_unlock(&server->timers.lock);
+    if (server->timers.started) pthread_join(server->timers.thread, NULL);
+
+    for (int i = wsnext(server, -1); i >= 0; i = wsnext(server, i)) wsclose(server, i);
+    if (!server->inherited) shutdown(server->fd, SHUT_RDWR);
+    close(server->fd);
+    if (server->wake >= 0) close(server->wake);
+    // The socket file of wsstartunix goes with the server (an abstract name goes with the socket)
+    if (!server->inherited && server->address.ss_family == AF_UNIX && ((struct sockaddr_un*)&server->address)->sun_path[0]) {
+      unlink(((struct sockaddr_un*)&server->address)->sun_path);
+    }
+    for (int i = 0; i < server->nlisteners; i++) close(server->listeners[i]);
+    for (unsigned int i = 0; i < server->registry.size; i += WS_REGISTRY_CHUNK) {
+      WebSocketConnection *chunk = server->registry.chunks[i >> WS_REGISTRY_CHUNK_BITS];
+      for (int j = 0; j < WS_REGISTRY_CHUNK; j++) {
+        // A handshake that a reactor was still going on with
+        if (chunk[j].shake) {
+          close(chunk[j].fd);
+          wspoolfree(chunk[j].shake, chunk[j].shake->block);
+        }
+        pthread_mutex_destroy(&chunk[j].lock);
+        wstlsclose(&chunk[j].tls);
+        pthread_mutex_destroy(&chunk[j].tls.lock);
+        wsdrop(&chunk[j].rx);
+        wsdiscard(&chunk[j].tx);
+        wsinflaterelease(&chunk[j].deflate);
+        wsdeflaterelease(&chunk[j].deflate);
+      }
+      free(chunk);
+    }
+    pthread_mutex_destroy(&server->registry.lock);
+    pthread_cond_destroy(&server->timers.wake);
+    pthread_mutex_destroy(&server->timers.lock);
+    // Every client was closed, and left its topics
+    pthread_rwlock_destroy(&server->topics.lock);
+    wstlscontextfree(server->tls);
+    wscountersfree(server->counters);
+    // Last, what the server had to say is written out
+    wslogclose(server->log);
     free(server);
   }
 }
\ No newline at end of file
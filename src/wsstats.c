@@ -0,0 +1,144 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Runtime counters of the server and of its connections, and their text exposition.
+ */
+
+#include <wsstats.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <time.h>
+
+typedef struct stats_counter {
+  const char *name;
+  const char *help;
+  size_t      offset;
+} StatsCounter;
+
+static const StatsCounter stats_counters[] = {
+  { "websocket_accepts_total",              "Connections accepted.",                                  offsetof(WebSocketCounters, accepts)              },
+  { "websocket_handshake_failures_total",   "Connections closed before the end of their handshake.",  offsetof(WebSocketCounters, handshakefailures)    },
+  { "websocket_refused_total",              "Connections refused for lack of a free slot.",           offsetof(WebSocketCounters, refused)              },
+  { "websocket_closes_total",               "Connections closed.",                                    offsetof(WebSocketCounters, closes)               },
+  { "websocket_scrapes_total",              "Requests for these metrics.",                            offsetof(WebSocketCounters, scrapes)              },
+  { "websocket_frames_received_total",      "Frames received.",                                       offsetof(WebSocketCounters, framesin)             },
+  { "websocket_frames_sent_total",          "Frames sent or queued.",                                 offsetof(WebSocketCounters, framesout)            },
+  { "websocket_received_bytes_total",       "Bytes read from the sockets.",                           offsetof(WebSocketCounters, bytesin)              },
+  { "websocket_sent_bytes_total",           "Bytes written to the sockets.",                          offsetof(WebSocketCounters, bytesout)             },
+  { "websocket_messages_received_total",    "Messages received.",                                     offsetof(WebSocketCounters, messagesin)           },
+  { "websocket_messages_sent_total",        "Messages sent or queued.",                               offsetof(WebSocketCounters, messagesout)          },
+  { "websocket_messages_dropped_total",     "Messages dropped on a full outbound queue.",             offsetof(WebSocketCounters, dropped)              },
+  { "websocket_overflow_disconnects_total", "Connections shut down on a full outbound queue.",        offsetof(WebSocketCounters, disconnected)         },
+  { "websocket_timeouts_total",             "Connections shut down on a deadline.",                   offsetof(WebSocketCounters, timeouts)             },
+  { "websocket_tls_handshakes_total",       "TLS handshakes done.",                                   offsetof(WebSocketCounters, tlshandshakes)        },
+  { "websocket_tls_resumed_total",          "TLS handshakes that resumed a session.",                 offsetof(WebSocketCounters, tlsresumed)           },
+  { "websocket_tls_offloaded_total",        "TLS connections sent through kTLS.",                     offsetof(WebSocketCounters, tlsoffloaded)         }
+};
+
+static int          stats_next  = 0;
+static __thread int stats_shard = -1;
+
+unsigned long long wsclock() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long)now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+WebSocketCounters *wscountersalloc() {
+  WebSocketCounters *counters = aligned_alloc(WS_STATS_LINE, WS_STATS_SHARDS * sizeof(WebSocketCounters));
+
+  if (counters) memset(counters, 0, WS_STATS_SHARDS * sizeof(WebSocketCounters));
+  return counters;
+}
+
+void wscountersfree(WebSocketCounters *counters) {
+  free(counters);
+}
+
+// The copy of the calling thread
+WebSocketCounters *wscounters(WebSocketCounters *counters) {
+  if (stats_shard < 0) stats_shard = __atomic_fetch_add(&stats_next, 1, __ATOMIC_RELAXED) % WS_STATS_SHARDS;
+  return &counters[stats_shard];
+}
+
+void wscountersum(const WebSocketCounters *counters, WebSocketCounters *total) {
+  unsigned long long *sum = (unsigned long long*)total;
+
+  memset(total, 0, sizeof(WebSocketCounters));
+  for (int i = 0; i < WS_STATS_SHARDS; i++) {
+    const unsigned long long *values = (const unsigned long long*)&counters[i];
+
+    for (size_t j = 0; j < sizeof(WebSocketCounters) / sizeof(unsigned long long); j++) {
+      sum[j] += __atomic_load_n(&values[j], __ATOMIC_RELAXED);
+    }
+  }
+}
+
+void wshistogram(WebSocketHistogram *histogram, const unsigned long long us) {
+  int bucket = us ? (int)(sizeof(unsigned long long) * 8) - __builtin_clzll(us) : 0;
+
+  if (bucket >= WS_STATS_BUCKETS) bucket = WS_STATS_BUCKETS - 1;
+  __atomic_add_fetch(&histogram->buckets[bucket], 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&histogram->count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&histogram->sum, us, __ATOMIC_RELAXED);
+}
+
+// Appends to the buffer as long as it fits, returns the new length
+size_t wsstatsprintf(char *buffer, const size_t size, size_t length, const char *format, ...) {
+  va_list args;
+  int     n;
+
+  if (length >= size) return length;
+  va_start(args, format);
+  n = vsnprintf(&buffer[length], size - length, format, args);
+  va_end(args);
+  // What did not fit is left out (an entry is never cut in the middle)
+  if (n < 0 || (size_t)n >= size - length) {
+    buffer[length] = 0;
+    return size;
+  }
+  return length + n;
+}
+
+size_t wsstatshistogram(char *buffer, const size_t size, size_t length, const char *name, const char *help,
+                        const WebSocketHistogram *histogram)
+{
+  unsigned long long cumulated = 0;
+
+  length = wsstatsprintf(buffer, size, length, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+  for (int i = 0; i < WS_STATS_BUCKETS - 1; i++) {
+    cumulated += histogram->buckets[i];
+    length     = wsstatsprintf(buffer, size, length, "%s_bucket{le=\"%.6f\"} %llu\n", name,
+                               ((1ULL << i) - 1) / 1e6, cumulated);
+  }
+  length = wsstatsprintf(buffer, size, length, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.6f\n%s_count %llu\n",
+                         name, histogram->count, name, histogram->sum / 1e6, name, histogram->count);
+  return length;
+}
+
+size_t wsstatsformat(const WebSocketStats *stats, char *buffer, const size_t size) {
+  size_t length = 0;
+
+  if (!size) return 0;
+  buffer[0] = 0;
+  length = wsstatsprintf(buffer, size, length, "# HELP websocket_connections Connections open.\n"
+                         "# TYPE websocket_connections gauge\nwebsocket_connections %u\n", stats->connections);
+  length = wsstatsprintf(buffer, size, length, "# HELP websocket_queued_bytes Bytes waiting in the outbound queues.\n"
+                         "# TYPE websocket_queued_bytes gauge\nwebsocket_queued_bytes %zu\n", stats->queued);
+  for (size_t i = 0; i < sizeof(stats_counters) / sizeof(StatsCounter); i++) {
+    const StatsCounter *counter = &stats_counters[i];
+
+    length = wsstatsprintf(buffer, size, length, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counter->name,
+                           counter->help, counter->name, counter->name,
+                           *(const unsigned long long*)((const char*)&stats->total + counter->offset));
+  }
+  length = wsstatshistogram(buffer, size, length, "websocket_handshake_seconds", "Time from accept to the end of the handshake.",
+                            &stats->total.handshake);
+  length = wsstatshistogram(buffer, size, length, "websocket_rtt_seconds", "Round trip of the pings that were answered.",
+                            &stats->total.rtt);
+  return length < size ? length : strlen(buffer);
+}
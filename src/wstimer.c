@@ -0,0 +1,104 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Hierarchical timer wheel for the deadlines of the connections.
+ */
+
+#include <wstimer.h>
+
+#include <time.h>
+
+unsigned long long wsticks() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((unsigned long long)now.tv_sec * 1000ULL + now.tv_nsec / 1000000) / WS_TIMER_TICK;
+}
+
+void wswheelinit(WebSocketWheel *wheel, const unsigned long long now) {
+  wheel->now   = now;
+  wheel->count = 0;
+  for (int level = 0; level < WS_TIMER_LEVELS; level++) {
+    for (int slot = 0; slot < WS_TIMER_SLOTS; slot++) {
+      WebSocketTimer *head = &wheel->slots[level][slot];
+
+      head->next = head->prev = head;
+    }
+  }
+}
+
+// Links the timer in the slot of its tick (its tick is ahead of the wheel)
+void wstimerlink(WebSocketWheel *wheel, WebSocketTimer *timer) {
+  WebSocketTimer *head;
+  int             level = WS_TIMER_LEVELS - 1;
+
+  // The highest level where the tick differs from the current one, the slots above are the same
+  while (level && (timer->expires >> (WS_TIMER_BITS * level)) == (wheel->now >> (WS_TIMER_BITS * level))) level--;
+  head = &wheel->slots[level][(timer->expires >> (WS_TIMER_BITS * level)) & (WS_TIMER_SLOTS - 1)];
+  timer->next       = head;
+  timer->prev       = head->prev;
+  head->prev->next  = timer;
+  head->prev        = timer;
+}
+
+void wstimerunlink(WebSocketTimer *timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next       = NULL;
+  timer->prev       = NULL;
+}
+
+void wstimerset(WebSocketWheel *wheel, WebSocketTimer *timer, unsigned long long expires) {
+  if (timer->prev) wstimerunlink(timer);
+  else             wheel->count++;
+  if (expires <= wheel->now)                    expires = wheel->now + 1;
+  else if (expires - wheel->now > WS_TIMER_MAX) expires = wheel->now + WS_TIMER_MAX;
+  timer->expires = expires;
+  wstimerlink(wheel, timer);
+}
+
+void wstimerunset(WebSocketWheel *wheel, WebSocketTimer *timer) {
+  if (timer->prev) {
+    wstimerunlink(timer);
+    wheel->count--;
+  }
+}
+
+int wstimerpending(const WebSocketTimer *timer) {
+  return timer->prev != NULL;
+}
+
+WebSocketTimer *wswheeladvance(WebSocketWheel *wheel, const unsigned long long now) {
+  WebSocketTimer  *expired = NULL;
+  WebSocketTimer **last    = &expired;
+
+  // Nothing to expire on the way
+  if (!wheel->count && now > wheel->now) wheel->now = now;
+  while (wheel->now < now) {
+    WebSocketTimer *head;
+
+    wheel->now++;
+    // The slots of the levels above that the wheel just got to move down
+    for (int level = 1; level < WS_TIMER_LEVELS; level++) {
+      if (wheel->now & ((1ULL << (WS_TIMER_BITS * level)) - 1)) break;
+      head = &wheel->slots[level][(wheel->now >> (WS_TIMER_BITS * level)) & (WS_TIMER_SLOTS - 1)];
+      while (head->next != head) {
+        WebSocketTimer *timer = head->next;
+
+        wstimerunlink(timer);
+        wstimerlink(wheel, timer);
+      }
+    }
+    head = &wheel->slots[0][wheel->now & (WS_TIMER_SLOTS - 1)];
+    while (head->next != head) {
+      WebSocketTimer *timer = head->next;
+
+      wstimerunlink(timer);
+      wheel->count--;
+      *last = timer;
+      last  = &timer->next;
+    }
+    if (!wheel->count) wheel->now = now;
+  }
+  *last = NULL;
+  return expired;
+}
@@ -0,0 +1,440 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: TLS of the connections (wss://) with OpenSSL, offloaded to the kernel (kTLS) where it can be.
+ * Standard: https://datatracker.ietf.org/doc/html/rfc8446
+ */
+
+#include <wstls.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+static BIO_METHOD     *tls_method = NULL;
+static pthread_once_t  tls_once   = PTHREAD_ONCE_INIT;
+
+void wstlsdefaults(WebSocketTLSOptions *options) {
+  options->enabled     = 0;
+  options->certificate = NULL;
+  options->key         = NULL;
+  options->authority   = NULL;
+  options->verify      = 1;
+  options->offload     = 1;
+  options->tickets     = WS_TLS_TICKETS;
+  options->cache       = WS_TLS_CACHE;
+}
+
+// Signals
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// SIGPIPE is held back while OpenSSL writes to the socket itself (a peer that went away must not kill
+// the process), and dropped if it was raised in the meantime
+void wstlsquiet(sigset_t *previous) {
+  sigset_t pipe;
+
+  sigemptyset(&pipe);
+  sigaddset(&pipe, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe, previous);
+}
+
+void wstlsloud(const sigset_t *previous) {
+  sigset_t pending;
+
+  if (!sigismember(previous, SIGPIPE) && !sigpending(&pending) && sigismember(&pending, SIGPIPE)) {
+    struct timespec now = { 0, 0 };
+    sigset_t        pipe;
+
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    sigtimedwait(&pipe, NULL, &now);
+  }
+  pthread_sigmask(SIG_SETMASK, previous, NULL);
+}
+
+// Once the handshake is done, what OpenSSL writes goes through this BIO: a send that never raises SIGPIPE
+int wstlsbiowrite(BIO *bio, const char *data, int size) {
+  int n = send((int)(intptr_t)BIO_get_data(bio), data, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+  BIO_clear_retry_flags(bio);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) BIO_set_retry_write(bio);
+  return n;
+}
+
+long wstlsbioctrl(BIO *bio, int command, long number, void *pointer) {
+  return command == BIO_CTRL_FLUSH;
+}
+
+int wstlsbiocreate(BIO *bio) {
+  BIO_set_init(bio, 1);
+  return 1;
+}
+
+void wstlsbiomethod() {
+  if ((tls_method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "websocket socket"))) {
+    BIO_meth_set_write(tls_method, wstlsbiowrite);
+    BIO_meth_set_ctrl(tls_method, wstlsbioctrl);
+    BIO_meth_set_create(tls_method, wstlsbiocreate);
+  }
+}
+
+// Contexts
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+SSL_CTX *wstlsnew(const WebSocketTLSOptions *options, const int server) {
+  SSL_CTX *context = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+
+  if (!context) return NULL;
+  SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+  // A peer that goes without its closing alert is only a closed connection
+  SSL_CTX_set_options(context, SSL_OP_IGNORE_UNEXPECTED_EOF | SSL_OP_NO_RENEGOTIATION | (options->offload ? SSL_OP_ENABLE_KTLS : 0));
+  // Writes are retried from wherever the queue is (see wstlssend), idle connections keep no record buffers
+  SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+  return context;
+}
+
+// Keeps a session that a server handed out to a connection made to it, for the next one (see wstlsopen)
+int wstlsremember(SSL *ssl, SSL_SESSION *session) {
+  WebSocketTLSContext *context = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+  const char          *peer    = SSL_get_app_data(ssl);
+  WebSocketTLSSession *entry   = NULL;
+
+  if (!peer) return 0;
+  pthread_mutex_lock(&context->lock);
+  for (int i = 0; i < WS_TLS_SESSIONS && !entry; i++) {
+    if (context->sessions[i].session && !strcmp(context->sessions[i].peer, peer)) entry = &context->sessions[i];
+  }
+  // Otherwise, the peer takes the place of the one that came in first
+  if (!entry) {
+    entry = &context->sessions[context->next++ % WS_TLS_SESSIONS];
+    snprintf(entry->peer, WS_TLS_PEER_SIZE, "%s", peer);
+  }
+  if (entry->session) SSL_SESSION_free(entry->session);
+  entry->session = session;
+  pthread_mutex_unlock(&context->lock);
+  // The reference is kept
+  return 1;
+}
+
+// Gives up on a context that could not be set up, reason says what failed (and what OpenSSL said about it)
+WebSocketTLSContext *wstlsabandon(WebSocketTLSContext *context, char *reason, const char *what) {
+  unsigned long error = ERR_peek_last_error();
+  char          detail[WS_TLS_REASON / 2];
+
+  if (error) ERR_error_string_n(error, detail, sizeof(detail));
+  snprintf(reason, WS_TLS_REASON, "%s%s%s", what, error ? ": " : "", error ? detail : "");
+  ERR_clear_error();
+  wstlscontextfree(context);
+  return NULL;
+}
+
+WebSocketTLSContext *wstlscontext(const WebSocketTLSOptions *options, char *reason) {
+  WebSocketTLSContext *context = calloc(1, sizeof(WebSocketTLSContext));
+
+  if (!context) return wstlsabandon(context, reason, "Out of memory");
+  pthread_mutex_init(&context->lock, NULL);
+  pthread_once(&tls_once, wstlsbiomethod);
+  ERR_clear_error();
+  if (!tls_method) return wstlsabandon(context, reason, "Cannot create the socket BIO");
+
+  if (options->certificate || options->key) {
+    SSL_CTX *server;
+
+    if (!options->certificate || !options->key) return wstlsabandon(context, reason, "The certificate goes with its key");
+    if (!(server = context->server = wstlsnew(options, 1))) return wstlsabandon(context, reason, "Cannot create the server context");
+    if (SSL_CTX_use_certificate_chain_file(server, options->certificate) != 1) {
+      return wstlsabandon(context, reason, "Cannot load the certificate");
+    }
+    if (SSL_CTX_use_PrivateKey_file(server, options->key, SSL_FILETYPE_PEM) != 1 || SSL_CTX_check_private_key(server) != 1) {
+      return wstlsabandon(context, reason, "Cannot load the key");
+    }
+    // Resumption: sessions kept by the server (TLS 1.2 session IDs), and tickets kept by the clients
+    SSL_CTX_set_session_id_context(server, (const unsigned char*)"websocket", strlen("websocket"));
+    SSL_CTX_set_session_cache_mode(server, options->cache > 0 ? SSL_SESS_CACHE_SERVER : SSL_SESS_CACHE_OFF);
+    if (options->cache > 0) SSL_CTX_sess_set_cache_size(server, options->cache);
+    SSL_CTX_set_num_tickets(server, options->tickets > 0 ? options->tickets : 0);
+    if (options->tickets <= 0) SSL_CTX_set_options(server, SSL_OP_NO_TICKET);
+  }
+
+  if (!(context->client = wstlsnew(options, 0))) return wstlsabandon(context, reason, "Cannot create the client context");
+  SSL_CTX_set_app_data(context->client, context);
+  SSL_CTX_set_session_cache_mode(context->client, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(context->client, wstlsremember);
+  if (options->verify) {
+    SSL_CTX_set_verify(context->client, SSL_VERIFY_PEER, NULL);
+    if ((options->authority ? SSL_CTX_load_verify_locations(context->client, options->authority, NULL)
+                            : SSL_CTX_set_default_verify_paths(context->client)) != 1)
+    {
+      return wstlsabandon(context, reason, "Cannot load the certificate authority");
+    }
+  }
+  return context;
+}
+
+void wstlscontextfree(WebSocketTLSContext *context) {
+  if (context) {
+    for (int i = 0; i < WS_TLS_SESSIONS; i++) SSL_SESSION_free(context->sessions[i].session);
+    SSL_CTX_free(context->server);
+    SSL_CTX_free(context->client);
+    pthread_mutex_destroy(&context->lock);
+    free(context);
+  }
+}
+
+// Connections
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+// Names the server, and offers it the last session it handed out (client side)
+int wstlspeer(WebSocketTLSContext *context, SSL *ssl, const char *host, const short port) {
+  unsigned char address[sizeof(struct in6_addr)];
+  char         *peer = malloc(WS_TLS_PEER_SIZE);
+
+  if (!peer) return 0;
+  snprintf(peer, WS_TLS_PEER_SIZE, "%s:%d", host, (unsigned short)port);
+  SSL_set_app_data(ssl, peer);
+  // A name is sent (SNI) and checked against the certificate, an address is only checked
+  if (inet_pton(AF_INET, host, address) == 1 || inet_pton(AF_INET6, host, address) == 1) {
+    X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host);
+  } else {
+    SSL_set_tlsext_host_name(ssl, host);
+    SSL_set1_host(ssl, host);
+  }
+  pthread_mutex_lock(&context->lock);
+  for (int i = 0; i < WS_TLS_SESSIONS; i++) {
+    if (context->sessions[i].session && !strcmp(context->sessions[i].peer, peer)) {
+      SSL_set_session(ssl, context->sessions[i].session);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&context->lock);
+  return 1;
+}
+
+void wstlsfree(SSL *ssl) {
+  free(SSL_get_app_data(ssl));
+  SSL_free(ssl);
+  ERR_clear_error();
+}
+
+int wstlsinit(WebSocketTLSContext *context, WebSocketTLS *tls, const int fd, const char *host, const short port) {
+  SSL_CTX *shared = host ? context->client : context->server;
+  SSL     *ssl;
+
+  tls->kernel  = 0;
+  tls->resumed = 0;
+  tls->fed     = 0;
+  if (!shared) return 0;
+  // OpenSSL reads and writes the socket itself, it must never wait on it
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  // A flight goes out as several records (e.g. the tickets after the handshake), none may wait on Nagle
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+  ERR_clear_error();
+  if (!(ssl = SSL_new(shared))) return 1;
+  if (!SSL_set_fd(ssl, fd) || (host && !wstlspeer(context, ssl, host, port))) {
+    wstlsfree(ssl);
+    return 1;
+  }
+  if (host) SSL_set_connect_state(ssl);
+  else      SSL_set_accept_state(ssl);
+  __atomic_store_n(&tls->ssl, ssl, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int wstlsstep(WebSocketTLS *tls, const int fd, const int timeout) {
+  SSL      *ssl   = tls->ssl;
+  int       error = SSL_ERROR_NONE;
+  sigset_t  signals;
+  int       status;
+
+  pthread_mutex_lock(&tls->lock);
+  ERR_clear_error();
+  wstlsquiet(&signals);
+  while ((status = SSL_do_handshake(ssl)) != 1) {
+    struct pollfd wait = { fd, POLLOUT, 0 };
+
+    // What the peer has to send is waited for by the caller, a flight that the socket does not take at
+    // once is waited for like any other write
+    error = SSL_get_error(ssl, status);
+    if (error != SSL_ERROR_WANT_WRITE || poll(&wait, 1, timeout) <= 0) break;
+  }
+  wstlsloud(&signals);
+  pthread_mutex_unlock(&tls->lock);
+  if (status != 1) {
+    ERR_clear_error();
+    return error == SSL_ERROR_WANT_READ ? -1 : 1;
+  }
+
+  // OpenSSL handed the record layer over to the kernel where it could (SSL_OP_ENABLE_KTLS)
+  if (BIO_get_ktls_send(SSL_get_wbio(ssl))) tls->kernel |= WS_TLS_SEND;
+  if (BIO_get_ktls_recv(SSL_get_rbio(ssl))) tls->kernel |= WS_TLS_RECV;
+  if (!(tls->kernel & WS_TLS_SEND)) {
+    BIO *bio = BIO_new(tls_method);
+
+    if (!bio) return 1;
+    BIO_set_data(bio, (void*)(intptr_t)fd);
+    SSL_set0_wbio(ssl, bio);
+  }
+  tls->resumed = SSL_session_reused(ssl);
+  return 0;
+}
+
+int wstlsopen(WebSocketTLSContext *context, WebSocketTLS *tls, const int fd, const char *host, const short port,
+              const int timeout)
+{
+  int status;
+
+  if (wstlsinit(context, tls, fd, host, port)) return 1;
+  if (!tls->ssl) return 0;
+  while ((status = wstlsstep(tls, fd, timeout)) < 0) {
+    struct pollfd wait = { fd, POLLIN, 0 };
+
+    if (poll(&wait, 1, timeout) <= 0) break;
+  }
+  if (status) wstlsclose(tls);
+  return status != 0;
+}
+
+void wstlsclose(WebSocketTLS *tls) {
+  SSL      *ssl;
+  sigset_t  signals;
+
+  pthread_mutex_lock(&tls->lock);
+  ssl = tls->ssl;
+  __atomic_store_n(&tls->ssl, NULL, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&tls->lock);
+  if (ssl) {
+    // The closing alert only goes out if the socket takes it right away
+    wstlsquiet(&signals);
+    SSL_shutdown(ssl);
+    wstlsloud(&signals);
+    wstlsfree(ssl);
+  }
+  tls->kernel  = 0;
+  tls->resumed = 0;
+  tls->fed     = 0;
+}
+
+// 1 when what comes off the socket has to be decrypted by OpenSSL
+int wstlsciphered(WebSocketTLS *tls) {
+  return __atomic_load_n(&tls->ssl, __ATOMIC_ACQUIRE) && !(tls->kernel & WS_TLS_RECV);
+}
+
+// What recv or sendmsg would have returned (and set errno to) for what OpenSSL did
+ssize_t wstlsresult(const int error, const size_t n) {
+  switch (error) {
+    case SSL_ERROR_NONE:
+      return n;
+    case SSL_ERROR_ZERO_RETURN:
+      return 0;
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+      errno = EAGAIN;
+      break;
+    case SSL_ERROR_SYSCALL:
+      if (!errno || errno == EAGAIN || errno == EWOULDBLOCK) errno = ECONNRESET;
+      break;
+    default:
+      errno = ECONNRESET;
+      break;
+  }
+  ERR_clear_error();
+  return -1;
+}
+
+ssize_t wstlsread(WebSocketTLS *tls, void *buffer, const size_t size) {
+  size_t n = 0;
+  int    error;
+
+  pthread_mutex_lock(&tls->lock);
+  if (!tls->ssl) {
+    pthread_mutex_unlock(&tls->lock);
+    errno = EBADF;
+    return -1;
+  }
+  ERR_clear_error();
+  error = SSL_read_ex(tls->ssl, buffer, size, &n) ? SSL_ERROR_NONE : SSL_get_error(tls->ssl, 0);
+  pthread_mutex_unlock(&tls->lock);
+  return wstlsresult(error, n);
+}
+
+ssize_t wstlsrecv(WebSocketTLS *tls, const int fd, void *buffer, const size_t size) {
+  if (!wstlsciphered(tls)) {
+    ssize_t n = recv(fd, buffer, size, MSG_DONTWAIT);
+
+    // The kernel leaves the records that are not data (e.g. a key update) to OpenSSL
+    if (n >= 0 || errno != EIO || !__atomic_load_n(&tls->ssl, __ATOMIC_ACQUIRE)) return n;
+  }
+  return wstlsread(tls, buffer, size);
+}
+
+/*
+NOTE:
+A write that OpenSSL could not finish has to be retried with the same bytes (at least as many), which
+the queue does: it starts again from the first byte that did not go out. The pieces of the vector are
+copied into one record while they are smaller than one, the rest of a bigger piece goes out on its own.
+*/
+ssize_t wstlssend(WebSocketTLS *tls, const int fd, struct iovec *iov, const int count) {
+  unsigned char  record[WS_TLS_RECORD];
+  const void    *data = iov[0].iov_base;
+  size_t         size = iov[0].iov_len;
+  size_t         n    = 0;
+  int            error;
+
+  if (!__atomic_load_n(&tls->ssl, __ATOMIC_ACQUIRE) || (tls->kernel & WS_TLS_SEND)) {
+    struct msghdr message;
+
+    memset(&message, 0, sizeof(struct msghdr));
+    message.msg_iov    = iov;
+    message.msg_iovlen = count;
+    return sendmsg(fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL);
+  }
+  if (count > 1 && size < WS_TLS_RECORD) {
+    size = 0;
+    for (int i = 0; i < count && size < WS_TLS_RECORD; i++) {
+      size_t piece = iov[i].iov_len < WS_TLS_RECORD - size ? iov[i].iov_len : WS_TLS_RECORD - size;
+
+      memcpy(&record[size], iov[i].iov_base, piece);
+      size += piece;
+    }
+    data = record;
+  }
+  pthread_mutex_lock(&tls->lock);
+  if (!tls->ssl) {
+    pthread_mutex_unlock(&tls->lock);
+    errno = EBADF;
+    return -1;
+  }
+  ERR_clear_error();
+  error = SSL_write_ex(tls->ssl, data, size, &n) ? SSL_ERROR_NONE : SSL_get_error(tls->ssl, 0);
+  pthread_mutex_unlock(&tls->lock);
+  return wstlsresult(error, n);
+}
+
+long wstlsfeed(WebSocketTLS *tls, const unsigned char *bytes, const size_t size) {
+  long taken = -1;
+
+  pthread_mutex_lock(&tls->lock);
+  if (tls->ssl) {
+    // From then on, OpenSSL reads from memory (an empty one asks for more)
+    if (!tls->fed) {
+      BIO *memory = BIO_new(BIO_s_mem());
+
+      if (memory) {
+        BIO_set_mem_eof_return(memory, -1);
+        SSL_set0_rbio(tls->ssl, memory);
+        tls->fed = 1;
+      }
+    }
+    if (tls->fed && (!size || BIO_write(SSL_get_rbio(tls->ssl), bytes, size) == (int)size)) taken = size;
+  }
+  pthread_mutex_unlock(&tls->lock);
+  return taken;
+}
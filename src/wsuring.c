@@ -0,0 +1,450 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: io_uring backend of the reactor.
+ */
+
+#include <wsuring.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// Headers that predate multishot receive build a backend that is never available
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT) && defined(__NR_io_uring_setup)
+
+int wsuringenter(WebSocketUring *ring, const unsigned int wait, const int timeout) {
+  struct __kernel_timespec      ts   = { timeout / 1000, (timeout % 1000) * 1000000LL };
+  struct io_uring_getevents_arg arg;
+  unsigned int                  count;
+  int                           n;
+
+  memset(&arg, 0, sizeof(struct io_uring_getevents_arg));
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts         = (unsigned long long)(unsigned long)&ts;
+  __atomic_store_n(ring->sqtail, ring->tail, __ATOMIC_RELEASE);
+  count = ring->tail - ring->submitted;
+  n     = syscall(__NR_io_uring_enter, ring->fd, count, wait, wait ? IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0,
+                  wait ? &arg : NULL, wait ? sizeof(struct io_uring_getevents_arg) : 0);
+  // The entries are taken even when the wait ends early (ETIME, EINTR)
+  ring->submitted = ring->tail - (__atomic_load_n(ring->sqtail, __ATOMIC_ACQUIRE) - __atomic_load_n(ring->sqhead, __ATOMIC_ACQUIRE));
+  return n;
+}
+
+// Next free submission entry, the queue is submitted first when it is full
+struct io_uring_sqe *wsuringsqe(WebSocketUring *ring) {
+  struct io_uring_sqe *sqe;
+  unsigned int         index;
+
+  if (ring->tail - __atomic_load_n(ring->sqhead, __ATOMIC_ACQUIRE) == ring->sqentries) wsuringenter(ring, 0, 0);
+  if (ring->tail - __atomic_load_n(ring->sqhead, __ATOMIC_ACQUIRE) == ring->sqentries) return NULL;
+  index = ring->tail & *ring->sqmask;
+  sqe   = &ring->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  ring->sqarray[index] = index;
+  ring->tail++;
+  return sqe;
+}
+
+int wsuringaccept(WebSocketUring *ring, const int listener) {
+  struct io_uring_sqe *sqe = wsuringsqe(ring);
+
+  if (!sqe) return 0;
+  sqe->opcode    = IORING_OP_ACCEPT;
+  sqe->fd        = listener;
+  sqe->ioprio    = IORING_ACCEPT_MULTISHOT;
+  sqe->user_data = URING_ACCEPT;
+  return 1;
+}
+
+int wsuringrecv(WebSocketUring *ring, const int fd, const unsigned long long data) {
+  struct io_uring_sqe *sqe = wsuringsqe(ring);
+
+  if (!sqe) return 0;
+  sqe->opcode    = IORING_OP_RECV;
+  sqe->fd        = fd;
+  sqe->ioprio    = IORING_RECV_MULTISHOT;
+  sqe->flags     = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = URING_GROUP;
+  sqe->user_data = data;
+  return 1;
+}
+
+int wsuringpoll(WebSocketUring *ring, const int fd) {
+  struct io_uring_sqe *sqe = wsuringsqe(ring);
+
+  if (!sqe) return 0;
+  sqe->opcode        = IORING_OP_POLL_ADD;
+  sqe->fd            = fd;
+  sqe->len           = IORING_POLL_ADD_MULTI;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data     = URING_OUTPUT;
+  return 1;
+}
+
+// Ends the receive of a client (along with any other that would still be going)
+int wsuringcancel(WebSocketUring *ring, const unsigned long long data) {
+  struct io_uring_sqe *sqe = wsuringsqe(ring);
+
+  if (!sqe) return 0;
+  sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+  sqe->fd           = -1;
+  sqe->addr         = data;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+  sqe->user_data    = URING_CANCEL;
+  return 1;
+}
+
+// Gives a buffer back to the kernel
+void wsuringrecycle(WebSocketUring *ring, const unsigned short id) {
+  struct io_uring_buf *buffer = &ring->buffers->bufs[ring->buftail & (URING_BUFFERS - 1)];
+
+  buffer->addr = (unsigned long long)(unsigned long)&ring->pool[(size_t)id * URING_BUFFER_SIZE];
+  buffer->len  = URING_BUFFER_SIZE;
+  buffer->bid  = id;
+  __atomic_store_n(&ring->buffers->tail, ++ring->buftail, __ATOMIC_RELEASE);
+}
+
+// Takes the next completion (copied), returns 0 when there is none
+int wsuringcomplete(WebSocketUring *ring, struct io_uring_cqe *cqe) {
+  unsigned int head = *ring->cqhead;
+
+  if (head == __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE)) return 0;
+  *cqe = ring->cqes[head & *ring->cqmask];
+  __atomic_store_n(ring->cqhead, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// Multishot receive with provided buffers only came with Linux 6.0: it is tried on a socket pair
+int wsuringprobe(WebSocketUring *ring) {
+  struct io_uring_cqe cqe;
+  int                 pair[2];
+  int                 works = 0;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) < 0) return 0;
+  if (wsuringrecv(ring, pair[0], 0) && write(pair[1], "", 1) == 1 && wsuringenter(ring, 1, 1000) >= 0 &&
+      wsuringcomplete(ring, &cqe))
+  {
+    works = cqe.res == 1 && (cqe.flags & IORING_CQE_F_BUFFER) && (cqe.flags & IORING_CQE_F_MORE);
+    if (cqe.flags & IORING_CQE_F_BUFFER) wsuringrecycle(ring, cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+  }
+  // The receive ends along with the socket
+  shutdown(pair[0], SHUT_RDWR);
+  close(pair[0]);
+  close(pair[1]);
+  while (works && (cqe.flags & IORING_CQE_F_MORE)) {
+    if (wsuringenter(ring, 1, 1000) < 0 && errno != EINTR && errno != ETIME) break;
+    while (wsuringcomplete(ring, &cqe)) {
+      if (cqe.flags & IORING_CQE_F_BUFFER) wsuringrecycle(ring, cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+  }
+  return works;
+}
+
+WebSocketUring *wsuringalloc() {
+  WebSocketUring          *ring = malloc(sizeof(WebSocketUring));
+  struct io_uring_params   params;
+  struct io_uring_buf_reg  registration;
+
+  if (!ring) return NULL;
+  memset(ring, 0, sizeof(WebSocketUring));
+  memset(&params, 0, sizeof(struct io_uring_params));
+  params.flags      = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+  params.cq_entries = URING_COMPLETIONS;
+  if ((ring->fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params)) < 0 ||
+      !(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+  {
+    if (ring->fd >= 0) close(ring->fd);
+    free(ring);
+    return NULL;
+  }
+
+  ring->sqringsize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  ring->cqringsize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (ring->cqringsize > ring->sqringsize) ring->sqringsize = ring->cqringsize;
+  ring->cqringsize = ring->sqringsize;
+  ring->sqessize   = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqring     = mmap(NULL, ring->sqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  ring->cqring     = ring->sqring;
+  ring->sqes       = mmap(NULL, ring->sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  ring->buffers    = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ring->pool       = mmap(NULL, (size_t)URING_BUFFERS * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring->sqring == MAP_FAILED || ring->sqes == MAP_FAILED || ring->buffers == MAP_FAILED || ring->pool == MAP_FAILED) {
+    wsuringfree(ring);
+    return NULL;
+  }
+  ring->sqhead    = (unsigned int*)((char*)ring->sqring + params.sq_off.head);
+  ring->sqtail    = (unsigned int*)((char*)ring->sqring + params.sq_off.tail);
+  ring->sqmask    = (unsigned int*)((char*)ring->sqring + params.sq_off.ring_mask);
+  ring->sqarray   = (unsigned int*)((char*)ring->sqring + params.sq_off.array);
+  ring->sqentries = params.sq_entries;
+  ring->cqhead    = (unsigned int*)((char*)ring->cqring + params.cq_off.head);
+  ring->cqtail    = (unsigned int*)((char*)ring->cqring + params.cq_off.tail);
+  ring->cqmask    = (unsigned int*)((char*)ring->cqring + params.cq_off.ring_mask);
+  ring->cqes      = (struct io_uring_cqe*)((char*)ring->cqring + params.cq_off.cqes);
+  ring->tail      = *ring->sqtail;
+  ring->submitted = ring->tail;
+
+  memset(&registration, 0, sizeof(struct io_uring_buf_reg));
+  registration.ring_addr    = (unsigned long long)(unsigned long)ring->buffers;
+  registration.ring_entries = URING_BUFFERS;
+  registration.bgid         = URING_GROUP;
+  if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+    munmap(ring->buffers, URING_BUFFERS * sizeof(struct io_uring_buf));
+    ring->buffers = NULL;
+    wsuringfree(ring);
+    return NULL;
+  }
+  for (int i = 0; i < URING_BUFFERS; i++) wsuringrecycle(ring, i);
+  if (!wsuringprobe(ring)) {
+    wsuringfree(ring);
+    return NULL;
+  }
+  return ring;
+}
+
+void wsuringfree(WebSocketUring *ring) {
+  if (ring) {
+    // Closing the ring cancels what is still pending
+    close(ring->fd);
+    if (ring->sqring && ring->sqring != MAP_FAILED)   munmap(ring->sqring, ring->sqringsize);
+    if (ring->sqes && ring->sqes != MAP_FAILED)       munmap(ring->sqes, ring->sqessize);
+    if (ring->buffers && ring->buffers != MAP_FAILED) munmap(ring->buffers, URING_BUFFERS * sizeof(struct io_uring_buf));
+    if (ring->pool && ring->pool != MAP_FAILED)       munmap(ring->pool, (size_t)URING_BUFFERS * URING_BUFFER_SIZE);
+    free(ring);
+  }
+}
+
+// Hands a connection that went through its handshake over to the application, returns 0 if it was
+// closed since
+int wsuringwelcome(WebSocketReactor *reactor, const int client) {
+  WebSocketServer     *server = reactor->server;
+  WebSocketConnection *connection;
+
+  if (!(connection = wsconnection(server, client))) return 0;
+  connection->shard = reactor->shard;
+  // OpenSSL decrypts what is received from here on, starting with what it may still hold from the handshake
+  if (wstlsciphered(&connection->tls)) wstlsfeed(&connection->tls, NULL, 0);
+  // The reactor also writes out the queue of the client when its socket fills up
+  wswatchoutput(server, client, reactor->fd);
+  reactor->onconnect(server, client, reactor->env);
+  return wsconnection(server, client) != NULL;
+}
+
+// Feeds what was received to a connection that is doing its handshake, returns how much of it the
+// request took once the connection is upgraded and served (-1 until then)
+long wsuringshake(WebSocketReactor *reactor, const int client, const unsigned char *bytes, const size_t size) {
+  long taken = wsfeed(reactor->server, client, bytes, size);
+
+  if (taken < 0) wsunshake(reactor->server, client);
+  if (taken < 0 || wsshake(reactor->server, client) != client || !wsuringwelcome(reactor, client)) return -1;
+  return taken;
+}
+
+// Feeds what was received to the connection and hands out every message it completes
+void wsuringread(WebSocketReactor *reactor, const int client, const unsigned char *bytes, size_t size) {
+  WebSocketServer *server = reactor->server;
+  unsigned char   *data;
+  unsigned char    empty  = 0;
+  size_t           readbytes;
+  int              status;
+
+  // The request comes first, the frames that came along with it are read next
+  if (size && wsshaking(server, client)) {
+    long taken = wsuringshake(reactor, client, bytes, size);
+
+    if (taken < 0) return;
+    bytes += taken;
+    size  -= taken;
+  }
+  do {
+    long taken  = size ? wsfeed(server, client, bytes, size) : 0;
+    int  parsed = 0;
+
+    if (taken < 0) return;
+    bytes += taken;
+    size  -= taken;
+    while ((status = wsnextview(server, client, &data, &readbytes)) != READ_AGAIN) {
+      WebSocketConnection *connection;
+
+      reactor->onread(server, client, data ? data : &empty, readbytes, status, reactor->env);
+      if (status < 0 && status != READ_BUFFER_OVERFLOW) {
+        wsclose(server, client);
+        return;
+      }
+      // The callback may have closed the client
+      if (!(connection = wsconnection(server, client))) return;
+      // What was received already still goes through, the receive stops for what comes next
+      if (!connection->paused && wsreactorhold(reactor, client)) wsuringcancel(reactor->ring, client);
+      parsed = 1;
+    }
+    // A full buffer that holds no frame would never take the rest
+    if (size && !taken && !parsed) {
+      wslog(server->log, WS_LOG_WARN, "Receive buffer of client %d is full", client);
+      reactor->onread(server, client, &empty, 0, READ_FAILURE, reactor->env);
+      wsclose(server, client);
+      return;
+    }
+  } while (size);
+}
+
+// Serves a connection that was made elsewhere and joined
+void wsuringattach(WebSocketReactor *reactor, const int client) {
+  WebSocketServer     *server     = reactor->server;
+  WebSocketConnection *connection = wsconnection(server, client);
+
+  if (!connection) return;
+  if (!wsuringrecv(reactor->ring, connection->fd, (unsigned long long)client)) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot watch client %d", client);
+    wsclose(server, client);
+    return;
+  }
+  // Frames sent along with the response were read by the handshake
+  if (wsuringwelcome(reactor, client) && (connection->rx.end || connection->tls.fed)) wsuringread(reactor, client, NULL, 0);
+}
+
+void wsuringaccepted(WebSocketReactor *reactor, const int fd) {
+  int client = wsgreet(reactor->server, fd, wsreactorexpire, reactor);
+
+  if (client < 0) return;
+  wsshaking(reactor->server, client)->shard = reactor->shard;
+  // The request is received like the frames that follow it, under the ID the connection will have
+  if (!wsuringrecv(reactor->ring, fd, (unsigned long long)client)) {
+    wslog(reactor->server->log, WS_LOG_ERROR, "Cannot watch client %d", client);
+    wsunshake(reactor->server, client);
+  }
+}
+
+void wsuringreceived(WebSocketReactor *reactor, const struct io_uring_cqe *cqe) {
+  WebSocketServer     *server = reactor->server;
+  WebSocketUring      *ring   = reactor->ring;
+  int                  client = (int)cqe->user_data;
+  unsigned char        empty  = 0;
+  WebSocketConnection *connection;
+  int                  shaking;
+
+  if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+    unsigned short id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+    wsuringread(reactor, client, &ring->pool[(size_t)id * URING_BUFFER_SIZE], cqe->res);
+    wsuringrecycle(ring, id);
+  }
+  // Completions left over from a connection that was closed in the meantime, or from a receive that
+  // was cancelled while the client was held (it goes on once resumed, see wsuringresume)
+  shaking = !(connection = wsconnection(server, client)) && (connection = wsshaking(server, client));
+  if (!connection || cqe->res == -ECANCELED) return;
+  if (cqe->res > 0 || cqe->res == -ENOBUFS) {
+    // The receive stops when it runs out of buffers (or of room for its completions)
+    if (!(cqe->flags & IORING_CQE_F_MORE) && !connection->paused) wsuringrecv(ring, connection->fd, (unsigned long long)client);
+  } else if (shaking) {
+    // Hung up before its request was in (or shut down on the handshake timeout)
+    wsunshake(server, client);
+  } else {
+    if (cqe->res < 0) wslog(server->log, WS_LOG_WARN, "Connection was closed by client unexpectedly");
+    reactor->onread(server, client, &empty, 0, READ_CONNECTION_CLOSED_CLIENT, reactor->env);
+    wsclose(server, client);
+  }
+}
+
+// Receives again from the clients that were held until the executor had room, serves those that were
+// joined and gives up on the handshakes that timed out
+void wsuringresume(WebSocketReactor *reactor) {
+  int       clients[REACTOR_MAX_EVENTS];
+  int       count;
+  eventfd_t value;
+
+  eventfd_read(reactor->wake, &value);
+  while ((count = wsreactorwoken(reactor, clients, REACTOR_MAX_EVENTS))) {
+    for (int i = 0; i < count; i++) {
+      WebSocketConnection *connection = wsconnection(reactor->server, clients[i]);
+
+      if (!connection || !connection->paused) continue;
+      wspause(reactor->server, clients[i], 0);
+      wsuringrecv(reactor->ring, connection->fd, (unsigned long long)clients[i]);
+      wsuringread(reactor, clients[i], NULL, 0);
+    }
+  }
+  while ((count = wsreactorjoined(reactor, clients, REACTOR_MAX_EVENTS))) {
+    for (int i = 0; i < count; i++) wsuringattach(reactor, clients[i]);
+  }
+  // What is left of their receive completes once they are shut down, and is let go of
+  while ((count = wsreactorexpired(reactor, clients, REACTOR_MAX_EVENTS))) {
+    for (int i = 0; i < count; i++) wsunshake(reactor->server, clients[i]);
+  }
+}
+
+// Writes out the queues whose socket can take more (the wake-up of the reactor is in the same set)
+void wsuringwrite(WebSocketReactor *reactor) {
+  struct epoll_event events[REACTOR_MAX_EVENTS];
+  int                n = epoll_wait(reactor->fd, events, REACTOR_MAX_EVENTS, 0);
+
+  for (int i = 0; i < n; i++) {
+    if (events[i].data.u64 == REACTOR_WAKE) wsuringresume(reactor);
+    else                                    wsflush(reactor->server, (int)events[i].data.u64);
+  }
+}
+
+void *wsuringreact(WebSocketReactor *reactor) {
+  WebSocketServer     *server = reactor->server;
+  WebSocketUring      *ring   = reactor->ring;
+  struct io_uring_cqe  cqe;
+  unsigned char        empty  = 0;
+
+  // Without a listening socket, the reactor only serves the connections that are joined to it
+  if ((reactor->listener >= 0 && !wsuringaccept(ring, reactor->listener)) || !wsuringpoll(ring, reactor->fd)) {
+    wslog(server->log, WS_LOG_ERROR, "Cannot watch server socket");
+    return NULL;
+  }
+  while (!__atomic_load_n(&server->close, __ATOMIC_ACQUIRE)) {
+    // Wakes up now and then to see if the server is closing
+    if (wsuringenter(ring, 1, WS_TIMEOUT) < 0 && errno != EINTR && errno != ETIME && errno != EBUSY) {
+      wslog(server->log, WS_LOG_ERROR, "Reactor failure");
+      break;
+    }
+    while (!__atomic_load_n(&server->close, __ATOMIC_ACQUIRE) && wsuringcomplete(ring, &cqe)) {
+      if (cqe.user_data == URING_ACCEPT) {
+        if (cqe.res >= 0)                     wsuringaccepted(reactor, cqe.res);
+        if (!(cqe.flags & IORING_CQE_F_MORE)) wsuringaccept(ring, reactor->listener);
+      } else if (cqe.user_data == URING_OUTPUT) {
+        wsuringwrite(reactor);
+        if (!(cqe.flags & IORING_CQE_F_MORE)) wsuringpoll(ring, reactor->fd);
+      } else if (cqe.user_data != URING_CANCEL) {
+        wsuringreceived(reactor, &cqe);
+      }
+    }
+  }
+
+  // Let the application know about the connections that are still open (the other shards see to theirs)
+  for (int i = wsnext(server, -1); i >= 0; i = wsnext(server, i)) {
+    WebSocketConnection *connection = wsconnection(server, i);
+
+    if (!connection || connection->shard != reactor->shard) continue;
+    reactor->onread(server, i, &empty, 0, READ_CONNECTION_CLOSED_SERVER, reactor->env);
+    wsclose(server, i);
+  }
+  wslog(server->log, WS_LOG_INFO, "Closing server");
+  return NULL;
+}
+
+#else
+
+WebSocketUring *wsuringalloc() {
+  return NULL;
+}
+
+void wsuringfree(WebSocketUring *ring) {
+}
+
+void *wsuringreact(WebSocketReactor *reactor) {
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,217 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Minimal loopback WebSocket client helpers shared by the benchmarks.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <wsserver.h>
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BENCH_REQUEST "GET / HTTP/1.1\r\n"                              \
+                      "Host: 127.0.0.1\r\n"                             \
+                      "Upgrade: websocket\r\n"                          \
+                      "Connection: Upgrade\r\n"                         \
+                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n" \
+                      "Sec-WebSocket-Version: 13\r\n"
+
+static inline double benchnow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Both ends of every connection live in the benchmark process, returns how many connections fit
+static inline int benchnofile() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit)) return 0;
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  getrlimit(RLIMIT_NOFILE, &limit);
+  return limit.rlim_cur > 64 ? (int)((limit.rlim_cur - 64) / 2) : 0;
+}
+
+// Reads a "key: value" line from a /proc file
+static inline long benchproc(const char *path, const char *key) {
+  char  line[256];
+  long  value = -1;
+  FILE *file  = fopen(path, "r");
+
+  if (!file) return -1;
+  while (fgets(line, sizeof(line), file)) {
+    if (!strncmp(line, key, strlen(key)) && line[strlen(key)] == ':') {
+      value = atol(&line[strlen(key) + 1]);
+      break;
+    }
+  }
+  fclose(file);
+  return value;
+}
+
+static inline long benchstatus(const char *key) {
+  return benchproc("/proc/self/status", key);
+}
+
+static inline int benchreadall(int fd, void *buffer, size_t size) {
+  for (size_t done = 0; done < size;) {
+    ssize_t n = read(fd, (char*)buffer + done, size - done);
+    if (n <= 0) return -1;
+    done += n;
+  }
+  return 0;
+}
+
+static inline int benchwriteall(int fd, const void *buffer, size_t size) {
+  for (size_t done = 0; done < size;) {
+    ssize_t n = write(fd, (const char*)buffer + done, size - done);
+    if (n <= 0) return -1;
+    done += n;
+  }
+  return 0;
+}
+
+// Performs the upgrade on a connected socket with extra header lines (each ending with \r\n), returns
+// the socket or -1 (it is then closed). The response headers are copied to response when it is not NULL.
+static inline int benchupgrade(int fd, const char *headers, char *response) {
+  char request[1024];
+  char buffer[512];
+
+  snprintf(request, sizeof(request), "%s%s\r\n", BENCH_REQUEST, headers);
+  if (benchwriteall(fd, request, strlen(request))) {
+    close(fd);
+    return -1;
+  }
+  // Read the response up to the blank line
+  for (size_t size = 0; size < sizeof(buffer) - 1;) {
+    if (read(fd, &buffer[size], 1) != 1) break;
+    buffer[++size] = 0;
+    if (size >= 4 && !strcmp(&buffer[size - 4], "\r\n\r\n")) {
+      if (!strstr(buffer, " 101 ")) break;
+      if (response) strcpy(response, buffer);
+      return fd;
+    }
+  }
+  close(fd);
+  return -1;
+}
+
+// Opens a client connection on the loopback, without the upgrade
+static inline int benchdial(const short port) {
+  struct sockaddr_in address;
+  int                nodelay = 1;
+  int                fd      = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (fd < 0) return -1;
+  memset(&address, 0, sizeof(struct sockaddr_in));
+  address.sin_family      = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port        = htons(port);
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int));
+  if (connect(fd, (struct sockaddr*)&address, sizeof(struct sockaddr_in)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Opens a client connection on the loopback and performs the upgrade (see benchupgrade)
+static inline int benchconnectwith(const short port, const char *headers, char *response) {
+  int fd = benchdial(port);
+
+  return fd < 0 ? -1 : benchupgrade(fd, headers, response);
+}
+
+// Same on a Unix socket (@ for an abstract name)
+static inline int benchconnectunix(const char *path) {
+  struct sockaddr_un address;
+  size_t             length = strlen(path);
+  int                fd     = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0 || length >= sizeof(address.sun_path)) {
+    if (fd >= 0) close(fd);
+    return -1;
+  }
+  memset(&address, 0, sizeof(struct sockaddr_un));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, path, length);
+  if (path[0] == '@') address.sun_path[0] = 0;
+  if (connect(fd, (struct sockaddr*)&address, offsetof(struct sockaddr_un, sun_path) + length + (path[0] != '@')) < 0) {
+    close(fd);
+    return -1;
+  }
+  return benchupgrade(fd, "", NULL);
+}
+
+static inline int benchconnect(const short port) {
+  return benchconnectwith(port, "", NULL);
+}
+
+// Encodes one masked frame, as a browser would, returns its size (frame needs size + 14 bytes)
+static inline size_t benchencode(unsigned char *frame, const void *buffer, const size_t size, const int opcode) {
+  unsigned char *mask;
+  size_t         length = 2;
+
+  frame[0] = 0x80 | opcode;
+  if (size < 126) {
+    frame[1] = 0x80 | size;
+  } else if (size <= 0xFFFF) {
+    frame[1] = 0x80 | 126;
+    frame[2] = size >> 8;
+    frame[3] = size;
+    length  += 2;
+  } else {
+    frame[1] = 0x80 | 127;
+    for (int i = 0; i < 8; i++) frame[2 + i] = (unsigned long long)size >> (56 - 8 * i);
+    length  += 8;
+  }
+  mask = &frame[length];
+  for (int i = 0; i < WS_MASK_SIZE; i++) mask[i] = rand();
+  length += WS_MASK_SIZE;
+  for (size_t i = 0; i < size; i++) frame[length + i] = ((const unsigned char*)buffer)[i] ^ mask[i % WS_MASK_SIZE];
+  return length + size;
+}
+
+static inline int benchsend(int fd, const void *buffer, const size_t size, const int opcode) {
+  unsigned char *frame = (unsigned char*)malloc(size + 14);
+  int            status;
+
+  if (!frame) return -1;
+  status = benchwriteall(fd, frame, benchencode(frame, buffer, size, opcode));
+  free(frame);
+  return status;
+}
+
+// Receives one unmasked frame, returns the payload size or -1 (the opcode is stored in *opcode, along
+// with the RSV bits)
+static inline long benchrecv(int fd, unsigned char *buffer, const size_t maxbytes, int *opcode) {
+  unsigned char      header[8];
+  unsigned long long size;
+
+  if (benchreadall(fd, header, 2)) return -1;
+  *opcode = header[0] & 0x7F;
+  size    = header[1] & 0x7F;
+  if (size == 126) {
+    if (benchreadall(fd, header, 2)) return -1;
+    size = (header[0] << 8) | header[1];
+  } else if (size == 127) {
+    if (benchreadall(fd, header, 8)) return -1;
+    size = 0;
+    for (int i = 0; i < 8; i++) size = (size << 8) | header[i];
+  }
+  if (size > maxbytes || benchreadall(fd, buffer, size)) return -1;
+  return (long)size;
+}
+
+#endif
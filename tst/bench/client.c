@@ -0,0 +1,119 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Client benchmark: connections made by the library client (wsconnect_client) against an
+ *              echo server in another process, time to connect them, memory they take, and echo round
+ *              trips per second with every frame masked.
+ *
+ * Usage: bench_client [clients] [seconds] [size] [reactors] [port]
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <sys/wait.h>
+
+/*
+NOTE:
+Every client keeps one message in flight: the echo is sent back as soon as it comes, until the time is
+up. The server gets its own process (and as many reactors as the client), so that the client process
+only counts its own side.
+*/
+static volatile int running    = 1;
+static long         roundtrips = 0;
+static int          connected  = 0;
+static size_t       size       = 32;
+
+void benchecho(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status == READ_BINARY) wswrite(server, client, buffer, read, FRAME_BINARY);
+}
+
+void benchnothing(WebSocketServer *server, int client, void *environment) {
+}
+
+int benchserver(const short port, const int reactors, int ready, int go) {
+  FILE      *null = fopen("/dev/null", "w");
+  WebSocket *ws   = wsalloc(port, null, null);
+  char       byte = 0;
+
+  if (!ws) return 1;
+  ws->mode    = WS_MODE_REACTOR;
+  ws->workers = reactors;
+  wsinit(ws, benchnothing, benchecho);
+  if (!ws->server) return 1;
+  benchwriteall(ready, &byte, 1);
+  benchreadall(go, &byte, 1);
+  wsfree(ws);
+  fclose(null);
+  return 0;
+}
+
+void benchconnected(WebSocketServer *server, int client, void *environment) {
+  __atomic_add_fetch(&connected, 1, __ATOMIC_RELAXED);
+}
+
+void benchreply(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status != READ_BINARY) return;
+  __atomic_add_fetch(&roundtrips, 1, __ATOMIC_RELAXED);
+  if (running) wswrite(server, client, buffer, read, FRAME_BINARY);
+}
+
+int main(int argc, char *argv[]) {
+  int            clients  = argc > 1 ? atoi(argv[1]) : 10000;
+  double         seconds  = argc > 2 ? atof(argv[2]) : 5;
+  int            reactors = argc > 4 ? atoi(argv[4]) : 1;
+  short          port     = argc > 5 ? atoi(argv[5]) : 8097;
+  FILE          *null     = fopen("/dev/null", "w");
+  unsigned char *message;
+  int            ready[2], go[2];
+  int           *ids;
+  int            made     = 0;
+  int            status;
+  char           byte     = 0;
+  pid_t          child;
+  WebSocket     *ws;
+  long           rss;
+  double         start, elapsed;
+
+  size = argc > 3 ? atol(argv[3]) : 32;
+  // Each process holds one end of every connection
+  if (clients > 2 * benchnofile()) clients = 2 * benchnofile();
+  if (!(message = calloc(1, size)) || !(ids = malloc(clients * sizeof(int)))) return 1;
+  if (pipe(ready) || pipe(go) || (child = fork()) < 0) return 1;
+  if (!child) _exit(benchserver(port, reactors, ready[1], go[0]));
+  if (benchreadall(ready[0], &byte, 1)) {
+    fprintf(stderr, "The server could not start\n");
+    return 1;
+  }
+
+  if (!(ws = wsalloc(0, null, null))) return 1;
+  ws->mode    = WS_MODE_REACTOR;
+  ws->workers = reactors;
+  wsinit(ws, benchconnected, benchreply);
+  if (!ws->server) return 1;
+  rss   = benchstatus("VmRSS");
+  start = benchnow();
+  for (int i = 0; i < clients; i++) {
+    if ((ids[made] = wsconnect_client(ws, "127.0.0.1", port, "/")) >= 0) made++;
+  }
+  while (__atomic_load_n(&connected, __ATOMIC_RELAXED) < made) usleep(1000);
+  elapsed = benchnow() - start;
+  printf("%d clients on %d reactor(s), %zu byte messages\n", made, reactors, size);
+  printf("connect    %10.2f us/connection (handshake included)\n", elapsed * 1e6 / (made ? made : 1));
+  printf("memory     %10.2f kB/connection\n", (double)(benchstatus("VmRSS") - rss) / (made ? made : 1));
+
+  start = benchnow();
+  for (int i = 0; i < made; i++) wswrite(ws->server, ids[i], message, size, FRAME_BINARY);
+  usleep(seconds * 1e6);
+  running = 0;
+  elapsed = benchnow() - start;
+  printf("echo       %10.0f round trips/s %10.2f MB/s each way\n", roundtrips / elapsed, roundtrips * size / elapsed / 1e6);
+
+  wsteardown(ws);
+  wsfree(ws);
+  benchwriteall(go[1], &byte, 1);
+  waitpid(child, &status, 0);
+  fclose(null);
+  free(ids);
+  free(message);
+  return made != clients;
+}
@@ -0,0 +1,225 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: permessage-deflate benchmark: bytes saved versus CPU spent for JSON-like messages, by
+ *              compression level and window size, then an echo over loopback with and without the
+ *              extension (the client compresses and checks the replies with zlib).
+ *
+ * Usage: bench_deflate [messages] [port]
+ */
+
+#include <wsserver.h>
+#include <wsdeflate.h>
+#include <wspool.h>
+#include "bench.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <zlib.h>
+
+#define BENCH_OFFER "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"
+
+// Messages that look like what a web application sends: records with a few varying fields
+size_t benchjson(char *buffer, const size_t size) {
+  static const char *names[] = { "alpha", "bravo", "charlie", "delta", "echo", "foxtrot" };
+  size_t             length  = 0;
+
+  length += sprintf(buffer, "[");
+  for (int i = 0; length + 160 < size; i++) {
+    length += sprintf(&buffer[length], "%s{\"id\":%d,\"name\":\"%s\",\"price\":%d.%02d,\"tags\":[\"%s\",\"%s\"],\"active\":%s}",
+                      i ? "," : "", rand() % 100000, names[rand() % 6], rand() % 1000, rand() % 100,
+                      names[rand() % 6], names[rand() % 6], rand() % 2 ? "true" : "false");
+  }
+  while (length < size - 1) buffer[length++] = ' ';
+  buffer[length++] = ']';
+  return length;
+}
+
+void benchcodec(const int level, const int bits, const size_t size, const long messages) {
+  WebSocketDeflateOptions options;
+  WebSocketDeflate        state;
+  char                   *payload = malloc(size);
+  unsigned char          *output  = malloc(size + 64);
+  unsigned char          *block;
+  size_t                  length  = 0, bsize;
+  double                  start, deflating, inflating;
+
+  wsdeflatedefaults(&options);
+  options.level      = level;
+  options.serverbits = bits;
+  options.threshold  = 0;
+  memset(&state, 0, sizeof(WebSocketDeflate));
+  state.enabled    = 1;
+  state.clientbits = bits;
+  benchjson(payload, size);
+
+  start = benchnow();
+  for (long i = 0; i < messages; i++) {
+    if ((length = wsdeflate(NULL, &options, (unsigned char*)payload, size, &block, &bsize))) {
+      if (i < messages - 1) wspoolfree(block, bsize);
+    }
+  }
+  deflating = (benchnow() - start) / messages;
+
+  start = benchnow();
+  for (long i = 0; length && i < messages; i++) {
+    const unsigned char *input     = block;
+    const unsigned char *trailer   = DEFLATE_TRAILER;
+    size_t               remaining = length, tail = sizeof(DEFLATE_TRAILER), produced, total = 0;
+
+    do {
+      wsinflate(&state, &input, &remaining, &output[total], size + 64 - total, &produced);
+      total += produced;
+    } while (remaining);
+    wsinflate(&state, &trailer, &tail, &output[total], size + 64 - total, &produced);
+    total += produced;
+    wsinflateend(&state);
+    if (total != size || memcmp(output, payload, size)) {
+      printf("level %d, %d bits, %zu bytes: round trip mismatch\n", level, bits, size);
+      break;
+    }
+  }
+  inflating = (benchnow() - start) / messages;
+
+  printf("%5d %4d %8zu %8zu %7.1f%% %10.0f %10.0f\n", level, bits, size, length, length * 100.0 / size,
+         deflating * 1e9, inflating * 1e9);
+  if (length) wspoolfree(block, bsize);
+  free(payload);
+  free(output);
+}
+
+// Echoes every message of one client until it goes away
+void *benchecho(void *args) {
+  WebSocketServer *server = args;
+  int              client;
+
+  while ((client = wsaccept(server)) >= 0) {
+    unsigned char *data;
+    size_t         size;
+    int            status;
+
+    while ((status = wsreadview(server, client, &data, &size)) >= 0) {
+      if (status == READ_TEXT || status == READ_BINARY) wswrite(server, client, data, size, status);
+    }
+    wsclose(server, client);
+  }
+  return NULL;
+}
+
+// Raw deflate of a message, as a client would send it (without the 00 00 FF FF trailer)
+size_t benchcompress(z_stream *stream, const void *payload, const size_t size, unsigned char *output, const size_t capacity) {
+  stream->next_in   = (unsigned char*)payload;
+  stream->avail_in  = size;
+  stream->next_out  = output;
+  stream->avail_out = capacity;
+  deflate(stream, Z_SYNC_FLUSH);
+  deflateReset(stream);
+  return capacity - stream->avail_out - 4;
+}
+
+int benchdecompress(z_stream *stream, const unsigned char *payload, const size_t size, unsigned char *output, const size_t capacity) {
+  unsigned char input[size + 4];
+
+  memcpy(input, payload, size);
+  memcpy(&input[size], DEFLATE_TRAILER, 4);
+  stream->next_in   = input;
+  stream->avail_in  = size + 4;
+  stream->next_out  = output;
+  stream->avail_out = capacity;
+  inflate(stream, Z_SYNC_FLUSH);
+  inflateReset(stream);
+  return capacity - stream->avail_out;
+}
+
+void benchwire(const short port, const int compress, const size_t size, const long messages) {
+  char          *payload  = malloc(size);
+  unsigned char *frame    = malloc(size + 64);
+  unsigned char *reply    = malloc(size + 64);
+  unsigned char *inflated = malloc(size + 64);
+  char           response[512];
+  z_stream       deflater, inflater;
+  size_t         wire     = 0;
+  long           errors   = 0;
+  double         start, elapsed;
+  int            fd;
+
+  memset(&deflater, 0, sizeof(z_stream));
+  memset(&inflater, 0, sizeof(z_stream));
+  deflateInit2(&deflater, DEFLATE_LEVEL, Z_DEFLATED, -DEFLATE_MAX_BITS, DEFLATE_MEMLEVEL, Z_DEFAULT_STRATEGY);
+  inflateInit2(&inflater, -DEFLATE_MAX_BITS);
+  benchjson(payload, size);
+  if ((fd = benchconnectwith(port, compress ? BENCH_OFFER : "", response)) < 0) return;
+  if (compress && !strstr(response, "Sec-WebSocket-Extensions: permessage-deflate")) {
+    printf("extension was not accepted\n");
+    close(fd);
+    return;
+  }
+
+  start = benchnow();
+  for (long i = 0; i < messages; i++) {
+    size_t length = compress ? benchcompress(&deflater, payload, size, reply, size + 64) : size;
+    long   received;
+    int    opcode;
+
+    length = benchencode(frame, compress ? (void*)reply : payload, length, FRAME_TEXT);
+    if (compress) frame[0] |= 0x40;
+    benchwriteall(fd, frame, length);
+    wire += length;
+    if ((received = benchrecv(fd, reply, size + 64, &opcode)) < 0) break;
+    wire += received + 2 + (received >= 126 ? 2 : 0) + (received > 0xFFFF ? 6 : 0);
+    if (opcode & 0x40) received = benchdecompress(&inflater, reply, received, inflated, size + 64);
+    else               memcpy(inflated, reply, received);
+    if ((size_t)received != size || memcmp(inflated, payload, size)) errors++;
+  }
+  elapsed = benchnow() - start;
+
+  printf("%-10s %8zu %12.0f %10.1f %10.1f %8ld\n", compress ? "deflate" : "plain", size, wire / (double)messages,
+         elapsed / messages * 1e6, messages / elapsed, errors);
+  close(fd);
+  deflateEnd(&deflater);
+  inflateEnd(&inflater);
+  free(payload);
+  free(frame);
+  free(reply);
+  free(inflated);
+}
+
+int main(int argc, char *argv[]) {
+  static const size_t sizes[]  = { 256, 1024, 4096, 16384, 65536 };
+  static const int    levels[] = { 1, 6, 9 };
+  static const int    bits[]   = { 15, 10 };
+  long                messages = argc > 1 ? atol(argv[1]) : 2000;
+  short               port     = argc > 2 ? atoi(argv[2]) : 8094;
+  FILE               *null     = fopen("/dev/null", "w");
+  WebSocketServer    *server;
+  pthread_t           thread;
+
+  signal(SIGPIPE, SIG_IGN);
+  srand(1);
+  printf("level bits    bytes   deflated   ratio  deflate ns  inflate ns\n");
+  for (int l = 0; l < 3; l++) {
+    for (int b = 0; b < 2; b++) {
+      for (int s = 0; s < 5; s++) benchcodec(levels[l], bits[b], sizes[s], messages);
+    }
+  }
+
+  if (!(server = wsstart(port, null, null))) return 1;
+  server->deflate.enabled = 1;
+  pthread_create(&thread, NULL, benchecho, server);
+  printf("\nmode          bytes  wire/round  us/round   rounds/s   errors\n");
+  for (int s = 0; s < 5; s++) {
+    benchwire(port, 0, sizes[s], messages);
+    benchwire(port, 1, sizes[s], messages);
+  }
+  {
+    WebSocketDeflateStats stats;
+
+    wsdeflatestats(&stats);
+    printf("\nstreams: %zu (%zu cached), skipped: %llu, deflated: %llu (%llu -> %llu bytes), inflated: %llu\n",
+           stats.streams, stats.cached, stats.skipped, stats.deflated, stats.deflatein, stats.deflateout, stats.inflated);
+  }
+  wsshutdown(server);
+  pthread_join(thread, NULL);
+  wsstop(server);
+  fclose(null);
+  return 0;
+}
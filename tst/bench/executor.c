@@ -0,0 +1,141 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Slow handler benchmark, read callbacks on the reading thread vs on the executor: echo
+ *              throughput, and whether every connection got its messages back in order.
+ *
+ * Usage: bench_executor [thread|reactor|uring|all] [connections] [messages] [delay us] [threads] [capacity] [port]
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <sys/wait.h>
+
+#define BENCH_WINDOW 8
+
+/*
+NOTE:
+Each message carries its sequence number, the handler sleeps for delay us (a lookup it would wait on)
+and echoes it. The clients keep BENCH_WINDOW messages in flight on every connection and check that the
+echoes come back in sequence. With a capacity below connections x BENCH_WINDOW, the server stops
+reading some of them along the way.
+*/
+static int delay = 0;
+
+void benchconnection(WebSocketServer *server, int client, void *environment) {
+}
+
+void benchslow(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status != READ_BINARY) return;
+  usleep(delay);
+  wswrite(server, client, buffer, read, status);
+}
+
+int benchclients(const short port, const int connections, const int messages, int ready, int go) {
+  int          *fds      = malloc(connections * sizeof(int));
+  unsigned int *sent     = calloc(connections, sizeof(int));
+  unsigned int *received = calloc(connections, sizeof(int));
+  char          byte     = 0;
+
+  if (!fds || !sent || !received || benchreadall(go, &byte, 1)) return 1;
+  for (int i = 0; i < connections; i++) {
+    if ((fds[i] = benchconnect(port)) < 0) return 1;
+  }
+  benchwriteall(ready, &byte, 1);
+  if (benchreadall(go, &byte, 1)) return 1;
+  for (int w = 0; w < BENCH_WINDOW && w < messages; w++) {
+    for (int i = 0; i < connections; i++) {
+      benchsend(fds[i], &sent[i], sizeof(int), FRAME_BINARY);
+      sent[i]++;
+    }
+  }
+  for (int m = 0; m < messages; m++) {
+    for (int i = 0; i < connections; i++) {
+      unsigned int sequence;
+      int          opcode;
+
+      if (benchrecv(fds[i], (unsigned char*)&sequence, sizeof(int), &opcode) != sizeof(int)) return 1;
+      if (sequence != received[i]++) return 2;
+      if (sent[i] < (unsigned int)messages) {
+        benchsend(fds[i], &sent[i], sizeof(int), FRAME_BINARY);
+        sent[i]++;
+      }
+    }
+  }
+  for (int i = 0; i < connections; i++) close(fds[i]);
+  return 0;
+}
+
+int benchmode(const int mode, const char *name, const int connections, const int messages, const int threads,
+              const size_t capacity, const short port)
+{
+  FILE      *null  = fopen("/dev/null", "w");
+  double     total = (double)connections * messages;
+  int        ready[2], go[2];
+  int        status;
+  char       byte  = 0;
+  pid_t      child;
+  WebSocket *ws;
+  double     start;
+
+  // The clients are forked before the server has any thread
+  if (pipe(ready) || pipe(go) || (child = fork()) < 0) return 1;
+  if (!child) _exit(benchclients(port, connections, messages, ready[1], go[0]));
+  if (!(ws = wsalloc(port, null, null))) return 1;
+  ws->mode              = mode;
+  ws->executor.threads  = threads;
+  ws->executor.capacity = capacity;
+  wsinit(ws, benchconnection, benchslow);
+  if (!ws->server) return 1;
+  benchwriteall(go[1], &byte, 1);
+  if (benchreadall(ready[0], &byte, 1)) {
+    fprintf(stderr, "%s: the clients could not connect\n", name);
+    return 1;
+  }
+
+  start = benchnow();
+  benchwriteall(go[1], &byte, 1);
+  waitpid(child, &status, 0);
+  start = benchnow() - start;
+  if (!WIFEXITED(status) || WEXITSTATUS(status) == 1) {
+    fprintf(stderr, "%s: echo failed\n", name);
+    return 1;
+  }
+  printf("%-8s %2d threads %8.0f msg/s   in order: %s\n", name, threads, total / start, WEXITSTATUS(status) ? "no" : "yes");
+
+  wsteardown(ws);
+  wsfree(ws);
+  fclose(null);
+  close(ready[0]);
+  close(ready[1]);
+  close(go[0]);
+  close(go[1]);
+  return WEXITSTATUS(status);
+}
+
+int main(int argc, char *argv[]) {
+  const char *which       = argc > 1 ? argv[1] : "all";
+  int         connections = argc > 2 ? atoi(argv[2]) : 32;
+  int         messages    = argc > 3 ? atoi(argv[3]) : 200;
+  int         threads     = argc > 5 ? atoi(argv[5]) : WS_EXECUTOR_THREADS;
+  size_t      capacity    = argc > 6 ? atol(argv[6]) : 64;
+  short       port        = argc > 7 ? atoi(argv[7]) : 8095;
+  int         failed      = 0;
+
+  delay = argc > 4 ? atoi(argv[4]) : 100;
+  if (connections > benchnofile() / 2) connections = benchnofile() / 2;
+  printf("%d connections x %d messages, %d us handler, executor capacity %zu\n", connections, messages, delay, capacity);
+  if (!strcmp(which, "all") || !strcmp(which, "thread")) {
+    failed |= benchmode(WS_MODE_THREAD, "thread", connections, messages, 0, capacity, port);
+    failed |= benchmode(WS_MODE_THREAD, "thread", connections, messages, threads, capacity, port);
+  }
+  if (!strcmp(which, "all") || !strcmp(which, "reactor")) {
+    failed |= benchmode(WS_MODE_REACTOR, "reactor", connections, messages, 0, capacity, port);
+    failed |= benchmode(WS_MODE_REACTOR, "reactor", connections, messages, threads, capacity, port);
+  }
+  if (!strcmp(which, "all") || !strcmp(which, "uring")) {
+    failed |= benchmode(WS_MODE_URING, "uring", connections, messages, 0, capacity, port);
+    failed |= benchmode(WS_MODE_URING, "uring", connections, messages, threads, capacity, port);
+  }
+  return failed;
+}
@@ -0,0 +1,374 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Load generator: thousands of loopback clients against an echo server (started in the
+ *              process, or already running), closed loop (one message in flight per client) or at a
+ *              fixed rate per client. Reports messages/s, MB/s and round-trip latency percentiles, or
+ *              the delivery latency of broadcasts in fan-out mode, and appends the results as a JSON
+ *              line to a file so that runs can be compared between releases.
+ *
+ * Usage: bench_load [-m echo|fanout] [-c clients] [-t threads] [-s size] [-r rate] [-d seconds]
+ *                   [-S thread|reactor] [-w workers] [-p port] [-x] [-o results]
+ *
+ *   -r  messages per second and per client (echo, 0 for a closed loop), broadcasts per second (fanout)
+ *   -x  the echo server is already running on the port (echo mode only)
+ *   -o  file the results are appended to (bench_load.jsonl by default)
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/epoll.h>
+
+#define LOAD_MAX_SAMPLES  (1 << 24)
+#define LOAD_EVENTS       256
+#define LOAD_DRAIN        1.0
+
+typedef struct load_options {
+  int         fanout;
+  int         clients;
+  int         threads;
+  size_t      size;
+  double      rate;
+  double      duration;
+  int         mode;
+  int         workers;
+  short       port;
+  int         external;
+  const char *output;
+} LoadOptions;
+
+typedef struct load_client {
+  int            fd;
+  unsigned char *buffer;
+  size_t         used;
+  double         next;
+  int            inflight;
+} LoadClient;
+
+typedef struct load_worker {
+  LoadOptions       *options;
+  LoadClient        *clients;
+  int                count;
+  pthread_t          thread;
+  unsigned int      *samples;
+  size_t             nsamples;
+  size_t             capacity;
+  unsigned long long sent;
+  unsigned long long received;
+  unsigned long long errors;
+} LoadWorker;
+
+static volatile int connected = 0;
+static volatile int stopping  = 0;
+static double       origin;
+
+void loadconnection(WebSocketServer *server, int client, void *environment) {
+  __atomic_add_fetch(&connected, 1, __ATOMIC_RELAXED);
+}
+
+void loadecho(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  LoadOptions *options = environment;
+
+  if (!options->fanout && (status == READ_TEXT || status == READ_BINARY)) wswrite(server, client, buffer, read, status);
+}
+
+// Latencies are kept in nanoseconds (up to 4 s), every one of them up to LOAD_MAX_SAMPLES per thread
+void loadsample(LoadWorker *worker, const double latency) {
+  if (worker->nsamples == worker->capacity) {
+    size_t        capacity = worker->capacity ? worker->capacity * 2 : 65536;
+    unsigned int *samples;
+
+    if (capacity > LOAD_MAX_SAMPLES || !(samples = realloc(worker->samples, capacity * sizeof(unsigned int)))) return;
+    worker->samples  = samples;
+    worker->capacity = capacity;
+  }
+  worker->samples[worker->nsamples++] = latency < 4.0 ? (unsigned int)(latency * 1e9) : 4000000000U;
+}
+
+// The payload starts with the time the message was meant to go out, relative to the start of the run
+int loadsend(LoadWorker *worker, LoadClient *client, unsigned char *payload, unsigned char *frame, const double when) {
+  double stamp = when - origin;
+
+  memcpy(payload, &stamp, sizeof(double));
+  if (benchwriteall(client->fd, frame, benchencode(frame, payload, worker->options->size, FRAME_BINARY))) {
+    worker->errors++;
+    return -1;
+  }
+  client->inflight++;
+  worker->sent++;
+  return 0;
+}
+
+// Takes every complete frame out of the buffer of the client, returns how many there were
+int loadparse(LoadWorker *worker, LoadClient *client, const double now) {
+  int    frames = 0;
+  size_t start  = 0;
+
+  while (client->used - start >= 2) {
+    unsigned char     *header = &client->buffer[start];
+    unsigned long long size   = header[1] & 0x7F;
+    size_t             length = 2;
+    double             stamp;
+
+    if (size == 126) {
+      if (client->used - start < 4) break;
+      size    = (header[2] << 8) | header[3];
+      length += 2;
+    } else if (size == 127) {
+      if (client->used - start < 10) break;
+      size = 0;
+      for (int i = 0; i < 8; i++) size = (size << 8) | header[2 + i];
+      length += 8;
+    }
+    if (client->used - start < length + size) break;
+    if (size >= sizeof(double)) {
+      memcpy(&stamp, &header[length], sizeof(double));
+      loadsample(worker, now - origin - stamp);
+    }
+    worker->received++;
+    client->inflight--;
+    start += length + size;
+    frames++;
+  }
+  memmove(client->buffer, &client->buffer[start], client->used - start);
+  client->used -= start;
+  return frames;
+}
+
+void *loadworker(void *args) {
+  LoadWorker        *worker   = args;
+  LoadOptions       *options  = worker->options;
+  size_t             capacity = 2 * (options->size + FRAME_HEADER_SIZE) + 65536;
+  unsigned char     *payload  = calloc(1, options->size);
+  unsigned char     *frame    = malloc(options->size + FRAME_HEADER_SIZE);
+  struct epoll_event events[LOAD_EVENTS];
+  int                poller   = epoll_create1(0);
+  double             end      = origin + options->duration;
+  double             period   = options->rate > 0 ? 1.0 / options->rate : 0;
+
+  for (int i = 0; i < worker->count; i++) {
+    LoadClient        *client = &worker->clients[i];
+    struct epoll_event event;
+
+    memset(&event, 0, sizeof(struct epoll_event));
+    event.events   = EPOLLIN;
+    event.data.u32 = i;
+    client->buffer = malloc(capacity);
+    epoll_ctl(poller, EPOLL_CTL_ADD, client->fd, &event);
+    // Clients at a fixed rate start spread over one period
+    client->next = origin + period * i / worker->count;
+    if (!options->fanout && !period) loadsend(worker, client, payload, frame, benchnow());
+  }
+
+  for (;;) {
+    double now     = benchnow();
+    double wake    = end + LOAD_DRAIN;
+    int    pending = 0;
+    int    n;
+
+    if (options->fanout) {
+      if (stopping && now > wake) break;
+    } else {
+      if (now < end) {
+        // Latencies are measured from the time each message was due, late sends included
+        for (int i = 0; period && i < worker->count; i++) {
+          LoadClient *client = &worker->clients[i];
+
+          while (client->next <= now && client->next < end) {
+            loadsend(worker, client, payload, frame, client->next);
+            client->next += period;
+          }
+          if (client->next < wake) wake = client->next;
+        }
+      }
+      for (int i = 0; i < worker->count; i++) pending += worker->clients[i].inflight;
+      if ((now >= end && !pending) || now > end + LOAD_DRAIN) break;
+      if (now >= end) wake = end + LOAD_DRAIN;
+    }
+
+    n = epoll_wait(poller, events, LOAD_EVENTS, wake > now ? (int)((wake - now) * 1000) + 1 : 0);
+    now = benchnow();
+    for (int e = 0; e < n; e++) {
+      LoadClient *client = &worker->clients[events[e].data.u32];
+      ssize_t     length = recv(client->fd, &client->buffer[client->used], capacity - client->used, MSG_DONTWAIT);
+      int         frames;
+
+      if (length <= 0) {
+        if (length < 0 && errno == EAGAIN) continue;
+        epoll_ctl(poller, EPOLL_CTL_DEL, client->fd, NULL);
+        worker->errors++;
+        continue;
+      }
+      client->used += length;
+      frames = loadparse(worker, client, now);
+      // Closed loop: the next message goes out as soon as the reply is in
+      while (!options->fanout && !period && now < end && frames--) loadsend(worker, client, payload, frame, now);
+    }
+  }
+
+  for (int i = 0; i < worker->count; i++) free(worker->clients[i].buffer);
+  close(poller);
+  free(payload);
+  free(frame);
+  return NULL;
+}
+
+int loadcompare(const void *a, const void *b) {
+  unsigned int x = *(const unsigned int*)a, y = *(const unsigned int*)b;
+  return x < y ? -1 : x > y;
+}
+
+double loadpercentile(const unsigned int *samples, const size_t count, const double percentile) {
+  return count ? samples[(size_t)(percentile * (count - 1))] / 1e3 : 0;
+}
+
+void loadusage() {
+  fprintf(stderr, "Usage: bench_load [-m echo|fanout] [-c clients] [-t threads] [-s size] [-r rate] [-d seconds]\n"
+                  "                  [-S thread|reactor] [-w workers] [-p port] [-x] [-o results]\n");
+}
+
+int main(int argc, char *argv[]) {
+  LoadOptions        options  = { 0, 1000, 0, 64, 0, 5, WS_MODE_REACTOR, 1, 8097, 0, "bench_load.jsonl" };
+  WebSocket         *ws       = NULL;
+  FILE              *null     = fopen("/dev/null", "w");
+  LoadWorker        *workers;
+  LoadClient        *clients;
+  unsigned int      *samples;
+  unsigned long long sent     = 0, received = 0, errors = 0, broadcasts = 0;
+  size_t             nsamples = 0;
+  double             elapsed;
+  int                opened   = 0, option;
+  FILE              *output;
+
+  while ((option = getopt(argc, argv, "m:c:t:s:r:d:S:w:p:xo:")) != -1) {
+    switch (option) {
+      case 'm': options.fanout   = !strcmp(optarg, "fanout");                                 break;
+      case 'c': options.clients  = atoi(optarg);                                              break;
+      case 't': options.threads  = atoi(optarg);                                              break;
+      case 's': options.size     = atol(optarg);                                              break;
+      case 'r': options.rate     = atof(optarg);                                              break;
+      case 'd': options.duration = atof(optarg);                                              break;
+      case 'S': options.mode     = strcmp(optarg, "thread") ? WS_MODE_REACTOR : WS_MODE_THREAD; break;
+      case 'w': options.workers  = atoi(optarg);                                              break;
+      case 'p': options.port     = atoi(optarg);                                              break;
+      case 'x': options.external = 1;                                                         break;
+      case 'o': options.output   = optarg;                                                    break;
+      default:  loadusage();                                                                  return 1;
+    }
+  }
+  if (options.size < sizeof(double)) options.size = sizeof(double);
+  if (options.threads < 1) options.threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (options.fanout && options.rate <= 0) options.rate = 100;
+  if (options.fanout) options.external = 0;
+  if (options.clients > benchnofile()) options.clients = benchnofile();
+  if (options.threads > options.clients) options.threads = options.clients;
+  signal(SIGPIPE, SIG_IGN);
+
+  if (!options.external) {
+    if (!(ws = wsalloc(options.port, null, null))) return 1;
+    ws->mode    = options.mode;
+    ws->workers = options.workers;
+    ws->env     = &options;
+    wsinit(ws, loadconnection, loadecho);
+    if (!ws->server) return 1;
+  }
+
+  workers = calloc(options.threads, sizeof(LoadWorker));
+  clients = calloc(options.clients, sizeof(LoadClient));
+  for (; opened < options.clients; opened++) {
+    if ((clients[opened].fd = benchconnect(options.port)) < 0) break;
+  }
+  if (!options.external) {
+    double start = benchnow();
+    while (connected < opened && benchnow() - start < 10);
+  }
+  if (!opened) {
+    fprintf(stderr, "Cannot connect to port %d\n", options.port);
+    return 1;
+  }
+  // Each thread drives a contiguous share of the clients
+  for (int t = 0, first = 0; t < options.threads; t++) {
+    int count = opened / options.threads + (t < opened % options.threads);
+
+    workers[t].options = &options;
+    workers[t].clients = &clients[first];
+    workers[t].count   = count;
+    first += count;
+  }
+
+  origin = benchnow();
+  for (int t = 0; t < options.threads; t++) pthread_create(&workers[t].thread, NULL, loadworker, &workers[t]);
+  if (options.fanout) {
+    unsigned char *payload = calloc(1, options.size);
+
+    // The broadcasts carry the time they were due, as the echoes do
+    for (double due = origin; due < origin + options.duration; due += 1.0 / options.rate, broadcasts++) {
+      double stamp;
+
+      while (benchnow() < due) usleep((due - benchnow()) * 1e6 > 50 ? (useconds_t)((due - benchnow()) * 1e6) : 0);
+      stamp = due - origin;
+      memcpy(payload, &stamp, sizeof(double));
+      wsmulticast(ws->server, payload, options.size, FRAME_BINARY);
+    }
+    stopping = 1;
+    free(payload);
+  }
+  for (int t = 0; t < options.threads; t++) pthread_join(workers[t].thread, NULL);
+  elapsed = options.duration;
+
+  for (int t = 0; t < options.threads; t++) {
+    sent     += workers[t].sent;
+    received += workers[t].received;
+    errors   += workers[t].errors;
+    nsamples += workers[t].nsamples;
+  }
+  if (options.fanout) sent = broadcasts;
+  samples = malloc((nsamples ? nsamples : 1) * sizeof(unsigned int));
+  for (int t = 0, done = 0; t < options.threads; t++) {
+    if (workers[t].nsamples) memcpy(&samples[done], workers[t].samples, workers[t].nsamples * sizeof(unsigned int));
+    done += workers[t].nsamples;
+    free(workers[t].samples);
+  }
+  qsort(samples, nsamples, sizeof(unsigned int), loadcompare);
+
+  {
+    double msgs = received / elapsed;
+    double mbs  = received * options.size / elapsed / 1e6;
+    double p50  = loadpercentile(samples, nsamples, 0.5);
+    double p99  = loadpercentile(samples, nsamples, 0.99);
+    double p999 = loadpercentile(samples, nsamples, 0.999);
+    double max  = loadpercentile(samples, nsamples, 1);
+
+    printf("%s, %s server (%d workers), %d clients on %d threads, %zu bytes, rate %g/s, %gs\n",
+           options.fanout ? "fanout" : "echo", options.external ? "external" : options.mode == WS_MODE_REACTOR ? "reactor" : "thread",
+           options.workers, opened, options.threads, options.size, options.rate, options.duration);
+    printf("sent:       %llu\nreceived:   %llu\nerrors:     %llu\n", sent, received, errors);
+    printf("throughput: %.0f msg/s, %.2f MB/s\n", msgs, mbs);
+    printf("latency:    p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n", p50, p99, p999, max);
+    if ((output = fopen(options.output, "a"))) {
+      fprintf(output, "{\"time\":%ld,\"test\":\"%s\",\"server\":\"%s\",\"workers\":%d,\"clients\":%d,\"threads\":%d,"
+                      "\"size\":%zu,\"rate\":%g,\"duration\":%g,\"sent\":%llu,\"received\":%llu,\"errors\":%llu,"
+                      "\"msg_per_s\":%.0f,\"mb_per_s\":%.3f,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}\n",
+              (long)time(NULL), options.fanout ? "fanout" : "echo",
+              options.external ? "external" : options.mode == WS_MODE_REACTOR ? "reactor" : "thread", options.workers,
+              opened, options.threads, options.size, options.rate, options.duration, sent, received, errors,
+              msgs, mbs, p50, p99, p999, max);
+      fclose(output);
+      printf("results:    appended to %s\n", options.output);
+    }
+  }
+
+  for (int i = 0; i < opened; i++) close(clients[i].fd);
+  if (ws) {
+    wsteardown(ws);
+    wsfree(ws);
+  }
+  free(samples);
+  free(clients);
+  free(workers);
+  fclose(null);
+  return 0;
+}
@@ -0,0 +1,80 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Payload masking throughput, per kernel, payload size and alignment.
+ *
+ * Usage: bench_mask [megabytes] [offset]
+ */
+
+#include <wsmask.h>
+#include "bench.h"
+
+#define BENCH_MASK_MAX (1 << 20)
+
+// Reference: the byte loop the kernels replace
+static void benchreference(unsigned char *dst, const unsigned char *src, size_t size, const unsigned char *mask, size_t phase) {
+  for (size_t i = 0; i < size; i++) dst[i] = src[i] ^ mask[(phase + i) % WS_MASK_SIZE];
+}
+
+// Every alignment, phase and small size, plus a payload masked in uneven pieces
+static int benchverify(const unsigned char *src, unsigned char *dst, unsigned char *expected, const unsigned char *mask) {
+  for (size_t offset = 0; offset < 32; offset++) {
+    for (size_t phase = 0; phase < WS_MASK_SIZE; phase++) {
+      for (size_t size = 0; size < 300; size++) {
+        benchreference(expected, &src[offset], size, mask, phase);
+        if (wsmask(&dst[offset], &src[offset], size, mask, phase) != (phase + size) % WS_MASK_SIZE ||
+            memcmp(&dst[offset], expected, size)) return 0;
+      }
+    }
+  }
+  benchreference(expected, src, 100000, mask, 0);
+  for (size_t done = 0, n = 1, phase = 0; done < 100000; done += n, n = n * 3 + 1) {
+    if (done + n > 100000) n = 100000 - done;
+    phase = wsmask(&dst[done], &src[done], n, mask, phase);
+  }
+  return !memcmp(dst, expected, 100000);
+}
+
+int main(int argc, char *argv[]) {
+  size_t         total  = (argc > 1 ? atol(argv[1]) : 1024) << 20;
+  size_t         offset = argc > 2 ? atol(argv[2]) : 1;
+  size_t         sizes[] = { 16, 125, 1024, 16384, 65536, BENCH_MASK_MAX };
+  unsigned char  mask[WS_MASK_SIZE] = { 0x37, 0xFA, 0x21, 0x3D };
+  unsigned char *src      = malloc(BENCH_MASK_MAX + 64);
+  unsigned char *dst      = malloc(BENCH_MASK_MAX + 64);
+  unsigned char *expected = malloc(BENCH_MASK_MAX + 64);
+  double         reference[sizeof(sizes) / sizeof(size_t)];
+
+  if (!src || !dst || !expected) return 1;
+  for (size_t i = 0; i < BENCH_MASK_MAX + 64; i++) src[i] = rand();
+  printf("auto:        %s\n", wsmaskname(wsmaskkernel()));
+  printf("offset:      %zu (src), %zu (dst)\n", offset, offset + 1);
+  printf("%-12s %10s %12s %10s\n", "kernel", "size", "GB/s", "speedup");
+
+  for (int kernel = MASK_KERNEL_BYTE; kernel <= MASK_KERNEL_AVX2; kernel++) {
+    if (!wsmaskselect(kernel)) {
+      printf("%-12s unsupported\n", wsmaskname(kernel));
+      continue;
+    }
+    if (!benchverify(src, dst, expected, mask)) {
+      fprintf(stderr, "Kernel %s gives a wrong result\n", wsmaskname(kernel));
+      return 1;
+    }
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(size_t); s++) {
+      size_t rounds = total / sizes[s];
+      size_t phase  = 0;
+      double start  = benchnow(), elapsed, rate;
+
+      // Unaligned on both ends, and phase carried from one round to the next
+      for (size_t r = 0; r < rounds; r++) phase = wsmask(&dst[offset + 1], &src[offset], sizes[s], mask, phase);
+      elapsed = benchnow() - start;
+      rate    = rounds * sizes[s] / elapsed / 1e9;
+      if (kernel == MASK_KERNEL_BYTE) reference[s] = rate;
+      printf("%-12s %10zu %12.2f %9.1fx\n", wsmaskname(kernel), sizes[s], rate, rate / reference[s]);
+    }
+  }
+  wsmaskselect(MASK_KERNEL_AUTO);
+  free(src);
+  free(dst);
+  free(expected);
+  return 0;
+}
@@ -0,0 +1,95 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Frame parser benchmark: receiving syscalls per message and messages per second, with the
+ *              client writing batches of frames (several frames per TCP segment).
+ *
+ * Usage: bench_parser [thread|reactor] [messages] [size] [batch] [port]
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+static volatile long received = 0;
+static volatile long syscalls = 0;
+
+/*
+NOTE:
+The library is linked into the benchmark, so these definitions take over the libc ones and count the
+receiving side syscalls (the client only writes while measuring).
+*/
+ssize_t read(int fd, void *buffer, size_t size) {
+  __atomic_add_fetch(&syscalls, 1, __ATOMIC_RELAXED);
+  return syscall(SYS_read, fd, buffer, size);
+}
+
+ssize_t recv(int fd, void *buffer, size_t size, int flags) {
+  __atomic_add_fetch(&syscalls, 1, __ATOMIC_RELAXED);
+  return syscall(SYS_recvfrom, fd, buffer, size, flags, NULL, NULL);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+  __atomic_add_fetch(&syscalls, 1, __ATOMIC_RELAXED);
+  return syscall(SYS_poll, fds, nfds, timeout);
+}
+
+int epoll_wait(int fd, struct epoll_event *events, int maxevents, int timeout) {
+  __atomic_add_fetch(&syscalls, 1, __ATOMIC_RELAXED);
+  return syscall(SYS_epoll_wait, fd, events, maxevents, timeout);
+}
+
+void benchconnection(WebSocketServer *server, int client, void *environment) {}
+
+void benchcount(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status == READ_TEXT || status == READ_BINARY) __atomic_add_fetch(&received, 1, __ATOMIC_RELAXED);
+}
+
+int main(int argc, char *argv[]) {
+  int            mode     = argc > 1 && !strcmp(argv[1], "thread") ? WS_MODE_THREAD : WS_MODE_REACTOR;
+  long           messages = argc > 2 ? atol(argv[2]) : 1000000;
+  size_t         size     = argc > 3 ? atol(argv[3]) : 64;
+  int            batch    = argc > 4 ? atoi(argv[4]) : 64;
+  short          port     = argc > 5 ? atoi(argv[5]) : 8092;
+  unsigned char *payload  = malloc(size);
+  unsigned char *frames   = malloc(batch * (size + 14));
+  size_t         length   = 0;
+  FILE          *null     = fopen("/dev/null", "w");
+  WebSocket     *ws;
+  long           calls;
+  double         start, elapsed;
+  int            fd;
+
+  signal(SIGPIPE, SIG_IGN);
+  if (!payload || !frames || !(ws = wsalloc(port, null, null))) return 1;
+  ws->mode = mode;
+  wsinit(ws, benchconnection, benchcount);
+  if (!ws->server || (fd = benchconnect(port)) < 0) return 1;
+
+  memset(payload, 'x', size);
+  for (int i = 0; i < batch; i++) length += benchencode(&frames[length], payload, size, FRAME_BINARY);
+
+  calls = syscalls;
+  start = benchnow();
+  for (long sent = 0; sent < messages; sent += batch) benchwriteall(fd, frames, length);
+  messages = (messages + batch - 1) / batch * batch;
+  while (received < messages && benchnow() - start < 60);
+  elapsed = benchnow() - start;
+  calls   = syscalls - calls;
+
+  printf("mode:        %s\n", mode == WS_MODE_REACTOR ? "reactor" : "thread");
+  printf("messages:    %ld/%ld x %zu bytes (batches of %d)\n", received, messages, size, batch);
+  printf("syscalls:    %ld (%.3f per message)\n", calls, calls / (double)(received ? received : 1));
+  printf("throughput:  %.0f msg/s (%.1f MB/s)\n", received / elapsed, received * size / elapsed / 1e6);
+
+  close(fd);
+  wsteardown(ws);
+  wsfree(ws);
+  free(payload);
+  free(frames);
+  fclose(null);
+  return 0;
+}
@@ -0,0 +1,159 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Outbound queue benchmark: broadcasts to fast readers while one client stops reading for
+ *              a while, for each overflow policy. Reports how long a broadcast takes (average and
+ *              worst), how much the stalled client had queued, and what it got in the end.
+ *
+ * Usage: bench_queue [thread|reactor] [clients] [messages] [size] [stall ms] [port]
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+
+typedef struct bench_reader {
+  int   *fds;
+  int    count;
+  int    messages;
+  size_t size;
+  long   missed;
+} BenchReader;
+
+typedef struct bench_stalled {
+  int    fd;
+  int    stall;
+  size_t received;
+} BenchStalled;
+
+static volatile int connected = 0;
+static volatile int last      = -1;
+static volatile int drains    = 0;
+
+void benchconnection(WebSocketServer *server, int client, void *environment) {
+  __atomic_store_n(&last, client, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&connected, 1, __ATOMIC_RELEASE);
+}
+
+void benchread(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+}
+
+void benchdrain(WebSocketServer *server, int client, void *environment) {
+  __atomic_add_fetch(&drains, 1, __ATOMIC_RELAXED);
+}
+
+// The fast clients read every message as it comes, until they all got them or the server goes quiet
+void *benchreader(void *args) {
+  BenchReader   *reader   = args;
+  unsigned char *buffer   = malloc(reader->size);
+  struct pollfd *inputs   = malloc(reader->count * sizeof(struct pollfd));
+  long           expected = (long)reader->count * reader->messages;
+  long           received = 0;
+
+  for (int i = 0; i < reader->count; i++) {
+    inputs[i].fd     = reader->fds[i];
+    inputs[i].events = POLLIN;
+  }
+  while (received < expected && poll(inputs, reader->count, 1000) > 0) {
+    for (int i = 0; i < reader->count; i++) {
+      int opcode;
+
+      if (!inputs[i].revents) continue;
+      // Clients that were disconnected are left out of the poll
+      if (benchrecv(inputs[i].fd, buffer, reader->size, &opcode) == (long)reader->size) received++;
+      else                                                                               inputs[i].fd = -1;
+    }
+  }
+  reader->missed = expected - received;
+  free(inputs);
+  free(buffer);
+  return NULL;
+}
+
+// The stalled client reads nothing for a while, then everything until the server goes quiet
+void *benchstalled(void *args) {
+  BenchStalled  *stalled = args;
+  unsigned char  buffer[65536];
+  struct pollfd  input   = { stalled->fd, POLLIN, 0 };
+  ssize_t        n;
+
+  usleep(stalled->stall * 1000);
+  while (poll(&input, 1, 500) > 0 && (n = read(stalled->fd, buffer, sizeof(buffer))) > 0) stalled->received += n;
+  return NULL;
+}
+
+void benchpolicy(const int mode, const int overflow, const short port, const int clients, const int messages,
+                 const size_t size, const int stall)
+{
+  static const char *names[] = { "block", "drop", "disconnect" };
+  FILE              *null    = fopen("/dev/null", "w");
+  unsigned char     *payload = malloc(size);
+  BenchReader        reader  = { malloc(clients * sizeof(int)), clients, messages, size, 0 };
+  BenchStalled       stalled = { -1, stall, 0 };
+  pthread_t          rthread, sthread;
+  WebSocket         *ws;
+  double             start, elapsed, worst = 0;
+  size_t             queued  = 0;
+  int                client;
+
+  connected = 0;
+  drains    = 0;
+  memset(payload, 'x', size);
+  if (!(ws = wsalloc(port, null, null))) return;
+  ws->mode      = mode;
+  ws->overflow  = overflow;
+  ws->ondrain   = benchdrain;
+  wsinit(ws, benchconnection, benchread);
+  if (!ws->server) return;
+
+  for (int i = 0; i < clients; i++) reader.fds[i] = benchconnect(port);
+  while (connected < clients);
+  stalled.fd = benchconnect(port);
+  while (connected < clients + 1);
+  client = last;
+
+  pthread_create(&rthread, NULL, benchreader, &reader);
+  pthread_create(&sthread, NULL, benchstalled, &stalled);
+  start = benchnow();
+  for (int m = 0; m < messages; m++) {
+    double before = benchnow();
+    size_t bytes;
+
+    wsmulticast(ws->server, payload, size, FRAME_BINARY);
+    if (benchnow() - before > worst) worst = benchnow() - before;
+    if ((bytes = wsqueued(ws->server, client)) > queued) queued = bytes;
+  }
+  elapsed = benchnow() - start;
+  pthread_join(rthread, NULL);
+  pthread_join(sthread, NULL);
+
+  printf("%-10s %10.1f %10.1f %10zu %10zu %8d %8ld\n", names[overflow], elapsed / messages * 1e6, worst * 1e6,
+         queued >> 10, stalled.received >> 10, drains, reader.missed);
+  for (int i = 0; i < clients; i++) close(reader.fds[i]);
+  close(stalled.fd);
+  wsteardown(ws);
+  wsfree(ws);
+  free(reader.fds);
+  free(payload);
+  fclose(null);
+}
+
+int main(int argc, char *argv[]) {
+  int    mode     = argc > 1 && !strcmp(argv[1], "thread") ? WS_MODE_THREAD : WS_MODE_REACTOR;
+  int    clients  = argc > 2 ? atoi(argv[2]) : 16;
+  int    messages = argc > 3 ? atoi(argv[3]) : 2000;
+  size_t size     = argc > 4 ? atol(argv[4]) : 4096;
+  int    stall    = argc > 5 ? atoi(argv[5]) : 500;
+  short  port     = argc > 6 ? atoi(argv[6]) : 8096;
+
+  signal(SIGPIPE, SIG_IGN);
+  printf("%s mode, %d fast clients + 1 stalled for %d ms, %d broadcasts of %zu bytes\n",
+         mode == WS_MODE_REACTOR ? "reactor" : "thread", clients, stall, messages, size);
+  printf("policy     us/broadcast  worst us  queued kB  stalled kB   drains   missed\n");
+  benchpolicy(mode, WS_OVERFLOW_DROP, port, clients, messages, size, stall);
+  benchpolicy(mode, WS_OVERFLOW_DISCONNECT, port + 1, clients, messages, size, stall);
+  benchpolicy(mode, WS_OVERFLOW_BLOCK, port + 2, clients, messages, size, stall);
+  return 0;
+}
@@ -0,0 +1,117 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Idle and active connection benchmark, thread-per-connection vs epoll (or io_uring) reactor,
+ *              and how long a client waits to connect behind others that are slow to send their request.
+ *
+ * Usage: bench_reactor [thread|reactor|uring] [connections] [active] [messages] [port] [stalled]
+ */
+
+#include <websocket.h>
+#include <wspool.h>
+#include "bench.h"
+
+static volatile int connected = 0;
+
+void benchconnection(WebSocketServer *server, int client, void *environment) {
+  __atomic_add_fetch(&connected, 1, __ATOMIC_RELAXED);
+}
+
+void benchecho(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status == READ_TEXT || status == READ_BINARY) wswrite(server, client, buffer, read, status);
+}
+
+int main(int argc, char *argv[]) {
+  const char   *name        = argc > 1 ? argv[1] : "reactor";
+  int           mode        = !strcmp(name, "thread") ? WS_MODE_THREAD : !strcmp(name, "uring") ? WS_MODE_URING : WS_MODE_REACTOR;
+  int           connections = argc > 2 ? atoi(argv[2]) : 4096;
+  int           active      = argc > 3 ? atoi(argv[3]) : 256;
+  int           messages    = argc > 4 ? atoi(argv[4]) : 100;
+  short         port        = argc > 5 ? atoi(argv[5]) : 8090;
+  int           stalled     = argc > 6 ? atoi(argv[6]) : 8;
+  int          *fds         = malloc(connections * sizeof(int));
+  int          *slow        = malloc((stalled > 0 ? stalled : 1) * sizeof(int));
+  unsigned char buffer[256];
+  FILE         *null        = fopen("/dev/null", "w");
+  WebSocket    *ws;
+  long          rss, threads;
+  double        start, elapsed;
+  int           opened = 0;
+
+  if (connections > benchnofile()) connections = benchnofile();
+  if (active > connections) active = connections;
+  if (!fds || !slow || !(ws = wsalloc(port, null, null))) return 1;
+  ws->mode = mode;
+  wsinit(ws, benchconnection, benchecho);
+  if (!ws->server) return 1;
+
+  rss     = benchstatus("VmRSS");
+  threads = benchstatus("Threads");
+
+  // Idle connections
+  start = benchnow();
+  for (; opened < connections; opened++) {
+    if ((fds[opened] = benchconnect(port)) < 0) break;
+  }
+  while (connected < opened && benchnow() - start < 10);
+  elapsed = benchnow() - start;
+  printf("mode:        %s\n", mode == WS_MODE_THREAD ? "thread" : mode == WS_MODE_URING ? "uring" : "reactor");
+  printf("idle:        %d/%d connections in %.3fs (%.0f conn/s)\n", connected, connections, elapsed, connected / elapsed);
+  printf("memory:      %+ld kB (%.2f kB/conn)\n", benchstatus("VmRSS") - rss, (benchstatus("VmRSS") - rss) / (double)(connected ? connected : 1));
+  printf("threads:     %+ld\n", benchstatus("Threads") - threads);
+
+  // Active connections (echo round-trips)
+  if (active > opened) active = opened;
+  memset(buffer, 'x', 64);
+  start = benchnow();
+  for (int m = 0; m < messages; m++) {
+    for (int i = 0; i < active; i++) benchsend(fds[i], buffer, 64, FRAME_TEXT);
+    for (int i = 0; i < active; i++) {
+      int opcode;
+      if (benchrecv(fds[i], buffer, sizeof(buffer), &opcode) != 64) {
+        fprintf(stderr, "Echo failed on connection %d\n", i);
+        return 1;
+      }
+    }
+  }
+  elapsed = benchnow() - start;
+  printf("active:      %d connections x %d messages in %.3fs (%.0f msg/s)\n", active, messages, elapsed, active * messages / elapsed);
+  {
+    WebSocketPoolStats stats;
+
+    wspoolstats(&stats);
+    printf("memory:      %+ld kB after traffic (%.2f kB/conn)\n", benchstatus("VmRSS") - rss, (benchstatus("VmRSS") - rss) / (double)(connected ? connected : 1));
+    printf("pool:        %zu kB in use, %zu kB cached, %zu kB large\n", stats.usedbytes >> 10, stats.cachedbytes >> 10, stats.largebytes >> 10);
+  }
+
+  // Clients that sent part of their request (from a single byte to all but its blank line) and hold on,
+  // then a client that connects and has a message echoed: it should not wait for them to time out
+  {
+    const char *request = BENCH_REQUEST;
+    double      worst   = 0;
+    int         opcode;
+    int         fd;
+
+    for (int i = 0; i < stalled; i++) {
+      if ((slow[i] = benchdial(port)) >= 0) benchwriteall(slow[i], request, 1 + i * (strlen(request) - 1) / stalled);
+    }
+    for (int i = 0; i < 10; i++) {
+      start = benchnow();
+      if ((fd = benchconnect(port)) < 0 || benchsend(fd, buffer, 64, FRAME_TEXT) || benchrecv(fd, buffer, sizeof(buffer), &opcode) != 64) {
+        fprintf(stderr, "Echo failed behind the stalled clients\n");
+        return 1;
+      }
+      if (benchnow() - start > worst) worst = benchnow() - start;
+      close(fd);
+    }
+    printf("stalled:     %d clients mid-request, connection and echo in %.3f ms at worst\n", stalled, worst * 1e3);
+    for (int i = 0; i < stalled; i++) close(slow[i]);
+  }
+
+  for (int i = 0; i < opened; i++) close(fds[i]);
+  wsteardown(ws);
+  wsfree(ws);
+  free(slow);
+  free(fds);
+  fclose(null);
+  return 0;
+}
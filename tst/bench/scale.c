@@ -0,0 +1,141 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Reactor sharding benchmark: connections accepted and echo round trips per second over
+ *              loopback, for 1, 2, 4... reactor workers (SO_REUSEPORT listeners), each with as many
+ *              client threads.
+ *
+ * Usage: bench_scale [max workers] [connections] [messages] [pin] [port]
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <pthread.h>
+#include <signal.h>
+
+typedef struct bench_client {
+  short  port;
+  int    connections;
+  int    messages;
+  int   *fds;
+  long   errors;
+} BenchClient;
+
+static volatile int connected = 0;
+
+void benchconnection(WebSocketServer *server, int client, void *environment) {
+  __atomic_add_fetch(&connected, 1, __ATOMIC_RELAXED);
+}
+
+void benchecho(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status == READ_TEXT || status == READ_BINARY) wswrite(server, client, buffer, read, status);
+}
+
+void *benchopen(void *args) {
+  BenchClient *client = args;
+
+  for (int i = 0; i < client->connections; i++) {
+    if ((client->fds[i] = benchconnect(client->port)) < 0) client->errors++;
+  }
+  return NULL;
+}
+
+void *benchtalk(void *args) {
+  BenchClient  *client = args;
+  unsigned char buffer[256];
+
+  memset(buffer, 'x', 64);
+  for (int m = 0; m < client->messages; m++) {
+    for (int i = 0; i < client->connections; i++) {
+      if (client->fds[i] >= 0) benchsend(client->fds[i], buffer, 64, FRAME_TEXT);
+    }
+    for (int i = 0; i < client->connections; i++) {
+      int opcode;
+
+      if (client->fds[i] >= 0 && benchrecv(client->fds[i], buffer, sizeof(buffer), &opcode) != 64) {
+        close(client->fds[i]);
+        client->fds[i] = -1;
+        client->errors++;
+      }
+    }
+  }
+  return NULL;
+}
+
+void benchrun(void *(*routine)(void*), BenchClient *clients, const int count) {
+  pthread_t threads[count];
+
+  for (int i = 0; i < count; i++) pthread_create(&threads[i], NULL, routine, &clients[i]);
+  for (int i = 0; i < count; i++) pthread_join(threads[i], NULL);
+}
+
+void benchscale(const short port, const int workers, const int pin, const int connections, const int messages) {
+  FILE        *null = fopen("/dev/null", "w");
+  BenchClient  clients[workers];
+  WebSocket   *ws;
+  double       start, accepting, talking;
+  long         errors = 0;
+  int          opened = 0;
+
+  connected = 0;
+  if (!(ws = wsalloc(port, null, null))) return;
+  ws->mode    = WS_MODE_REACTOR;
+  ws->workers = workers;
+  ws->pin     = pin;
+  wsinit(ws, benchconnection, benchecho);
+  if (!ws->server) {
+    wsfree(ws);
+    fclose(null);
+    return;
+  }
+
+  for (int i = 0; i < workers; i++) {
+    clients[i].port        = port;
+    clients[i].connections = connections / workers;
+    clients[i].messages    = messages;
+    clients[i].fds         = malloc(clients[i].connections * sizeof(int));
+    clients[i].errors      = 0;
+    opened                += clients[i].connections;
+  }
+
+  start = benchnow();
+  benchrun(benchopen, clients, workers);
+  while (connected < opened && benchnow() - start < 10);
+  accepting = benchnow() - start;
+
+  start = benchnow();
+  benchrun(benchtalk, clients, workers);
+  talking = benchnow() - start;
+
+  for (int i = 0; i < workers; i++) {
+    for (int j = 0; j < clients[i].connections; j++) {
+      if (clients[i].fds[j] >= 0) close(clients[i].fds[j]);
+    }
+    errors += clients[i].errors;
+    free(clients[i].fds);
+  }
+  printf("%7d %6d %11d %12.0f %12.0f %8ld\n", workers, ws->shards, connected, connected / accepting,
+         (double)opened * messages / talking, errors);
+  wsteardown(ws);
+  wsfree(ws);
+  fclose(null);
+}
+
+int main(int argc, char *argv[]) {
+  int   cores       = sysconf(_SC_NPROCESSORS_ONLN);
+  int   workers     = argc > 1 ? atoi(argv[1]) : cores;
+  int   connections = argc > 2 ? atoi(argv[2]) : 512;
+  int   messages    = argc > 3 ? atoi(argv[3]) : 200;
+  int   pin         = argc > 4 ? atoi(argv[4]) : 1;
+  short port        = argc > 5 ? atoi(argv[5]) : 8095;
+
+  signal(SIGPIPE, SIG_IGN);
+  if (connections > benchnofile() / 2) connections = benchnofile() / 2;
+  printf("%d cores, %d connections, %d messages each%s\n", cores, connections, messages, pin ? ", pinned" : "");
+  printf("workers shards connections     conn/s        msg/s   errors\n");
+  for (int w = 1; w <= workers; w *= 2) {
+    // Each run gets a port of its own, the sockets of the previous one may still be in TIME_WAIT
+    benchscale(port++, w, pin, connections, messages);
+  }
+  return 0;
+}
@@ -0,0 +1,47 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Timer wheel benchmark: cost of setting, moving and expiring timers by number of timers.
+ *
+ * Usage: bench_timer [max timers] [span ticks]
+ */
+
+#include <wstimer.h>
+#include "bench.h"
+
+int benchwheel(const int count, const unsigned long long span) {
+  WebSocketTimer *timers = calloc(count, sizeof(WebSocketTimer));
+  WebSocketWheel *wheel  = malloc(sizeof(WebSocketWheel));
+  double          set, move, expire;
+  int             expired = 0;
+
+  if (!timers || !wheel) return 1;
+  wswheelinit(wheel, 0);
+  srand(count);
+  set = benchnow();
+  for (int i = 0; i < count; i++) wstimerset(wheel, &timers[i], 1 + rand() % span);
+  set  = benchnow() - set;
+  // What a connection that was heard from does: its deadline moves
+  move = benchnow();
+  for (int i = 0; i < count; i++) wstimerset(wheel, &timers[i], 1 + rand() % span);
+  move = benchnow() - move;
+  expire = benchnow();
+  for (unsigned long long now = 1; wheel->count; now++) {
+    for (WebSocketTimer *timer = wswheeladvance(wheel, now); timer; timer = timer->next) expired++;
+  }
+  expire = benchnow() - expire;
+  printf("%9d timers %8.1f ns/set %8.1f ns/move %8.1f ns/expiry (%llu ticks)\n", count, set * 1e9 / count,
+         move * 1e9 / count, expire * 1e9 / count, span);
+  free(timers);
+  free(wheel);
+  return expired != count;
+}
+
+int main(int argc, char *argv[]) {
+  int                max    = argc > 1 ? atoi(argv[1]) : 1000000;
+  unsigned long long span   = argc > 2 ? atoll(argv[2]) : 6000;
+  int                failed = 0;
+
+  printf("Deadlines spread over %llu ticks of %d ms\n", span, WS_TIMER_TICK);
+  for (int count = 1000; count <= max; count *= 10) failed |= benchwheel(count, span);
+  return failed;
+}
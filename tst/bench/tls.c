@@ -0,0 +1,200 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: TLS benchmark: connections made by the library client against an echo server in another
+ *              process, in plain and over TLS (full handshakes, resumed ones, with and without kTLS),
+ *              time to connect them and echo round trips per second.
+ *
+ * Usage: bench_tls [clients] [seconds] [size] [port]
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <sys/wait.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+/*
+NOTE:
+The server process listens on four ports: plain, TLS that never resumes (no tickets, no cache), and TLS
+that resumes, with the kernel taking the records (offload) and without. The certificate is made up for
+the run (P-256, for 127.0.0.1) and is what the clients check the server against. Whether kTLS was used
+depends on the kernel (the tls module): the kernel column tells how many connections it took.
+*/
+typedef struct bench_run {
+  const char *name;
+  int         tls;
+  int         resume;
+  int         offload;
+} BenchRun;
+
+static const BenchRun runs[] = {
+  { "plain",           0, 0, 0 },
+  { "tls full",        1, 0, 1 },
+  { "tls resumed",     1, 1, 1 },
+  { "tls userspace",   1, 1, 0 },
+};
+
+#define BENCH_RUNS (int)(sizeof(runs) / sizeof(runs[0]))
+
+static volatile int running    = 1;
+static long         roundtrips = 0;
+static int          connected  = 0;
+static char         certificate[32] = "/tmp/bench_tls_certXXXXXX";
+static char         key[32]         = "/tmp/bench_tls_keyXXXXXX";
+
+// Self-signed certificate for 127.0.0.1, written to the two temporary files
+int benchcertificate() {
+  EVP_PKEY       *pkey = EVP_EC_gen("P-256");
+  X509           *x509 = X509_new();
+  X509_EXTENSION *san  = NULL;
+  X509V3_CTX      ctx;
+  FILE           *file;
+  int             fd, failed = 1;
+
+  if (!pkey || !x509) goto done;
+  X509_set_version(x509, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+  X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+  X509_gmtime_adj(X509_getm_notAfter(x509), 24 * 3600);
+  X509_set_pubkey(x509, pkey);
+  X509_NAME_add_entry_by_txt(X509_get_subject_name(x509), "CN", MBSTRING_ASC, (unsigned char*)"127.0.0.1", -1, -1, 0);
+  X509_set_issuer_name(x509, X509_get_subject_name(x509));
+  X509V3_set_ctx(&ctx, x509, x509, NULL, NULL, 0);
+  if (!(san = X509V3_EXT_conf_nid(NULL, &ctx, NID_subject_alt_name, "IP:127.0.0.1")) || !X509_add_ext(x509, san, -1)) goto done;
+  if (!X509_sign(x509, pkey, EVP_sha256())) goto done;
+
+  if ((fd = mkstemp(certificate)) < 0 || !(file = fdopen(fd, "w"))) goto done;
+  PEM_write_X509(file, x509);
+  fclose(file);
+  if ((fd = mkstemp(key)) < 0 || !(file = fdopen(fd, "w"))) goto done;
+  PEM_write_PrivateKey(file, pkey, NULL, NULL, 0, NULL, NULL);
+  fclose(file);
+  failed = 0;
+
+done:
+  X509_EXTENSION_free(san);
+  X509_free(x509);
+  EVP_PKEY_free(pkey);
+  return failed;
+}
+
+void benchecho(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status == READ_BINARY) wswrite(server, client, buffer, read, FRAME_BINARY);
+}
+
+void benchnothing(WebSocketServer *server, int client, void *environment) {
+}
+
+int benchserver(const short port, int ready, int go) {
+  FILE      *null = fopen("/dev/null", "w");
+  WebSocket *ws[BENCH_RUNS];
+  char       byte = 0;
+
+  for (int i = 0; i < BENCH_RUNS; i++) {
+    if (!(ws[i] = wsalloc(port + i, null, null))) return 1;
+    ws[i]->mode            = WS_MODE_REACTOR;
+    ws[i]->tls.enabled     = runs[i].tls;
+    ws[i]->tls.certificate = certificate;
+    ws[i]->tls.key         = key;
+    ws[i]->tls.offload     = runs[i].offload;
+    ws[i]->tls.tickets     = runs[i].resume ? WS_TLS_TICKETS : 0;
+    ws[i]->tls.cache       = runs[i].resume ? WS_TLS_CACHE : 0;
+    wsinit(ws[i], benchnothing, benchecho);
+    if (!ws[i]->server) return 1;
+  }
+  benchwriteall(ready, &byte, 1);
+  benchreadall(go, &byte, 1);
+  for (int i = 0; i < BENCH_RUNS; i++) wsfree(ws[i]);
+  fclose(null);
+  return 0;
+}
+
+void benchconnected(WebSocketServer *server, int client, void *environment) {
+  __atomic_add_fetch(&connected, 1, __ATOMIC_RELAXED);
+}
+
+void benchreply(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status != READ_BINARY) return;
+  __atomic_add_fetch(&roundtrips, 1, __ATOMIC_RELAXED);
+  if (running) wswrite(server, client, buffer, read, FRAME_BINARY);
+}
+
+// Connects the clients to one of the servers and echoes, returns how many could not connect
+int benchrun(const BenchRun *run, const short port, const int clients, const double seconds,
+             const unsigned char *message, const size_t size) {
+  FILE           *null = fopen("/dev/null", "w");
+  WebSocket      *ws   = wsalloc(0, null, null);
+  int            *ids  = malloc(clients * sizeof(int));
+  int             made = 0;
+  WebSocketStats  stats;
+  double          start, connect, elapsed;
+
+  if (!ws || !ids) return clients;
+  ws->mode            = WS_MODE_REACTOR;
+  ws->tls.enabled     = run->tls;
+  ws->tls.authority   = certificate;
+  ws->tls.offload     = run->offload;
+  wsinit(ws, benchconnected, benchreply);
+  if (!ws->server) return clients;
+  running    = 1;
+  roundtrips = 0;
+  connected  = 0;
+
+  start = benchnow();
+  for (int i = 0; i < clients; i++) {
+    if ((ids[made] = wsconnect_client(ws, "127.0.0.1", port, "/")) >= 0) made++;
+  }
+  while (__atomic_load_n(&connected, __ATOMIC_RELAXED) < made) usleep(1000);
+  connect = benchnow() - start;
+
+  start = benchnow();
+  for (int i = 0; i < made; i++) wswrite(ws->server, ids[i], message, size, FRAME_BINARY);
+  usleep(seconds * 1e6);
+  running = 0;
+  elapsed = benchnow() - start;
+
+  wsstats(ws->server, &stats);
+  printf("%-14s %10.2f us/connection %6llu resumed %6llu kernel %10.0f round trips/s %10.2f MB/s\n", run->name,
+         connect * 1e6 / (made ? made : 1), stats.total.tlsresumed, stats.total.tlsoffloaded, roundtrips / elapsed,
+         roundtrips * size / elapsed / 1e6);
+
+  wsteardown(ws);
+  wsfree(ws);
+  fclose(null);
+  free(ids);
+  return clients - made;
+}
+
+int main(int argc, char *argv[]) {
+  int            clients = argc > 1 ? atoi(argv[1]) : 1000;
+  double         seconds = argc > 2 ? atof(argv[2]) : 3;
+  size_t         size    = argc > 3 ? atol(argv[3]) : 1024;
+  short          port    = argc > 4 ? atoi(argv[4]) : 8098;
+  unsigned char *message;
+  int            ready[2], go[2];
+  int            status;
+  int            failed  = 0;
+  char           byte    = 0;
+  pid_t          child;
+
+  if (clients > 2 * benchnofile()) clients = 2 * benchnofile();
+  if (!(message = calloc(1, size)) || benchcertificate()) return 1;
+  if (pipe(ready) || pipe(go) || (child = fork()) < 0) return 1;
+  if (!child) _exit(benchserver(port, ready[1], go[0]));
+  if (benchreadall(ready[0], &byte, 1)) {
+    fprintf(stderr, "The servers could not start\n");
+    return 1;
+  }
+
+  printf("%d clients, %zu byte messages, %.1f s of echoes per run\n", clients, size, seconds);
+  for (int i = 0; i < BENCH_RUNS; i++) failed += benchrun(&runs[i], port + i, clients, seconds, message, size);
+
+  benchwriteall(go[1], &byte, 1);
+  waitpid(child, &status, 0);
+  unlink(certificate);
+  unlink(key);
+  free(message);
+  return failed != 0;
+}
@@ -0,0 +1,126 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Topic benchmark: publishing to subscribers only vs filtering every client in the application.
+ *
+ * Usage: bench_topics [clients] [topics] [rounds] [size] [port]
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <sys/wait.h>
+
+/*
+NOTE:
+Each client is subscribed to one topic (clients are spread evenly over them), and each round publishes
+one message to every topic. The filter loop is what an application does without topics: for each
+publication, go through every client, look up its topic and write to those that match. The clients
+read nothing until the end, the socket buffers hold what they are sent.
+*/
+static int    topics     = 1000;
+static int   *membership = NULL;
+static int    joined     = 0;
+
+void benchjoin(WebSocketServer *server, int client, void *environment) {
+  int  index = __atomic_fetch_add(&joined, 1, __ATOMIC_RELAXED);
+  char name[32];
+
+  membership[client & WS_SLOT_MASK] = index % topics;
+  snprintf(name, sizeof(name), "topic/%d", index % topics);
+  wssubscribe(server, client, name);
+}
+
+void benchignore(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+}
+
+int benchclients(const short port, const int clients, int ready, int go) {
+  int  *fds  = malloc(clients * sizeof(int));
+  char  byte = 0;
+
+  if (!fds || benchreadall(go, &byte, 1)) return 1;
+  for (int i = 0; i < clients; i++) {
+    if ((fds[i] = benchconnect(port)) < 0) return 1;
+  }
+  benchwriteall(ready, &byte, 1);
+  if (benchreadall(go, &byte, 1)) return 1;
+  for (int i = 0; i < clients; i++) close(fds[i]);
+  return 0;
+}
+
+// Every client is gone through for each publication
+long benchfilter(WebSocketServer *server, const unsigned char *message, const size_t size) {
+  long sent = 0;
+
+  for (int topic = 0; topic < topics; topic++) {
+    for (int client = wsnext(server, -1); client >= 0; client = wsnext(server, client)) {
+      if (membership[client & WS_SLOT_MASK] == topic && wswrite(server, client, message, size, FRAME_BINARY) >= 0) sent++;
+    }
+  }
+  return sent;
+}
+
+long benchpublish(WebSocketServer *server, const unsigned char *message, const size_t size) {
+  long sent = 0;
+  char name[32];
+
+  for (int topic = 0; topic < topics; topic++) {
+    snprintf(name, sizeof(name), "topic/%d", topic);
+    sent += wspublish(server, name, message, size, FRAME_BINARY);
+  }
+  return sent;
+}
+
+int main(int argc, char *argv[]) {
+  int            clients = argc > 1 ? atoi(argv[1]) : 10000;
+  int            rounds  = argc > 3 ? atoi(argv[3]) : 10;
+  size_t         size    = argc > 4 ? atol(argv[4]) : 32;
+  short          port    = argc > 5 ? atoi(argv[5]) : 8096;
+  FILE          *null    = fopen("/dev/null", "w");
+  unsigned char *message;
+  int            ready[2], go[2];
+  int            status;
+  char           byte    = 0;
+  pid_t          child;
+  WebSocket     *ws;
+  double         filter  = 0, publish = 0;
+  long           sent[2] = { 0, 0 };
+
+  topics = argc > 2 ? atoi(argv[2]) : 1000;
+  if (clients > benchnofile()) clients = benchnofile();
+  if (!(message = calloc(1, size)) || !(membership = malloc(WS_MAX_CONN * sizeof(int)))) return 1;
+  if (pipe(ready) || pipe(go) || (child = fork()) < 0) return 1;
+  if (!child) _exit(benchclients(port, clients, ready[1], go[0]));
+  if (!(ws = wsalloc(port, null, null))) return 1;
+  ws->mode = WS_MODE_REACTOR;
+  wsinit(ws, benchjoin, benchignore);
+  if (!ws->server) return 1;
+  benchwriteall(go[1], &byte, 1);
+  if (benchreadall(ready[0], &byte, 1)) {
+    fprintf(stderr, "The clients could not connect\n");
+    return 1;
+  }
+  while (__atomic_load_n(&joined, __ATOMIC_RELAXED) < clients) usleep(1000);
+
+  for (int round = 0; round < rounds; round++) {
+    double start = benchnow();
+
+    sent[0] += benchfilter(ws->server, message, size);
+    filter  += benchnow() - start;
+    start    = benchnow();
+    sent[1] += benchpublish(ws->server, message, size);
+    publish += benchnow() - start;
+  }
+  printf("%d clients, %d topics, %d rounds of %zu bytes\n", clients, topics, rounds, size);
+  printf("filter loop %10.2f us/publication %10ld sent\n", filter * 1e6 / ((double)rounds * topics), sent[0]);
+  printf("topics      %10.2f us/publication %10ld sent (x%.1f)\n", publish * 1e6 / ((double)rounds * topics), sent[1],
+         publish > 0 ? filter / publish : 0);
+
+  benchwriteall(go[1], &byte, 1);
+  waitpid(child, &status, 0);
+  wsteardown(ws);
+  wsfree(ws);
+  fclose(null);
+  free(membership);
+  free(message);
+  return sent[0] != sent[1];
+}
@@ -0,0 +1,120 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Unix socket benchmark: round trip of a message on loopback TCP vs a Unix socket, bound by the
+ *              server or inherited from the process that started it.
+ *
+ * Usage: bench_unix [thread|reactor] [messages] [size] [port]
+ */
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <sys/stat.h>
+
+/*
+NOTE:
+One client keeps one message in flight and times each echo: the latency of a message is what the
+loopback costs on top of the server. The inherited socket is bound and listened on by the benchmark, as
+a supervisor would (socket activation), the server only takes it over: its start is timed as well.
+*/
+#define BENCH_PATH      "/tmp/bench_unix.sock"
+#define BENCH_ABSTRACT  "@bench_unix"
+
+void benchecho(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status == READ_BINARY) wswrite(server, client, buffer, read, FRAME_BINARY);
+}
+
+void benchnothing(WebSocketServer *server, int client, void *environment) {
+}
+
+int benchcompare(const void *a, const void *b) {
+  double x = *(const double*)a, y = *(const double*)b;
+
+  return (x > y) - (x < y);
+}
+
+// A listening socket made the way a supervisor would, on an abstract name
+int benchinherit(const char *name) {
+  struct sockaddr_un address;
+  int                fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0) return -1;
+  memset(&address, 0, sizeof(struct sockaddr_un));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path + 1, name + 1, strlen(name) - 1);
+  if (bind(fd, (struct sockaddr*)&address, offsetof(struct sockaddr_un, sun_path) + strlen(name)) < 0 ||
+      listen(fd, WS_BACKLOG) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Runs the round trips against a server that listens as set, returns 1 if it could not
+int benchrun(const char *name, const int mode, const short port, const char *path, const int fd, const int messages,
+             const size_t size)
+{
+  FILE          *null     = fopen("/dev/null", "w");
+  WebSocket     *ws       = wsalloc(port, null, null);
+  unsigned char *message  = calloc(1, size);
+  unsigned char *echo     = malloc(size);
+  double        *times    = malloc(messages * sizeof(double));
+  int            warmup   = messages / 10;
+  int            client   = -1;
+  int            opcode;
+  double         start, started, total = 0;
+
+  if (!ws || !message || !echo || !times) return 1;
+  ws->mode       = mode;
+  ws->socketpath = path;
+  ws->socketfd   = fd;
+  start   = benchnow();
+  wsinit(ws, benchnothing, benchecho);
+  started = benchnow() - start;
+  if (!ws->server) return 1;
+  client = path ? benchconnectunix(path) : fd >= 0 ? benchconnectunix(BENCH_ABSTRACT) : benchconnect(port);
+  if (client < 0) return 1;
+
+  for (int i = -warmup; i < messages; i++) {
+    start = benchnow();
+    if (benchsend(client, message, size, FRAME_BINARY) || benchrecv(client, echo, size, &opcode) != (long)size) return 1;
+    if (i >= 0) total += times[i] = benchnow() - start;
+  }
+  qsort(times, messages, sizeof(double), benchcompare);
+  printf("%-15s start %8.1f us   round trip %8.2f us mean %8.2f us p50 %8.2f us p99 %10.0f messages/s\n", name,
+         started * 1e6, total * 1e6 / messages, times[messages / 2] * 1e6, times[messages * 99 / 100] * 1e6,
+         messages / total);
+
+  close(client);
+  wsteardown(ws);
+  wsfree(ws);
+  fclose(null);
+  free(times);
+  free(echo);
+  free(message);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int         mode     = argc > 1 && !strcmp(argv[1], "thread") ? WS_MODE_THREAD : WS_MODE_REACTOR;
+  int         messages = argc > 2 ? atoi(argv[2]) : 100000;
+  size_t      size     = argc > 3 ? atol(argv[3]) : 64;
+  short       port     = argc > 4 ? atoi(argv[4]) : 8099;
+  int         failed   = 0;
+  struct stat info;
+
+  if (messages < 1) messages = 1;
+  printf("%d round trips of %zu bytes, %s mode\n", messages, size, mode == WS_MODE_THREAD ? "thread" : "reactor");
+  failed |= benchrun("tcp", mode, port, NULL, -1, messages, size);
+  failed |= benchrun("unix", mode, 0, BENCH_PATH, -1, messages, size);
+  failed |= benchrun("unix abstract", mode, 0, BENCH_ABSTRACT, -1, messages, size);
+  failed |= benchrun("unix inherited", mode, 0, NULL, benchinherit(BENCH_ABSTRACT), messages, size);
+  // The socket file goes with the server
+  if (!stat(BENCH_PATH, &info)) {
+    fprintf(stderr, "%s was left behind\n", BENCH_PATH);
+    failed = 1;
+  }
+  if (failed) fprintf(stderr, "A run failed\n");
+  return failed;
+}
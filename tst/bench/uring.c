@@ -0,0 +1,190 @@
+/* Author: Philippe Caron (philippe-caron@hotmail.com)
+ * Date: 18 Oct 2026
+ * Description: Echo benchmark of the I/O backends (threads, epoll reactor, io_uring reactor): system
+ *              calls and CPU time of the server per message.
+ *
+ * Usage: bench_uring [thread|reactor|uring|all] [connections] [messages] [size] [port]
+ */
+
+// RTLD_NEXT
+#define _GNU_SOURCE
+
+#include <websocket.h>
+#include "bench.h"
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+/*
+NOTE:
+The I/O calls of the server go through the wrappers below, which count them (the calls libc makes on
+its own, e.g. futex, are not seen). The clients run in a child process: neither their calls nor their
+CPU time are counted.
+*/
+static unsigned long long calls = 0;
+
+#define BENCH_NEXT(name)                           \
+  static __typeof__(&name) next = NULL;            \
+  __atomic_add_fetch(&calls, 1, __ATOMIC_RELAXED); \
+  if (!next) next = (__typeof__(&name))dlsym(RTLD_NEXT, #name)
+
+ssize_t recv(int fd, void *buffer, size_t size, int flags) {
+  BENCH_NEXT(recv);
+  return next(fd, buffer, size, flags);
+}
+
+ssize_t sendmsg(int fd, const struct msghdr *message, int flags) {
+  BENCH_NEXT(sendmsg);
+  return next(fd, message, flags);
+}
+
+ssize_t write(int fd, const void *buffer, size_t size) {
+  BENCH_NEXT(write);
+  return next(fd, buffer, size);
+}
+
+ssize_t read(int fd, void *buffer, size_t size) {
+  BENCH_NEXT(read);
+  return next(fd, buffer, size);
+}
+
+int poll(struct pollfd *fds, nfds_t count, int timeout) {
+  BENCH_NEXT(poll);
+  return next(fds, count, timeout);
+}
+
+int epoll_wait(int fd, struct epoll_event *events, int count, int timeout) {
+  BENCH_NEXT(epoll_wait);
+  return next(fd, events, count, timeout);
+}
+
+int epoll_ctl(int fd, int operation, int target, struct epoll_event *event) {
+  BENCH_NEXT(epoll_ctl);
+  return next(fd, operation, target, event);
+}
+
+int accept(int fd, struct sockaddr *restrict address, socklen_t *restrict length) {
+  BENCH_NEXT(accept);
+  return next(fd, address, length);
+}
+
+// io_uring_enter (the only raw system call of the server)
+long syscall(long number, ...) {
+  long    args[6];
+  va_list list;
+
+  va_start(list, number);
+  for (int i = 0; i < 6; i++) args[i] = va_arg(list, long);
+  va_end(list);
+  {
+    BENCH_NEXT(syscall);
+    return next(number, args[0], args[1], args[2], args[3], args[4], args[5]);
+  }
+}
+
+void benchconnection(WebSocketServer *server, int client, void *environment) {
+}
+
+void benchecho(WebSocketServer *server, int client, unsigned char *buffer, size_t read, int status, void *environment) {
+  if (status == READ_TEXT || status == READ_BINARY) wswrite(server, client, buffer, read, status);
+}
+
+// Every connection sends a message and waits for its echo, messages times over
+int benchclients(const short port, const int connections, const int messages, const size_t size, int ready, int go) {
+  unsigned char *buffer = malloc(size + 14);
+  int           *fds    = malloc(connections * sizeof(int));
+  char           byte   = 0;
+
+  if (!buffer || !fds || benchreadall(go, &byte, 1)) return 1;
+  for (int i = 0; i < connections; i++) {
+    if ((fds[i] = benchconnect(port)) < 0) return 1;
+  }
+  benchwriteall(ready, &byte, 1);
+  if (benchreadall(go, &byte, 1)) return 1;
+  memset(buffer, 'x', size);
+  for (int m = 0; m < messages; m++) {
+    for (int i = 0; i < connections; i++) benchsend(fds[i], buffer, size, FRAME_BINARY);
+    for (int i = 0; i < connections; i++) {
+      int opcode;
+      if (benchrecv(fds[i], buffer, size, &opcode) != (long)size) return 1;
+    }
+  }
+  for (int i = 0; i < connections; i++) close(fds[i]);
+  return 0;
+}
+
+double benchcpu() {
+  struct rusage usage;
+
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int benchmode(const int mode, const char *name, const int connections, const int messages, const size_t size, const short port) {
+  FILE      *null  = fopen("/dev/null", "w");
+  double     total = (double)connections * messages;
+  int        ready[2], go[2];
+  int        status;
+  char       byte  = 0;
+  pid_t      child;
+  WebSocket *ws;
+  double     start, cpu;
+  long long  counted;
+
+  // The clients are forked before the server has any thread
+  if (pipe(ready) || pipe(go) || (child = fork()) < 0) return 1;
+  if (!child) _exit(benchclients(port, connections, messages, size, ready[1], go[0]));
+  if (!(ws = wsalloc(port, null, null))) return 1;
+  ws->mode    = mode;
+  ws->workers = 1;
+  wsinit(ws, benchconnection, benchecho);
+  if (!ws->server) return 1;
+  if (mode == WS_MODE_URING && !ws->reactors[0]->ring) fprintf(stderr, "%s: io_uring is not available, epoll is used\n", name);
+  benchwriteall(go[1], &byte, 1);
+  if (benchreadall(ready[0], &byte, 1)) {
+    fprintf(stderr, "%s: the clients could not connect\n", name);
+    return 1;
+  }
+
+  counted = __atomic_load_n(&calls, __ATOMIC_RELAXED);
+  cpu     = benchcpu();
+  start   = benchnow();
+  benchwriteall(go[1], &byte, 1);
+  waitpid(child, &status, 0);
+  start   = benchnow() - start;
+  cpu     = benchcpu() - cpu;
+  counted = __atomic_load_n(&calls, __ATOMIC_RELAXED) - counted;
+  if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+    fprintf(stderr, "%s: echo failed\n", name);
+    return 1;
+  }
+  printf("%-8s %8.0f msg/s %8.2f syscalls/msg %8.2f us CPU/msg\n", name, total / start, counted / total, cpu * 1e6 / total);
+
+  wsteardown(ws);
+  wsfree(ws);
+  fclose(null);
+  close(ready[0]);
+  close(ready[1]);
+  close(go[0]);
+  close(go[1]);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  const char *which       = argc > 1 ? argv[1] : "all";
+  int         connections = argc > 2 ? atoi(argv[2]) : 64;
+  int         messages    = argc > 3 ? atoi(argv[3]) : 1000;
+  size_t      size        = argc > 4 ? atol(argv[4]) : 64;
+  short       port        = argc > 5 ? atoi(argv[5]) : 8094;
+  int         failed      = 0;
+
+  if (connections > benchnofile()) connections = benchnofile();
+  printf("%d connections x %d messages of %zu bytes (echo, CPU and system calls of the server only)\n", connections, messages, size);
+  if (!strcmp(which, "all") || !strcmp(which, "thread"))  failed |= benchmode(WS_MODE_THREAD, "thread", connections, messages, size, port);
+  if (!strcmp(which, "all") || !strcmp(which, "reactor")) failed |= benchmode(WS_MODE_REACTOR, "reactor", connections, messages, size, port);
+  if (!strcmp(which, "all") || !strcmp(which, "uring"))   failed |= benchmode(WS_MODE_URING, "uring", connections, messages, size, port);
+  return failed;
+}